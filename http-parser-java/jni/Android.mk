@@ -6,7 +6,7 @@ LOCAL_CPPFLAGS := -std=c++11 -fexceptions
 
 LOCAL_MODULE := httpparser-jni
 
-LOCAL_SRC_FILES := callbacks.cpp parser.cpp logger.cpp
+LOCAL_SRC_FILES := callbacks.cpp jni_env.cpp jni_cache.cpp parser.cpp logger.cpp
 
 LOCAL_STATIC_LIBRARIES := httpparser-c
 
@@ -1,8 +1,18 @@
 #include <jni.h>
 #include "../../http-parser/src/parser.h"
 #include "callbacks.h"
-#include <string>
-#include <stdexcept>
+#include "jni_env.h"
+#include "jni_cache.h"
+#include "com_adguard_http_parser_NativeParser_Callbacks.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Size of per-connection body data buffer
+#define BODY_BUFFER_SIZE 65536
+
+#define EVENT(name) com_adguard_http_parser_NativeParser_Callbacks_##name
+// Records are aligned to 8 bytes
+#define EVENT_RECORD_SIZE(length) ((EVENT(EVENT_HEADER_SIZE) + (length) + 7) & ~((size_t) 7))
 
 /**
  * Callbacks definitions
@@ -18,40 +28,40 @@ parser_callbacks parserCallbacks = {
         .http_response_body_finished = NativeParser_HttpResponseBodyFinished
 };
 
-std::map<connection_context *, Callbacks *> Callbacks::callbacksMap;
+/*
+ * Java callbacks. Get env of current thread (attaching it if needed) and call Java method
+ */
 
 /**
- * Attaches VM to native thread and get JNIEnv
- * @param vm Java virtual machine
- * @return JNIEnv object
+ * Gets env for calling Java callback
+ * @return Env, or NULL if it can't be obtained or exception thrown by previous callback is pending
+ *         (no Java methods may be called until native method returns)
  */
-static JNIEnv *getEnv(JavaVM *vm) {
-    JNIEnv *env;
-#ifdef ANDROID
-    if (vm->AttachCurrentThread(&env, NULL) != JNI_OK) {
-#else
-    if (vm->AttachCurrentThread((void **) &env, NULL) != JNI_OK) {
-#endif /* defined(ANDROID) */
-        throw std::runtime_error("Can't attach to Java VM");
+static JNIEnv *getCallbackEnv() {
+    JNIEnv *env = getEnv(jniCache.vm);
+    if (env == NULL || env->ExceptionCheck()) {
+        return NULL;
     }
     return env;
 }
 
-/*
- * Java callbacks. Attach VM to native thread add call Java method, then detach
- */
-
 int NativeParser_HttpRequestReceived(connection_context *connection_ctx, void *message) {
-    Callbacks* callbacks = Callbacks::get(connection_ctx);
+    Callbacks *callbacks = Callbacks::get(connection_ctx);
     if (callbacks == NULL) {
         return -1;
     }
+    if (callbacks->eventsEnabled()) {
+        http_message *detached = connection_detach_message(connection_ctx);
+        return callbacks->receivedEvent(EVENT(EVENT_REQUEST_RECEIVED), (jlong) detached);
+    }
 
-    http_message *clone = http_message_clone((const http_message *) message);
-    JNIEnv *env = getEnv(callbacks->vm);
-    int r = env->CallIntMethod(callbacks->obj, callbacks->HttpRequestReceivedCallback,
-                               connection_get_id(connection_ctx), (jlong) clone);
-    callbacks->vm->DetachCurrentThread();
+    JNIEnv *env = getCallbackEnv();
+    if (env == NULL) {
+        return -1;
+    }
+    http_message *detached = connection_detach_message(connection_ctx);
+    int r = env->CallIntMethod(callbacks->obj, jniCache.HttpRequestReceivedCallback,
+                               connection_get_id(connection_ctx), (jlong) detached);
     return r;
 }
 
@@ -60,11 +70,16 @@ int NativeParser_HttpRequestBodyStarted(connection_context *connection_ctx) {
     if (callbacks == NULL) {
         return -1;
     }
+    if (callbacks->eventsEnabled()) {
+        return callbacks->recordEvent(EVENT(EVENT_REQUEST_BODY_STARTED), 0, NULL, 0);
+    }
 
-    JNIEnv *env = getEnv(callbacks->vm);
-    int r = env->CallIntMethod(callbacks->obj, callbacks->HttpRequestBodyStartedCallback,
+    JNIEnv *env = getCallbackEnv();
+    if (env == NULL) {
+        return -1;
+    }
+    int r = env->CallIntMethod(callbacks->obj, jniCache.HttpRequestBodyStartedCallback,
                                connection_get_id(connection_ctx));
-    callbacks->vm->DetachCurrentThread();
     return r;
 }
 
@@ -73,16 +88,16 @@ void NativeParser_HttpRequestBodyData(connection_context *connection_ctx, const
     if (callbacks == NULL) {
         return;
     }
+    if (callbacks->eventsEnabled()) {
+        callbacks->recordEvent(EVENT(EVENT_REQUEST_BODY_DATA), 0, data, length);
+        return;
+    }
 
-    JNIEnv *env = getEnv(callbacks->vm);
-    jbyteArray arr = env->NewByteArray((jsize) length);
-    env->SetByteArrayRegion(arr, 0, (jsize) length, (jbyte *) data);
-    env->CallVoidMethod(callbacks->obj, callbacks->HttpRequestBodyDataCallback,
-                        connection_get_id(connection_ctx), arr);
-
-    // JNI will not auto clean local references since this method wasn't invoked from JVM
-    env->DeleteLocalRef(arr);
-    callbacks->vm->DetachCurrentThread();
+    JNIEnv *env = getCallbackEnv();
+    if (env == NULL) {
+        return;
+    }
+    callbacks->bodyData(env, jniCache.HttpRequestBodyDataCallback, data, length);
 }
 
 void NativeParser_HttpRequestBodyFinished(connection_context *connection_ctx) {
@@ -90,11 +105,17 @@ void NativeParser_HttpRequestBodyFinished(connection_context *connection_ctx) {
     if (callbacks == NULL) {
         return;
     }
+    if (callbacks->eventsEnabled()) {
+        callbacks->recordEvent(EVENT(EVENT_REQUEST_BODY_FINISHED), 0, NULL, 0);
+        return;
+    }
 
-    JNIEnv *env = getEnv(callbacks->vm);
-    env->CallVoidMethod(callbacks->obj, callbacks->HttpRequestBodyFinishedCallback,
+    JNIEnv *env = getCallbackEnv();
+    if (env == NULL) {
+        return;
+    }
+    env->CallVoidMethod(callbacks->obj, jniCache.HttpRequestBodyFinishedCallback,
                         connection_get_id(connection_ctx));
-    callbacks->vm->DetachCurrentThread();
 }
 
 int NativeParser_HttpResponseReceived(connection_context *connection_ctx, void *message) {
@@ -102,13 +123,18 @@ int NativeParser_HttpResponseReceived(connection_context *connection_ctx, void *
     if (callbacks == NULL) {
         return -1;
     }
+    if (callbacks->eventsEnabled()) {
+        http_message *detached = connection_detach_message(connection_ctx);
+        return callbacks->receivedEvent(EVENT(EVENT_RESPONSE_RECEIVED), (jlong) detached);
+    }
 
-    http_message *clone = http_message_clone((const http_message *) message);
-
-    JNIEnv *env = getEnv(callbacks->vm);
-    int r = env->CallIntMethod(callbacks->obj, callbacks->HttpResponseReceivedCallback,
-                               connection_get_id(connection_ctx), (jlong) clone);
-    callbacks->vm->DetachCurrentThread();
+    JNIEnv *env = getCallbackEnv();
+    if (env == NULL) {
+        return -1;
+    }
+    http_message *detached = connection_detach_message(connection_ctx);
+    int r = env->CallIntMethod(callbacks->obj, jniCache.HttpResponseReceivedCallback,
+                               connection_get_id(connection_ctx), (jlong) detached);
     return r;
 }
 
@@ -117,11 +143,16 @@ int NativeParser_HttpResponseBodyStarted(connection_context *connection_ctx) {
     if (callbacks == NULL) {
         return -1;
     }
+    if (callbacks->eventsEnabled()) {
+        return callbacks->recordEvent(EVENT(EVENT_RESPONSE_BODY_STARTED), 0, NULL, 0);
+    }
 
-    JNIEnv *env = getEnv(callbacks->vm);
-    int r = env->CallIntMethod(callbacks->obj, callbacks->HttpResponseBodyStartedCallback,
+    JNIEnv *env = getCallbackEnv();
+    if (env == NULL) {
+        return -1;
+    }
+    int r = env->CallIntMethod(callbacks->obj, jniCache.HttpResponseBodyStartedCallback,
                                connection_get_id(connection_ctx));
-    callbacks->vm->DetachCurrentThread();
     return r;
 }
 
@@ -130,16 +161,16 @@ void NativeParser_HttpResponseBodyData(connection_context *connection_ctx, const
     if (callbacks == NULL) {
         return;
     }
+    if (callbacks->eventsEnabled()) {
+        callbacks->recordEvent(EVENT(EVENT_RESPONSE_BODY_DATA), 0, data, length);
+        return;
+    }
 
-    JNIEnv *env = getEnv(callbacks->vm);
-    jbyteArray arr = env->NewByteArray((jsize) length);
-    env->SetByteArrayRegion(arr, 0, (jsize) length, (jbyte *) data);
-    env->CallVoidMethod(callbacks->obj, callbacks->HttpResponseBodyDataCallback,
-                        connection_get_id(connection_ctx), arr);
-
-    // JNI will not auto clean local references since this method wasn't invoked from JVM
-    env->DeleteLocalRef(arr);
-    callbacks->vm->DetachCurrentThread();
+    JNIEnv *env = getCallbackEnv();
+    if (env == NULL) {
+        return;
+    }
+    callbacks->bodyData(env, jniCache.HttpResponseBodyDataCallback, data, length);
 }
 
 void NativeParser_HttpResponseBodyFinished(connection_context *connection_ctx) {
@@ -147,46 +178,177 @@ void NativeParser_HttpResponseBodyFinished(connection_context *connection_ctx) {
     if (callbacks == NULL) {
         return;
     }
+    if (callbacks->eventsEnabled()) {
+        callbacks->recordEvent(EVENT(EVENT_RESPONSE_BODY_FINISHED), 0, NULL, 0);
+        return;
+    }
 
-    JNIEnv *env = getEnv(callbacks->vm);
-    env->CallVoidMethod(callbacks->obj, callbacks->HttpResponseBodyFinishedCallback,
+    JNIEnv *env = getCallbackEnv();
+    if (env == NULL) {
+        return;
+    }
+    env->CallVoidMethod(callbacks->obj, jniCache.HttpResponseBodyFinishedCallback,
                         connection_get_id(connection_ctx));
-    callbacks->vm->DetachCurrentThread();
 }
 
 Callbacks::Callbacks(JNIEnv *env, jobject callbacksObject, connection_context *context) {
-    jclass callbacksClass = env->FindClass("Lcom/adguard/http/parser/NativeParser$Callbacks;");
-    if (callbacksClass == NULL) {
-        throw std::runtime_error("Can't find class NativeParser$Callbacks");
+    this->obj = env->NewGlobalRef(callbacksObject);
+    this->bodyBufferData = NULL;
+    this->bodyBuffer = NULL;
+    this->eventData = NULL;
+    this->eventBuffer = NULL;
+    this->eventCapacity = 0;
+    this->decodeBody = false;
+    this->connection = context;
+    connection_set_user_data(context, this);
+}
+
+Callbacks::~Callbacks() {
+    JNIEnv *env = getEnv(jniCache.vm);
+    if (env != NULL) {
+        if (bodyBuffer != NULL) {
+            // Java side must not access buffer memory after it is freed
+            env->CallVoidMethod(obj, jniCache.SetBodyBufferMethod, (jobject) NULL);
+            env->DeleteGlobalRef(bodyBuffer);
+        }
+        if (eventBuffer != NULL) {
+            // Dispatch events recorded while closing connection
+            flushEvents();
+            env->CallVoidMethod(obj, jniCache.SetEventBufferMethod, (jobject) NULL);
+            env->DeleteGlobalRef(eventBuffer);
+        }
+        env->DeleteGlobalRef(obj);
     }
+    free(bodyBufferData);
+    free(eventData);
+}
 
-    if (env->GetJavaVM(&this->vm) != JNI_OK) {
-        throw std::runtime_error("Can't get Java VM");
+bool Callbacks::initBodyBuffer(JNIEnv *env) {
+    bodyBufferData = (char *) malloc(BODY_BUFFER_SIZE);
+    if (bodyBufferData == NULL) {
+        return false;
+    }
+    jobject buffer = env->NewDirectByteBuffer(bodyBufferData, BODY_BUFFER_SIZE);
+    if (buffer == NULL) {
+        free(bodyBufferData);
+        bodyBufferData = NULL;
+        return false;
     }
+    bodyBuffer = env->NewGlobalRef(buffer);
+    env->DeleteLocalRef(buffer);
+    env->CallVoidMethod(obj, jniCache.SetBodyBufferMethod, bodyBuffer);
+    return true;
+}
 
-    this->obj = env->NewGlobalRef(callbacksObject);
-    this->HttpRequestReceivedCallback = env->GetMethodID(callbacksClass, "onHttpRequestReceived", "(JJ)I");
-    this->HttpRequestBodyStartedCallback = env->GetMethodID(callbacksClass, "onHttpRequestBodyStarted", "(J)Z");
-    this->HttpRequestBodyDataCallback = env->GetMethodID(callbacksClass, "onHttpRequestBodyData", "(J[B)V");
-    this->HttpRequestBodyFinishedCallback = env->GetMethodID(callbacksClass, "onHttpRequestBodyFinished", "(J)V");
-    this->HttpResponseReceivedCallback = env->GetMethodID(callbacksClass, "onHttpResponseReceived", "(JJ)I");
-    this->HttpResponseBodyStartedCallback = env->GetMethodID(callbacksClass, "onHttpResponseBodyStarted", "(J)Z");
-    this->HttpResponseBodyDataCallback = env->GetMethodID(callbacksClass, "onHttpResponseBodyData", "(J[B)V");
-    this->HttpResponseBodyFinishedCallback = env->GetMethodID(callbacksClass, "onHttpResponseBodyFinished", "(J)V");
+void Callbacks::bodyData(JNIEnv *env, jmethodID method, const char *data, size_t length) {
+    if (bodyBuffer == NULL && !initBodyBuffer(env)) {
+        return;
+    }
 
-    this->connection = context;
-    callbacksMap[context] = this;
+    connection_id_t id = connection_get_id(connection);
+    while (length > 0) {
+        size_t part = length < BODY_BUFFER_SIZE ? length : BODY_BUFFER_SIZE;
+        memcpy(bodyBufferData, data, part);
+        env->CallVoidMethod(obj, method, id, (jint) part);
+        if (env->ExceptionCheck()) {
+            return;
+        }
+        data += part;
+        length -= part;
+    }
 }
 
-Callbacks::~Callbacks() {
-    getEnv(vm)->DeleteGlobalRef(obj);
-    callbacksMap.erase(this->connection);
+Callbacks *Callbacks::get(connection_context *context) {
+    return (Callbacks *) connection_get_user_data(context);
 }
 
-Callbacks *Callbacks::get(connection_context *context) {
-    auto it = callbacksMap.find(context);
-    if (it == callbacksMap.end()) {
-        return NULL;
+bool Callbacks::enableEvents(JNIEnv *env, size_t capacity, bool decode) {
+    if (eventData != NULL) {
+        return true;
+    }
+    // Ring should hold at least one event with some body data
+    if (capacity < EVENT(EVENTS_START) + EVENT_RECORD_SIZE(1)) {
+        capacity = EVENT(EVENTS_START) + EVENT_RECORD_SIZE(1);
+    }
+    eventData = (char *) calloc(1, capacity);
+    if (eventData == NULL) {
+        return false;
+    }
+    jobject buffer = env->NewDirectByteBuffer(eventData, capacity);
+    if (buffer == NULL) {
+        free(eventData);
+        eventData = NULL;
+        return false;
+    }
+    eventBuffer = env->NewGlobalRef(buffer);
+    env->DeleteLocalRef(buffer);
+    eventCapacity = capacity;
+    decodeBody = decode;
+    env->CallVoidMethod(obj, jniCache.SetEventBufferMethod, eventBuffer);
+    return true;
+}
+
+int Callbacks::flushEvents() {
+    int r = -1;
+    JNIEnv *env = getCallbackEnv();
+    if (env != NULL) {
+        r = env->CallIntMethod(obj, jniCache.DrainEventsMethod);
+    }
+    // Events are lost if Java side has failed, but ring must be usable anyway
+    jint used = 0;
+    memcpy(eventData, &used, sizeof(used));
+    return r;
+}
+
+int Callbacks::receivedEvent(int type, jlong handle) {
+    recordEvent(type, handle, NULL, 0);
+    // Dispatch right away, so callback result (skip body/upgrade) and pause() from callback
+    // reach parser before body of message is parsed. Events recorded before are dispatched first.
+    return flushEvents();
+}
+
+/*
+ * Ring layout (native byte order):
+ *   jint used              -- number of bytes of records after EVENTS_START
+ *   jint reserved
+ *   records:
+ *     jint type
+ *     jint length          -- length of body data following the header
+ *     jlong id             -- connection id
+ *     jlong handle         -- pointer to http_message owned by Java side, or 0
+ *     char data[length]    -- body data, padded to 8 bytes
+ */
+int Callbacks::recordEvent(int type, jlong handle, const char *data, size_t length) {
+    size_t maxLength = eventCapacity - EVENT(EVENTS_START) - EVENT(EVENT_HEADER_SIZE);
+    jlong id = (jlong) connection_get_id(connection);
+    do {
+        size_t part = length < maxLength ? length : maxLength;
+        jint used;
+        memcpy(&used, eventData, sizeof(used));
+        if (EVENT(EVENTS_START) + used + EVENT_RECORD_SIZE(part) > eventCapacity) {
+            flushEvents();
+            used = 0;
+        }
+
+        char *record = eventData + EVENT(EVENTS_START) + used;
+        jint recordType = (jint) type;
+        jint recordLength = (jint) part;
+        memcpy(record, &recordType, sizeof(jint));
+        memcpy(record + 4, &recordLength, sizeof(jint));
+        memcpy(record + 8, &id, sizeof(jlong));
+        memcpy(record + 16, &handle, sizeof(jlong));
+        if (part > 0) {
+            memcpy(record + EVENT(EVENT_HEADER_SIZE), data, part);
+        }
+        used += (jint) EVENT_RECORD_SIZE(part);
+        memcpy(eventData, &used, sizeof(used));
+
+        data += part;
+        length -= part;
+    } while (length > 0);
+
+    if (type == EVENT(EVENT_REQUEST_BODY_STARTED) || type == EVENT(EVENT_RESPONSE_BODY_STARTED)) {
+        return decodeBody ? 1 : 0;
     }
-    return it->second;
+    return 0;
 }
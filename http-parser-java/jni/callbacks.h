@@ -5,31 +5,84 @@
 #ifndef JNI_CALLBACKS_H
 #define JNI_CALLBACKS_H
 
-#include <map>
-
 /**
- * This class stores all callbacks to java and provides c-style callbacks for C HTTP library
+ * This class stores all callbacks to java and provides c-style callbacks for C HTTP library.
+ * Callbacks object is stored in connection user data.
  */
 class Callbacks {
 
-    static std::map<connection_context *, Callbacks *> callbacksMap;
     connection_context *connection;
+    // Native memory of body data buffer, allocated on first body data
+    char *bodyBufferData;
+    // Direct ByteBuffer wrapping bodyBufferData (global ref)
+    jobject bodyBuffer;
+
+    // Event ring: native memory, direct ByteBuffer wrapping it (global ref) and its capacity.
+    // If eventData is not NULL, callbacks are recorded into ring instead of calling Java methods.
+    char *eventData;
+    jobject eventBuffer;
+    size_t eventCapacity;
+    // Decode body in batched mode (body started callback result can't be obtained from Java)
+    bool decodeBody;
+
+    bool initBodyBuffer(JNIEnv *env);
+    // Dispatches recorded events by single Java call, returns result of last message received callback
+    int flushEvents();
 
 public:
-    JavaVM *vm;
+    // NativeParser$Callbacks object (global ref), its methods are cached in jniCache
     jobject obj;
-    jmethodID HttpRequestReceivedCallback;
-    jmethodID HttpRequestBodyStartedCallback;
-    jmethodID HttpRequestBodyDataCallback;
-    jmethodID HttpRequestBodyFinishedCallback;
-    jmethodID HttpResponseReceivedCallback;
-    jmethodID HttpResponseBodyStartedCallback;
-    jmethodID HttpResponseBodyDataCallback;
-    jmethodID HttpResponseBodyFinishedCallback;
 
     Callbacks(JNIEnv *env, jobject callbackObject, connection_context *context);
     ~Callbacks();
 
+    /**
+     * Passes body data to Java callback through per-connection direct ByteBuffer.
+     * Data is copied into buffer by parts not larger than buffer size, callback is invoked for each part.
+     * @param env JNI env
+     * @param method Body data callback
+     * @param data Body data
+     * @param length Length of body data
+     */
+    void bodyData(JNIEnv *env, jmethodID method, const char *data, size_t length);
+
+    /**
+     * Switches connection to batched mode: callbacks are recorded into event ring in direct memory
+     * and Java side dispatches them after native call returns. If ring is full or message is received,
+     * it is drained by single Java call.
+     * @param env JNI env
+     * @param capacity Ring capacity in bytes
+     * @param decode Decode body (returned to parser instead of body started callback result)
+     * @return False if memory can't be allocated
+     */
+    bool enableEvents(JNIEnv *env, size_t capacity, bool decode);
+
+    /**
+     * Checks if connection is in batched mode
+     */
+    bool eventsEnabled() const {
+        return eventData != NULL;
+    }
+
+    /**
+     * Records event into ring. Body data larger than ring is split into several events.
+     * @param type Event type (EVENT_* constant of NativeParser$Callbacks)
+     * @param handle Native pointer to http_message or 0
+     * @param data Body data or NULL
+     * @param length Length of body data
+     * @return Body started callback result for body started events, 0 otherwise
+     */
+    int recordEvent(int type, jlong handle, const char *data, size_t length);
+
+    /**
+     * Records message received event and dispatches ring synchronously, so that message received
+     * callback is called before body of message is parsed
+     * @param type Event type (EVENT_REQUEST_RECEIVED or EVENT_RESPONSE_RECEIVED)
+     * @param handle Native pointer to detached http_message
+     * @return Message received callback result
+     */
+    int receivedEvent(int type, jlong handle);
+
     static Callbacks *get(connection_context *context);
 };
 
@@ -23,6 +23,14 @@ JNIEXPORT jlong JNICALL Java_com_adguard_http_parser_HttpMessage_createHttpMessa
 JNIEXPORT void JNICALL Java_com_adguard_http_parser_HttpMessage_addHeader
   (JNIEnv *, jclass, jlong, jstring, jstring);
 
+/*
+ * Class:     com_adguard_http_parser_HttpMessage
+ * Method:    appendHeader
+ * Signature: (JLjava/lang/String;Ljava/lang/String;)V
+ */
+JNIEXPORT void JNICALL Java_com_adguard_http_parser_HttpMessage_appendHeader
+  (JNIEnv *, jclass, jlong, jstring, jstring);
+
 /*
  * Class:     com_adguard_http_parser_HttpMessage
  * Method:    getHeaders
@@ -31,6 +39,38 @@ JNIEXPORT void JNICALL Java_com_adguard_http_parser_HttpMessage_addHeader
 JNIEXPORT jlongArray JNICALL Java_com_adguard_http_parser_HttpMessage_getHeaders
   (JNIEnv *, jclass, jlong);
 
+/*
+ * Class:     com_adguard_http_parser_HttpMessage
+ * Method:    getHeader
+ * Signature: (JLjava/lang/String;)Ljava/lang/String;
+ */
+JNIEXPORT jstring JNICALL Java_com_adguard_http_parser_HttpMessage_getHeader
+  (JNIEnv *, jclass, jlong, jstring);
+
+/*
+ * Class:     com_adguard_http_parser_HttpMessage
+ * Method:    getHeaderValues
+ * Signature: (J[Ljava/lang/String;)[Ljava/lang/String;
+ */
+JNIEXPORT jobjectArray JNICALL Java_com_adguard_http_parser_HttpMessage_getHeaderValues
+  (JNIEnv *, jclass, jlong, jobjectArray);
+
+/*
+ * Class:     com_adguard_http_parser_HttpMessage
+ * Method:    getAllHeaderValues
+ * Signature: (JLjava/lang/String;)[Ljava/lang/String;
+ */
+JNIEXPORT jobjectArray JNICALL Java_com_adguard_http_parser_HttpMessage_getAllHeaderValues
+  (JNIEnv *, jclass, jlong, jstring);
+
+/*
+ * Class:     com_adguard_http_parser_HttpMessage
+ * Method:    getSnapshot
+ * Signature: (J)[B
+ */
+JNIEXPORT jbyteArray JNICALL Java_com_adguard_http_parser_HttpMessage_getSnapshot
+  (JNIEnv *, jclass, jlong);
+
 /*
  * Class:     com_adguard_http_parser_HttpMessage
  * Method:    removeHeader
@@ -23,6 +23,14 @@ JNIEXPORT void JNICALL Java_com_adguard_http_parser_NativeParser_init
 JNIEXPORT jlong JNICALL Java_com_adguard_http_parser_NativeParser_connect
   (JNIEnv *, jclass, jlong, jlong, jobject);
 
+/*
+ * Class:     com_adguard_http_parser_NativeParser
+ * Method:    enableEvents0
+ * Signature: (JIZ)V
+ */
+JNIEXPORT void JNICALL Java_com_adguard_http_parser_NativeParser_enableEvents0
+  (JNIEnv *, jclass, jlong, jint, jboolean);
+
 /*
  * Class:     com_adguard_http_parser_NativeParser
  * Method:    disconnect0
@@ -34,11 +42,43 @@ JNIEXPORT void JNICALL Java_com_adguard_http_parser_NativeParser_disconnect0
 /*
  * Class:     com_adguard_http_parser_NativeParser
  * Method:    input0
- * Signature: (JI[B)V
+ * Signature: (JI[B)I
  */
-JNIEXPORT void JNICALL Java_com_adguard_http_parser_NativeParser_input0
+JNIEXPORT jint JNICALL Java_com_adguard_http_parser_NativeParser_input0__JI_3B
   (JNIEnv *, jclass, jlong, jint, jbyteArray);
 
+/*
+ * Class:     com_adguard_http_parser_NativeParser
+ * Method:    input0
+ * Signature: (JI[BII)I
+ */
+JNIEXPORT jint JNICALL Java_com_adguard_http_parser_NativeParser_input0__JI_3BII
+  (JNIEnv *, jclass, jlong, jint, jbyteArray, jint, jint);
+
+/*
+ * Class:     com_adguard_http_parser_NativeParser
+ * Method:    input0
+ * Signature: (JILjava/nio/ByteBuffer;II)I
+ */
+JNIEXPORT jint JNICALL Java_com_adguard_http_parser_NativeParser_input0__JILjava_nio_ByteBuffer_2II
+  (JNIEnv *, jclass, jlong, jint, jobject, jint, jint);
+
+/*
+ * Class:     com_adguard_http_parser_NativeParser
+ * Method:    pause0
+ * Signature: (J)V
+ */
+JNIEXPORT void JNICALL Java_com_adguard_http_parser_NativeParser_pause0
+  (JNIEnv *, jclass, jlong);
+
+/*
+ * Class:     com_adguard_http_parser_NativeParser
+ * Method:    resume0
+ * Signature: (J)Z
+ */
+JNIEXPORT jboolean JNICALL Java_com_adguard_http_parser_NativeParser_resume0
+  (JNIEnv *, jclass, jlong);
+
 /*
  * Class:     com_adguard_http_parser_NativeParser
  * Method:    closeConnection
@@ -7,6 +7,26 @@
 #ifdef __cplusplus
 extern "C" {
 #endif
+#undef com_adguard_http_parser_NativeParser_Callbacks_EVENT_REQUEST_RECEIVED
+#define com_adguard_http_parser_NativeParser_Callbacks_EVENT_REQUEST_RECEIVED 1L
+#undef com_adguard_http_parser_NativeParser_Callbacks_EVENT_REQUEST_BODY_STARTED
+#define com_adguard_http_parser_NativeParser_Callbacks_EVENT_REQUEST_BODY_STARTED 2L
+#undef com_adguard_http_parser_NativeParser_Callbacks_EVENT_REQUEST_BODY_DATA
+#define com_adguard_http_parser_NativeParser_Callbacks_EVENT_REQUEST_BODY_DATA 3L
+#undef com_adguard_http_parser_NativeParser_Callbacks_EVENT_REQUEST_BODY_FINISHED
+#define com_adguard_http_parser_NativeParser_Callbacks_EVENT_REQUEST_BODY_FINISHED 4L
+#undef com_adguard_http_parser_NativeParser_Callbacks_EVENT_RESPONSE_RECEIVED
+#define com_adguard_http_parser_NativeParser_Callbacks_EVENT_RESPONSE_RECEIVED 5L
+#undef com_adguard_http_parser_NativeParser_Callbacks_EVENT_RESPONSE_BODY_STARTED
+#define com_adguard_http_parser_NativeParser_Callbacks_EVENT_RESPONSE_BODY_STARTED 6L
+#undef com_adguard_http_parser_NativeParser_Callbacks_EVENT_RESPONSE_BODY_DATA
+#define com_adguard_http_parser_NativeParser_Callbacks_EVENT_RESPONSE_BODY_DATA 7L
+#undef com_adguard_http_parser_NativeParser_Callbacks_EVENT_RESPONSE_BODY_FINISHED
+#define com_adguard_http_parser_NativeParser_Callbacks_EVENT_RESPONSE_BODY_FINISHED 8L
+#undef com_adguard_http_parser_NativeParser_Callbacks_EVENTS_START
+#define com_adguard_http_parser_NativeParser_Callbacks_EVENTS_START 8L
+#undef com_adguard_http_parser_NativeParser_Callbacks_EVENT_HEADER_SIZE
+#define com_adguard_http_parser_NativeParser_Callbacks_EVENT_HEADER_SIZE 24L
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,107 @@
+//
+// Classes, method and field IDs resolved once in JNI_OnLoad
+//
+
+#include "jni_cache.h"
+
+JniCache jniCache;
+
+/**
+ * Finds class and creates global ref to it
+ * @param env JNI env
+ * @param name Class name
+ * @return Global ref to class, or NULL if class is not found (exception is pending)
+ */
+static jclass findClass(JNIEnv *env, const char *name) {
+    jclass cls = env->FindClass(name);
+    if (cls == NULL) {
+        return NULL;
+    }
+    jclass globalRef = (jclass) env->NewGlobalRef(cls);
+    env->DeleteLocalRef(cls);
+    return globalRef;
+}
+
+/**
+ * Resolves all cached classes and IDs
+ * @param env JNI env
+ * @return False if some class or member is not found
+ */
+static bool initCache(JNIEnv *env) {
+    JniCache &c = jniCache;
+
+    c.NativeParserClass = findClass(env, "com/adguard/http/parser/NativeParser");
+    if (c.NativeParserClass == NULL) {
+        return false;
+    }
+    c.ParserCtxPtrField = env->GetFieldID(c.NativeParserClass, "parserCtxPtr", "J");
+
+    c.CallbacksClass = findClass(env, "com/adguard/http/parser/NativeParser$Callbacks");
+    if (c.CallbacksClass == NULL) {
+        return false;
+    }
+    c.HttpRequestReceivedCallback = env->GetMethodID(c.CallbacksClass, "onHttpRequestReceived", "(JJ)I");
+    c.HttpRequestBodyStartedCallback = env->GetMethodID(c.CallbacksClass, "onHttpRequestBodyStarted", "(J)Z");
+    c.HttpRequestBodyDataCallback = env->GetMethodID(c.CallbacksClass, "onHttpRequestBodyData", "(JI)V");
+    c.HttpRequestBodyFinishedCallback = env->GetMethodID(c.CallbacksClass, "onHttpRequestBodyFinished", "(J)V");
+    c.HttpResponseReceivedCallback = env->GetMethodID(c.CallbacksClass, "onHttpResponseReceived", "(JJ)I");
+    c.HttpResponseBodyStartedCallback = env->GetMethodID(c.CallbacksClass, "onHttpResponseBodyStarted", "(J)Z");
+    c.HttpResponseBodyDataCallback = env->GetMethodID(c.CallbacksClass, "onHttpResponseBodyData", "(JI)V");
+    c.HttpResponseBodyFinishedCallback = env->GetMethodID(c.CallbacksClass, "onHttpResponseBodyFinished", "(J)V");
+    c.SetBodyBufferMethod = env->GetMethodID(c.CallbacksClass, "setBodyBuffer", "(Ljava/nio/ByteBuffer;)V");
+    c.SetEventBufferMethod = env->GetMethodID(c.CallbacksClass, "setEventBuffer", "(Ljava/nio/ByteBuffer;)V");
+    c.DrainEventsMethod = env->GetMethodID(c.CallbacksClass, "drainEvents", "()I");
+
+    c.NativeLoggerClass = findClass(env, "com/adguard/http/parser/NativeLogger");
+    if (c.NativeLoggerClass == NULL) {
+        return false;
+    }
+    c.LoggerNativePtrField = env->GetFieldID(c.NativeLoggerClass, "nativePtr", "J");
+    c.LoggerCallbackClass = findClass(env, "com/adguard/http/parser/NativeLogger$NativeCallback");
+    if (c.LoggerCallbackClass == NULL) {
+        return false;
+    }
+    c.LoggerBatchCallbackMethod = env->GetMethodID(c.LoggerCallbackClass, "logBatch",
+                                                   "([I[Ljava/lang/String;[Ljava/lang/String;)V");
+
+    c.StringClass = findClass(env, "java/lang/String");
+
+    c.NullPointerException = findClass(env, "java/lang/NullPointerException");
+    c.IllegalArgumentException = findClass(env, "java/lang/IllegalArgumentException");
+    c.IOException = findClass(env, "java/io/IOException");
+    c.RuntimeException = findClass(env, "java/lang/RuntimeException");
+    c.OutOfMemoryError = findClass(env, "java/lang/OutOfMemoryError");
+
+    // GetMethodID()/GetFieldID() leave pending exception if member is not found
+    return !env->ExceptionCheck();
+}
+
+extern "C" JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM *vm, void *reserved) {
+    JNIEnv *env;
+    if (vm->GetEnv((void **) &env, JNI_VERSION_1_6) != JNI_OK) {
+        return JNI_ERR;
+    }
+    jniCache.vm = vm;
+    if (!initCache(env)) {
+        return JNI_ERR;
+    }
+    return JNI_VERSION_1_6;
+}
+
+extern "C" JNIEXPORT void JNICALL JNI_OnUnload(JavaVM *vm, void *reserved) {
+    JNIEnv *env;
+    if (vm->GetEnv((void **) &env, JNI_VERSION_1_6) != JNI_OK) {
+        return;
+    }
+    jclass *classes[] = {
+            &jniCache.NativeParserClass, &jniCache.CallbacksClass, &jniCache.NativeLoggerClass,
+            &jniCache.LoggerCallbackClass, &jniCache.StringClass, &jniCache.NullPointerException, &jniCache.IllegalArgumentException,
+            &jniCache.IOException, &jniCache.RuntimeException, &jniCache.OutOfMemoryError
+    };
+    for (size_t i = 0; i < sizeof(classes) / sizeof(classes[0]); i++) {
+        if (*classes[i] != NULL) {
+            env->DeleteGlobalRef(*classes[i]);
+            *classes[i] = NULL;
+        }
+    }
+}
@@ -0,0 +1,54 @@
+//
+// Classes, method and field IDs resolved once in JNI_OnLoad
+//
+
+#ifndef JNI_CACHE_H
+#define JNI_CACHE_H
+
+#include <jni.h>
+
+/**
+ * Global refs to classes and their method and field IDs.
+ * Filled in JNI_OnLoad(), so they are resolved with the class loader of the library
+ * and may be used from any thread, including native threads attached by getEnv().
+ */
+struct JniCache {
+    JavaVM *vm;
+
+    // NativeParser
+    jclass NativeParserClass;
+    jfieldID ParserCtxPtrField;
+
+    // NativeParser$Callbacks
+    jclass CallbacksClass;
+    jmethodID HttpRequestReceivedCallback;
+    jmethodID HttpRequestBodyStartedCallback;
+    jmethodID HttpRequestBodyDataCallback;
+    jmethodID HttpRequestBodyFinishedCallback;
+    jmethodID HttpResponseReceivedCallback;
+    jmethodID HttpResponseBodyStartedCallback;
+    jmethodID HttpResponseBodyDataCallback;
+    jmethodID HttpResponseBodyFinishedCallback;
+    jmethodID SetBodyBufferMethod;
+    jmethodID SetEventBufferMethod;
+    jmethodID DrainEventsMethod;
+
+    // NativeLogger and NativeLogger$NativeCallback
+    jclass NativeLoggerClass;
+    jfieldID LoggerNativePtrField;
+    jclass LoggerCallbackClass;
+    jmethodID LoggerBatchCallbackMethod;
+
+    jclass StringClass;
+
+    // Exceptions thrown by native code
+    jclass NullPointerException;
+    jclass IllegalArgumentException;
+    jclass IOException;
+    jclass RuntimeException;
+    jclass OutOfMemoryError;
+};
+
+extern JniCache jniCache;
+
+#endif //JNI_CACHE_H
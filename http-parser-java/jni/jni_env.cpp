@@ -0,0 +1,65 @@
+//
+// Per-thread JNIEnv cache
+//
+
+#include <pthread.h>
+#include "jni_env.h"
+
+/**
+ * Thread-local env cache entry
+ */
+struct ThreadEnv {
+    JavaVM *vm;
+    JNIEnv *env;
+    // Thread was attached by getEnv() and should be detached on exit
+    bool attached;
+};
+
+static pthread_key_t threadEnvKey;
+static pthread_once_t threadEnvKeyOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * Thread exit handler, detaches native threads attached by getEnv()
+ * @param value Thread-local env cache entry
+ */
+static void threadEnvDestructor(void *value) {
+    ThreadEnv *threadEnv = (ThreadEnv *) value;
+    if (threadEnv->attached) {
+        threadEnv->vm->DetachCurrentThread();
+    }
+    delete threadEnv;
+}
+
+static void threadEnvKeyCreate() {
+    pthread_key_create(&threadEnvKey, threadEnvDestructor);
+}
+
+JNIEnv *getEnv(JavaVM *vm) {
+    pthread_once(&threadEnvKeyOnce, threadEnvKeyCreate);
+    ThreadEnv *threadEnv = (ThreadEnv *) pthread_getspecific(threadEnvKey);
+    if (threadEnv != NULL) {
+        return threadEnv->env;
+    }
+
+    JNIEnv *env;
+    bool attached = false;
+    jint r = vm->GetEnv((void **) &env, JNI_VERSION_1_6);
+    if (r == JNI_EDETACHED) {
+#ifdef ANDROID
+        r = vm->AttachCurrentThreadAsDaemon(&env, NULL);
+#else
+        r = vm->AttachCurrentThreadAsDaemon((void **) &env, NULL);
+#endif /* defined(ANDROID) */
+        attached = true;
+    }
+    if (r != JNI_OK) {
+        return NULL;
+    }
+
+    threadEnv = new ThreadEnv;
+    threadEnv->vm = vm;
+    threadEnv->env = env;
+    threadEnv->attached = attached;
+    pthread_setspecific(threadEnvKey, threadEnv);
+    return env;
+}
@@ -0,0 +1,20 @@
+//
+// Per-thread JNIEnv cache
+//
+
+#ifndef JNI_ENV_H
+#define JNI_ENV_H
+
+#include <jni.h>
+
+/**
+ * Gets JNIEnv of current thread.
+ * Env of thread which is already attached to VM (e.g. Java thread calling into native code)
+ * is returned as is. Native thread is attached as daemon on first call and detached when it exits.
+ * Env is cached in thread-local storage, so VM is queried only once per thread.
+ * @param vm Java virtual machine
+ * @return JNIEnv object, or NULL if thread can't be attached
+ */
+JNIEnv *getEnv(JavaVM *vm);
+
+#endif //JNI_ENV_H
@@ -4,44 +4,62 @@
 
 #include "com_adguard_http_parser_NativeLogger.h"
 #include "../../http-parser/src/logger.h"
+#include "jni_env.h"
+#include "jni_cache.h"
 
 struct LoggerCtx {
-    JavaVM *vm;
     jobject callbackObject;
-    jmethodID callbackMethod;
 };
 
 extern "C" {
-    void NativeLogger_callback(logger *ctx, logger_log_level_t log_level, const char *thread_info, const char *message);
+    void NativeLogger_batchCallback(logger *ctx, const logger_record *records, size_t count);
 }
 
 /**
- * C callback for HTTP parser's logger
+ * C batch callback for HTTP parser's logger. Called from logger flush thread,
+ * passes batch of records to Java by one call.
  * @param ctx Logger context
- * @param log_level Log level
- * @param thread_info Current thread info (thread name + pid)
- * @param message Formatted message
+ * @param records Log records
+ * @param count Number of records
  */
-void NativeLogger_callback(logger *ctx, logger_log_level_t log_level, const char *thread_info, const char *message) {
+void NativeLogger_batchCallback(logger *ctx, const logger_record *records, size_t count) {
     LoggerCtx *loggerCtx = (LoggerCtx *) ctx->attachment;
-    JNIEnv *env;
-#ifdef ANDROID
-    if (loggerCtx->vm->AttachCurrentThread(&env, NULL) != JNI_OK) {
-#else
-    if (loggerCtx->vm->AttachCurrentThread((void **) &env, NULL) != JNI_OK) {
-#endif /* defined(ANDROID) */
+    JNIEnv *env = getEnv(jniCache.vm);
+    if (env == NULL) {
         return;
     }
 
-    jstring threadInfoString = thread_info ? env->NewStringUTF(thread_info) : NULL;
-    jstring messageString = message ? env->NewStringUTF(message) : NULL;
+    jint levels[LOGGER_BATCH_SIZE];
+    jintArray levelArray = env->NewIntArray((jsize) count);
+    jobjectArray threadInfoArray = env->NewObjectArray((jsize) count, jniCache.StringClass, NULL);
+    jobjectArray messageArray = env->NewObjectArray((jsize) count, jniCache.StringClass, NULL);
+    if (levelArray == NULL || threadInfoArray == NULL || messageArray == NULL) {
+        env->ExceptionClear();
+        env->DeleteLocalRef(levelArray);
+        env->DeleteLocalRef(threadInfoArray);
+        env->DeleteLocalRef(messageArray);
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        levels[i] = (jint) records[i].log_level;
+        // Delete refs at once, only few local refs are guaranteed to be available
+        jstring threadInfoString = env->NewStringUTF(records[i].thread_info);
+        env->SetObjectArrayElement(threadInfoArray, (jsize) i, threadInfoString);
+        env->DeleteLocalRef(threadInfoString);
+        jstring messageString = env->NewStringUTF(records[i].message);
+        env->SetObjectArrayElement(messageArray, (jsize) i, messageString);
+        env->DeleteLocalRef(messageString);
+    }
+    env->SetIntArrayRegion(levelArray, 0, (jsize) count, levels);
 
-    env->CallVoidMethod(loggerCtx->callbackObject, loggerCtx->callbackMethod, (int) log_level,
-                                   threadInfoString, messageString);
+    env->CallVoidMethod(loggerCtx->callbackObject, jniCache.LoggerBatchCallbackMethod,
+                        levelArray, threadInfoArray, messageArray);
+    // Exception can't be thrown to anybody on flush thread
+    env->ExceptionClear();
 
-    env->DeleteLocalRef(threadInfoString);
-    env->DeleteLocalRef(messageString);
-    loggerCtx->vm->DetachCurrentThread();
+    env->DeleteLocalRef(levelArray);
+    env->DeleteLocalRef(threadInfoArray);
+    env->DeleteLocalRef(messageArray);
 }
 
 /**
@@ -60,22 +78,15 @@ jobject Java_com_adguard_http_parser_NativeLogger_open0(JNIEnv *env, jclass cls,
 
     LoggerCtx *loggerCtx = new LoggerCtx;
     loggerCtx->callbackObject = env->NewGlobalRef(callback);
-    jclass callbackClass = env->FindClass("com/adguard/http/parser/NativeLogger$NativeCallback");
-    if (callbackClass == NULL) {
-        delete loggerCtx;
-        return NULL;
-    }
-    loggerCtx->callbackMethod = env->GetMethodID(callbackClass, "log", "(ILjava/lang/String;Ljava/lang/String;)V");
-    env->GetJavaVM(&loggerCtx->vm);
 
-    logger *log = logger_open(NULL, (logger_log_level_t) logLevel, NativeLogger_callback, loggerCtx);
-
-    jfieldID nativePtr = env->GetFieldID(cls, "nativePtr", "J");
-    if (nativePtr == NULL) {
+    logger *log = logger_open_batched((logger_log_level_t) logLevel, NativeLogger_batchCallback, loggerCtx);
+    if (log == NULL) {
+        env->DeleteGlobalRef(loggerCtx->callbackObject);
         delete loggerCtx;
         return NULL;
     }
-    env->SetLongField(loggerObject, nativePtr, (jlong) log);
+
+    env->SetLongField(loggerObject, jniCache.LoggerNativePtrField, (jlong) log);
 
     return loggerObject;
 }
@@ -108,11 +119,7 @@ jobject Java_com_adguard_http_parser_NativeLogger_open1(JNIEnv *env, jclass cls,
         log = logger_open(NULL, (logger_log_level_t) logLevel, NULL, NULL);
     }
 
-    jfieldID nativePtr = env->GetFieldID(cls, "nativePtr", "J");
-    if (nativePtr == NULL) {
-        return NULL;
-    }
-    env->SetLongField(loggerObject, nativePtr, (jlong) log);
+    env->SetLongField(loggerObject, jniCache.LoggerNativePtrField, (jlong) log);
 
     return loggerObject;
 }
@@ -150,6 +157,10 @@ void Java_com_adguard_http_parser_NativeLogger_close(JNIEnv *env, jclass cls, jl
  */
 void Java_com_adguard_http_parser_NativeLogger_log(JNIEnv *env, jclass cls, jlong nativePtr, jint log_level, jstring message) {
     logger *log = (logger *) nativePtr;
+    // Check level before converting message
+    if (!logger_is_enabled(log, (logger_log_level_t) log_level)) {
+        return;
+    }
 
     jboolean isCopy;
     const char *messageChars = env->GetStringUTFChars(message, &isCopy);
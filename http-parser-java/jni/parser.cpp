@@ -1,4 +1,5 @@
 #include <jni.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <map>
@@ -8,6 +9,12 @@
 #include "com_adguard_http_parser_HttpMessage_HttpHeaderField.h"
 #include "../../http-parser/src/parser.h"
 #include "callbacks.h"
+#include "jni_cache.h"
+
+// Size of stack buffer used for passing byte array regions to parser
+#define INPUT_REGION_BUFFER_SIZE 8192
+// Size of stack buffer used for header field names, longer names are allocated
+#define FIELD_NAME_BUFFER_SIZE 256
 
 static void processError(JNIEnv *env, int returnCode, connection_context *context);
 static void processError(JNIEnv *env, int returnCode, const char *message);
@@ -41,6 +48,28 @@ jlong Java_com_adguard_http_parser_NativeParser_connect(JNIEnv *env, jclass cls,
     return (jlong) connection_ctx;
 }
 
+/**
+ * Switches connection to batched mode: callbacks are recorded into event ring and dispatched
+ * by Java side after native call returns (message received events are dispatched immediately)
+ * @param env JNI env
+ * @param cls NativeParser class
+ * @param connectionPtr Pointer to connection context (from NativeConnection object)
+ * @param capacity Event ring capacity in bytes
+ * @param decodeBody Decode body of all messages of connection
+ */
+void Java_com_adguard_http_parser_NativeParser_enableEvents0(JNIEnv *env, jclass cls, jlong connectionPtr,
+                                                            jint capacity, jboolean decodeBody) {
+    connection_context *context = (connection_context *) connectionPtr;
+    Callbacks *callbacks = Callbacks::get(context);
+    if (callbacks == NULL || capacity <= 0) {
+        processError(env, PARSER_INVALID_ARGUMENT_ERROR, "Invalid connection or capacity");
+        return;
+    }
+    if (!callbacks->enableEvents(env, (size_t) capacity, decodeBody == JNI_TRUE)) {
+        env->ThrowNew(jniCache.OutOfMemoryError, "Can't allocate event ring");
+    }
+}
+
 /**
  * Tells parser that one of sides of connection was disconnected
  * @param env JNI env
@@ -52,6 +81,10 @@ void Java_com_adguard_http_parser_NativeParser_disconnect0(JNIEnv *env, jclass c
                                                           jint direction) {
     connection_context *context = (connection_context *) connectionPtr;
     int r = parser_disconnect(context, (transfer_direction_t) direction);
+    if (env->ExceptionCheck()) {
+        // Exception thrown by callback is passed to Java side
+        return;
+    }
     processError(env, r, context);
 }
 
@@ -62,17 +95,139 @@ void Java_com_adguard_http_parser_NativeParser_disconnect0(JNIEnv *env, jclass c
  * @param connectionPtr Pointer to connection context (from NativeConnection object)
  * @param direction Transfer direction
  * @param bytes Input data
+ * @return Number of consumed bytes (less than input length if connection was paused)
  */
-void Java_com_adguard_http_parser_NativeParser_input0(JNIEnv *env, jclass cls, jlong connectionPtr, jint direction,
-                                                     jbyteArray bytes) {
+jint Java_com_adguard_http_parser_NativeParser_input0__JI_3B(JNIEnv *env, jclass cls, jlong connectionPtr,
+                                                            jint direction, jbyteArray bytes) {
     connection_context *context = (connection_context *) connectionPtr;
     jbyte *data = env->GetByteArrayElements(bytes, NULL);
     int len = env->GetArrayLength(bytes);
     int r = parser_input(context, (transfer_direction_t) direction, (const char *) data, len);
     env->ReleaseByteArrayElements(bytes, data, JNI_ABORT);
+    if (env->ExceptionCheck()) {
+        // Exception thrown by callback is passed to Java side
+        return (jint) connection_get_input_consumed(context);
+    }
+    if (r != PARSER_PAUSED) {
+        processError(env, r, context);
+    }
+    return (jint) connection_get_input_consumed(context);
+}
+
+/**
+ * Processes input from local/remote side, taking data from the region of byte array.
+ * Callbacks call Java methods during parser_input(), so array can't be held with
+ * GetPrimitiveArrayCritical() here. Instead, only the given region is copied by parts
+ * into a stack buffer, without copying the whole array or allocating memory.
+ * @param env JNI env
+ * @param cls NativeParser class
+ * @param connectionPtr Pointer to connection context (from NativeConnection object)
+ * @param direction Transfer direction
+ * @param bytes Input data
+ * @param offset Offset of data in array
+ * @param length Length of data
+ * @return Number of consumed bytes (less than length if connection was paused)
+ */
+jint Java_com_adguard_http_parser_NativeParser_input0__JI_3BII(JNIEnv *env, jclass cls, jlong connectionPtr,
+                                                              jint direction, jbyteArray bytes,
+                                                              jint offset, jint length) {
+    connection_context *context = (connection_context *) connectionPtr;
+    if (offset < 0 || length < 0 || offset > env->GetArrayLength(bytes) - length) {
+        processError(env, PARSER_INVALID_ARGUMENT_ERROR, "Array region is out of bounds");
+        return 0;
+    }
+
+    char buffer[INPUT_REGION_BUFFER_SIZE];
+    jint consumed = 0;
+    while (consumed < length) {
+        jint part = length - consumed < INPUT_REGION_BUFFER_SIZE ? length - consumed : INPUT_REGION_BUFFER_SIZE;
+        env->GetByteArrayRegion(bytes, offset + consumed, part, (jbyte *) buffer);
+        int r = parser_input(context, (transfer_direction_t) direction, buffer, (size_t) part);
+        if (env->ExceptionCheck()) {
+            // Exception thrown by callback is passed to Java side, no JNI calls may be made until return
+            return consumed + (jint) connection_get_input_consumed(context);
+        }
+        if (r != 0) {
+            if (r != PARSER_PAUSED) {
+                processError(env, r, context);
+            }
+            return consumed + (jint) connection_get_input_consumed(context);
+        }
+        consumed += part;
+    }
+    return consumed;
+}
+
+/**
+ * Processes input from local/remote side, taking data directly from the memory of direct ByteBuffer
+ * @param env JNI env
+ * @param cls NativeParser class
+ * @param connectionPtr Pointer to connection context (from NativeConnection object)
+ * @param direction Transfer direction
+ * @param buffer Direct ByteBuffer
+ * @param position Position of data in buffer
+ * @param limit Limit of data in buffer
+ * @return Number of consumed bytes (less than limit - position if connection was paused)
+ */
+jint Java_com_adguard_http_parser_NativeParser_input0__JILjava_nio_ByteBuffer_2II(JNIEnv *env, jclass cls,
+                                                                                 jlong connectionPtr,
+                                                                                 jint direction, jobject buffer,
+                                                                                 jint position, jint limit) {
+    connection_context *context = (connection_context *) connectionPtr;
+    char *data = (char *) env->GetDirectBufferAddress(buffer);
+    if (data == NULL) {
+        processError(env, PARSER_INVALID_ARGUMENT_ERROR, "Buffer is not direct");
+        return 0;
+    }
+    if (position < 0 || position > limit || limit > env->GetDirectBufferCapacity(buffer)) {
+        processError(env, PARSER_INVALID_ARGUMENT_ERROR, "Buffer region is out of bounds");
+        return 0;
+    }
+
+    int r = parser_input(context, (transfer_direction_t) direction, data + position, (size_t) (limit - position));
+    if (env->ExceptionCheck()) {
+        // Exception thrown by callback is passed to Java side
+        return (jint) connection_get_input_consumed(context);
+    }
+    if (r != PARSER_PAUSED) {
+        processError(env, r, context);
+    }
+    return (jint) connection_get_input_consumed(context);
+}
+
+/**
+ * Pauses input processing, may be called from body data callback
+ * @param env JNI env
+ * @param cls NativeParser class
+ * @param connectionPtr Pointer to connection context (from NativeConnection object)
+ */
+void Java_com_adguard_http_parser_NativeParser_pause0(JNIEnv *env, jclass cls, jlong connectionPtr) {
+    connection_context *context = (connection_context *) connectionPtr;
+    int r = parser_connection_pause(context);
     processError(env, r, context);
 }
 
+/**
+ * Resumes input processing of paused connection
+ * @param env JNI env
+ * @param cls NativeParser class
+ * @param connectionPtr Pointer to connection context (from NativeConnection object)
+ * @return False if connection was paused again by body data callback
+ */
+jboolean Java_com_adguard_http_parser_NativeParser_resume0(JNIEnv *env, jclass cls, jlong connectionPtr) {
+    connection_context *context = (connection_context *) connectionPtr;
+    int r = parser_connection_resume(context);
+    if (env->ExceptionCheck()) {
+        // Exception thrown by callback is passed to Java side
+        return JNI_TRUE;
+    }
+    if (r == PARSER_PAUSED) {
+        return JNI_FALSE;
+    }
+    processError(env, r, context);
+    return JNI_TRUE;
+}
+
 /**
  * Closes connection, tell parser to free corresponding data structures
  * @param env JNI env
@@ -81,12 +236,13 @@ void Java_com_adguard_http_parser_NativeParser_input0(JNIEnv *env, jclass cls, j
  */
 void Java_com_adguard_http_parser_NativeParser_closeConnection(JNIEnv *env, jclass cls, jlong connectionPtr) {
     connection_context *context = (connection_context *) connectionPtr;
+    Callbacks *callbacks = Callbacks::get(context);
     int r = parser_connection_close(context);
     // `context' memory is freed at this point
     processError(env, r, "");
 
     // Delete callbacks
-    delete Callbacks::get(context);
+    delete callbacks;
 }
 
 /**
@@ -112,18 +268,13 @@ jlong Java_com_adguard_http_parser_NativeParser_getConnectionId(JNIEnv *env, jcl
 void Java_com_adguard_http_parser_NativeParser_init(JNIEnv *env, jclass cls, jobject parser, jlong loggerPtr) {
     fprintf(stderr, "NativeParser.init()\n");
 
-    jfieldID parserCtxPtr = env->GetFieldID(cls, "parserCtxPtr", "J");
-    if (parserCtxPtr == NULL) {
-        return;
-    }
-
     logger *log = (logger *) loggerPtr;
     parser_context *parser_ctx;
     int r = parser_create(log, &parser_ctx);
     if (r == 0) {
-        env->SetLongField(parser, parserCtxPtr, (jlong) parser_ctx);
+        env->SetLongField(parser, jniCache.ParserCtxPtrField, (jlong) parser_ctx);
     } else {
-        env->ThrowNew(env->FindClass("java/io/Exception"), "NativeParser()");
+        env->ThrowNew(jniCache.IOException, "NativeParser()");
     }
 }
 
@@ -137,7 +288,7 @@ void Java_com_adguard_http_parser_NativeParser_closeParser(JNIEnv *env, jclass c
     parser_context *parser_ctx = (parser_context *) parserPtr;
     int r = parser_destroy(parser_ctx);
     if (r != 0) {
-        env->ThrowNew(env->FindClass("java/io/Exception"), "NativeParser.close()");
+        env->ThrowNew(jniCache.IOException, "NativeParser.close()");
     }
 }
 
@@ -258,6 +409,218 @@ jlongArray Java_com_adguard_http_parser_HttpMessage_getHeaders(JNIEnv *env, jcla
     return array;
 }
 
+/**
+ * Copies field name to stack buffer without pinning Java string, or to heap if name is long
+ * @param env JNI env
+ * @param name Field name
+ * @param buffer Stack buffer of FIELD_NAME_BUFFER_SIZE characters
+ * @param p_length Pointer to variable where length of name will be stored
+ * @return Copied name (buffer or memory which must be freed), or NULL if it can't be allocated
+ */
+static char *copyFieldName(JNIEnv *env, jstring name, char *buffer, size_t *p_length) {
+    jsize length = env->GetStringLength(name);
+    jsize utfLength = env->GetStringUTFLength(name);
+    char *chars = utfLength < FIELD_NAME_BUFFER_SIZE ? buffer : (char *) malloc((size_t) utfLength + 1);
+    if (chars == NULL) {
+        env->ThrowNew(jniCache.OutOfMemoryError, "Can't allocate field name");
+        return NULL;
+    }
+    env->GetStringUTFRegion(name, 0, length, chars);
+    *p_length = (size_t) utfLength;
+    return chars;
+}
+
+/**
+ * Finds value of header field
+ * @param env JNI env
+ * @param message Pointer to http_message structure
+ * @param name Field name
+ * @return Field value, or NULL if there is no such field
+ */
+static jstring findHeader(JNIEnv *env, http_message *message, jstring name) {
+    char buffer[FIELD_NAME_BUFFER_SIZE];
+    size_t length;
+    char *chars = copyFieldName(env, name, buffer, &length);
+    if (chars == NULL) {
+        return NULL;
+    }
+    const char *value = http_message_find_header_field(message, chars, length, NULL);
+    if (chars != buffer) {
+        free(chars);
+    }
+    return value != NULL ? env->NewStringUTF(value) : NULL;
+}
+
+/**
+ * Get value of HTTP header field with given name, ignoring case
+ * @param env JNI env
+ * @param cls HttpMessage class
+ * @param nativePtr Pointer to http_message structure (from HttpMessage)
+ * @param name Field name
+ * @return Field value, or null if there is no such field
+ */
+jstring Java_com_adguard_http_parser_HttpMessage_getHeader(JNIEnv *env, jclass cls, jlong nativePtr, jstring name) {
+    return findHeader(env, (http_message *) nativePtr, name);
+}
+
+/**
+ * Get values of several HTTP header fields by one call
+ * @param env JNI env
+ * @param cls HttpMessage class
+ * @param nativePtr Pointer to http_message structure (from HttpMessage)
+ * @param names Field names
+ * @return Field values in order of names, null for missing fields
+ */
+jobjectArray Java_com_adguard_http_parser_HttpMessage_getHeaderValues(JNIEnv *env, jclass cls, jlong nativePtr,
+                                                                      jobjectArray names) {
+    http_message *message = (http_message *) nativePtr;
+    jsize count = env->GetArrayLength(names);
+    jobjectArray values = env->NewObjectArray(count, jniCache.StringClass, NULL);
+    if (values == NULL) {
+        return NULL;
+    }
+    for (jsize i = 0; i < count; i++) {
+        jstring name = (jstring) env->GetObjectArrayElement(names, i);
+        if (name == NULL) {
+            env->ThrowNew(jniCache.NullPointerException, "Field name is null");
+            return NULL;
+        }
+        jstring value = findHeader(env, message, name);
+        env->DeleteLocalRef(name);
+        if (env->ExceptionCheck()) {
+            return NULL;
+        }
+        if (value != NULL) {
+            env->SetObjectArrayElement(values, i, value);
+            env->DeleteLocalRef(value);
+        }
+    }
+    return values;
+}
+
+/**
+ * Get values of all HTTP header fields with given name, ignoring case
+ * @param env JNI env
+ * @param cls HttpMessage class
+ * @param nativePtr Pointer to http_message structure (from HttpMessage)
+ * @param name Field name
+ * @return Field values in order of fields in message, empty array if there is no such field
+ */
+jobjectArray Java_com_adguard_http_parser_HttpMessage_getAllHeaderValues(JNIEnv *env, jclass cls, jlong nativePtr,
+                                                                         jstring name) {
+    http_message *message = (http_message *) nativePtr;
+    char buffer[FIELD_NAME_BUFFER_SIZE];
+    size_t length;
+    char *chars = copyFieldName(env, name, buffer, &length);
+    if (chars == NULL) {
+        return NULL;
+    }
+    // First pass counts values, second one fills array
+    http_header_iter iter;
+    jsize count = 0;
+    http_message_header_iter(message, chars, length, &iter);
+    while (http_header_iter_next(&iter, NULL) != NULL) {
+        count++;
+    }
+    jobjectArray values = env->NewObjectArray(count, jniCache.StringClass, NULL);
+    const char *value;
+    http_message_header_iter(message, chars, length, &iter);
+    for (jsize i = 0; values != NULL && (value = http_header_iter_next(&iter, NULL)) != NULL; i++) {
+        jstring str = env->NewStringUTF(value);
+        if (str == NULL) {
+            values = NULL;
+            break;
+        }
+        env->SetObjectArrayElement(values, i, str);
+        env->DeleteLocalRef(str);
+    }
+    if (chars != buffer) {
+        free(chars);
+    }
+    return values;
+}
+
+/**
+ * Length of string in snapshot
+ * @param str String or NULL
+ * @return Length of string with its length prefix
+ */
+static size_t snapshotStringSize(const char *str) {
+    return 4 + (str != NULL ? strlen(str) : 0);
+}
+
+/**
+ * Writes big-endian 32-bit integer to snapshot
+ * @param out Output pointer
+ * @param value Value
+ * @return Output pointer after written value
+ */
+static char *snapshotPutInt(char *out, int32_t value) {
+    uint32_t v = (uint32_t) value;
+    out[0] = (char) (v >> 24);
+    out[1] = (char) (v >> 16);
+    out[2] = (char) (v >> 8);
+    out[3] = (char) v;
+    return out + 4;
+}
+
+/**
+ * Writes string to snapshot as length (-1 for NULL) and bytes
+ * @param out Output pointer
+ * @param str String or NULL
+ * @return Output pointer after written string
+ */
+static char *snapshotPutString(char *out, const char *str) {
+    if (str == NULL) {
+        return snapshotPutInt(out, -1);
+    }
+    size_t length = strlen(str);
+    out = snapshotPutInt(out, (int32_t) length);
+    memcpy(out, str, length);
+    return out + length;
+}
+
+/**
+ * Get snapshot of HttpMessage: status code, method, URL, status text and all header fields
+ * serialized into one byte array, decoded by HttpMessageSnapshot on Java side.
+ * Format (big-endian): int status code, string method, string URL, string status, int field count,
+ * then field name and value strings. Every string is int length (-1 for NULL) followed by bytes.
+ * @param env JNI env
+ * @param cls HttpMessage class
+ * @param nativePtr Pointer to http_message structure (from HttpMessage)
+ * @return Snapshot bytes
+ */
+jbyteArray Java_com_adguard_http_parser_HttpMessage_getSnapshot(JNIEnv *env, jclass cls, jlong nativePtr) {
+    http_message *message = (http_message *) nativePtr;
+    size_t size = 4 + snapshotStringSize(message->method) + snapshotStringSize(message->url)
+                  + snapshotStringSize(message->status) + 4;
+    for (size_t i = 0; i < message->field_count; i++) {
+        size += snapshotStringSize(message->fields[i].name) + snapshotStringSize(message->fields[i].value);
+    }
+
+    jbyteArray arr = env->NewByteArray((jsize) size);
+    if (arr == NULL) {
+        return NULL;
+    }
+    // No JNI calls are made while array is held
+    char *data = (char *) env->GetPrimitiveArrayCritical(arr, NULL);
+    if (data == NULL) {
+        return NULL;
+    }
+    char *out = data;
+    out = snapshotPutInt(out, (int32_t) message->status_code);
+    out = snapshotPutString(out, message->method);
+    out = snapshotPutString(out, message->url);
+    out = snapshotPutString(out, message->status);
+    out = snapshotPutInt(out, (int32_t) message->field_count);
+    for (size_t i = 0; i < message->field_count; i++) {
+        out = snapshotPutString(out, message->fields[i].name);
+        out = snapshotPutString(out, message->fields[i].value);
+    }
+    env->ReleasePrimitiveArrayCritical(arr, data, 0);
+    return arr;
+}
+
 /**
  * Add new HTTP header to HttpMessage
  * @param env JNI env
@@ -282,6 +645,24 @@ void Java_com_adguard_http_parser_HttpMessage_addHeader(JNIEnv *env, jclass cls,
     }
 }
 
+/**
+ * Append HTTP header field to HttpMessage, even if it already has field with this name
+ * @param env JNI env
+ * @param cls HttpMessage class
+ * @param nativePtr Pointer to http_message structure (from HttpMessage)
+ * @param fieldName Field name
+ * @param value Field value
+ */
+void Java_com_adguard_http_parser_HttpMessage_appendHeader(JNIEnv *env, jclass cls, jlong nativePtr,
+                                                           jstring fieldName, jstring value) {
+    const char *fieldChars = env->GetStringUTFChars(fieldName, NULL);
+    const char *valueChars = env->GetStringUTFChars(value, NULL);
+    http_message_append_header_field((http_message *) nativePtr, fieldChars, strlen(fieldChars),
+                                     valueChars, strlen(valueChars));
+    env->ReleaseStringUTFChars(fieldName, fieldChars);
+    env->ReleaseStringUTFChars(value, valueChars);
+}
+
 /**
  * Remove HTTP header field with given name
  * @param env JNI env
@@ -333,11 +714,30 @@ jstring Java_com_adguard_http_parser_HttpMessage_00024HttpHeaderField_getValue(J
 jint Java_com_adguard_http_parser_HttpMessage_sizeBytes(JNIEnv *env, jclass cls, jlong nativePtr) {
     http_message *message = (http_message *) nativePtr;
     size_t length = 0;
-    char *message_raw = http_message_raw(message, &length);
-    free(message_raw);
+    http_message_serialize_into(message, NULL, 0, &length);
     return (jint) length;
 }
 
+/**
+ * Serialize HttpMessage directly into Java byte array
+ * @param env JNI env
+ * @param message Pointer to http_message structure
+ * @param arr Byte array
+ * @param capacity Length of byte array
+ * @param p_length Pointer to variable where serialized length will be stored
+ * @return 0 if success, PARSER_BUFFER_TOO_SMALL_ERROR if array is too small
+ */
+static int serializeIntoArray(JNIEnv *env, http_message *message, jbyteArray arr, size_t capacity, size_t *p_length) {
+    // No JNI calls are made while array is held
+    char *data = (char *) env->GetPrimitiveArrayCritical(arr, NULL);
+    if (data == NULL) {
+        return PARSER_NULL_POINTER_ERROR;
+    }
+    int r = http_message_serialize_into(message, data, capacity, p_length);
+    env->ReleasePrimitiveArrayCritical(arr, data, r == 0 ? 0 : JNI_ABORT);
+    return r;
+}
+
 /**
  * Serialize HttpMessage into correct HTTP request/response
  * @param env JNI env
@@ -348,11 +748,13 @@ jint Java_com_adguard_http_parser_HttpMessage_sizeBytes(JNIEnv *env, jclass cls,
 jbyteArray Java_com_adguard_http_parser_HttpMessage_getBytes__J(JNIEnv *env, jclass cls, jlong nativePtr) {
     http_message *message = (http_message *) nativePtr;
     size_t length = 0;
-    char *message_raw = http_message_raw(message, &length);
+    http_message_serialize_into(message, NULL, 0, &length);
 
     jbyteArray arr = env->NewByteArray((jsize) length);
-    env->SetByteArrayRegion(arr, 0, (jsize) length, (jbyte *) message_raw);
-    free(message_raw);
+    if (arr == NULL) {
+        return NULL;
+    }
+    serializeIntoArray(env, message, arr, length, &length);
     return arr;
 }
 
@@ -366,10 +768,12 @@ jbyteArray Java_com_adguard_http_parser_HttpMessage_getBytes__J(JNIEnv *env, jcl
 void Java_com_adguard_http_parser_HttpMessage_getBytes__J_3B(JNIEnv *env, jclass cls, jlong nativePtr, jbyteArray arr) {
     http_message *message = (http_message *) nativePtr;
     size_t length = 0;
-    char *message_raw = http_message_raw(message, &length);
-
-    env->SetByteArrayRegion(arr, 0, (jsize) length, (jbyte *) message_raw);
-    free(message_raw);
+    size_t capacity = (size_t) env->GetArrayLength(arr);
+    if (serializeIntoArray(env, message, arr, capacity, &length) == PARSER_BUFFER_TOO_SMALL_ERROR) {
+        char error[128];
+        snprintf(error, sizeof(error), "Destination array is too small: %zu bytes needed", length);
+        env->ThrowNew(jniCache.IllegalArgumentException, error);
+    }
 }
 
 /**
@@ -432,24 +836,24 @@ static void processError(JNIEnv *env, int returnCode, const char *message) {
     char final_message[256];
     switch ((error_type_t) returnCode) {
         case PARSER_NULL_POINTER_ERROR:
-            env->ThrowNew(env->FindClass("java/lang/NullPointerException"), message);
+            env->ThrowNew(jniCache.NullPointerException, message);
             break;
         case PARSER_HTTP_PARSE_ERROR:
             snprintf(final_message, 256, "HTTP parse error: %s", message);
-            env->ThrowNew(env->FindClass("java/io/IOException"), final_message);
+            env->ThrowNew(jniCache.IOException, final_message);
             break;
         case PARSER_ZLIB_ERROR:
             snprintf(final_message, 256, "Zlib error: %s", message);
-            env->ThrowNew(env->FindClass("java/io/IOException"), final_message);
+            env->ThrowNew(jniCache.IOException, final_message);
             break;
         case PARSER_INVALID_ARGUMENT_ERROR:
-            env->ThrowNew(env->FindClass("java/lang/IllegalArgumentException"), message);
+            env->ThrowNew(jniCache.IllegalArgumentException, message);
             break;
         case PARSER_ALREADY_CONNECTED_ERROR:
-            env->ThrowNew(env->FindClass("java/io/IOException"), message);
+            env->ThrowNew(jniCache.IOException, message);
             break;
         default:
-            env->ThrowNew(env->FindClass("java/lang/RuntimeException"), message);
+            env->ThrowNew(jniCache.RuntimeException, message);
             break;
     }
 }
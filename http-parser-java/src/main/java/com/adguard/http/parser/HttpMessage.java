@@ -29,6 +29,20 @@ public class HttpMessage implements Closeable {
 		addHeader(nativePtr, key, value);
 	}
 
+	private static native void appendHeader(long nativePtr, String key, String value);
+
+	/**
+	 * Appends header field, even if message already has field with this name (e.g. Set-Cookie)
+	 * @param key Field name
+	 * @param value Field value
+	 */
+	public void appendHeader(String key, String value) {
+		if (key == null || value == null) {
+			throw new NullPointerException();
+		}
+		appendHeader(nativePtr, key, value);
+	}
+
 	private static native long[] getHeaders(long nativePtr);
 
 	private HttpHeaderField[] getHeaders() {
@@ -40,14 +54,57 @@ public class HttpMessage implements Closeable {
 		return headerFields;
 	}
 
+	private static native String getHeader(long nativePtr, String name);
+
+	/**
+	 * Gets value of header field, name is case-insensitive.
+	 * If there are several fields with this name, value of the first one is returned
+	 * @param name Field name
+	 * @return Field value or null if there is no such field
+	 */
 	public String getHeader(String name) {
-		// TODO: do that in native code
-		for (HttpHeaderField field : getHeaders()) {
-			if (field.getKey().toLowerCase().equals(name.toLowerCase())) {
-				return field.getValue();
-			}
+		if (name == null) {
+			throw new NullPointerException();
+		}
+		return getHeader(nativePtr, name);
+	}
+
+	private static native String[] getHeaderValues(long nativePtr, String[] names);
+
+	/**
+	 * Gets values of several header fields by one native call, names are case-insensitive
+	 * @param names Field names
+	 * @return Field values in order of names, null for missing fields
+	 */
+	public String[] getHeaders(String... names) {
+		if (names == null) {
+			throw new NullPointerException();
+		}
+		return getHeaderValues(nativePtr, names);
+	}
+
+	private static native String[] getAllHeaderValues(long nativePtr, String name);
+
+	/**
+	 * Gets values of all header fields with given name, name is case-insensitive
+	 * @param name Field name
+	 * @return Field values in order of fields in message, empty array if there is no such field
+	 */
+	public String[] getHeaderValues(String name) {
+		if (name == null) {
+			throw new NullPointerException();
 		}
-		return null;
+		return getAllHeaderValues(nativePtr, name);
+	}
+
+	private static native byte[] getSnapshot(long nativePtr);
+
+	/**
+	 * Gets copy of start line and all header fields by one native call.
+	 * Snapshot isn't updated by further changes of message
+	 */
+	public HttpMessageSnapshot getSnapshot() {
+		return new HttpMessageSnapshot(getSnapshot(nativePtr));
 	}
 
 	private static native void removeHeader(long nativePtr, String name);
@@ -103,6 +160,11 @@ public class HttpMessage implements Closeable {
 
 	private static native void getBytes(long nativePtr, byte[] destination);
 
+	/**
+	 * Serializes message into the beginning of given array
+	 * @param destination Array of at least {@link #sizeBytes()} bytes
+	 * @throws IllegalArgumentException if array is too small
+	 */
 	public void getBytes(byte[] destination) {
 		getBytes(nativePtr, destination);
 	}
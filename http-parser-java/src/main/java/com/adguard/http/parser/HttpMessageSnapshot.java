@@ -0,0 +1,137 @@
+package com.adguard.http.parser;
+
+import java.nio.charset.Charset;
+import java.nio.charset.StandardCharsets;
+
+/**
+ * Read-only copy of HTTP message start line and header fields, obtained by one native call.
+ * Serialized data is decoded lazily: string offsets are indexed on first access,
+ * strings are created only when requested.
+ */
+public class HttpMessageSnapshot {
+
+	private static final Charset CHARSET = StandardCharsets.UTF_8;
+
+	// Indexes of strings
+	private static final int METHOD = 0;
+	private static final int URL = 1;
+	private static final int STATUS = 2;
+	private static final int FIELDS = 3;
+
+	private final byte[] data;
+	// Offset of every string (its data, after length) and its length (-1 for null), filled on first access
+	private int[] offsets;
+	private int[] lengths;
+	private String[] strings;
+
+	HttpMessageSnapshot(byte[] data) {
+		this.data = data;
+	}
+
+	private int getInt(int offset) {
+		return ((data[offset] & 0xff) << 24) | ((data[offset + 1] & 0xff) << 16)
+				| ((data[offset + 2] & 0xff) << 8) | (data[offset + 3] & 0xff);
+	}
+
+	private int skipString(int position) {
+		return position + 4 + Math.max(getInt(position), 0);
+	}
+
+	private void index() {
+		if (offsets != null) {
+			return;
+		}
+		int position = 4;
+		for (int i = 0; i < FIELDS; i++) {
+			position = skipString(position);
+		}
+		int count = FIELDS + getInt(position) * 2;
+
+		offsets = new int[count];
+		lengths = new int[count];
+		position = 4;
+		for (int i = 0; i < count; i++) {
+			if (i == FIELDS) {
+				// Skip field count
+				position += 4;
+			}
+			lengths[i] = getInt(position);
+			offsets[i] = position + 4;
+			position = offsets[i] + Math.max(lengths[i], 0);
+		}
+		strings = new String[count];
+	}
+
+	private String getString(int index) {
+		index();
+		String str = strings[index];
+		if (str == null && lengths[index] >= 0) {
+			str = new String(data, offsets[index], lengths[index], CHARSET);
+			strings[index] = str;
+		}
+		return str;
+	}
+
+	/**
+	 * Compares string with ASCII name ignoring case, without creating string
+	 */
+	private boolean equalsIgnoreCase(int index, String name) {
+		int length = lengths[index];
+		if (length != name.length()) {
+			return false;
+		}
+		int offset = offsets[index];
+		for (int i = 0; i < length; i++) {
+			char c = (char) (data[offset + i] & 0xff);
+			char n = name.charAt(i);
+			if (c != n && Character.toLowerCase(c) != Character.toLowerCase(n)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	public int getStatusCode() {
+		return getInt(0);
+	}
+
+	public String getMethod() {
+		return getString(METHOD);
+	}
+
+	public String getUrl() {
+		return getString(URL);
+	}
+
+	public String getStatus() {
+		return getString(STATUS);
+	}
+
+	public int getFieldCount() {
+		index();
+		return (offsets.length - FIELDS) / 2;
+	}
+
+	public String getKey(int i) {
+		return getString(FIELDS + i * 2);
+	}
+
+	public String getValue(int i) {
+		return getString(FIELDS + i * 2 + 1);
+	}
+
+	/**
+	 * Finds value of first header field with given name
+	 * @param name Field name, case-insensitive
+	 * @return Field value or null if there is no such field
+	 */
+	public String getHeader(String name) {
+		int fieldCount = getFieldCount();
+		for (int i = 0; i < fieldCount; i++) {
+			if (equalsIgnoreCase(FIELDS + i * 2, name)) {
+				return getValue(i);
+			}
+		}
+		return null;
+	}
+}
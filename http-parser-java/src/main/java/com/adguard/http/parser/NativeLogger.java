@@ -89,6 +89,15 @@ public class NativeLogger implements Closeable {
 		private void log(int logLevel, String threadInfo, String message) {
 			callback.log(LogLevel.getByCode(logLevel), threadInfo, message);
 		}
+
+		/**
+		 * Called by native logger flush thread with batch of records
+		 */
+		private void logBatch(int[] logLevels, String[] threadInfos, String[] messages) {
+			for (int i = 0; i < logLevels.length; i++) {
+				log(logLevels[i], threadInfos[i], messages[i]);
+			}
+		}
 	}
 
 	public interface Callback {
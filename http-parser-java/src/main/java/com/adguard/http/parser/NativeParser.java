@@ -1,6 +1,8 @@
 package com.adguard.http.parser;
 
 import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
 
 /**
  * Created by s.fionov on 08.11.16.
@@ -26,18 +28,112 @@ public class NativeParser implements Parser {
 		return new NativeConnection(connect(parserCtxPtr, id, new Callbacks(callbacks)));
 	}
 
+	public static native void enableEvents0(long connectionNativePtr, int capacity, boolean decodeBody) throws IOException;
+
+	/**
+	 * Creates connection in batched mode. Native code records parser events into event ring in direct memory
+	 * instead of calling Java methods, and they are dispatched to callbacks after input(), resume(), disconnect()
+	 * and close() return, so there is one JNI call per input instead of one per event.
+	 * Message received events are dispatched immediately together with events recorded before them,
+	 * so message received callback is called before body of message is parsed, like in
+	 * {@link #connect(long, ParserCallbacks)}.
+	 * <p>
+	 * Differences from {@link #connect(long, ParserCallbacks)}:
+	 * <ul>
+	 * <li>body started callback result is ignored, body is decoded according to {@code decodeBody};</li>
+	 * <li>{@link #pause(Connection)} called from body callbacks takes effect for the next input only.</li>
+	 * </ul>
+	 * @param id Connection id
+	 * @param callbacks Callbacks
+	 * @param eventRingCapacity Event ring capacity in bytes. If ring becomes full, events are dispatched
+	 *                          by single call from native code
+	 * @param decodeBody Decode bodies of messages
+	 */
+	public NativeConnection connect(long id, ParserCallbacks callbacks, int eventRingCapacity, boolean decodeBody) throws IOException {
+		Callbacks events = new Callbacks(callbacks);
+		NativeConnection connection = new NativeConnection(connect(parserCtxPtr, id, events), events);
+		enableEvents0(connection.nativePtr, eventRingCapacity, decodeBody);
+		return connection;
+	}
+
+	/**
+	 * Dispatches events recorded by native code, if connection is in batched mode
+	 */
+	private static void dispatchEvents(Connection connection) {
+		Callbacks events = ((NativeConnection) connection).events;
+		if (events != null) {
+			events.drainEvents();
+		}
+	}
+
 	public native static synchronized void disconnect0(long connectionNativePtr, int direction) throws IOException;
 
 	@Override
 	public void disconnect(Connection connection, Direction direction) throws IOException {
-		disconnect0(((NativeConnection) connection).nativePtr, direction.getCode());
+		try {
+			disconnect0(((NativeConnection) connection).nativePtr, direction.getCode());
+		} finally {
+			dispatchEvents(connection);
+		}
+	}
+
+	public static native int input0(long connectionNativePtr, int direction, byte[] data) throws IOException;
+
+	@Override
+	public int input(Connection connection, Direction direction, byte[] data) throws IOException {
+		try {
+			return input0(((NativeConnection) connection).nativePtr, direction.getCode(), data);
+		} finally {
+			dispatchEvents(connection);
+		}
+	}
+
+	public static native int input0(long connectionNativePtr, int direction, byte[] data, int offset, int length) throws IOException;
+
+	@Override
+	public int input(Connection connection, Direction direction, byte[] data, int offset, int length) throws IOException {
+		try {
+			return input0(((NativeConnection) connection).nativePtr, direction.getCode(), data, offset, length);
+		} finally {
+			dispatchEvents(connection);
+		}
+	}
+
+	public static native int input0(long connectionNativePtr, int direction, ByteBuffer buffer, int position, int limit) throws IOException;
+
+	@Override
+	public int input(Connection connection, Direction direction, ByteBuffer buffer) throws IOException {
+		long nativePtr = ((NativeConnection) connection).nativePtr;
+		int consumed;
+		try {
+			if (buffer.isDirect()) {
+				consumed = input0(nativePtr, direction.getCode(), buffer, buffer.position(), buffer.limit());
+			} else {
+				consumed = input0(nativePtr, direction.getCode(), buffer.array(), buffer.arrayOffset() + buffer.position(), buffer.remaining());
+			}
+		} finally {
+			dispatchEvents(connection);
+		}
+		buffer.position(buffer.position() + consumed);
+		return consumed;
+	}
+
+	public static native void pause0(long connectionNativePtr) throws IOException;
+
+	@Override
+	public void pause(Connection connection) throws IOException {
+		pause0(((NativeConnection) connection).nativePtr);
 	}
 
-	public static native void input0(long connectionNativePtr, int direction, byte[] data) throws IOException;
+	public static native boolean resume0(long connectionNativePtr) throws IOException;
 
 	@Override
-	public void input(Connection connection, Direction direction, byte[] data) throws IOException {
-		input0(((NativeConnection) connection).nativePtr, direction.getCode(), data);
+	public boolean resume(Connection connection) throws IOException {
+		try {
+			return resume0(((NativeConnection) connection).nativePtr);
+		} finally {
+			dispatchEvents(connection);
+		}
 	}
 
 	public static native void closeConnection(long connectionNativePtr) throws IOException;
@@ -57,10 +153,130 @@ public class NativeParser implements Parser {
 	}
 
 	private static class Callbacks {
+		// Event types and ring layout, see callbacks.cpp
+		static final int EVENT_REQUEST_RECEIVED = 1;
+		static final int EVENT_REQUEST_BODY_STARTED = 2;
+		static final int EVENT_REQUEST_BODY_DATA = 3;
+		static final int EVENT_REQUEST_BODY_FINISHED = 4;
+		static final int EVENT_RESPONSE_RECEIVED = 5;
+		static final int EVENT_RESPONSE_BODY_STARTED = 6;
+		static final int EVENT_RESPONSE_BODY_DATA = 7;
+		static final int EVENT_RESPONSE_BODY_FINISHED = 8;
+		static final int EVENTS_START = 8;
+		static final int EVENT_HEADER_SIZE = 24;
+
 		private final ParserCallbacks callbacks;
+		private final ParserBufferCallbacks bufferCallbacks;
+		// Per-connection buffer with body data, set by native code
+		private ByteBuffer bodyBuffer;
+		// Event ring and read-only view of it for passing body data to callbacks, set by native code
+		private ByteBuffer eventBuffer;
+		private ByteBuffer eventView;
 
 		private Callbacks(ParserCallbacks callbacks) {
 			this.callbacks = callbacks;
+			this.bufferCallbacks = callbacks instanceof ParserBufferCallbacks ? (ParserBufferCallbacks) callbacks : null;
+		}
+
+		void setBodyBuffer(ByteBuffer buffer) {
+			bodyBuffer = buffer == null ? null : buffer.asReadOnlyBuffer();
+		}
+
+		void setEventBuffer(ByteBuffer buffer) {
+			if (buffer == null) {
+				eventBuffer = null;
+				eventView = null;
+			} else {
+				eventBuffer = buffer.order(ByteOrder.nativeOrder());
+				eventView = buffer.asReadOnlyBuffer();
+			}
+		}
+
+		/**
+		 * Dispatches all events recorded in event ring and empties it
+		 * @return Result of last message received callback, or 0
+		 */
+		int drainEvents() {
+			ByteBuffer events = eventBuffer;
+			if (events == null) {
+				return 0;
+			}
+			int result = 0;
+			int end = EVENTS_START + events.getInt(0);
+			int position = EVENTS_START;
+			while (position < end) {
+				int type = events.getInt(position);
+				int length = events.getInt(position + 4);
+				long id = events.getLong(position + 8);
+				long handle = events.getLong(position + 16);
+				int dataPosition = position + EVENT_HEADER_SIZE;
+				switch (type) {
+					case EVENT_REQUEST_RECEIVED:
+						result = onHttpRequestReceived(id, handle);
+						break;
+					case EVENT_REQUEST_BODY_STARTED:
+						onHttpRequestBodyStarted(id);
+						break;
+					case EVENT_REQUEST_BODY_DATA:
+						if (bufferCallbacks != null) {
+							bufferCallbacks.onHttpRequestBodyData(id, getEventData(dataPosition, length));
+						} else {
+							callbacks.onHttpRequestBodyData(id, getEventBytes(dataPosition, length));
+						}
+						break;
+					case EVENT_REQUEST_BODY_FINISHED:
+						onHttpRequestBodyFinished(id);
+						break;
+					case EVENT_RESPONSE_RECEIVED:
+						result = onHttpResponseReceived(id, handle);
+						break;
+					case EVENT_RESPONSE_BODY_STARTED:
+						onHttpResponseBodyStarted(id);
+						break;
+					case EVENT_RESPONSE_BODY_DATA:
+						if (bufferCallbacks != null) {
+							bufferCallbacks.onHttpResponseBodyData(id, getEventData(dataPosition, length));
+						} else {
+							callbacks.onHttpResponseBodyData(id, getEventBytes(dataPosition, length));
+						}
+						break;
+					case EVENT_RESPONSE_BODY_FINISHED:
+						onHttpResponseBodyFinished(id);
+						break;
+					default:
+						throw new IllegalStateException("Unknown event type " + type);
+				}
+				// Records are aligned to 8 bytes
+				position = (dataPosition + length + 7) & ~7;
+			}
+			events.putInt(0, 0);
+			return result;
+		}
+
+		private ByteBuffer getEventData(int position, int length) {
+			eventView.clear();
+			eventView.position(position);
+			eventView.limit(position + length);
+			return eventView;
+		}
+
+		private byte[] getEventBytes(int position, int length) {
+			byte[] data = new byte[length];
+			getEventData(position, length).get(data);
+			return data;
+		}
+
+		private byte[] getBodyData(int length) {
+			byte[] data = new byte[length];
+			bodyBuffer.clear();
+			bodyBuffer.get(data);
+			return data;
+		}
+
+		private ByteBuffer getBodyBuffer(int length) {
+			bodyBuffer.clear();
+			bodyBuffer.limit(length);
+			return bodyBuffer;
 		}
 
 		int onHttpRequestReceived(long id, long nativePtr) {
@@ -72,9 +288,12 @@ public class NativeParser implements Parser {
 			return callbacks.onHttpRequestBodyStarted(id);
 		}
 
-		// TODO: pass pointer to be able to provide byte array from the byte array pool
-		void onHttpRequestBodyData(long id, byte[] data) {
-			callbacks.onHttpRequestBodyData(id, data);
+		void onHttpRequestBodyData(long id, int length) {
+			if (bufferCallbacks != null) {
+				bufferCallbacks.onHttpRequestBodyData(id, getBodyBuffer(length));
+			} else {
+				callbacks.onHttpRequestBodyData(id, getBodyData(length));
+			}
 		}
 
 		void onHttpRequestBodyFinished(long id) {
@@ -90,9 +309,12 @@ public class NativeParser implements Parser {
 			return callbacks.onHttpResponseBodyStarted(id);
 		}
 
-		// TODO: pass pointer to be able to provide byte array from the byte array pool
-		void onHttpResponseBodyData(long id, byte[] data) {
-			callbacks.onHttpResponseBodyData(id, data);
+		void onHttpResponseBodyData(long id, int length) {
+			if (bufferCallbacks != null) {
+				bufferCallbacks.onHttpResponseBodyData(id, getBodyBuffer(length));
+			} else {
+				callbacks.onHttpResponseBodyData(id, getBodyData(length));
+			}
 		}
 
 		void onHttpResponseBodyFinished(long id) {
@@ -105,9 +327,16 @@ public class NativeParser implements Parser {
 	 */
 	public static class NativeConnection implements Parser.Connection {
 		private long nativePtr;
+		// Callbacks dispatching recorded events, if connection is in batched mode
+		private final Callbacks events;
 
 		public NativeConnection(long nativePtr) {
+			this(nativePtr, null);
+		}
+
+		private NativeConnection(long nativePtr, Callbacks events) {
 			this.nativePtr = nativePtr;
+			this.events = events;
 		}
 
 		@Override
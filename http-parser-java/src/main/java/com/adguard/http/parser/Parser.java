@@ -13,7 +13,38 @@ public interface Parser extends Closeable {
 
 	void disconnect(Connection connection, Direction direction) throws IOException;
 
-	void input(Connection connection, Direction direction, byte[] data) throws IOException;
+	/**
+	 * Processes input data
+	 * @return Number of consumed bytes. If connection was paused by callback, it is less than data length,
+	 * and the rest of data should be passed again after {@link #resume(Connection)}
+	 */
+	int input(Connection connection, Direction direction, byte[] data) throws IOException;
+
+	/**
+	 * Processes input data from the region of byte array
+	 * @return Number of consumed bytes
+	 * @see #input(Connection, Direction, byte[])
+	 */
+	int input(Connection connection, Direction direction, byte[] data, int offset, int length) throws IOException;
+
+	/**
+	 * Processes input data between position and limit of buffer. Direct buffers are passed to parser without copying.
+	 * Buffer position is advanced by the number of consumed bytes
+	 * @return Number of consumed bytes
+	 * @see #input(Connection, Direction, byte[])
+	 */
+	int input(Connection connection, Direction direction, ByteBuffer buffer) throws IOException;
+
+	/**
+	 * Pauses input processing of connection. May be called from body data callbacks
+	 */
+	void pause(Connection connection) throws IOException;
+
+	/**
+	 * Resumes input processing of paused connection
+	 * @return False if connection was paused again while passing held body data
+	 */
+	boolean resume(Connection connection) throws IOException;
 
 	void close(Connection connection) throws IOException;
 
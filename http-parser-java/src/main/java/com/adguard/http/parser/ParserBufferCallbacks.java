@@ -0,0 +1,31 @@
+package com.adguard.http.parser;
+
+import java.nio.ByteBuffer;
+
+/**
+ * Parser callbacks receiving body data in a reusable per-connection direct buffer instead of a new byte array.
+ * <p>
+ * Buffer lifetime rules:
+ * <ul>
+ * <li>buffer content is valid only until the callback returns, it is overwritten by the next body data chunk;</li>
+ * <li>buffer must not be retained or passed to other threads: copy data if it's needed later;</li>
+ * <li>buffer memory is freed when connection is closed.</li>
+ * </ul>
+ * Methods receiving byte arrays are not called for implementations of this interface.
+ */
+public interface ParserBufferCallbacks extends ParserCallbacks {
+
+	/**
+	 * Called for every chunk of request body data
+	 * @param id Connection id
+	 * @param data Read-only buffer with data between position and limit
+	 */
+	void onHttpRequestBodyData(long id, ByteBuffer data);
+
+	/**
+	 * Called for every chunk of response body data
+	 * @param id Connection id
+	 * @param data Read-only buffer with data between position and limit
+	 */
+	void onHttpResponseBodyData(long id, ByteBuffer data);
+}
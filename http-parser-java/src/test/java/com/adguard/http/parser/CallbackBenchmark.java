@@ -0,0 +1,220 @@
+package com.adguard.http.parser;
+
+import org.openjdk.jmh.annotations.Benchmark;
+import org.openjdk.jmh.annotations.BenchmarkMode;
+import org.openjdk.jmh.annotations.Fork;
+import org.openjdk.jmh.annotations.Measurement;
+import org.openjdk.jmh.annotations.Mode;
+import org.openjdk.jmh.annotations.OutputTimeUnit;
+import org.openjdk.jmh.annotations.Scope;
+import org.openjdk.jmh.annotations.Setup;
+import org.openjdk.jmh.annotations.State;
+import org.openjdk.jmh.annotations.TearDown;
+import org.openjdk.jmh.annotations.Warmup;
+import org.openjdk.jmh.runner.Runner;
+import org.openjdk.jmh.runner.RunnerException;
+import org.openjdk.jmh.runner.options.Options;
+import org.openjdk.jmh.runner.options.OptionsBuilder;
+
+import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.nio.charset.StandardCharsets;
+import java.util.concurrent.TimeUnit;
+
+/**
+ * Measures cost of native-to-Java callbacks: one chunked request with many small chunks
+ * results in one body data upcall per chunk.
+ * Run with: mvn test-compile exec:java -Dexec.classpathScope=test -Dexec.mainClass=com.adguard.http.parser.CallbackBenchmark
+ */
+@State(Scope.Thread)
+@BenchmarkMode(Mode.AverageTime)
+@OutputTimeUnit(TimeUnit.NANOSECONDS)
+@Warmup(iterations = 5, time = 1)
+@Measurement(iterations = 10, time = 1)
+@Fork(1)
+public class CallbackBenchmark {
+
+	static {
+		System.loadLibrary("httpparser-jni");
+	}
+
+	private static final int CHUNK_COUNT = 100;
+
+	private NativeLogger logger;
+	private NativeParser parser;
+	private Parser.Connection connection;
+	private Parser.Connection bufferConnection;
+	private Parser.Connection batchedConnection;
+	private byte[] request;
+	private long bodyBytes;
+
+	@Setup
+	public void setUp() throws IOException {
+		StringBuilder sb = new StringBuilder("POST /upload HTTP/1.1\r\n" +
+				"Host: example.org\r\n" +
+				"Transfer-Encoding: chunked\r\n" +
+				"\r\n");
+		for (int i = 0; i < CHUNK_COUNT; i++) {
+			sb.append("10\r\n0123456789abcdef\r\n");
+		}
+		sb.append("0\r\n\r\n");
+		request = sb.toString().getBytes(StandardCharsets.US_ASCII);
+
+		logger = NativeLogger.open(NativeLogger.LogLevel.ERROR);
+		parser = new NativeParser(logger);
+		connection = parser.connect(1, new ParserCallbacks() {
+			@Override
+			public void onHttpRequestReceived(long id, HttpMessage message) {
+			}
+
+			@Override
+			public boolean onHttpRequestBodyStarted(long id) {
+				return false;
+			}
+
+			@Override
+			public void onHttpRequestBodyData(long id, byte[] data) {
+				bodyBytes += data.length;
+			}
+
+			@Override
+			public void onHttpRequestBodyFinished(long id) {
+			}
+
+			@Override
+			public void onHttpResponseReceived(long id, HttpMessage message) {
+			}
+
+			@Override
+			public boolean onHttpResponseBodyStarted(long id) {
+				return false;
+			}
+
+			@Override
+			public void onHttpResponseBodyData(long id, byte[] data) {
+			}
+
+			@Override
+			public void onHttpResponseBodyFinished(long id) {
+			}
+		});
+		bufferConnection = parser.connect(2, new BufferCallbacks());
+		batchedConnection = parser.connect(3, new BufferCallbacks(), 64 * 1024, false);
+	}
+
+	private class BufferCallbacks implements ParserBufferCallbacks {
+		@Override
+		public void onHttpRequestReceived(long id, HttpMessage message) {
+		}
+
+		@Override
+		public boolean onHttpRequestBodyStarted(long id) {
+			return false;
+		}
+
+		@Override
+		public void onHttpRequestBodyData(long id, byte[] data) {
+		}
+
+		@Override
+		public void onHttpRequestBodyData(long id, ByteBuffer data) {
+			bodyBytes += data.remaining();
+		}
+
+		@Override
+		public void onHttpRequestBodyFinished(long id) {
+		}
+
+		@Override
+		public void onHttpResponseReceived(long id, HttpMessage message) {
+		}
+
+		@Override
+		public boolean onHttpResponseBodyStarted(long id) {
+			return false;
+		}
+
+		@Override
+		public void onHttpResponseBodyData(long id, byte[] data) {
+		}
+
+		@Override
+		public void onHttpResponseBodyData(long id, ByteBuffer data) {
+		}
+
+		@Override
+		public void onHttpResponseBodyFinished(long id) {
+		}
+	}
+
+	@TearDown
+	public void tearDown() throws IOException {
+		parser.close(batchedConnection);
+		parser.close(bufferConnection);
+		parser.close(connection);
+		parser.close();
+		logger.close();
+	}
+
+	/**
+	 * One request, {@link #CHUNK_COUNT} body data callbacks
+	 */
+	@Benchmark
+	public long requestWithChunkedBody() throws IOException {
+		parser.input(connection, Direction.OUT, request);
+		return bodyBytes;
+	}
+
+	/**
+	 * Same as {@link #requestWithChunkedBody()}, body data is delivered through per-connection direct buffer
+	 */
+	@Benchmark
+	public long requestWithChunkedBodyBuffer() throws IOException {
+		parser.input(bufferConnection, Direction.OUT, request);
+		return bodyBytes;
+	}
+
+	/**
+	 * Same as {@link #requestWithChunkedBodyBuffer()}, events are recorded into event ring
+	 * and dispatched after input returns
+	 */
+	@Benchmark
+	public long requestWithChunkedBodyBatched() throws IOException {
+		parser.input(batchedConnection, Direction.OUT, request);
+		return bodyBytes;
+	}
+
+	/**
+	 * Logger callback, called for every log line of native code
+	 */
+	@Benchmark
+	public void loggerCallback(LoggerState state) {
+		state.logger.log(NativeLogger.LogLevel.INFO, "message");
+	}
+
+	@State(Scope.Thread)
+	public static class LoggerState {
+		NativeLogger logger;
+
+		@Setup
+		public void setUp() {
+			logger = NativeLogger.open(NativeLogger.LogLevel.INFO, new NativeLogger.Callback() {
+				@Override
+				public void log(NativeLogger.LogLevel logLevel, String threadInfo, String message) {
+				}
+			});
+		}
+
+		@TearDown
+		public void tearDown() {
+			logger.close();
+		}
+	}
+
+	public static void main(String[] args) throws RunnerException {
+		Options options = new OptionsBuilder()
+				.include(CallbackBenchmark.class.getSimpleName())
+				.build();
+		new Runner(options).run();
+	}
+}
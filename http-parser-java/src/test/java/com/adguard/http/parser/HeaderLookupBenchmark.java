@@ -0,0 +1,110 @@
+package com.adguard.http.parser;
+
+import org.openjdk.jmh.annotations.Benchmark;
+import org.openjdk.jmh.annotations.BenchmarkMode;
+import org.openjdk.jmh.annotations.Fork;
+import org.openjdk.jmh.annotations.Measurement;
+import org.openjdk.jmh.annotations.Mode;
+import org.openjdk.jmh.annotations.OutputTimeUnit;
+import org.openjdk.jmh.annotations.Scope;
+import org.openjdk.jmh.annotations.Setup;
+import org.openjdk.jmh.annotations.State;
+import org.openjdk.jmh.annotations.TearDown;
+import org.openjdk.jmh.annotations.Warmup;
+import org.openjdk.jmh.runner.Runner;
+import org.openjdk.jmh.runner.RunnerException;
+import org.openjdk.jmh.runner.options.Options;
+import org.openjdk.jmh.runner.options.OptionsBuilder;
+
+import java.util.concurrent.TimeUnit;
+
+/**
+ * Measures header field lookup on message with {@link #FIELD_COUNT} fields:
+ * snapshot-based lookup (previous implementation of {@link HttpMessage#getHeader(String)})
+ * compared to native indexed lookup, one by one and in bulk.
+ * Run with: mvn test-compile exec:java -Dexec.classpathScope=test -Dexec.mainClass=com.adguard.http.parser.HeaderLookupBenchmark
+ */
+@State(Scope.Thread)
+@BenchmarkMode(Mode.AverageTime)
+@OutputTimeUnit(TimeUnit.NANOSECONDS)
+@Warmup(iterations = 5, time = 1)
+@Measurement(iterations = 10, time = 1)
+@Fork(1)
+public class HeaderLookupBenchmark {
+
+	static {
+		System.loadLibrary("httpparser-jni");
+	}
+
+	private static final int FIELD_COUNT = 30;
+
+	// Typical lookups of filtering code, in different case than in message
+	private static final String[] NAMES = {"content-type", "CONTENT-ENCODING", "x-field-25", "Cookie"};
+
+	private HttpMessage message;
+
+	@Setup
+	public void setUp() {
+		message = HttpMessage.create();
+		message.addHeader("Content-Type", "text/html");
+		message.addHeader("Content-Encoding", "gzip");
+		message.addHeader("Cookie", "a=b");
+		for (int i = message.getSnapshot().getFieldCount(); i < FIELD_COUNT; i++) {
+			message.addHeader("X-Field-" + i, Integer.toString(i));
+		}
+	}
+
+	@TearDown
+	public void tearDown() {
+		message.close();
+	}
+
+	/**
+	 * Lookup of each name in snapshot of message
+	 */
+	@Benchmark
+	public int snapshotLookup() {
+		int found = 0;
+		for (String name : NAMES) {
+			if (message.getSnapshot().getHeader(name) != null) {
+				found++;
+			}
+		}
+		return found;
+	}
+
+	/**
+	 * One native call per name
+	 */
+	@Benchmark
+	public int nativeLookup() {
+		int found = 0;
+		for (String name : NAMES) {
+			if (message.getHeader(name) != null) {
+				found++;
+			}
+		}
+		return found;
+	}
+
+	/**
+	 * One native call for all names
+	 */
+	@Benchmark
+	public int nativeBulkLookup() {
+		int found = 0;
+		for (String value : message.getHeaders(NAMES)) {
+			if (value != null) {
+				found++;
+			}
+		}
+		return found;
+	}
+
+	public static void main(String[] args) throws RunnerException {
+		Options options = new OptionsBuilder()
+				.include(HeaderLookupBenchmark.class.getSimpleName())
+				.build();
+		new Runner(options).run();
+	}
+}
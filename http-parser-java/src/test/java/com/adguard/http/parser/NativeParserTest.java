@@ -0,0 +1,121 @@
+package com.adguard.http.parser;
+
+import org.junit.After;
+import org.junit.Before;
+import org.junit.Test;
+
+import java.io.IOException;
+import java.nio.charset.StandardCharsets;
+import java.util.ArrayList;
+import java.util.List;
+
+import static org.junit.Assert.assertEquals;
+import static org.junit.Assert.assertTrue;
+
+/**
+ * Checks that message received callback is called before body is parsed, in both direct and batched modes
+ */
+public class NativeParserTest {
+
+	private static final String BODY = "0123456789abcdef";
+	private static final byte[] REQUEST = ("POST /upload HTTP/1.1\r\n" +
+			"Host: example.org\r\n" +
+			"Content-Length: " + BODY.length() + "\r\n" +
+			"\r\n" + BODY).getBytes(StandardCharsets.US_ASCII);
+
+	private NativeLogger logger;
+	private NativeParser parser;
+
+	@Before
+	public void setUp() {
+		logger = NativeLogger.open(NativeLogger.LogLevel.ERROR);
+		parser = new NativeParser(logger);
+	}
+
+	@After
+	public void tearDown() throws IOException {
+		parser.close();
+		logger.close();
+	}
+
+	/**
+	 * Records callbacks and pauses connection when request is received
+	 */
+	private class PausingCallbacks implements ParserCallbacks {
+		final List<String> events = new ArrayList<>();
+		Parser.Connection connection;
+
+		@Override
+		public void onHttpRequestReceived(long id, HttpMessage message) {
+			events.add("received");
+			try {
+				parser.pause(connection);
+			} catch (IOException e) {
+				throw new IllegalStateException(e);
+			}
+		}
+
+		@Override
+		public boolean onHttpRequestBodyStarted(long id) {
+			events.add("started");
+			return false;
+		}
+
+		@Override
+		public void onHttpRequestBodyData(long id, byte[] data) {
+			events.add(new String(data, StandardCharsets.US_ASCII));
+		}
+
+		@Override
+		public void onHttpRequestBodyFinished(long id) {
+			events.add("finished");
+		}
+
+		@Override
+		public void onHttpResponseReceived(long id, HttpMessage message) {
+		}
+
+		@Override
+		public boolean onHttpResponseBodyStarted(long id) {
+			return false;
+		}
+
+		@Override
+		public void onHttpResponseBodyData(long id, byte[] data) {
+		}
+
+		@Override
+		public void onHttpResponseBodyFinished(long id) {
+		}
+	}
+
+	private void checkPauseOnRequestReceived(boolean batched) throws IOException {
+		PausingCallbacks callbacks = new PausingCallbacks();
+		callbacks.connection = batched ? parser.connect(1, callbacks, 1024, false) : parser.connect(1, callbacks);
+		try {
+			int consumed = parser.input(callbacks.connection, Direction.OUT, REQUEST);
+			assertTrue(consumed < REQUEST.length);
+			assertEquals(1, callbacks.events.size());
+			assertEquals("received", callbacks.events.get(0));
+
+			assertTrue(parser.resume(callbacks.connection));
+			consumed += parser.input(callbacks.connection, Direction.OUT, REQUEST, consumed, REQUEST.length - consumed);
+			assertEquals(REQUEST.length, consumed);
+			assertEquals("started", callbacks.events.get(1));
+			assertEquals(BODY, callbacks.events.get(2));
+			assertEquals("finished", callbacks.events.get(callbacks.events.size() - 1));
+		} finally {
+			parser.close(callbacks.connection);
+		}
+	}
+
+	@Test
+	public void testPauseOnRequestReceived() throws IOException {
+		checkPauseOnRequestReceived(false);
+	}
+
+	@Test
+	public void testPauseOnRequestReceivedBatched() throws IOException {
+		checkPauseOnRequestReceived(true);
+	}
+}
@@ -6,6 +6,6 @@ LOCAL_CFLAGS := -std=c99
 
 LOCAL_MODULE := httpparser-c
 
-LOCAL_SRC_FILES := src/parser.c src/logger.c src/nodejs_http_parser/http_parser.c
+LOCAL_SRC_FILES := src/parser.c src/logger.c src/engine.c src/engine_epoll.c src/engine_uring.c src/scheduler.c src/chunk_queue.c src/message_binary.c src/serialize_cache.c src/nodejs_http_parser/http_parser.c
 
 include $(BUILD_STATIC_LIBRARY)
@@ -0,0 +1,147 @@
+/*
+ *  Lock-free single-producer/single-consumer input chunk queue.
+ *  Ring buffer of chunk pointers. Producer only writes `tail', consumer only writes `head'.
+ *  Each side caches last seen index of the other side to avoid touching its cache line
+ *  on every operation.
+ */
+// posix_memalign() is not declared in strict C99 mode
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdlib.h>
+
+#include "chunk_queue.h"
+
+#define CACHE_LINE_SIZE 64
+
+struct chunk_queue {
+    input_chunk             **slots;
+    size_t                  mask;
+
+    // Consumer side
+    size_t                  head __attribute__((aligned(CACHE_LINE_SIZE)));
+    size_t                  cached_tail;
+    // Partially processed chunk of paused connection
+    input_chunk             *pending;
+
+    // Producer side
+    size_t                  tail __attribute__((aligned(CACHE_LINE_SIZE)));
+    size_t                  cached_head;
+};
+
+input_chunk *input_chunk_alloc(size_t capacity) {
+    input_chunk *chunk = malloc(sizeof(input_chunk) + capacity);
+    if (chunk == NULL) {
+        return NULL;
+    }
+    chunk->direction = DIRECTION_IN;
+    chunk->length = 0;
+    chunk->offset = 0;
+    chunk->capacity = capacity;
+    return chunk;
+}
+
+void input_chunk_free(input_chunk *chunk) {
+    free(chunk);
+}
+
+int chunk_queue_create(size_t capacity, chunk_queue **p_queue) {
+    if (p_queue == NULL) {
+        return PARSER_NULL_POINTER_ERROR;
+    }
+    if (capacity == 0) {
+        return PARSER_INVALID_ARGUMENT_ERROR;
+    }
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+
+    chunk_queue *queue;
+    if (posix_memalign((void **) &queue, CACHE_LINE_SIZE, sizeof(chunk_queue)) != 0) {
+        return PARSER_OUT_OF_MEMORY_ERROR;
+    }
+    queue->slots = calloc(size, sizeof(input_chunk *));
+    if (queue->slots == NULL) {
+        free(queue);
+        return PARSER_OUT_OF_MEMORY_ERROR;
+    }
+    queue->mask = size - 1;
+    queue->head = 0;
+    queue->cached_tail = 0;
+    queue->pending = NULL;
+    queue->tail = 0;
+    queue->cached_head = 0;
+
+    *p_queue = queue;
+    return 0;
+}
+
+void chunk_queue_destroy(chunk_queue *queue) {
+    input_chunk *chunk;
+    input_chunk_free(queue->pending);
+    while ((chunk = chunk_queue_pop(queue)) != NULL) {
+        input_chunk_free(chunk);
+    }
+    free(queue->slots);
+    free(queue);
+}
+
+int chunk_queue_push(chunk_queue *queue, input_chunk *chunk) {
+    size_t tail = queue->tail;
+    if (tail - queue->cached_head > queue->mask) {
+        queue->cached_head = __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE);
+        if (tail - queue->cached_head > queue->mask) {
+            return 1;
+        }
+    }
+    queue->slots[tail & queue->mask] = chunk;
+    // Publish slot contents together with new tail
+    __atomic_store_n(&queue->tail, tail + 1, __ATOMIC_RELEASE);
+    return 0;
+}
+
+input_chunk *chunk_queue_pop(chunk_queue *queue) {
+    size_t head = queue->head;
+    if (head == queue->cached_tail) {
+        queue->cached_tail = __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+        if (head == queue->cached_tail) {
+            return NULL;
+        }
+    }
+    input_chunk *chunk = queue->slots[head & queue->mask];
+    // Slot may be reused by producer after that
+    __atomic_store_n(&queue->head, head + 1, __ATOMIC_RELEASE);
+    return chunk;
+}
+
+int chunk_queue_drain(chunk_queue *queue, connection_context *context) {
+    int r = 0;
+    for (;;) {
+        input_chunk *chunk = queue->pending;
+        queue->pending = NULL;
+        if (chunk == NULL && (chunk = chunk_queue_pop(queue)) == NULL) {
+            break;
+        }
+
+        r = parser_input(context, chunk->direction, chunk->data + chunk->offset, chunk->length - chunk->offset);
+        if (r == PARSER_PAUSED) {
+            chunk->offset += connection_get_input_consumed(context);
+            if (chunk->offset < chunk->length) {
+                queue->pending = chunk;
+            } else {
+                input_chunk_free(chunk);
+            }
+            break;
+        }
+        input_chunk_free(chunk);
+        if (r != 0) {
+            break;
+        }
+    }
+    return r;
+}
+
+int chunk_queue_is_empty(chunk_queue *queue) {
+    return queue->pending == NULL &&
+           __atomic_load_n(&queue->head, __ATOMIC_ACQUIRE) == __atomic_load_n(&queue->tail, __ATOMIC_ACQUIRE);
+}
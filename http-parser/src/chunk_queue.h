@@ -0,0 +1,100 @@
+/*
+ *  Lock-free single-producer/single-consumer input chunk queue API.
+ *  Hands connection input over from I/O thread to parsing thread without locks and copying:
+ *  I/O thread reads socket data directly into a chunk and pushes it, parsing thread drains
+ *  the queue into parser_input().
+ */
+#ifndef HTTP_PARSER_CHUNK_QUEUE_H
+#define HTTP_PARSER_CHUNK_QUEUE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "parser.h"
+
+/**
+ * Input chunk. Chunk has exactly one owner: it is owned by the thread which allocated it,
+ * then by the queue after successful push, then by the thread which popped it.
+ */
+typedef struct {
+    // Transfer direction of data
+    transfer_direction_t    direction;
+    // Length of data
+    size_t                  length;
+    // Number of already processed bytes (used by chunk_queue_drain())
+    size_t                  offset;
+    // Size of data array
+    size_t                  capacity;
+    // Data, allocated in the same block with chunk
+    char                    data[];
+} input_chunk;
+
+typedef struct chunk_queue chunk_queue;
+
+/**
+ * Allocates input chunk
+ * @param capacity Data capacity
+ * @return Chunk with zero length. Should be freed by input_chunk_free() or passed to queue
+ */
+input_chunk *input_chunk_alloc(size_t capacity);
+
+/**
+ * Frees input chunk
+ * @param chunk Chunk
+ */
+void input_chunk_free(input_chunk *chunk);
+
+/**
+ * Creates queue
+ * @param capacity Maximum number of chunks in queue (rounded up to a power of two)
+ * @param p_queue Pointer to variable where queue will be stored
+ * @return 0 if success, PARSER_OUT_OF_MEMORY_ERROR if queue can't be allocated
+ */
+int chunk_queue_create(size_t capacity, chunk_queue **p_queue);
+
+/**
+ * Destroys queue and frees chunks remaining in it
+ * @param queue Queue
+ */
+void chunk_queue_destroy(chunk_queue *queue);
+
+/**
+ * Pushes chunk to queue. Should be called from producer thread only.
+ * On success, ownership of chunk is transferred to queue.
+ * @param queue Queue
+ * @param chunk Chunk
+ * @return 0 if success, non-zero value if queue is full (chunk is still owned by caller)
+ */
+int chunk_queue_push(chunk_queue *queue, input_chunk *chunk);
+
+/**
+ * Pops chunk from queue. Should be called from consumer thread only.
+ * @param queue Queue
+ * @return Chunk owned by caller, or NULL if queue is empty
+ */
+input_chunk *chunk_queue_pop(chunk_queue *queue);
+
+/**
+ * Passes all queued chunks to parser_input() and frees them. Should be called from consumer thread only.
+ * If connection is paused by callback, the rest of chunk is kept and is passed first
+ * on next call after parser_connection_resume().
+ * @param queue Queue
+ * @param context Connection context
+ * @return 0 if success, PARSER_PAUSED if connection is paused, or parser_input() error
+ */
+int chunk_queue_drain(chunk_queue *queue, connection_context *context);
+
+/**
+ * Checks if queue is empty. May be called from any thread, result is approximate
+ * when called from other than consumer thread.
+ * @param queue Queue
+ * @return Non-zero value if queue is empty
+ */
+int chunk_queue_is_empty(chunk_queue *queue);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HTTP_PARSER_CHUNK_QUEUE_H */
@@ -0,0 +1,342 @@
+/*
+ *  Native HTTP engine.
+ *  Socket loop which forwards data between client and server sockets
+ *  and feeds it to parser_input() without leaving native code.
+ *  Socket I/O is done by one of the backends (engine_epoll.c, engine_uring.c).
+ */
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include "engine_internal.h"
+
+/**
+ * Gets backend operations
+ * @param backend Backend
+ * @return Backend operations, or NULL if backend is not compiled in
+ */
+static const engine_backend_ops *backend_ops(engine_backend_t backend) {
+    switch (backend) {
+        case ENGINE_BACKEND_EPOLL:
+            return &engine_epoll_ops;
+#ifdef HAVE_IO_URING
+        case ENGINE_BACKEND_IO_URING:
+            return &engine_uring_ops;
+#endif
+        default:
+            return NULL;
+    }
+}
+
+/*
+ *  Internal interface for backends:
+ */
+
+/**
+ * Marks connection as paused, so that it is checked for resume after each engine iteration
+ */
+static void connection_set_paused(engine *eng, engine_connection *conn) {
+    if (!conn->paused) {
+        conn->paused = 1;
+        eng->paused_count++;
+    }
+}
+
+/**
+ * Passes held input of endpoint to parser, processed buffers are queued for writing to opposite socket
+ * @param ep Endpoint
+ * @return 0 if all input is processed, PARSER_PAUSED if parser is paused again, or parser_input() error
+ */
+static int endpoint_process_input(engine_endpoint *ep) {
+    engine_endpoint *peer = engine_endpoint_peer(ep);
+    engine_buffer *buf;
+    while ((buf = STAILQ_FIRST(&ep->in_queue)) != NULL) {
+        if (buf->offset < buf->length) {
+            int r = parser_input(ep->conn->context, ep->direction, buf->data + buf->offset, buf->length - buf->offset);
+            if (r == PARSER_PAUSED) {
+                // The rest of buffer is passed again after resume
+                buf->offset += connection_get_input_consumed(ep->conn->context);
+                return r;
+            }
+            if (r != 0) {
+                return r;
+            }
+        }
+        STAILQ_REMOVE_HEAD(&ep->in_queue, entry);
+        buf->offset = 0;
+        STAILQ_INSERT_TAIL(&peer->out_queue, buf, entry);
+        peer->out_count++;
+    }
+    return 0;
+}
+
+int engine_endpoint_input(engine *eng, engine_endpoint *ep, engine_buffer *buf) {
+    eng->stats.bytes_received += buf->length;
+    int held = !STAILQ_EMPTY(&ep->in_queue);
+    buf->offset = 0;
+    STAILQ_INSERT_TAIL(&ep->in_queue, buf, entry);
+    if (held) {
+        // Previous input is held by paused parser, keep data order
+        return 0;
+    }
+    int r = endpoint_process_input(ep);
+    if (r == PARSER_PAUSED) {
+        connection_set_paused(eng, ep->conn);
+        return 0;
+    }
+    return r;
+}
+
+int engine_endpoint_eof(engine *eng, engine_endpoint *ep) {
+    ENGINE_LOG(LOG_LEVEL_TRACE, "engine_endpoint_eof(fd=%d)", ep->fd);
+    ep->read_closed = 1;
+    if (ep->direction == DIRECTION_IN) {
+        // Let parser finish message which is terminated by EOF
+        int r = parser_input(ep->conn->context, DIRECTION_IN, NULL, 0);
+        if (r == PARSER_PAUSED) {
+            // Paused by callback of finished message, the next input is held until resume
+            connection_set_paused(eng, ep->conn);
+        } else if (r != 0) {
+            return r;
+        }
+        parser_disconnect(ep->conn->context, DIRECTION_IN);
+    }
+    // Client half-close is not reported to parser, since response is still expected
+    return 0;
+}
+
+void engine_close_connection(engine *eng, engine_connection *conn, error_type_t error) {
+    if (conn->closed) {
+        return;
+    }
+    ENGINE_LOG(LOG_LEVEL_TRACE, "engine_close_connection(id=%d, error=%d)",
+               (int) connection_get_id(conn->context), (int) error);
+    conn->closed = 1;
+    if (conn->paused) {
+        conn->paused = 0;
+        eng->paused_count--;
+    }
+    eng->ops->close_connection(eng, conn);
+
+    if (eng->callbacks != NULL && eng->callbacks->connection_closed != NULL) {
+        eng->callbacks->connection_closed(conn->context, error);
+    }
+    parser_connection_close(conn->context);
+    conn->context = NULL;
+
+    TAILQ_REMOVE(&eng->connections, conn, entry);
+    TAILQ_INSERT_TAIL(&eng->closed_connections, conn, entry);
+    eng->connection_count--;
+}
+
+void engine_free_closed_connections(engine *eng, int force) {
+    engine_connection *conn, *next;
+    for (conn = TAILQ_FIRST(&eng->closed_connections); conn != NULL; conn = next) {
+        next = TAILQ_NEXT(conn, entry);
+        if (conn->pending_ops == 0 || force) {
+            TAILQ_REMOVE(&eng->closed_connections, conn, entry);
+            eng->ops->release_connection(eng, conn);
+            free(conn);
+        }
+    }
+}
+
+/**
+ * Passes input held by paused parser again if connection was resumed by parser_connection_resume()
+ * @param eng Engine
+ * @param conn Connection
+ */
+static void connection_check_resumed(engine *eng, engine_connection *conn) {
+    if (connection_is_paused(conn->context)) {
+        return;
+    }
+    ENGINE_LOG(LOG_LEVEL_TRACE, "connection_check_resumed(id=%d)", (int) connection_get_id(conn->context));
+    conn->paused = 0;
+    eng->paused_count--;
+
+    // Request is processed first, as it was sent before response
+    int r = endpoint_process_input(&conn->client);
+    if (r == 0) {
+        r = endpoint_process_input(&conn->server);
+    }
+    if (r == PARSER_PAUSED) {
+        connection_set_paused(eng, conn);
+        r = 0;
+    }
+    if (r == 0) {
+        r = eng->ops->resume_connection(eng, conn);
+    }
+
+    if (r != 0) {
+        engine_close_connection(eng, conn, (error_type_t) r);
+    } else if (engine_connection_finished(conn)) {
+        engine_close_connection(eng, conn, PARSER_OK);
+    }
+}
+
+static void endpoint_init(engine_endpoint *ep, engine_connection *conn, int fd, transfer_direction_t direction) {
+    memset(ep, 0, sizeof(engine_endpoint));
+    ep->fd = fd;
+    ep->direction = direction;
+    ep->conn = conn;
+    STAILQ_INIT(&ep->out_queue);
+    STAILQ_INIT(&ep->in_queue);
+}
+
+/*
+ *  API implementation
+ */
+
+int engine_backend_supported(engine_backend_t backend) {
+    const engine_backend_ops *ops = backend_ops(backend);
+    if (ops == NULL) {
+        return 0;
+    }
+
+    // Probe backend by initializing it
+    engine probe;
+    memset(&probe, 0, sizeof(probe));
+    probe.stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    int supported = probe.stop_fd >= 0 && ops->init(&probe) == 0;
+    if (supported) {
+        ops->destroy(&probe);
+    }
+    if (probe.stop_fd >= 0) {
+        close(probe.stop_fd);
+    }
+    return supported;
+}
+
+int engine_create(logger *log, parser_context *parser_ctx, engine_backend_t backend,
+                  engine_callbacks *callbacks, engine **p_engine) {
+    if (p_engine == NULL || parser_ctx == NULL) {
+        return PARSER_NULL_POINTER_ERROR;
+    }
+    const engine_backend_ops *ops = backend_ops(backend);
+    if (ops == NULL) {
+        return PARSER_INVALID_ARGUMENT_ERROR;
+    }
+
+    engine *eng = calloc(1, sizeof(engine));
+    eng->log = log;
+    eng->parser_ctx = parser_ctx;
+    eng->callbacks = callbacks;
+    eng->backend = backend;
+    eng->ops = ops;
+    TAILQ_INIT(&eng->connections);
+    TAILQ_INIT(&eng->closed_connections);
+
+    ENGINE_LOG(LOG_LEVEL_TRACE, "engine_create(backend=%d)", (int) backend);
+
+    eng->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (eng->stop_fd < 0) {
+        ENGINE_LOG(LOG_LEVEL_ERROR, "engine_create(): %s", strerror(errno));
+        free(eng);
+        return PARSER_IO_ERROR;
+    }
+    int r = ops->init(eng);
+    if (r != 0) {
+        ENGINE_LOG(LOG_LEVEL_ERROR, "engine_create(): backend initialization failed");
+        close(eng->stop_fd);
+        free(eng);
+        return r;
+    }
+
+    *p_engine = eng;
+    return 0;
+}
+
+int engine_destroy(engine *eng) {
+    ENGINE_LOG(LOG_LEVEL_TRACE, "engine_destroy()");
+    engine_connection *conn;
+    while ((conn = TAILQ_FIRST(&eng->connections)) != NULL) {
+        engine_close_connection(eng, conn, PARSER_OK);
+    }
+    engine_free_closed_connections(eng, 1);
+    eng->ops->destroy(eng);
+    close(eng->stop_fd);
+    free(eng);
+    return 0;
+}
+
+int engine_add_connection(engine *eng, connection_id_t id, int client_fd, int server_fd,
+                          parser_callbacks *callbacks, connection_context **p_context) {
+    ENGINE_LOG(LOG_LEVEL_TRACE, "engine_add_connection(id=%d, client_fd=%d, server_fd=%d)",
+               (int) id, client_fd, server_fd);
+    if (client_fd < 0 || server_fd < 0) {
+        return PARSER_INVALID_ARGUMENT_ERROR;
+    }
+
+    connection_context *context;
+    int r = parser_connect(eng->parser_ctx, id, callbacks, &context);
+    if (r != 0) {
+        return r;
+    }
+
+    engine_connection *conn = calloc(1, sizeof(engine_connection));
+    conn->context = context;
+    endpoint_init(&conn->client, conn, client_fd, DIRECTION_OUT);
+    endpoint_init(&conn->server, conn, server_fd, DIRECTION_IN);
+
+    r = eng->ops->add_connection(eng, conn);
+    if (r != 0) {
+        parser_connection_close(context);
+        free(conn);
+        return r;
+    }
+
+    TAILQ_INSERT_TAIL(&eng->connections, conn, entry);
+    eng->connection_count++;
+
+    if (p_context != NULL) {
+        *p_context = context;
+    }
+    return 0;
+}
+
+int engine_run_once(engine *eng, int timeout_ms) {
+    int n = eng->ops->run_once(eng, timeout_ms);
+    if (eng->paused_count > 0) {
+        engine_connection *conn, *next;
+        for (conn = TAILQ_FIRST(&eng->connections); conn != NULL; conn = next) {
+            next = TAILQ_NEXT(conn, entry);
+            if (conn->paused) {
+                connection_check_resumed(eng, conn);
+            }
+        }
+    }
+    engine_free_closed_connections(eng, 0);
+    return n;
+}
+
+int engine_run(engine *eng) {
+    ENGINE_LOG(LOG_LEVEL_TRACE, "engine_run()");
+    int r = 0;
+    while (!eng->stopped) {
+        if (engine_run_once(eng, -1) < 0) {
+            r = PARSER_IO_ERROR;
+            break;
+        }
+    }
+    eng->stopped = 0;
+    ENGINE_LOG(LOG_LEVEL_TRACE, "engine_run() returned %d", r);
+    return r;
+}
+
+int engine_stop(engine *eng) {
+    uint64_t value = 1;
+    if (write(eng->stop_fd, &value, sizeof(value)) != sizeof(value)) {
+        return PARSER_IO_ERROR;
+    }
+    return 0;
+}
+
+size_t engine_get_connection_count(engine *eng) {
+    return eng->connection_count;
+}
+
+void engine_get_stats(engine *eng, engine_stats *stats) {
+    *stats = eng->stats;
+}
@@ -0,0 +1,154 @@
+/*
+ *  Native HTTP engine API.
+ *  Owns client and server sockets of proxied connections, polls them with epoll or io_uring,
+ *  forwards traffic between them and feeds it to the parser, so that the embedder
+ *  only receives parsed events.
+ */
+#ifndef HTTP_PARSER_ENGINE_H
+#define HTTP_PARSER_ENGINE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "parser.h"
+#include "logger.h"
+
+/**
+ * Size of one pooled I/O buffer
+ */
+#define ENGINE_BUFFER_SIZE 16384
+
+/**
+ * Maximum number of buffers queued for writing to one socket.
+ * When this limit is reached, engine stops reading from the opposite socket until the queue is drained.
+ */
+#define ENGINE_MAX_PENDING_BUFFERS 16
+
+/**
+ * Number of buffers in io_uring provided buffer ring (must be a power of two)
+ */
+#define ENGINE_URING_BUFFERS 1024
+
+/**
+ * Number of io_uring submission queue entries
+ */
+#define ENGINE_URING_ENTRIES 1024
+
+typedef struct engine engine;
+
+/**
+ * Socket I/O backend
+ * EPOLL - readiness-based loop (epoll_wait + recv/send per socket)
+ * IO_URING - completion-based loop (multishot recv with provided buffer ring, linked sends)
+ */
+typedef enum {
+    ENGINE_BACKEND_EPOLL = 0,
+    ENGINE_BACKEND_IO_URING = 1
+} engine_backend_t;
+
+/**
+ * Engine counters
+ */
+typedef struct {
+    // Number of system calls made by engine
+    unsigned long syscalls;
+    // Number of bytes received from sockets
+    unsigned long bytes_received;
+    // Number of bytes sent to sockets
+    unsigned long bytes_sent;
+} engine_stats;
+
+typedef struct {
+    /**
+     * Connection closed callback. Called before connection context is destroyed.
+     * @param context Connection context
+     * @param error PARSER_OK if both sides were closed normally, otherwise error code
+     */
+    void (*connection_closed)(connection_context *context, error_type_t error);
+} engine_callbacks;
+
+/**
+ * Checks if I/O backend is supported by this build and running kernel
+ * @param backend Backend
+ * @return Non-zero value if backend is supported
+ */
+int engine_backend_supported(engine_backend_t backend);
+
+/**
+ * Creates new engine
+ * @param log Logger
+ * @param parser_ctx Parser context which will be used for engine connections
+ * @param backend Socket I/O backend
+ * @param callbacks Engine callbacks (may be null)
+ * @param p_engine Pointer to variable where engine will be stored
+ * @return 0 if success
+ */
+int engine_create(logger *log, parser_context *parser_ctx, engine_backend_t backend,
+                  engine_callbacks *callbacks, engine **p_engine);
+
+/**
+ * Destroys engine, closing all its connections
+ * @param eng Engine
+ * @return 0 if success
+ */
+int engine_destroy(engine *eng);
+
+/**
+ * Adds connection to engine. Engine takes ownership of both sockets and closes them
+ * when connection is finished.
+ * Callbacks may pause connection by parser_connection_pause(). Engine then stops reading its sockets
+ * and holds input which isn't consumed by parser, until parser_connection_resume() is called
+ * on engine thread (e.g. from callback of another connection).
+ * @param eng Engine
+ * @param id Connection id
+ * @param client_fd Client socket (data from it is parsed as DIRECTION_OUT)
+ * @param server_fd Server socket (data from it is parsed as DIRECTION_IN)
+ * @param callbacks Parser callbacks
+ * @param p_context Pointer to variable where connection context will be stored (may be null)
+ * @return 0 if success
+ */
+int engine_add_connection(engine *eng, connection_id_t id, int client_fd, int server_fd,
+                          parser_callbacks *callbacks, connection_context **p_context);
+
+/**
+ * Waits for socket events and processes them
+ * @param eng Engine
+ * @param timeout_ms Timeout in milliseconds (-1 for infinite)
+ * @return Number of processed events, or negative value in case of error
+ */
+int engine_run_once(engine *eng, int timeout_ms);
+
+/**
+ * Processes socket events until engine_stop() is called
+ * @param eng Engine
+ * @return 0 if success
+ */
+int engine_run(engine *eng);
+
+/**
+ * Stops engine_run() loop. May be called from any thread.
+ * @param eng Engine
+ * @return 0 if success
+ */
+int engine_stop(engine *eng);
+
+/**
+ * Gets number of connections currently handled by engine
+ * @param eng Engine
+ * @return Number of connections
+ */
+size_t engine_get_connection_count(engine *eng);
+
+/**
+ * Gets engine counters
+ * @param eng Engine
+ * @param stats Pointer to structure where counters will be written
+ */
+void engine_get_stats(engine *eng, engine_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HTTP_PARSER_ENGINE_H */
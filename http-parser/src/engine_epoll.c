@@ -0,0 +1,383 @@
+/*
+ *  Native HTTP engine: epoll backend.
+ *  Level-triggered readiness loop, one recv() per readable socket per iteration.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "engine_internal.h"
+
+/**
+ * Maximum number of events processed by one epoll_wait() call
+ */
+#define EPOLL_MAX_EVENTS 64
+
+/**
+ * Maximum number of free buffers kept in pool
+ */
+#define EPOLL_MAX_POOLED_BUFFERS 256
+
+typedef struct {
+    int                     epoll_fd;
+    // Pool of free buffers
+    struct engine_buffer_queue buffer_pool;
+    size_t                  pooled_count;
+} engine_epoll;
+
+#define EPOLL_DATA(eng) ((engine_epoll *) (eng)->backend_data)
+
+/*
+ *  Buffer pool:
+ */
+
+static engine_buffer *buffer_get(engine *eng) {
+    engine_epoll *ep_data = EPOLL_DATA(eng);
+    engine_buffer *buf = STAILQ_FIRST(&ep_data->buffer_pool);
+    if (buf != NULL) {
+        STAILQ_REMOVE_HEAD(&ep_data->buffer_pool, entry);
+        ep_data->pooled_count--;
+    } else {
+        // Descriptor and data are allocated in one block
+        buf = malloc(sizeof(engine_buffer) + ENGINE_BUFFER_SIZE);
+        buf->data = (char *) (buf + 1);
+    }
+    buf->offset = 0;
+    buf->length = 0;
+    return buf;
+}
+
+static void buffer_put(engine *eng, engine_buffer *buf) {
+    engine_epoll *ep_data = EPOLL_DATA(eng);
+    if (ep_data->pooled_count >= EPOLL_MAX_POOLED_BUFFERS) {
+        free(buf);
+        return;
+    }
+    STAILQ_INSERT_HEAD(&ep_data->buffer_pool, buf, entry);
+    ep_data->pooled_count++;
+}
+
+static void endpoint_clear_queue(engine *eng, engine_endpoint *ep) {
+    engine_buffer *buf;
+    while ((buf = STAILQ_FIRST(&ep->out_queue)) != NULL) {
+        STAILQ_REMOVE_HEAD(&ep->out_queue, entry);
+        buffer_put(eng, buf);
+    }
+    ep->out_count = 0;
+    while ((buf = STAILQ_FIRST(&ep->in_queue)) != NULL) {
+        STAILQ_REMOVE_HEAD(&ep->in_queue, entry);
+        buffer_put(eng, buf);
+    }
+}
+
+static void endpoint_unregister(engine *eng, engine_endpoint *ep) {
+    if (ep->registered) {
+        epoll_ctl(EPOLL_DATA(eng)->epoll_fd, EPOLL_CTL_DEL, ep->fd, NULL);
+        eng->stats.syscalls++;
+        ep->registered = 0;
+    }
+}
+
+/**
+ * Recalculates polled events of endpoint.
+ * Reading is suspended while opposite endpoint has too much pending data or input is held by paused parser.
+ * Fully closed endpoints are removed from epoll. Hung up endpoints are removed while nothing is polled,
+ * since hang up is always reported, and are added back when reading or writing is possible again.
+ * @param eng Engine
+ * @param ep Endpoint
+ * @return 0 if success
+ */
+static int endpoint_update_events(engine *eng, engine_endpoint *ep) {
+    if (ep->conn->closed) {
+        return 0;
+    }
+    if (ep->read_closed && ep->write_closed) {
+        endpoint_unregister(eng, ep);
+        return 0;
+    }
+
+    uint32_t events = 0;
+    if (engine_endpoint_readable(ep)) {
+        events |= EPOLLIN;
+    }
+    if (ep->out_count > 0) {
+        events |= EPOLLOUT;
+    }
+    if (events == 0 && ep->hup) {
+        endpoint_unregister(eng, ep);
+        return 0;
+    }
+    if (ep->registered && events == ep->events) {
+        return 0;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = events;
+    event.data.ptr = ep;
+    eng->stats.syscalls++;
+    if (epoll_ctl(EPOLL_DATA(eng)->epoll_fd, ep->registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, ep->fd, &event) != 0) {
+        return PARSER_IO_ERROR;
+    }
+    ep->events = events;
+    ep->registered = 1;
+    return 0;
+}
+
+/**
+ * Writes as much pending data to endpoint socket as possible.
+ * If opposite side is closed and all data is written, shuts down write side of the socket.
+ * @param eng Engine
+ * @param ep Endpoint
+ * @return 0 if success
+ */
+static int endpoint_flush(engine *eng, engine_endpoint *ep) {
+    engine_buffer *buf;
+    while ((buf = STAILQ_FIRST(&ep->out_queue)) != NULL) {
+        ssize_t n = send(ep->fd, buf->data + buf->offset, buf->length - buf->offset, MSG_NOSIGNAL);
+        eng->stats.syscalls++;
+        if (n < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+                return 0;
+            }
+            return PARSER_IO_ERROR;
+        }
+        eng->stats.bytes_sent += n;
+        buf->offset += n;
+        if (buf->offset < buf->length) {
+            return 0;
+        }
+        STAILQ_REMOVE_HEAD(&ep->out_queue, entry);
+        ep->out_count--;
+        buffer_put(eng, buf);
+    }
+
+    if (engine_endpoint_peer(ep)->read_closed && !ep->write_closed) {
+        shutdown(ep->fd, SHUT_WR);
+        eng->stats.syscalls++;
+        ep->write_closed = 1;
+    }
+    return 0;
+}
+
+/**
+ * Reads data from endpoint socket, passes it to parser and queues it for writing to opposite socket
+ * @param eng Engine
+ * @param ep Endpoint
+ * @return 0 if success
+ */
+static int endpoint_read(engine *eng, engine_endpoint *ep) {
+    engine_endpoint *peer = engine_endpoint_peer(ep);
+    engine_buffer *buf = buffer_get(eng);
+    int r;
+
+    ssize_t n = recv(ep->fd, buf->data, ENGINE_BUFFER_SIZE, 0);
+    eng->stats.syscalls++;
+    if (n < 0) {
+        buffer_put(eng, buf);
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) {
+            return 0;
+        }
+        return PARSER_IO_ERROR;
+    }
+
+    if (n == 0) {
+        buffer_put(eng, buf);
+        r = engine_endpoint_eof(eng, ep);
+        if (r != 0) {
+            return r;
+        }
+        return endpoint_flush(eng, peer);
+    }
+
+    buf->length = (size_t) n;
+    r = engine_endpoint_input(eng, ep, buf);
+    if (r != 0) {
+        return r;
+    }
+    return endpoint_flush(eng, peer);
+}
+
+static int endpoint_register(engine *eng, engine_endpoint *ep) {
+    int flags = fcntl(ep->fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(ep->fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        return PARSER_IO_ERROR;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = ep;
+    if (epoll_ctl(EPOLL_DATA(eng)->epoll_fd, EPOLL_CTL_ADD, ep->fd, &event) != 0) {
+        return PARSER_IO_ERROR;
+    }
+    ep->events = EPOLLIN;
+    ep->registered = 1;
+    return 0;
+}
+
+/**
+ * Processes epoll event of one endpoint
+ * @param eng Engine
+ * @param ep Endpoint
+ * @param events Event mask returned by epoll_wait()
+ */
+static void process_event(engine *eng, engine_endpoint *ep, uint32_t events) {
+    engine_connection *conn = ep->conn;
+    int r = 0;
+
+    if (events & EPOLLERR) {
+        r = PARSER_IO_ERROR;
+    } else {
+        if (events & EPOLLHUP) {
+            ep->hup = 1;
+        }
+        // Hang up is processed as readable socket, recv() will return the rest of data and EOF.
+        // If reading is suspended, it's processed when endpoint is readable again.
+        if (engine_endpoint_readable(ep) && (events & (EPOLLIN | EPOLLHUP))) {
+            r = endpoint_read(eng, ep);
+        }
+        if (r == 0 && (events & EPOLLOUT)) {
+            r = endpoint_flush(eng, ep);
+        }
+    }
+
+    if (r == 0) {
+        r = endpoint_update_events(eng, ep);
+    }
+    if (r == 0) {
+        r = endpoint_update_events(eng, engine_endpoint_peer(ep));
+    }
+
+    if (r != 0) {
+        engine_close_connection(eng, conn, (error_type_t) r);
+    } else if (engine_connection_finished(conn)) {
+        engine_close_connection(eng, conn, PARSER_OK);
+    }
+}
+
+/*
+ *  Backend operations
+ */
+
+static int epoll_init(engine *eng) {
+    engine_epoll *ep_data = calloc(1, sizeof(engine_epoll));
+    STAILQ_INIT(&ep_data->buffer_pool);
+    ep_data->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (ep_data->epoll_fd < 0) {
+        free(ep_data);
+        return PARSER_IO_ERROR;
+    }
+
+    struct epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN;
+    event.data.ptr = NULL;
+    if (epoll_ctl(ep_data->epoll_fd, EPOLL_CTL_ADD, eng->stop_fd, &event) != 0) {
+        close(ep_data->epoll_fd);
+        free(ep_data);
+        return PARSER_IO_ERROR;
+    }
+
+    eng->backend_data = ep_data;
+    return 0;
+}
+
+static void epoll_destroy(engine *eng) {
+    engine_epoll *ep_data = EPOLL_DATA(eng);
+    engine_buffer *buf;
+    while ((buf = STAILQ_FIRST(&ep_data->buffer_pool)) != NULL) {
+        STAILQ_REMOVE_HEAD(&ep_data->buffer_pool, entry);
+        free(buf);
+    }
+    close(ep_data->epoll_fd);
+    free(ep_data);
+    eng->backend_data = NULL;
+}
+
+static int epoll_add_connection(engine *eng, engine_connection *conn) {
+    if (endpoint_register(eng, &conn->client) != 0) {
+        return PARSER_IO_ERROR;
+    }
+    if (endpoint_register(eng, &conn->server) != 0) {
+        epoll_ctl(EPOLL_DATA(eng)->epoll_fd, EPOLL_CTL_DEL, conn->client.fd, NULL);
+        return PARSER_IO_ERROR;
+    }
+    return 0;
+}
+
+static void epoll_close_connection(engine *eng, engine_connection *conn) {
+    engine_endpoint *endpoints[] = { &conn->client, &conn->server };
+    for (int i = 0; i < 2; i++) {
+        engine_endpoint *ep = endpoints[i];
+        endpoint_unregister(eng, ep);
+        close(ep->fd);
+        endpoint_clear_queue(eng, ep);
+    }
+}
+
+static void epoll_release_connection(engine *eng, engine_connection *conn) {
+    // Everything is released on close
+    (void) eng;
+    (void) conn;
+}
+
+static int epoll_resume_connection(engine *eng, engine_connection *conn) {
+    // Endpoints which were hung up while input was held are polled again, so the rest
+    // of their data and EOF are read after held input is processed
+    int r = endpoint_flush(eng, &conn->client);
+    if (r == 0) {
+        r = endpoint_flush(eng, &conn->server);
+    }
+    if (r == 0) {
+        r = endpoint_update_events(eng, &conn->client);
+    }
+    if (r == 0) {
+        r = endpoint_update_events(eng, &conn->server);
+    }
+    return r;
+}
+
+static int epoll_run_once(engine *eng, int timeout_ms) {
+    struct epoll_event events[EPOLL_MAX_EVENTS];
+    int n = epoll_wait(EPOLL_DATA(eng)->epoll_fd, events, EPOLL_MAX_EVENTS, timeout_ms);
+    eng->stats.syscalls++;
+    if (n < 0) {
+        if (errno == EINTR) {
+            return 0;
+        }
+        ENGINE_LOG(LOG_LEVEL_ERROR, "epoll_run_once(): epoll_wait() failed: %s", strerror(errno));
+        return -PARSER_IO_ERROR;
+    }
+
+    for (int i = 0; i < n; i++) {
+        engine_endpoint *ep = events[i].data.ptr;
+        if (ep == NULL) {
+            uint64_t value;
+            if (read(eng->stop_fd, &value, sizeof(value)) > 0) {
+                eng->stopped = 1;
+            }
+            continue;
+        }
+        if (ep->conn->closed) {
+            // Connection was closed while processing previous events of this batch
+            continue;
+        }
+        process_event(eng, ep, events[i].events);
+    }
+    return n;
+}
+
+const engine_backend_ops engine_epoll_ops = {
+    .init = epoll_init,
+    .destroy = epoll_destroy,
+    .add_connection = epoll_add_connection,
+    .close_connection = epoll_close_connection,
+    .release_connection = epoll_release_connection,
+    .resume_connection = epoll_resume_connection,
+    .run_once = epoll_run_once
+};
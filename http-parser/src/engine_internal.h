@@ -0,0 +1,198 @@
+/*
+ *  Native HTTP engine internals shared between engine core and its I/O backends.
+ */
+#ifndef HTTP_PARSER_ENGINE_INTERNAL_H
+#define HTTP_PARSER_ENGINE_INTERNAL_H
+
+#include <stdint.h>
+#include <sys/queue.h>
+
+#include "engine.h"
+
+#define ENGINE_LOG(args...) logger_log(eng->log, args)
+
+typedef struct engine_connection engine_connection;
+typedef struct engine_endpoint engine_endpoint;
+
+/*
+ * I/O buffer. Data is read into it, passed to parser and then queued for
+ * writing to the opposite socket.
+ */
+typedef struct engine_buffer {
+    // Buffer memory (ENGINE_BUFFER_SIZE bytes)
+    char                    *data;
+    // Offset of first unwritten byte, or of first byte not consumed by parser while buffer is held
+    size_t                  offset;
+    // Length of data in buffer
+    size_t                  length;
+    // Buffer id in io_uring provided buffer ring
+    unsigned short          bid;
+    // Endpoint which buffer is being written to (io_uring backend only)
+    engine_endpoint         *ep;
+    STAILQ_ENTRY(engine_buffer) entry;
+} engine_buffer;
+
+STAILQ_HEAD(engine_buffer_queue, engine_buffer);
+
+/*
+ * One side of proxied connection
+ */
+struct engine_endpoint {
+    // Socket
+    int                     fd;
+    // Direction of data which is read from this socket
+    transfer_direction_t    direction;
+    // EOF is received from socket
+    int                     read_closed;
+    // Write side of socket is shut down
+    int                     write_closed;
+    // Data read from opposite socket which is waiting to be written to this socket
+    struct engine_buffer_queue out_queue;
+    // Number of buffers in out_queue
+    size_t                  out_count;
+    // Data read from this socket which is held while parser is paused, reading is stopped until it's processed
+    struct engine_buffer_queue in_queue;
+    // Pointer to parent connection
+    engine_connection       *conn;
+
+    // Epoll backend state:
+    // Events which are currently polled
+    uint32_t                events;
+    // Socket is registered in epoll
+    int                     registered;
+    // Hang up was reported. It can't be masked, so socket isn't polled while there are no wanted events
+    int                     hup;
+
+    // Io_uring backend state:
+    // Multishot receive is active
+    int                     recv_armed;
+    // Cancellation of multishot receive is requested
+    int                     recv_cancelling;
+    // Number of submitted send requests which are not completed yet
+    size_t                  send_inflight;
+};
+
+struct engine_connection {
+    // Parser connection context
+    connection_context      *context;
+    // Client side (DIRECTION_OUT)
+    engine_endpoint         client;
+    // Server side (DIRECTION_IN)
+    engine_endpoint         server;
+    // Connection is closed and is waiting to be freed
+    int                     closed;
+    // Parser was paused by callback, input is held until parser_connection_resume()
+    int                     paused;
+    // Number of backend requests which still reference this connection
+    size_t                  pending_ops;
+    TAILQ_ENTRY(engine_connection) entry;
+};
+
+TAILQ_HEAD(engine_connection_list, engine_connection);
+
+/*
+ * I/O backend operations
+ */
+typedef struct {
+    // Initializes backend state
+    int (*init)(engine *eng);
+    // Frees backend state
+    void (*destroy)(engine *eng);
+    // Starts polling connection sockets
+    int (*add_connection)(engine *eng, engine_connection *conn);
+    // Stops I/O on closed connection sockets
+    void (*close_connection)(engine *eng, engine_connection *conn);
+    // Releases connection resources before it is freed
+    void (*release_connection)(engine *eng, engine_connection *conn);
+    // Writes data released by resumed parser and restarts reading of sockets without held input
+    int (*resume_connection)(engine *eng, engine_connection *conn);
+    // Waits for I/O and processes it
+    int (*run_once)(engine *eng, int timeout_ms);
+} engine_backend_ops;
+
+struct engine {
+    logger                  *log;
+    parser_context          *parser_ctx;
+    engine_callbacks        *callbacks;
+    engine_backend_t        backend;
+    const engine_backend_ops *ops;
+    // Backend-specific state
+    void                    *backend_data;
+    // Eventfd used for engine_stop() wakeups
+    int                     stop_fd;
+    int                     stopped;
+    size_t                  connection_count;
+    // Number of paused connections
+    size_t                  paused_count;
+    struct engine_connection_list connections;
+    // Closed connections which are waiting for pending backend requests before being freed
+    struct engine_connection_list closed_connections;
+    engine_stats            stats;
+};
+
+extern const engine_backend_ops engine_epoll_ops;
+#ifdef HAVE_IO_URING
+extern const engine_backend_ops engine_uring_ops;
+#endif
+
+/**
+ * Gets opposite endpoint of connection
+ */
+static inline engine_endpoint *engine_endpoint_peer(engine_endpoint *ep) {
+    return ep == &ep->conn->client ? &ep->conn->server : &ep->conn->client;
+}
+
+/**
+ * Checks if endpoint may read its socket
+ */
+static inline int engine_endpoint_readable(engine_endpoint *ep) {
+    return !ep->read_closed && STAILQ_EMPTY(&ep->in_queue) &&
+           engine_endpoint_peer(ep)->out_count < ENGINE_MAX_PENDING_BUFFERS;
+}
+
+/**
+ * Checks if both sides of connection are closed and all data is written
+ */
+static inline int engine_connection_finished(engine_connection *conn) {
+    return conn->client.read_closed && conn->server.read_closed &&
+           conn->client.out_count == 0 && conn->server.out_count == 0 &&
+           STAILQ_EMPTY(&conn->client.in_queue) && STAILQ_EMPTY(&conn->server.in_queue);
+}
+
+/**
+ * Passes buffer received from endpoint socket to parser and queues it for writing to opposite socket.
+ * If parser is paused, buffer is held in endpoint input queue until connection is resumed.
+ * Buffer is owned by endpoint after this call, even if error is returned.
+ * @param eng Engine
+ * @param ep Endpoint
+ * @param buf Received buffer (`length' bytes of data)
+ * @return 0 if success
+ */
+int engine_endpoint_input(engine *eng, engine_endpoint *ep, engine_buffer *buf);
+
+/**
+ * Processes EOF received from endpoint socket.
+ * Endpoint must not have held input, EOF is read again after it is processed.
+ * @param eng Engine
+ * @param ep Endpoint
+ * @return 0 if success
+ */
+int engine_endpoint_eof(engine *eng, engine_endpoint *ep);
+
+/**
+ * Closes connection. Memory is freed by engine_free_closed_connections() after all
+ * pending backend requests are completed.
+ * @param eng Engine
+ * @param conn Connection
+ * @param error Error code which is passed to connection_closed() callback
+ */
+void engine_close_connection(engine *eng, engine_connection *conn, error_type_t error);
+
+/**
+ * Frees closed connections without pending backend requests
+ * @param eng Engine
+ * @param force Free connections regardless of pending requests (used on engine destruction)
+ */
+void engine_free_closed_connections(engine *eng, int force);
+
+#endif /* HTTP_PARSER_ENGINE_INTERNAL_H */
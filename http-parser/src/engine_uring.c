@@ -0,0 +1,645 @@
+/*
+ *  Native HTTP engine: io_uring backend.
+ *  Each socket has one multishot recv request which picks buffers from a provided buffer ring,
+ *  received buffers are passed to parser and then sent to the opposite socket as a chain of
+ *  linked send requests, and returned to the ring when the send is complete.
+ *  Raw io_uring system calls are used, so no liburing dependency is needed.
+ */
+#ifdef HAVE_IO_URING
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+
+#include "engine_internal.h"
+
+/*
+ * Request types. Type is stored in low bits of request user data, the rest is a pointer
+ * to endpoint (recv) or buffer (send).
+ */
+#define URING_OP_RECV       1
+#define URING_OP_SEND       2
+#define URING_OP_STOP       3
+#define URING_OP_CANCEL     4
+#define URING_OP_MASK       7
+
+#define URING_USER_DATA(ptr, op)    ((uint64_t) (uintptr_t) (ptr) | (op))
+#define URING_USER_DATA_PTR(data)   ((void *) (uintptr_t) ((data) & ~(uint64_t) URING_OP_MASK))
+#define URING_USER_DATA_OP(data)    ((int) ((data) & URING_OP_MASK))
+
+/**
+ * Provided buffer group id
+ */
+#define URING_BUFFER_GROUP 0
+
+typedef struct {
+    int                     ring_fd;
+    // Submission queue
+    unsigned                sq_entries;
+    unsigned                *sq_head;
+    unsigned                *sq_tail;
+    unsigned                *sq_mask;
+    unsigned                *sq_array;
+    // Tail including entries which are not published yet
+    unsigned                sq_local_tail;
+    // Number of entries which are not submitted yet
+    unsigned                to_submit;
+    struct io_uring_sqe     *sqes;
+    size_t                  sqes_size;
+    // Completion queue (shares mapping with submission queue)
+    unsigned                *cq_head;
+    unsigned                *cq_tail;
+    unsigned                *cq_mask;
+    struct io_uring_cqe     *cqes;
+    void                    *ring_ptr;
+    size_t                  ring_size;
+    // Provided buffer ring
+    struct io_uring_buf_ring *buf_ring;
+    size_t                  buf_ring_size;
+    unsigned short          buf_ring_tail;
+    // Buffer memory and descriptors
+    char                    *buffer_memory;
+    engine_buffer           *buffers;
+    // Number of buffers in provided buffer ring (including ones picked by kernel but not completed yet)
+    unsigned                free_buffers;
+    // Receiving is stopped because provided buffer ring was empty
+    int                     starved;
+    // Target of stop eventfd read request
+    uint64_t                stop_value;
+} engine_uring;
+
+#define URING_DATA(eng) ((engine_uring *) (eng)->backend_data)
+
+/*
+ *  System call wrappers:
+ */
+
+static inline int sys_io_uring_setup(unsigned entries, struct io_uring_params *params) {
+    return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+static inline int sys_io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags,
+                                     void *arg, size_t arg_size) {
+    return (int) syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, arg, arg_size);
+}
+
+static inline int sys_io_uring_register(int fd, unsigned opcode, void *arg, unsigned nr_args) {
+    return (int) syscall(__NR_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+/*
+ *  Submission:
+ */
+
+/**
+ * Publishes queued submission entries to kernel and optionally waits for completions
+ * @param eng Engine
+ * @param wait Wait for at least one completion
+ * @param timeout_ms Wait timeout in milliseconds (-1 for infinite)
+ * @return 0 if success
+ */
+static int uring_submit(engine *eng, int wait, int timeout_ms) {
+    engine_uring *u = URING_DATA(eng);
+    __atomic_store_n(u->sq_tail, u->sq_local_tail, __ATOMIC_RELEASE);
+
+    struct __kernel_timespec ts;
+    struct io_uring_getevents_arg arg;
+    unsigned flags = 0;
+    if (wait) {
+        memset(&arg, 0, sizeof(arg));
+        if (timeout_ms >= 0) {
+            ts.tv_sec = timeout_ms / 1000;
+            ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+            arg.ts = (uint64_t) (uintptr_t) &ts;
+        }
+        flags = IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+    }
+
+    int r = sys_io_uring_enter(u->ring_fd, u->to_submit, wait ? 1 : 0, flags,
+                               wait ? &arg : NULL, wait ? sizeof(arg) : 0);
+    eng->stats.syscalls++;
+    if (r < 0) {
+        if (errno == ETIME || errno == EINTR || errno == EBUSY || errno == EAGAIN) {
+            return 0;
+        }
+        ENGINE_LOG(LOG_LEVEL_ERROR, "uring_submit(): io_uring_enter() failed: %s", strerror(errno));
+        return PARSER_IO_ERROR;
+    }
+    u->to_submit -= (unsigned) r;
+    return 0;
+}
+
+/**
+ * Makes sure that `count' submission entries may be acquired without intermediate submit.
+ * Linked requests must be submitted in one batch, otherwise chain is broken.
+ */
+static void uring_reserve(engine *eng, unsigned count) {
+    engine_uring *u = URING_DATA(eng);
+    unsigned head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    if (u->sq_local_tail - head + count > u->sq_entries) {
+        uring_submit(eng, 0, 0);
+    }
+}
+
+static struct io_uring_sqe *uring_get_sqe(engine *eng) {
+    engine_uring *u = URING_DATA(eng);
+    unsigned head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+    if (u->sq_local_tail - head >= u->sq_entries) {
+        uring_submit(eng, 0, 0);
+        head = __atomic_load_n(u->sq_head, __ATOMIC_ACQUIRE);
+        if (u->sq_local_tail - head >= u->sq_entries) {
+            return NULL;
+        }
+    }
+    unsigned index = u->sq_local_tail & *u->sq_mask;
+    struct io_uring_sqe *sqe = &u->sqes[index];
+    memset(sqe, 0, sizeof(struct io_uring_sqe));
+    u->sq_array[index] = index;
+    u->sq_local_tail++;
+    u->to_submit++;
+    return sqe;
+}
+
+/*
+ *  Provided buffers:
+ */
+
+static void buffer_recycle(engine *eng, engine_buffer *buf) {
+    engine_uring *u = URING_DATA(eng);
+    struct io_uring_buf *entry = &u->buf_ring->bufs[u->buf_ring_tail & (ENGINE_URING_BUFFERS - 1)];
+    entry->addr = (uint64_t) (uintptr_t) buf->data;
+    entry->len = ENGINE_BUFFER_SIZE;
+    entry->bid = buf->bid;
+    u->buf_ring_tail++;
+    __atomic_store_n(&u->buf_ring->tail, u->buf_ring_tail, __ATOMIC_RELEASE);
+    u->free_buffers++;
+    buf->ep = NULL;
+}
+
+static void endpoint_recycle_queue(engine *eng, engine_endpoint *ep) {
+    engine_buffer *buf;
+    while ((buf = STAILQ_FIRST(&ep->out_queue)) != NULL) {
+        STAILQ_REMOVE_HEAD(&ep->out_queue, entry);
+        buffer_recycle(eng, buf);
+    }
+    ep->out_count = 0;
+    while ((buf = STAILQ_FIRST(&ep->in_queue)) != NULL) {
+        STAILQ_REMOVE_HEAD(&ep->in_queue, entry);
+        buffer_recycle(eng, buf);
+    }
+}
+
+/*
+ *  Endpoint requests:
+ */
+
+static int endpoint_arm_recv(engine *eng, engine_endpoint *ep) {
+    struct io_uring_sqe *sqe = uring_get_sqe(eng);
+    if (sqe == NULL) {
+        return PARSER_IO_ERROR;
+    }
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = ep->fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->user_data = URING_USER_DATA(ep, URING_OP_RECV);
+    ep->recv_armed = 1;
+    ep->conn->pending_ops++;
+    return 0;
+}
+
+static int endpoint_cancel_recv(engine *eng, engine_endpoint *ep) {
+    struct io_uring_sqe *sqe = uring_get_sqe(eng);
+    if (sqe == NULL) {
+        return PARSER_IO_ERROR;
+    }
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = -1;
+    sqe->addr = URING_USER_DATA(ep, URING_OP_RECV);
+    sqe->user_data = URING_USER_DATA(NULL, URING_OP_CANCEL);
+    ep->recv_cancelling = 1;
+    return 0;
+}
+
+/**
+ * Starts or stops receiving depending on endpoint state.
+ * Receiving is stopped while opposite endpoint has too much pending data or input is held by paused parser.
+ * @param eng Engine
+ * @param ep Endpoint
+ * @return 0 if success
+ */
+static int endpoint_update_recv(engine *eng, engine_endpoint *ep) {
+    int want = !URING_DATA(eng)->starved && engine_endpoint_readable(ep);
+    if (want && !ep->recv_armed) {
+        return endpoint_arm_recv(eng, ep);
+    }
+    if (!want && ep->recv_armed && !ep->recv_cancelling) {
+        return endpoint_cancel_recv(eng, ep);
+    }
+    return 0;
+}
+
+/**
+ * Submits queued data of endpoint as a chain of linked send requests.
+ * Only one chain per endpoint is in flight and each send waits until the whole buffer is sent,
+ * so that data order is preserved.
+ * If opposite side is closed and all data is written, shuts down write side of the socket.
+ * @param eng Engine
+ * @param ep Endpoint
+ * @return 0 if success
+ */
+static int endpoint_flush(engine *eng, engine_endpoint *ep) {
+    if (ep->send_inflight > 0) {
+        return 0;
+    }
+    if (STAILQ_EMPTY(&ep->out_queue)) {
+        if (engine_endpoint_peer(ep)->read_closed && !ep->write_closed) {
+            shutdown(ep->fd, SHUT_WR);
+            eng->stats.syscalls++;
+            ep->write_closed = 1;
+        }
+        return 0;
+    }
+
+    size_t count = ep->out_count < ENGINE_MAX_PENDING_BUFFERS ? ep->out_count : ENGINE_MAX_PENDING_BUFFERS;
+    uring_reserve(eng, (unsigned) count);
+    size_t i = 0;
+    engine_buffer *buf;
+    STAILQ_FOREACH(buf, &ep->out_queue, entry) {
+        if (i == count) {
+            break;
+        }
+        struct io_uring_sqe *sqe = uring_get_sqe(eng);
+        if (sqe == NULL) {
+            return PARSER_IO_ERROR;
+        }
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = ep->fd;
+        sqe->addr = (uint64_t) (uintptr_t) (buf->data + buf->offset);
+        sqe->len = (uint32_t) (buf->length - buf->offset);
+        // Short send isn't a failure and doesn't break the chain, so next buffer would be sent
+        // before the rest of this one. With MSG_WAITALL the kernel retries until all data is sent,
+        // and fails the request (cancelling the rest of chain) only if it can't be sent.
+        sqe->msg_flags = MSG_NOSIGNAL | MSG_WAITALL;
+        if (i + 1 < count) {
+            sqe->flags = IOSQE_IO_LINK;
+        }
+        sqe->user_data = URING_USER_DATA(buf, URING_OP_SEND);
+        buf->ep = ep;
+        ep->send_inflight++;
+        ep->conn->pending_ops++;
+        i++;
+    }
+    return 0;
+}
+
+/**
+ * Updates connection state after its request is completed, closes connection if it is finished
+ * @param eng Engine
+ * @param conn Connection
+ * @param r Result of request processing
+ */
+static void connection_update(engine *eng, engine_connection *conn, int r) {
+    if (r == 0) {
+        r = endpoint_update_recv(eng, &conn->client);
+    }
+    if (r == 0) {
+        r = endpoint_update_recv(eng, &conn->server);
+    }
+
+    if (r != 0) {
+        engine_close_connection(eng, conn, (error_type_t) r);
+    } else if (engine_connection_finished(conn)) {
+        engine_close_connection(eng, conn, PARSER_OK);
+    }
+}
+
+/**
+ * Restarts receiving on all connections after buffers were returned to starved buffer ring
+ */
+static void resume_starved(engine *eng) {
+    URING_DATA(eng)->starved = 0;
+    engine_connection *conn, *next;
+    for (conn = TAILQ_FIRST(&eng->connections); conn != NULL; conn = next) {
+        next = TAILQ_NEXT(conn, entry);
+        connection_update(eng, conn, 0);
+    }
+}
+
+/**
+ * Restarts receiving if buffer ring was starved and buffers were returned to it.
+ * Must be called after every place where buffers are recycled, otherwise receiving
+ * may stay stopped forever if connections holding buffers are closed.
+ */
+static void check_starved(engine *eng) {
+    engine_uring *u = URING_DATA(eng);
+    if (u->starved && u->free_buffers > 0) {
+        resume_starved(eng);
+    }
+}
+
+/*
+ *  Completion handlers:
+ */
+
+static void handle_recv(engine *eng, engine_endpoint *ep, struct io_uring_cqe *cqe) {
+    engine_uring *u = URING_DATA(eng);
+    engine_connection *conn = ep->conn;
+    engine_buffer *buf = NULL;
+    if (cqe->flags & IORING_CQE_F_BUFFER) {
+        buf = &u->buffers[cqe->flags >> IORING_CQE_BUFFER_SHIFT];
+        u->free_buffers--;
+    }
+    if (!(cqe->flags & IORING_CQE_F_MORE)) {
+        // Multishot request is terminated
+        ep->recv_armed = 0;
+        ep->recv_cancelling = 0;
+        conn->pending_ops--;
+    }
+
+    if (conn->closed) {
+        if (buf != NULL) {
+            buffer_recycle(eng, buf);
+            check_starved(eng);
+        }
+        return;
+    }
+
+    int r = 0;
+    if (cqe->res > 0 && buf != NULL) {
+        // Completions received after parser was paused are held too
+        buf->length = (size_t) cqe->res;
+        r = engine_endpoint_input(eng, ep, buf);
+        if (r == 0) {
+            r = endpoint_flush(eng, engine_endpoint_peer(ep));
+        }
+    } else if (cqe->res == 0) {
+        if (buf != NULL) {
+            buffer_recycle(eng, buf);
+        }
+        // If input is held by paused parser, EOF is received again when receiving is restarted
+        if (STAILQ_EMPTY(&ep->in_queue)) {
+            r = engine_endpoint_eof(eng, ep);
+            if (r == 0) {
+                r = endpoint_flush(eng, engine_endpoint_peer(ep));
+            }
+        }
+    } else if (cqe->res == -ENOBUFS) {
+        u->starved = 1;
+    } else if (cqe->res != -ECANCELED) {
+        r = PARSER_IO_ERROR;
+    }
+
+    connection_update(eng, conn, r);
+    // Buffer may be recycled above, or returned to ring before ENOBUFS completion was handled
+    check_starved(eng);
+}
+
+static void handle_send(engine *eng, engine_buffer *buf, struct io_uring_cqe *cqe) {
+    engine_endpoint *ep = buf->ep;
+    engine_connection *conn = ep->conn;
+    ep->send_inflight--;
+    conn->pending_ops--;
+    if (conn->closed) {
+        // Buffers are recycled when connection is released
+        return;
+    }
+
+    int r = 0;
+    if (cqe->res >= 0) {
+        eng->stats.bytes_sent += cqe->res;
+        buf->offset += cqe->res;
+        if (buf->offset >= buf->length) {
+            STAILQ_REMOVE(&ep->out_queue, buf, engine_buffer, entry);
+            ep->out_count--;
+            buffer_recycle(eng, buf);
+        }
+    } else if (cqe->res != -ECANCELED) {
+        // Request is cancelled if previous request in chain has failed, the rest of data
+        // is submitted again from buffer offsets when the whole chain is completed
+        r = PARSER_IO_ERROR;
+    }
+
+    if (r == 0 && ep->send_inflight == 0) {
+        r = endpoint_flush(eng, ep);
+    }
+    connection_update(eng, conn, r);
+    check_starved(eng);
+}
+
+static int arm_stop(engine *eng) {
+    engine_uring *u = URING_DATA(eng);
+    struct io_uring_sqe *sqe = uring_get_sqe(eng);
+    if (sqe == NULL) {
+        return PARSER_IO_ERROR;
+    }
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = eng->stop_fd;
+    sqe->addr = (uint64_t) (uintptr_t) &u->stop_value;
+    sqe->len = sizeof(u->stop_value);
+    sqe->user_data = URING_USER_DATA(NULL, URING_OP_STOP);
+    return 0;
+}
+
+/*
+ *  Backend operations
+ */
+
+static void uring_free(engine_uring *u) {
+    if (u->ring_fd >= 0) close(u->ring_fd);
+    if (u->ring_ptr != NULL) munmap(u->ring_ptr, u->ring_size);
+    if (u->sqes != NULL) munmap(u->sqes, u->sqes_size);
+    if (u->buf_ring != NULL) munmap(u->buf_ring, u->buf_ring_size);
+    free(u->buffer_memory);
+    free(u->buffers);
+    free(u);
+}
+
+static int uring_init(engine *eng) {
+    engine_uring *u = calloc(1, sizeof(engine_uring));
+    if (u == NULL) {
+        return PARSER_OUT_OF_MEMORY_ERROR;
+    }
+    u->ring_fd = -1;
+
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    // Multishot receive may post many completions per submission
+    params.flags = IORING_SETUP_CQSIZE;
+    params.cq_entries = ENGINE_URING_ENTRIES * 4;
+    u->ring_fd = sys_io_uring_setup(ENGINE_URING_ENTRIES, &params);
+    if (u->ring_fd < 0) {
+        goto error;
+    }
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP) || !(params.features & IORING_FEAT_EXT_ARG)) {
+        goto error;
+    }
+
+    // Map rings
+    size_t sq_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    size_t cq_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    u->ring_size = sq_size > cq_size ? sq_size : cq_size;
+    u->ring_ptr = mmap(NULL, u->ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                       u->ring_fd, IORING_OFF_SQ_RING);
+    if (u->ring_ptr == MAP_FAILED) {
+        u->ring_ptr = NULL;
+        goto error;
+    }
+    u->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    u->sqes = mmap(NULL, u->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                   u->ring_fd, IORING_OFF_SQES);
+    if (u->sqes == MAP_FAILED) {
+        u->sqes = NULL;
+        goto error;
+    }
+
+    char *ring = u->ring_ptr;
+    u->sq_entries = params.sq_entries;
+    u->sq_head = (unsigned *) (ring + params.sq_off.head);
+    u->sq_tail = (unsigned *) (ring + params.sq_off.tail);
+    u->sq_mask = (unsigned *) (ring + params.sq_off.ring_mask);
+    u->sq_array = (unsigned *) (ring + params.sq_off.array);
+    u->sq_local_tail = *u->sq_tail;
+    u->cq_head = (unsigned *) (ring + params.cq_off.head);
+    u->cq_tail = (unsigned *) (ring + params.cq_off.tail);
+    u->cq_mask = (unsigned *) (ring + params.cq_off.ring_mask);
+    u->cqes = (struct io_uring_cqe *) (ring + params.cq_off.cqes);
+
+    // Register provided buffer ring
+    u->buf_ring_size = ENGINE_URING_BUFFERS * sizeof(struct io_uring_buf);
+    u->buf_ring = mmap(NULL, u->buf_ring_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (u->buf_ring == MAP_FAILED) {
+        u->buf_ring = NULL;
+        goto error;
+    }
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = (uint64_t) (uintptr_t) u->buf_ring;
+    reg.ring_entries = ENGINE_URING_BUFFERS;
+    reg.bgid = URING_BUFFER_GROUP;
+    if (sys_io_uring_register(u->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) != 0) {
+        goto error;
+    }
+
+    u->buffer_memory = malloc((size_t) ENGINE_URING_BUFFERS * ENGINE_BUFFER_SIZE);
+    u->buffers = calloc(ENGINE_URING_BUFFERS, sizeof(engine_buffer));
+    if (u->buffer_memory == NULL || u->buffers == NULL) {
+        uring_free(u);
+        return PARSER_OUT_OF_MEMORY_ERROR;
+    }
+
+    eng->backend_data = u;
+    for (unsigned i = 0; i < ENGINE_URING_BUFFERS; i++) {
+        u->buffers[i].data = u->buffer_memory + (size_t) i * ENGINE_BUFFER_SIZE;
+        u->buffers[i].bid = (unsigned short) i;
+        buffer_recycle(eng, &u->buffers[i]);
+    }
+
+    if (arm_stop(eng) != 0) {
+        eng->backend_data = NULL;
+        goto error;
+    }
+    return 0;
+
+    error:
+    uring_free(u);
+    return PARSER_IO_ERROR;
+}
+
+static void uring_destroy(engine *eng) {
+    // Closing ring cancels all pending requests
+    uring_free(URING_DATA(eng));
+    eng->backend_data = NULL;
+}
+
+static int uring_add_connection(engine *eng, engine_connection *conn) {
+    int r = endpoint_arm_recv(eng, &conn->client);
+    if (r == 0) {
+        r = endpoint_arm_recv(eng, &conn->server);
+    }
+    return r;
+}
+
+static void uring_close_connection(engine *eng, engine_connection *conn) {
+    // Shutdown completes pending receive and send requests, sockets are closed on release
+    shutdown(conn->client.fd, SHUT_RDWR);
+    shutdown(conn->server.fd, SHUT_RDWR);
+    eng->stats.syscalls += 2;
+}
+
+static void uring_release_connection(engine *eng, engine_connection *conn) {
+    close(conn->client.fd);
+    close(conn->server.fd);
+    endpoint_recycle_queue(eng, &conn->client);
+    endpoint_recycle_queue(eng, &conn->server);
+    check_starved(eng);
+}
+
+static int uring_resume_connection(engine *eng, engine_connection *conn) {
+    int r = endpoint_flush(eng, &conn->client);
+    if (r == 0) {
+        r = endpoint_flush(eng, &conn->server);
+    }
+    if (r == 0) {
+        r = endpoint_update_recv(eng, &conn->client);
+    }
+    if (r == 0) {
+        r = endpoint_update_recv(eng, &conn->server);
+    }
+    return r;
+}
+
+static int uring_run_once(engine *eng, int timeout_ms) {
+    engine_uring *u = URING_DATA(eng);
+    unsigned head = *u->cq_head;
+    int wait = head == __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE);
+    if (wait || u->to_submit > 0) {
+        if (uring_submit(eng, wait, timeout_ms) != 0) {
+            return -PARSER_IO_ERROR;
+        }
+    }
+
+    int n = 0;
+    head = *u->cq_head;
+    while (head != __atomic_load_n(u->cq_tail, __ATOMIC_ACQUIRE) && n < (int) (*u->cq_mask + 1)) {
+        struct io_uring_cqe cqe = u->cqes[head & *u->cq_mask];
+        head++;
+        __atomic_store_n(u->cq_head, head, __ATOMIC_RELEASE);
+        n++;
+
+        void *ptr = URING_USER_DATA_PTR(cqe.user_data);
+        switch (URING_USER_DATA_OP(cqe.user_data)) {
+            case URING_OP_RECV:
+                handle_recv(eng, ptr, &cqe);
+                break;
+            case URING_OP_SEND:
+                handle_send(eng, ptr, &cqe);
+                break;
+            case URING_OP_STOP:
+                eng->stopped = 1;
+                arm_stop(eng);
+                break;
+            default:
+                break;
+        }
+    }
+    return n;
+}
+
+const engine_backend_ops engine_uring_ops = {
+    .init = uring_init,
+    .destroy = uring_destroy,
+    .add_connection = uring_add_connection,
+    .close_connection = uring_close_connection,
+    .release_connection = uring_release_connection,
+    .resume_connection = uring_resume_connection,
+    .run_once = uring_run_once
+};
+
+#endif /* HAVE_IO_URING */
@@ -2,6 +2,10 @@
 // Created by s.fionov on 25.11.16.
 //
 
+// clock_gettime(), posix_memalign() and fileno() are not declared in strict C99 mode, syscall() needs _DEFAULT_SOURCE
+#define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE
+
 #include <stdio.h>
 #include <errno.h>
 #include <memory.h>
@@ -19,9 +23,40 @@
 #endif /* !defined(ANDROID) */
 
 #define TIME_FORMAT "%d.%m.%Y %H:%M:%S%z"
+// Flush thread wakes up at least once per this interval
+#define LOGGER_FLUSH_INTERVAL_MS 50
+#define CACHE_LINE_SIZE 64
+
+/*
+ * Bounded multi-producer single-consumer ring of log records.
+ * Each slot has sequence number: slot is free for producer at position `pos' if sequence == pos,
+ * and contains record for consumer if sequence == pos + 1.
+ */
+typedef struct {
+    size_t              sequence;
+    logger_record       record;
+} logger_slot;
+
+struct logger_ring {
+    logger_slot             slots[LOGGER_RING_CAPACITY];
+    logger_batch_callback_t batch_callback;
+    pthread_t               thread;
+    pthread_mutex_t         lock;
+    pthread_cond_t          cond;
+    int                     stop;
+
+    // Producers side
+    size_t                  enqueue_pos __attribute__((aligned(CACHE_LINE_SIZE)));
+    size_t                  dropped;
+
+    // Flush thread side
+    size_t                  dequeue_pos __attribute__((aligned(CACHE_LINE_SIZE)));
+    logger_record           batch[LOGGER_BATCH_SIZE];
+};
 
 static const char *log_level_name(int level);
 static void logger_log_to_file(logger *ctx, logger_log_level_t log_level, const char *thread_info, const char *message);
+static void *logger_flush_thread(void *arg);
 
 logger *logger_open(const char *filename, logger_log_level_t log_level, logger_callback_t callback, void *attachment) {
     logger *ctx = calloc(1, sizeof(logger));
@@ -44,10 +79,145 @@ logger *logger_open(const char *filename, logger_log_level_t log_level, logger_c
     }
     ctx->log_level = log_level;
     ctx->attachment = attachment;
+    return ctx;
+}
+
+logger *logger_open_batched(logger_log_level_t log_level, logger_batch_callback_t callback, void *attachment) {
+    struct logger_ring *ring;
+    if (callback == NULL || posix_memalign((void **) &ring, CACHE_LINE_SIZE, sizeof(struct logger_ring)) != 0) {
+        return NULL;
+    }
+    memset(ring, 0, sizeof(struct logger_ring));
+    for (size_t i = 0; i < LOGGER_RING_CAPACITY; i++) {
+        ring->slots[i].sequence = i;
+    }
+    ring->batch_callback = callback;
+
+    logger *ctx = calloc(1, sizeof(logger));
+    if (ctx == NULL) {
+        free(ring);
+        return NULL;
+    }
+    pthread_mutex_init(&ring->lock, NULL);
+    pthread_cond_init(&ring->cond, NULL);
+    ctx->log_level = log_level;
+    ctx->attachment = attachment;
+    ctx->ring = ring;
+    if (pthread_create(&ring->thread, NULL, logger_flush_thread, ctx) != 0) {
+        pthread_cond_destroy(&ring->cond);
+        pthread_mutex_destroy(&ring->lock);
+        free(ring);
+        free(ctx);
+        return NULL;
+    }
+    return ctx;
+}
+
+/**
+ * Puts record into ring of batched logger (internal function).
+ * Doesn't block: if ring is full, record is dropped.
+ */
+static void logger_ring_put(struct logger_ring *ring, logger_log_level_t log_level,
+                            const char *thread_info, const char *fmt, va_list args) {
+    size_t pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+    logger_slot *slot;
+    for (;;) {
+        slot = &ring->slots[pos % LOGGER_RING_CAPACITY];
+        size_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+        if (sequence == pos) {
+            if (__atomic_compare_exchange_n(&ring->enqueue_pos, &pos, pos + 1, 1,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if ((ssize_t) (sequence - pos) < 0) {
+            __atomic_add_fetch(&ring->dropped, 1, __ATOMIC_RELAXED);
+            return;
+        } else {
+            pos = __atomic_load_n(&ring->enqueue_pos, __ATOMIC_RELAXED);
+        }
+    }
+
+    slot->record.log_level = log_level;
+    snprintf(slot->record.thread_info, LOGGER_THREAD_INFO_SIZE, "%s", thread_info);
+    vsnprintf(slot->record.message, LOGGER_MESSAGE_SIZE, fmt, args);
+    __atomic_store_n(&slot->sequence, pos + 1, __ATOMIC_RELEASE);
+
+    if ((pos + 1) % LOGGER_BATCH_SIZE == 0) {
+        // Full batch is ready, don't wait for flush interval
+        pthread_cond_signal(&ring->cond);
+    }
+}
+
+/**
+ * Passes all records from ring to batch callback (internal function)
+ */
+static void logger_ring_flush(logger *ctx) {
+    struct logger_ring *ring = ctx->ring;
+    size_t count = 0;
+    for (;;) {
+        logger_slot *slot = &ring->slots[ring->dequeue_pos % LOGGER_RING_CAPACITY];
+        if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) != ring->dequeue_pos + 1) {
+            break;
+        }
+        ring->batch[count++] = slot->record;
+        // Slot may be reused by producers after that
+        __atomic_store_n(&slot->sequence, ring->dequeue_pos + LOGGER_RING_CAPACITY, __ATOMIC_RELEASE);
+        ring->dequeue_pos++;
+        if (count == LOGGER_BATCH_SIZE) {
+            ring->batch_callback(ctx, ring->batch, count);
+            count = 0;
+        }
+    }
+
+    size_t dropped = __atomic_exchange_n(&ring->dropped, 0, __ATOMIC_RELAXED);
+    if (dropped > 0) {
+        logger_record *record = &ring->batch[count++];
+        record->log_level = LOG_LEVEL_WARN;
+        snprintf(record->thread_info, LOGGER_THREAD_INFO_SIZE, "[logger]");
+        snprintf(record->message, LOGGER_MESSAGE_SIZE, "%zu log records dropped", dropped);
+    }
+    if (count > 0) {
+        ring->batch_callback(ctx, ring->batch, count);
+    }
+}
+
+static void *logger_flush_thread(void *arg) {
+    logger *ctx = arg;
+    struct logger_ring *ring = ctx->ring;
+    pthread_mutex_lock(&ring->lock);
+    while (!ring->stop) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += LOGGER_FLUSH_INTERVAL_MS * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&ring->cond, &ring->lock, &deadline);
+        pthread_mutex_unlock(&ring->lock);
+        logger_ring_flush(ctx);
+        pthread_mutex_lock(&ring->lock);
+    }
+    pthread_mutex_unlock(&ring->lock);
+    // Records logged before logger_close()
+    logger_ring_flush(ctx);
+    return NULL;
 }
 
 int logger_close(logger *ctx) {
     int r = 0;
+    struct logger_ring *ring = ctx->ring;
+    if (ring != NULL) {
+        pthread_mutex_lock(&ring->lock);
+        ring->stop = 1;
+        pthread_cond_signal(&ring->cond);
+        pthread_mutex_unlock(&ring->lock);
+        pthread_join(ring->thread, NULL);
+        pthread_cond_destroy(&ring->cond);
+        pthread_mutex_destroy(&ring->lock);
+        free(ring);
+        ctx->ring = NULL;
+    }
     if (ctx->log_file) {
         fflush(ctx->log_file);
         if (fileno(ctx->log_file) < 3 && fclose(ctx->log_file) != 0) {
@@ -91,13 +261,18 @@ static const char *log_level_name(int level) {
 }
 
 void logger_log(logger *ctx, logger_log_level_t log_level, const char *message, ...) {
+    if (!logger_is_enabled(ctx, log_level)) {
+        return;
+    }
     va_list args;
     va_start(args, message);
-    if (ctx->callback_func && log_level <= ctx->log_level) {
-        char fmt_message[256];
-        vsnprintf(fmt_message, 256, message, args);
-        char thread_info[64];
-        snprintf(thread_info, 64, "[tid=%ld]", (long int) gettid());
+    char thread_info[LOGGER_THREAD_INFO_SIZE];
+    snprintf(thread_info, LOGGER_THREAD_INFO_SIZE, "[tid=%ld]", (long int) gettid());
+    if (ctx->ring != NULL) {
+        logger_ring_put(ctx->ring, log_level, thread_info, message, args);
+    } else {
+        char fmt_message[LOGGER_MESSAGE_SIZE];
+        vsnprintf(fmt_message, LOGGER_MESSAGE_SIZE, message, args);
         ctx->callback_func(ctx, log_level, thread_info, fmt_message);
     }
     va_end(args);
@@ -22,14 +22,46 @@ typedef enum {
     LOG_LEVEL_TRACE = 4
 } logger_log_level_t;
 
+/**
+ * Maximum length of formatted message and thread info (including terminating zero)
+ */
+#define LOGGER_MESSAGE_SIZE 256
+#define LOGGER_THREAD_INFO_SIZE 64
+
+/**
+ * Number of records in ring of batched logger
+ */
+#define LOGGER_RING_CAPACITY 1024
+
+/**
+ * Maximum number of records passed to batch callback at once
+ */
+#define LOGGER_BATCH_SIZE 64
+
 struct logger;
 typedef struct logger logger;
 
+struct logger_ring;
+
+/**
+ * Log record of batched logger
+ */
+typedef struct {
+    logger_log_level_t log_level;
+    char thread_info[LOGGER_THREAD_INFO_SIZE];
+    char message[LOGGER_MESSAGE_SIZE];
+} logger_record;
+
 /**
  * Logger callback type
  */
 typedef void (*logger_callback_t)(logger *ctx, logger_log_level_t log_level, const char *thread_info, const char *message);
 
+/**
+ * Batched logger callback type. Called from logger flush thread.
+ */
+typedef void (*logger_batch_callback_t)(logger *ctx, const logger_record *records, size_t count);
+
 /**
  * Logger context definition
  */
@@ -38,6 +70,8 @@ struct logger {
     FILE *log_file;
     logger_log_level_t log_level;
     void *attachment;
+    // Record ring and flush thread of batched logger, NULL for other loggers
+    struct logger_ring *ring;
 };
 
 /**
@@ -49,6 +83,27 @@ struct logger {
  */
 extern logger *logger_open(const char *filename, logger_log_level_t log_level, logger_callback_t callback, void *attachment);
 
+/**
+ * Initialize batched logger. Records are formatted by logging thread and put into lock-free ring
+ * without blocking, then they are passed to callback in batches by separate flush thread.
+ * If ring is full, records are dropped, and the number of dropped records is logged later.
+ * @param log_level Logger log level
+ * @param callback Batch callback
+ * @param attachment Attachment
+ * @return Logger context, or NULL if flush thread can't be started
+ */
+extern logger *logger_open_batched(logger_log_level_t log_level, logger_batch_callback_t callback, void *attachment);
+
+/**
+ * Checks if message with given log level will be logged, so it is worth formatting
+ * @param ctx Logger context
+ * @param log_level Log level
+ * @return True if message will be logged
+ */
+static inline int logger_is_enabled(const logger *ctx, logger_log_level_t log_level) {
+    return log_level <= ctx->log_level && (ctx->callback_func != NULL || ctx->ring != NULL);
+}
+
 /**
  * Log message
  * @param ctx Logger context
@@ -73,7 +128,7 @@ extern void logger_set_log_level(logger *ctx, logger_log_level_t log_level);
 extern int logger_is_open(logger *ctx);
 
 /**
- * Close logger
+ * Close logger. Batched logger delivers remaining records and stops flush thread.
  * @param ctx Logger context
  * @return 0 if success
  */
@@ -0,0 +1,273 @@
+/*
+ *  Compact binary HTTP message format.
+ *  Numbers are read and written byte by byte, so encoded buffer needs no alignment
+ *  and has the same layout on all platforms.
+ */
+#include <stdint.h>
+#include <string.h>
+#include <strings.h>
+
+#include "message_binary.h"
+
+#define HEADER_SIZE 40
+#define FIELD_SIZE 20
+
+// Offsets of header members
+#define OFFSET_LENGTH 4
+#define OFFSET_STATUS_CODE 8
+#define OFFSET_FIELD_COUNT 12
+#define OFFSET_METHOD 16
+#define OFFSET_URL 24
+#define OFFSET_STATUS 32
+
+/*
+ * Well-known field names, ID is index + 1.
+ * IDs are part of format, so names may only be appended.
+ */
+static const char *const known_names[] = {
+        "Host", "User-Agent", "Accept", "Accept-Encoding", "Accept-Language",
+        "Accept-Ranges", "Age", "Authorization", "Cache-Control", "Connection",
+        "Content-Encoding", "Content-Length", "Content-Range", "Content-Security-Policy", "Content-Type",
+        "Cookie", "Date", "ETag", "Expires", "If-Modified-Since",
+        "If-None-Match", "Keep-Alive", "Last-Modified", "Location", "Origin",
+        "Pragma", "Proxy-Connection", "Range", "Referer", "Server",
+        "Set-Cookie", "Strict-Transport-Security", "Transfer-Encoding", "Upgrade", "Vary",
+        "Via", "X-Frame-Options"
+};
+
+#define KNOWN_NAME_COUNT (sizeof(known_names) / sizeof(known_names[0]))
+
+static inline void put_u32(unsigned char *out, uint32_t value) {
+    out[0] = (unsigned char) value;
+    out[1] = (unsigned char) (value >> 8);
+    out[2] = (unsigned char) (value >> 16);
+    out[3] = (unsigned char) (value >> 24);
+}
+
+static inline uint32_t get_u32(const unsigned char *in) {
+    return in[0] | ((uint32_t) in[1] << 8) | ((uint32_t) in[2] << 16) | ((uint32_t) in[3] << 24);
+}
+
+/**
+ * Finds ID of well-known field name, case of name must match
+ * @param name Field name
+ * @param length Length of field name
+ * @return Name ID, or 0 if name isn't well-known
+ */
+static uint32_t known_name_id(const char *name, size_t length) {
+    for (uint32_t i = 0; i < KNOWN_NAME_COUNT; i++) {
+        if (known_names[i][0] == name[0] && strlen(known_names[i]) == length
+            && memcmp(known_names[i], name, length) == 0) {
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Gets size of string in string table
+ * @param str String (may be NULL)
+ * @return Size of string with null byte, 0 for NULL
+ */
+static inline size_t string_size(const char *str) {
+    return str != NULL ? strlen(str) + 1 : 0;
+}
+
+/**
+ * Writes string reference and copies string to string table
+ * @param buffer Output buffer
+ * @param ref Offset of reference in buffer
+ * @param p_offset Pointer to offset of free space in string table
+ * @param str String (may be NULL)
+ */
+static void put_string(unsigned char *buffer, size_t ref, size_t *p_offset, const char *str) {
+    if (str == NULL) {
+        put_u32(buffer + ref, 0);
+        put_u32(buffer + ref + 4, 0);
+        return;
+    }
+    size_t length = strlen(str);
+    memcpy(buffer + *p_offset, str, length + 1);
+    put_u32(buffer + ref, (uint32_t) *p_offset);
+    put_u32(buffer + ref + 4, (uint32_t) length);
+    *p_offset += length + 1;
+}
+
+int http_message_encode_binary(const http_message *message, char *buffer, size_t capacity, size_t *p_needed) {
+    if (message == NULL || p_needed == NULL) return PARSER_NULL_POINTER_ERROR;
+
+    size_t length = HEADER_SIZE + (size_t) message->field_count * FIELD_SIZE
+                    + string_size(message->method) + string_size(message->url) + string_size(message->status);
+    for (unsigned int i = 0; i < message->field_count; i++) {
+        const char *name = message->fields[i].name;
+        if (name != NULL && known_name_id(name, strlen(name)) == 0) {
+            length += strlen(name) + 1;
+        }
+        length += string_size(message->fields[i].value);
+    }
+    *p_needed = length;
+    if (length > UINT32_MAX) return PARSER_INVALID_ARGUMENT_ERROR;
+    if (capacity < length) return PARSER_BUFFER_TOO_SMALL_ERROR;
+    if (buffer == NULL) return PARSER_NULL_POINTER_ERROR;
+
+    unsigned char *out = (unsigned char *) buffer;
+    memcpy(out, HTTP_MESSAGE_BINARY_MAGIC, 4);
+    put_u32(out + OFFSET_LENGTH, (uint32_t) length);
+    put_u32(out + OFFSET_STATUS_CODE, message->status_code);
+    put_u32(out + OFFSET_FIELD_COUNT, message->field_count);
+    size_t offset = HEADER_SIZE + (size_t) message->field_count * FIELD_SIZE;
+    put_string(out, OFFSET_METHOD, &offset, message->method);
+    put_string(out, OFFSET_URL, &offset, message->url);
+    put_string(out, OFFSET_STATUS, &offset, message->status);
+    for (unsigned int i = 0; i < message->field_count; i++) {
+        const http_header_field *field = &message->fields[i];
+        size_t entry = HEADER_SIZE + (size_t) i * FIELD_SIZE;
+        uint32_t id = field->name != NULL ? known_name_id(field->name, strlen(field->name)) : 0;
+        put_u32(out + entry, id);
+        put_string(out, entry + 4, &offset, id != 0 ? NULL : field->name);
+        put_string(out, entry + 12, &offset, field->value);
+    }
+    return 0;
+}
+
+/**
+ * Checks string reference of encoded message
+ * @param data Encoded message
+ * @param length Length of encoded message
+ * @param strings Offset of string table
+ * @param ref Offset of reference
+ * @return True if reference is NULL or points to null-terminated string inside string table
+ */
+static int check_string(const unsigned char *data, size_t length, size_t strings, size_t ref) {
+    size_t offset = get_u32(data + ref);
+    size_t str_length = get_u32(data + ref + 4);
+    if (offset == 0) {
+        return str_length == 0;
+    }
+    return offset >= strings && offset < length && str_length < length - offset && data[offset + str_length] == '\0';
+}
+
+int http_message_view_init(http_message_view *view, const void *buffer, size_t length) {
+    if (view == NULL || buffer == NULL) return PARSER_NULL_POINTER_ERROR;
+    const unsigned char *data = buffer;
+    if (length < HEADER_SIZE || memcmp(data, HTTP_MESSAGE_BINARY_MAGIC, 4) != 0) {
+        return PARSER_INVALID_ARGUMENT_ERROR;
+    }
+    size_t encoded_length = get_u32(data + OFFSET_LENGTH);
+    size_t field_count = get_u32(data + OFFSET_FIELD_COUNT);
+    if (encoded_length < HEADER_SIZE || encoded_length > length || field_count > (encoded_length - HEADER_SIZE) / FIELD_SIZE) {
+        return PARSER_INVALID_ARGUMENT_ERROR;
+    }
+    size_t strings = HEADER_SIZE + field_count * FIELD_SIZE;
+    if (!check_string(data, encoded_length, strings, OFFSET_METHOD)
+        || !check_string(data, encoded_length, strings, OFFSET_URL)
+        || !check_string(data, encoded_length, strings, OFFSET_STATUS)) {
+        return PARSER_INVALID_ARGUMENT_ERROR;
+    }
+    for (size_t i = 0; i < field_count; i++) {
+        size_t entry = HEADER_SIZE + i * FIELD_SIZE;
+        uint32_t id = get_u32(data + entry);
+        if (id > KNOWN_NAME_COUNT || (id != 0 && get_u32(data + entry + 4) != 0)
+            || !check_string(data, encoded_length, strings, entry + 4)
+            || !check_string(data, encoded_length, strings, entry + 12)) {
+            return PARSER_INVALID_ARGUMENT_ERROR;
+        }
+    }
+    view->data = data;
+    view->length = encoded_length;
+    view->status_code = get_u32(data + OFFSET_STATUS_CODE);
+    view->field_count = (unsigned int) field_count;
+    return 0;
+}
+
+size_t http_message_view_length(const http_message_view *view) {
+    return view->length;
+}
+
+/**
+ * Gets string of encoded message
+ * @param view Pointer to view
+ * @param ref Offset of string reference
+ * @param p_length Pointer to variable where length of string will be stored (may be NULL)
+ * @return String, or NULL if reference is NULL
+ */
+static const char *view_string(const http_message_view *view, size_t ref, size_t *p_length) {
+    uint32_t offset = get_u32(view->data + ref);
+    if (p_length != NULL) {
+        *p_length = get_u32(view->data + ref + 4);
+    }
+    return offset != 0 ? (const char *) view->data + offset : NULL;
+}
+
+const char *http_message_view_method(const http_message_view *view, size_t *p_length) {
+    return view_string(view, OFFSET_METHOD, p_length);
+}
+
+const char *http_message_view_url(const http_message_view *view, size_t *p_length) {
+    return view_string(view, OFFSET_URL, p_length);
+}
+
+const char *http_message_view_status(const http_message_view *view, size_t *p_length) {
+    return view_string(view, OFFSET_STATUS, p_length);
+}
+
+int http_message_view_field(const http_message_view *view, unsigned int i, http_header_field_view *p_field) {
+    if (view == NULL || p_field == NULL) return PARSER_NULL_POINTER_ERROR;
+    if (i >= view->field_count) return PARSER_INVALID_ARGUMENT_ERROR;
+    size_t entry = HEADER_SIZE + (size_t) i * FIELD_SIZE;
+    uint32_t id = get_u32(view->data + entry);
+    if (id != 0) {
+        p_field->name = known_names[id - 1];
+        p_field->name_length = strlen(p_field->name);
+    } else {
+        p_field->name = view_string(view, entry + 4, &p_field->name_length);
+    }
+    p_field->value = view_string(view, entry + 12, &p_field->value_length);
+    return 0;
+}
+
+const char *http_message_view_find_header_field(const http_message_view *view, const char *name,
+                                                size_t name_length, size_t *p_value_length) {
+    if (view == NULL || name == NULL || name_length == 0) return NULL;
+    http_header_field_view field;
+    for (unsigned int i = 0; i < view->field_count; i++) {
+        http_message_view_field(view, i, &field);
+        if (field.name != NULL && field.name_length == name_length
+            && strncasecmp(field.name, name, name_length) == 0) {
+            if (p_value_length != NULL) {
+                *p_value_length = field.value_length;
+            }
+            return field.value;
+        }
+    }
+    return NULL;
+}
+
+http_message *http_message_view_to_message(const http_message_view *view) {
+    if (view == NULL) return NULL;
+    http_message *message = http_message_create();
+    if (message == NULL) return NULL;
+    const char *str;
+    size_t length;
+    if ((str = http_message_view_method(view, &length)) != NULL) {
+        http_message_set_method(message, str, length);
+    }
+    if ((str = http_message_view_url(view, &length)) != NULL) {
+        http_message_set_url(message, str, length);
+    }
+    if ((str = http_message_view_status(view, &length)) != NULL) {
+        http_message_set_status(message, str, length);
+    }
+    if (view->status_code != 0) {
+        http_message_set_status_code(message, view->status_code);
+    }
+    http_header_field_view field;
+    for (unsigned int i = 0; i < view->field_count; i++) {
+        http_message_view_field(view, i, &field);
+        if (field.name != NULL) {
+            http_message_append_header_field(message, field.name, field.name_length,
+                                             field.value, field.value_length);
+        }
+    }
+    return message;
+}
@@ -0,0 +1,131 @@
+/*
+ *  Compact binary HTTP message format API.
+ *  Encoded message is one contiguous relocatable buffer without pointers, so it may be
+ *  cached on disk, mmapped or passed to another process, and read there through
+ *  a read-only view without parsing and allocation.
+ */
+#ifndef HTTP_PARSER_MESSAGE_BINARY_H
+#define HTTP_PARSER_MESSAGE_BINARY_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "parser.h"
+
+/*
+ *  Format (all numbers are 32-bit little-endian):
+ *    header:  magic "HMB1", total length, status code, field count,
+ *             method, url and status string references
+ *    fields:  field count entries of well-known name ID, name reference, value reference
+ *    strings: null-terminated strings
+ *  String reference is offset from the beginning of buffer and length, offset 0 means NULL.
+ *  Fields with well-known names (e.g. "Content-Type") have non-zero name ID and no name string.
+ */
+#define HTTP_MESSAGE_BINARY_MAGIC "HMB1"
+
+/**
+ * Read-only view of encoded message. Buffer must be valid while view is used.
+ */
+typedef struct {
+    const unsigned char     *data;
+    size_t                  length;
+    unsigned int            status_code;
+    unsigned int            field_count;
+} http_message_view;
+
+/**
+ * Header field of encoded message. Strings are null-terminated and point into encoded buffer
+ * or into static table of well-known names.
+ */
+typedef struct {
+    const char              *name;
+    size_t                  name_length;
+    const char              *value;
+    size_t                  value_length;
+} http_header_field_view;
+
+/**
+ * Encodes HTTP message into caller-provided buffer
+ * @param message Pointer to HTTP message
+ * @param buffer Output buffer (may be NULL if capacity is 0)
+ * @param capacity Size of output buffer
+ * @param p_needed Pointer to variable where length of encoded message will be stored
+ * @return 0 if success, PARSER_BUFFER_TOO_SMALL_ERROR if buffer is too small
+ */
+int http_message_encode_binary(const http_message *message, char *buffer, size_t capacity, size_t *p_needed);
+
+/**
+ * Initializes view of encoded message. All string references are checked here,
+ * so view accessors may be used with buffers from untrusted storage.
+ * @param view Pointer to view
+ * @param buffer Encoded message
+ * @param length Length of buffer (may be greater than length of encoded message)
+ * @return 0 if success, PARSER_INVALID_ARGUMENT_ERROR if buffer isn't a valid encoded message
+ */
+int http_message_view_init(http_message_view *view, const void *buffer, size_t length);
+
+/**
+ * Gets encoded length of message from its view
+ * @param view Pointer to view
+ * @return Length of encoded message
+ */
+size_t http_message_view_length(const http_message_view *view);
+
+/**
+ * Gets method of encoded request
+ * @param view Pointer to view
+ * @param p_length Pointer to variable where length of method will be stored (may be NULL)
+ * @return Method, or NULL if it isn't set
+ */
+const char *http_message_view_method(const http_message_view *view, size_t *p_length);
+
+/**
+ * Gets URL of encoded request
+ * @param view Pointer to view
+ * @param p_length Pointer to variable where length of URL will be stored (may be NULL)
+ * @return URL, or NULL if it isn't set
+ */
+const char *http_message_view_url(const http_message_view *view, size_t *p_length);
+
+/**
+ * Gets status of encoded response
+ * @param view Pointer to view
+ * @param p_length Pointer to variable where length of status will be stored (may be NULL)
+ * @return Status, or NULL if it isn't set
+ */
+const char *http_message_view_status(const http_message_view *view, size_t *p_length);
+
+/**
+ * Gets header field of encoded message
+ * @param view Pointer to view
+ * @param i Field index
+ * @param p_field Pointer to variable where field will be stored
+ * @return 0 if success, PARSER_INVALID_ARGUMENT_ERROR if there is no such field
+ */
+int http_message_view_field(const http_message_view *view, unsigned int i, http_header_field_view *p_field);
+
+/**
+ * Finds value of header field of encoded message with given name, ignoring case of name.
+ * If there are several fields with this name, the first one is found.
+ * @param view Pointer to view
+ * @param name Field name (character array)
+ * @param name_length Length of field name character array
+ * @param p_value_length Pointer to variable where length of value will be stored (may be NULL)
+ * @return Field value, or NULL if there is no such field
+ */
+const char *http_message_view_find_header_field(const http_message_view *view, const char *name,
+                                                size_t name_length, size_t *p_value_length);
+
+/**
+ * Creates HTTP message from its view, e.g. to change cached message
+ * @param view Pointer to view
+ * @return New message (should be freed by http_message_free()), or NULL if it can't be allocated
+ */
+http_message *http_message_view_to_message(const http_message_view *view);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HTTP_PARSER_MESSAGE_BINARY_H */
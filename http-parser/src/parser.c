@@ -2,10 +2,15 @@
  *  HTTP parser internals.
  *  Based on http parser API from Node.js project. 
  */
+#include <ctype.h>
+#include <pthread.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/queue.h>
+#include <sys/uio.h>
 
 #include "nodejs_http_parser/http_parser.h"
 #include "parser.h"
@@ -16,6 +21,101 @@
 #define PARSER_LOG(args...) logger_log(parser_ctx->log, args)
 #define CTX_LOG(args...) logger_log(context->parser_ctx->log, args)
 
+/*
+ * Reference counted storage.
+ * Strings and field arrays of messages are shared between clones. Reference count is stored
+ * before data, so strings are still usual null-terminated strings for readers.
+ * Shared storage is immutable, it is copied before change (see rc_unique()).
+ */
+typedef union {
+    unsigned int refcount;
+    // Keep data aligned for field arrays (max_align_t is not available in C99)
+    long double align_ld;
+    long long align_ll;
+    void *align_ptr;
+} rc_header;
+
+#define RC_HEADER(ptr) ((rc_header *) (ptr) - 1)
+
+/**
+ * Allocates reference counted storage with reference count 1
+ * @param size Size of data
+ * @return Pointer to data
+ */
+static void *rc_alloc(size_t size) {
+    rc_header *header = malloc(sizeof(rc_header) + size);
+    if (header == NULL) {
+        return NULL;
+    }
+    header->refcount = 1;
+    return header + 1;
+}
+
+/**
+ * Changes size of reference counted storage, which must not be shared
+ * @param ptr Pointer to data (may be NULL)
+ * @param size New size of data
+ * @return Pointer to data
+ */
+static void *rc_realloc(void *ptr, size_t size) {
+    if (ptr == NULL) {
+        return rc_alloc(size);
+    }
+    rc_header *header = realloc(RC_HEADER(ptr), sizeof(rc_header) + size);
+    return header != NULL ? header + 1 : NULL;
+}
+
+/**
+ * Adds reference to storage
+ * @param ptr Pointer to data (may be NULL)
+ * @return Pointer to data
+ */
+static inline void *rc_retain(const void *ptr) {
+    if (ptr != NULL) {
+        __atomic_add_fetch(&RC_HEADER(ptr)->refcount, 1, __ATOMIC_RELAXED);
+    }
+    return (void *) ptr;
+}
+
+/**
+ * Removes reference to storage without freeing it
+ * @param ptr Pointer to data (may be NULL)
+ * @return True if this was the last reference, then caller must free storage by rc_free()
+ */
+static inline int rc_unref(void *ptr) {
+    return ptr != NULL && __atomic_sub_fetch(&RC_HEADER(ptr)->refcount, 1, __ATOMIC_ACQ_REL) == 0;
+}
+
+/**
+ * Frees storage which has no references
+ * @param ptr Pointer to data
+ */
+static inline void rc_free(void *ptr) {
+    free(RC_HEADER(ptr));
+}
+
+/**
+ * Removes reference to storage
+ * @param ptr Pointer to data (may be NULL)
+ * @return True if this was the last reference and storage is freed
+ */
+static inline int rc_release(void *ptr) {
+    if (!rc_unref(ptr)) {
+        return 0;
+    }
+    rc_free(ptr);
+    return 1;
+}
+
+/**
+ * Checks if storage is referenced only by caller, so it may be changed
+ * @param ptr Pointer to data
+ * @return True if storage isn't shared
+ */
+static inline int rc_unique(const void *ptr) {
+    return __atomic_load_n(&RC_HEADER(ptr)->refcount, __ATOMIC_ACQUIRE) == 1;
+}
+
 /**
  * Create HTTP message
  * @param message Pointer to variable where pointer to newly allocated message will be placed
@@ -25,22 +125,283 @@ static inline void create_http_message(http_message **message) {
     memset(*message, 0, sizeof(http_message));
 }
 
+/*
+ * Small-string arena.
+ * Short field names and values are stored in chunks of message arena instead of separate heap strings,
+ * they are never freed separately. Chunks are reference counted storage shared with clones.
+ * Only unshared chunk is appended to, otherwise new chunk is started which keeps reference to previous one.
+ */
+// Maximum size of string in arena, including null byte
+#define ARENA_STRING_SIZE 24
+#define ARENA_CHUNK_MIN_SIZE 128
+#define ARENA_CHUNK_MAX_SIZE 4096
+
+struct http_string_arena {
+    // Previous chunk, its strings may be still used by fields
+    struct http_string_arena *previous;
+    size_t used;
+    size_t size;
+    char data[];
+};
+
+/**
+ * Allocates string in arena of message
+ * @param message Pointer to HTTP message
+ * @param size Size of string, including null byte (not more than ARENA_STRING_SIZE)
+ * @return Pointer to string, or NULL if chunk can't be allocated
+ */
+static char *arena_alloc(http_message *message, size_t size) {
+    struct http_string_arena *arena = message->arena;
+    if (arena == NULL || arena->size - arena->used < size || !rc_unique(arena)) {
+        size_t chunk_size = arena != NULL && arena->size < ARENA_CHUNK_MAX_SIZE ? arena->size * 2 : ARENA_CHUNK_MIN_SIZE;
+        struct http_string_arena *chunk = rc_alloc(sizeof(struct http_string_arena) + chunk_size);
+        if (chunk == NULL) {
+            return NULL;
+        }
+        // Reference of message is moved to the new chunk
+        chunk->previous = arena;
+        chunk->used = 0;
+        chunk->size = chunk_size;
+        message->arena = arena = chunk;
+    }
+    char *str = arena->data + arena->used;
+    arena->used += size;
+    return str;
+}
+
+/**
+ * Removes reference to arena, chunks are freed with their last references
+ * @param arena Arena (may be NULL)
+ */
+static void arena_release(struct http_string_arena *arena) {
+    while (rc_unref(arena)) {
+        struct http_string_arena *previous = arena->previous;
+        rc_free(arena);
+        arena = previous;
+    }
+}
+
+// Flags of http_header_field.arena_flags
+#define FIELD_NAME_ARENA 1
+#define FIELD_VALUE_ARENA 2
+
+/**
+ * Adds reference to strings of field which are stored on heap
+ * @param field Pointer to header field
+ */
+static inline void field_retain(const http_header_field *field) {
+    if (!(field->arena_flags & FIELD_NAME_ARENA)) {
+        rc_retain(field->name);
+    }
+    if (!(field->arena_flags & FIELD_VALUE_ARENA)) {
+        rc_retain(field->value);
+    }
+}
+
+/**
+ * Removes reference to strings of field which are stored on heap
+ * @param field Pointer to header field
+ */
+static inline void field_release(http_header_field *field) {
+    if (!(field->arena_flags & FIELD_NAME_ARENA)) {
+        rc_release(field->name);
+    }
+    if (!(field->arena_flags & FIELD_VALUE_ARENA)) {
+        rc_release(field->value);
+    }
+}
+
+/**
+ * Removes reference to field array, fields are freed with the last reference
+ * @param fields Field array (may be NULL)
+ * @param count Number of fields
+ */
+static void release_fields(http_header_field *fields, unsigned int count) {
+    // Only the thread which removes the last reference may release strings of fields
+    if (!rc_unref(fields)) {
+        return;
+    }
+    for (unsigned int i = 0; i < count; i++) {
+        field_release(&fields[i]);
+    }
+    rc_free(fields);
+}
+
+/**
+ * Makes field array of message unshared before its change.
+ * Only array is copied, field names and values are still shared until they are changed.
+ * @param message Pointer to HTTP message
+ */
+static void unshare_fields(http_message *message) {
+    http_header_field *fields = message->fields;
+    if (fields == NULL || rc_unique(fields)) {
+        return;
+    }
+    message->fields = rc_alloc(message->field_count * sizeof(http_header_field));
+    memcpy(message->fields, fields, message->field_count * sizeof(http_header_field));
+    for (unsigned int i = 0; i < message->field_count; i++) {
+        field_retain(&message->fields[i]);
+    }
+    release_fields(fields, message->field_count);
+}
+
 /**
  * Destroy HTTP message, including its state and field variables
  * @param message Pointer to HTTP message
  */
 static void destroy_http_message(http_message *message) {
-    free(message->url);
-    free(message->status);
-    free(message->method);
-    for (int i = 0; i < message->field_count; i++) {
-        free(message->fields[i].name);
-        free(message->fields[i].value);
-    }
-    free(message->fields);
+    rc_release(message->url);
+    rc_release(message->status);
+    rc_release(message->method);
+    release_fields(message->fields, message->field_count);
+    free(message->index);
+    arena_release(message->arena);
+    rc_release(message->raw);
     free(message);
 }
 
+/*
+ * Case-insensitive header field name index.
+ * Open addressing hash table, fields with equal names are found in order of insertion.
+ */
+// Messages with less fields are scanned without index
+#define HEADER_INDEX_MIN_FIELDS 8
+
+typedef struct {
+    unsigned int hash;
+    // Field index + 1, or 0 if slot is empty
+    unsigned int field;
+} http_header_index_slot;
+
+struct http_header_index {
+    size_t mask;
+    http_header_index_slot slots[];
+};
+
+/**
+ * Calculates case-insensitive hash of field name (FNV-1a)
+ * @param name Field name
+ * @param length Length of field name
+ * @return Hash value
+ */
+static unsigned int header_name_hash(const char *name, size_t length) {
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char) tolower((unsigned char) name[i]);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Checks if field name is equal to given name ignoring case
+ * @param field_name Null-terminated field name (may be NULL)
+ * @param name Name
+ * @param length Length of name
+ * @return True if names are equal
+ */
+static inline int header_name_equals(const char *field_name, const char *name, size_t length) {
+    if (field_name == name) {
+        // Interned names are compared by pointer
+        return field_name != NULL && field_name[length] == '\0';
+    }
+    return field_name != NULL && strncasecmp(field_name, name, length) == 0 && field_name[length] == '\0';
+}
+
+/**
+ * Drops header field index, should be called after fields are added, removed or renamed
+ * @param message Pointer to HTTP message
+ */
+static inline void header_index_invalidate(http_message *message) {
+    free(message->index);
+    message->index = NULL;
+}
+
+/**
+ * Builds header field index
+ * @param message Pointer to HTTP message
+ * @return Index, or NULL if it can't be allocated
+ */
+static struct http_header_index *header_index_build(http_message *message) {
+    size_t size = 1;
+    while (size < message->field_count * 2) {
+        size <<= 1;
+    }
+    struct http_header_index *index = calloc(1, sizeof(struct http_header_index) + size * sizeof(http_header_index_slot));
+    if (index == NULL) {
+        return NULL;
+    }
+    index->mask = size - 1;
+    for (unsigned int i = 0; i < message->field_count; i++) {
+        const char *name = message->fields[i].name;
+        if (name == NULL) {
+            continue;
+        }
+        unsigned int hash = header_name_hash(name, strlen(name));
+        size_t pos = hash & index->mask;
+        while (index->slots[pos].field != 0) {
+            pos = (pos + 1) & index->mask;
+        }
+        index->slots[pos].hash = hash;
+        index->slots[pos].field = i + 1;
+    }
+    return index;
+}
+
+/**
+ * Gets header field index, building it on first call.
+ * Lookups don't change message otherwise, so index is published atomically and concurrent
+ * lookups on the same message are safe: if two threads build it, one of indices is dropped.
+ * @param message Pointer to HTTP message
+ * @return Index, or NULL if it can't be allocated
+ */
+static struct http_header_index *header_index_get(http_message *message) {
+    struct http_header_index *index = __atomic_load_n(&message->index, __ATOMIC_ACQUIRE);
+    if (index != NULL) {
+        return index;
+    }
+    if ((index = header_index_build(message)) == NULL) {
+        return NULL;
+    }
+    struct http_header_index *published = NULL;
+    if (!__atomic_compare_exchange_n(&message->index, &published, index, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+        free(index);
+        return published;
+    }
+    return index;
+}
+
+/**
+ * Finds header field by name ignoring case
+ * @param message Pointer to HTTP message
+ * @param name Field name
+ * @param length Length of field name
+ * @return Field, or NULL if there is no such field
+ */
+static http_header_field *header_index_find(http_message *message, const char *name, size_t length) {
+    if (message->field_count < HEADER_INDEX_MIN_FIELDS) {
+        for (unsigned int i = 0; i < message->field_count; i++) {
+            if (header_name_equals(message->fields[i].name, name, length)) {
+                return &message->fields[i];
+            }
+        }
+        return NULL;
+    }
+
+    struct http_header_index *index = header_index_get(message);
+    if (index == NULL) {
+        return NULL;
+    }
+    unsigned int hash = header_name_hash(name, length);
+    for (size_t pos = hash & index->mask; index->slots[pos].field != 0; pos = (pos + 1) & index->mask) {
+        http_header_field *field = &message->fields[index->slots[pos].field - 1];
+        if (index->slots[pos].hash == hash && header_name_equals(field->name, name, length)) {
+            return field;
+        }
+    }
+    return NULL;
+}
+
 /**
  * External interface for destroy_http_message()
  * @param message Pointer to HTTP message
@@ -54,38 +415,42 @@ void http_message_free(http_message *message) {
  * @param message Pointer to HTTP message
  */
 static void add_http_header_param(http_message *message) {
+    header_index_invalidate(message);
+    unshare_fields(message);
+    // Parser resets this flag when header block of parsed message is attached
+    message->dirty = 1;
     message->field_count++;
-    if (message->fields == NULL) {
-        message->fields = malloc(sizeof(http_header_field));
-        memset(message->fields, 0, sizeof(http_header_field));
-    } else {
-        message->fields = realloc(message->fields, message->field_count * sizeof(http_header_field));
-        memset(&message->fields[message->field_count - 1], 0, sizeof(http_header_field));
-    }
+    message->fields = rc_realloc(message->fields, message->field_count * sizeof(http_header_field));
+    memset(&message->fields[message->field_count - 1], 0, sizeof(http_header_field));
 }
 
 /**
- * Appends chars from character array `src' to null-terminated string `dst'
- * @param dst Pointer to null-terminated string (may be reallocated)
+ * Appends chars from character array `src' to null-terminated reference counted string `dst'
+ * @param dst Pointer to null-terminated string (may be reallocated or copied, if it is shared)
  * @param src Character array
  * @param len Length of character array
  */
 static inline void append_chars(char **dst, const char *src, size_t len) {
-    size_t old_len;
+    size_t old_len = 0;
     if (*dst == NULL) {
-        *dst = malloc(len + 1);
-        old_len = 0;
-    } else {
+        *dst = rc_alloc(len + 1);
+    } else if (rc_unique(*dst)) {
         old_len = strlen(*dst);
-        *dst = realloc(*dst, old_len + len + 1);
+        *dst = rc_realloc(*dst, old_len + len + 1);
+    } else {
+        char *shared = *dst;
+        old_len = strlen(shared);
+        *dst = rc_alloc(old_len + len + 1);
+        memcpy(*dst, shared, old_len);
+        rc_release(shared);
     }
     memcpy(*dst + old_len, src, len);
     (*dst)[old_len + len] = 0;
 }
 
 /**
- * Appends bytes from character array `src' to character array `dst'
- * `dst' may contain null bytes.
+ * Appends bytes from character array `src' to reference counted character array `dst'
+ * `dst' may contain null bytes and must not be shared.
  * @param dst Pointer to character array (may be reallocated)
  * @param dst_len Pointer to variable that contains length on `dst' array
  * @param src Character array
@@ -95,24 +460,90 @@ static inline void append_bytes(char **dst, size_t *dst_len, const char *src, si
     if (*dst == NULL) {
         *dst_len = 0;
     }
-    *dst = realloc(*dst, *dst_len + len + 1);
+    *dst = rc_realloc(*dst, *dst_len + len + 1);
     memcpy(*dst + *dst_len, src, len);
     (*dst)[*dst_len + len] = 0;
     *dst_len += len;
 }
 
 /**
- * Copy characters from `src' characted array to dst null-terminated string
- * @param dst Pointer to null-terminated string (may be reallocated)
+ * Copy characters from `src' characted array to dst null-terminated reference counted string
+ * @param dst Pointer to null-terminated string (may be reallocated, shared string is released)
  * @param src Character array
  * @param len Length of character array
  */
 static inline void set_chars(char **dst, const char *src, size_t len) {
-    *dst = realloc(*dst, len + 1);
+    if (*dst != NULL && rc_unique(*dst)) {
+        *dst = rc_realloc(*dst, len + 1);
+    } else {
+        rc_release(*dst);
+        *dst = rc_alloc(len + 1);
+    }
     memcpy(*dst, src, len);
     (*dst)[len] = 0;
 }
 
+/**
+ * Copies characters to name or value of field, short strings are stored in arena of message
+ * @param message Pointer to HTTP message which owns field
+ * @param field Pointer to header field
+ * @param flag FIELD_NAME_ARENA for name or FIELD_VALUE_ARENA for value
+ * @param src Character array (may be old string of field)
+ * @param len Length of character array
+ */
+static void field_set_chars(http_message *message, http_header_field *field, int flag,
+                            const char *src, size_t len) {
+    char **dst = flag == FIELD_NAME_ARENA ? &field->name : &field->value;
+    char *str = len < ARENA_STRING_SIZE ? arena_alloc(message, len + 1) : NULL;
+    if (str == NULL) {
+        if (field->arena_flags & flag) {
+            *dst = NULL;
+            field->arena_flags &= ~flag;
+        }
+        set_chars(dst, src, len);
+        return;
+    }
+    memcpy(str, src, len);
+    str[len] = 0;
+    if (!(field->arena_flags & flag)) {
+        rc_release(*dst);
+    }
+    *dst = str;
+    field->arena_flags |= flag;
+}
+
+/**
+ * Appends characters to name or value of field, string is moved to heap when it becomes long
+ * @param message Pointer to HTTP message which owns field
+ * @param field Pointer to header field
+ * @param flag FIELD_NAME_ARENA for name or FIELD_VALUE_ARENA for value
+ * @param src Character array
+ * @param len Length of character array
+ */
+static void field_append_chars(http_message *message, http_header_field *field, int flag,
+                               const char *src, size_t len) {
+    char **dst = flag == FIELD_NAME_ARENA ? &field->name : &field->value;
+    if (*dst == NULL) {
+        field_set_chars(message, field, flag, src, len);
+        return;
+    }
+    if (!(field->arena_flags & flag)) {
+        append_chars(dst, src, len);
+        return;
+    }
+    // String in arena isn't changed, since it may be shared with clones
+    size_t old_len = strlen(*dst);
+    char *str = old_len + len < ARENA_STRING_SIZE ? arena_alloc(message, old_len + len + 1) : NULL;
+    if (str == NULL) {
+        str = rc_alloc(old_len + len + 1);
+        field->arena_flags &= ~flag;
+    }
+    memcpy(str, *dst, old_len);
+    memcpy(str + old_len, src, len);
+    str[old_len + len] = 0;
+    *dst = str;
+}
+
 /**
  * Content-Encoding enum type.
  * Encoding supported by this library - `identity', `deflate' and `gzip'
@@ -125,6 +556,17 @@ typedef enum {
 
 typedef struct parser_context parser_context;
 
+/**
+ * Events of http_parser which are handled by parser_execute() after http_parser_execute() returns
+ */
+typedef enum {
+    HEADER_EVENT_NONE = 0,
+    // First byte of message is consumed
+    HEADER_EVENT_MESSAGE_BEGIN,
+    // Last byte of header block is reached (but not consumed)
+    HEADER_EVENT_HEADERS_COMPLETE
+} header_event_t;
+
 /*
  * Connection context structure
  */
@@ -137,6 +579,8 @@ struct connection_context { /* structure has name for queue.h macros */
     error_type_t            body_callback_error;
     // Connection info (endpoint names), not used by any current language bindings
     connection_info         *info;
+    // User data (e.g. language binding callbacks object)
+    void                    *user_data;
     // Parser callbacks
     parser_callbacks        *callbacks;
     // Pointer to Node.js http_parser implementation
@@ -161,10 +605,23 @@ struct connection_context { /* structure has name for queue.h macros */
     int                     body_started;
     // Decode is needed flag
     int                     need_decode;
+    // Input processing is paused by parser_connection_pause()
+    int                     paused;
+    // Original header blocks of messages are kept (copied from parser context on connect)
+    int                     keep_raw_headers;
+    // Event which stopped http_parser to let parser_execute() track header block
+    header_event_t          header_event;
+    // Header block of current message is being collected
+    int                     in_header_block;
+    // Part of header block collected from previous inputs
+    char                    *header_block;
+    size_t                  header_block_length;
     // Content-Encoding of body - identity (no encoding), deflate, gzip. Determined from headers.
     content_encoding_t      content_encoding;
     // Zlib decode input buffer. Contains tail on previous input buffer which can't be processed right now
+    // (e.g. because callback paused connection), grows if tail doesn't fit
     char                    *decode_in_buffer;
+    size_t                  decode_in_size;
     // Zlib decode output buffer. Contains currently decompressed data
     char                    *decode_out_buffer;
     // Zlib stream
@@ -187,6 +644,7 @@ typedef void (*body_data_callback)(connection_context *context, const char *at,
  * Initializes zlib stream for current HTTP message body.
  * Used internally by http_parser_on_body().
  */
+static int headers_received(connection_context *context);
 static int message_inflate_init(connection_context *context);
 /*
  * Inflate current input buffer and call body_data_callback for each decompressed chunk
@@ -229,6 +687,10 @@ struct parser_context {
     struct context_by_id context_by_id_hash[HASH_SIZE];
     int context_by_id_hash_initialized;
     logger *log;
+    // Intern table of header strings, NULL if interning is disabled
+    struct intern_table *interned;
+    // Original header blocks of parsed messages are kept, see parser_set_keep_raw_headers()
+    int keep_raw_headers;
 };
 
 static void context_by_id_init(parser_context *parser_ctx) {
@@ -267,6 +729,231 @@ static connection_context *context_by_id_remove(parser_context *parser_ctx, conn
     return NULL;
 }
 
+/*
+ * Intern table of header strings, shared by all connections of parser context.
+ * Table holds one reference to each reference counted string, so interned strings
+ * stay valid in messages after table is destroyed.
+ */
+// Longer strings aren't interned
+#define INTERN_MAX_LENGTH 128
+// Table isn't grown after this number of strings
+#define INTERN_MAX_COUNT 4096
+
+typedef struct {
+    unsigned int hash;
+    char *str;
+} intern_slot;
+
+/*
+ * Slot array of intern table. Slots are only added, so they are read without lock.
+ * When table is grown, previous arrays are kept until table is destroyed, since they may be still read.
+ */
+typedef struct intern_slots {
+    size_t mask;
+    struct intern_slots *previous;
+    intern_slot slots[];
+} intern_slots;
+
+struct intern_table {
+    // Serializes insertions
+    pthread_mutex_t lock;
+    int flags;
+    size_t count;
+    intern_slots *slots;
+};
+
+// Long values which are interned by default with PARSER_INTERN_VALUES (short values are stored in arena)
+static const char *const frequent_values[] = {
+        "text/html; charset=utf-8", "text/html; charset=UTF-8", "text/plain; charset=utf-8",
+        "text/css; charset=utf-8", "application/json; charset=utf-8", "application/javascript; charset=utf-8",
+        "application/x-www-form-urlencoded", "max-age=31536000; includeSubDomains",
+        "no-cache, no-store, must-revalidate",
+        "text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8",
+        "image/avif,image/webp,image/apng,image/svg+xml,image/*,*/*;q=0.8"
+};
+
+/**
+ * Calculates case-sensitive hash of string (FNV-1a)
+ * @param str String
+ * @param length Length of string
+ * @return Hash value
+ */
+static inline unsigned int intern_hash(const char *str, size_t length) {
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char) str[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Finds slot of string in slot array, may be called without lock
+ * @param slots Slot array
+ * @param str String
+ * @param length Length of string
+ * @param hash Hash of string
+ * @return Slot with this string, or empty slot where it may be inserted
+ */
+static intern_slot *intern_find(intern_slots *slots, const char *str, size_t length, unsigned int hash) {
+    size_t pos = hash & slots->mask;
+    const char *interned;
+    // Hash of slot is written before string is published
+    while ((interned = __atomic_load_n(&slots->slots[pos].str, __ATOMIC_ACQUIRE)) != NULL) {
+        if (slots->slots[pos].hash == hash && memcmp(interned, str, length) == 0 && interned[length] == '\0') {
+            break;
+        }
+        pos = (pos + 1) & slots->mask;
+    }
+    return &slots->slots[pos];
+}
+
+/**
+ * Allocates slot array
+ * @param size Number of slots (power of two)
+ * @return Slot array, or NULL if it can't be allocated
+ */
+static intern_slots *intern_slots_alloc(size_t size) {
+    intern_slots *slots = calloc(1, sizeof(intern_slots) + size * sizeof(intern_slot));
+    if (slots != NULL) {
+        slots->mask = size - 1;
+    }
+    return slots;
+}
+
+/**
+ * Gets interned copy of string
+ * @param table Intern table
+ * @param str String
+ * @param length Length of string
+ * @param insert Add string to table if it isn't interned yet
+ * @return Reference counted string with added reference, or NULL if string isn't interned
+ */
+static char *intern_get(struct intern_table *table, const char *str, size_t length, int insert) {
+    if (length > INTERN_MAX_LENGTH) {
+        return NULL;
+    }
+    unsigned int hash = intern_hash(str, length);
+    // Table holds reference to string, so it may be retained without lock
+    char *interned = intern_find(__atomic_load_n(&table->slots, __ATOMIC_ACQUIRE), str, length, hash)->str;
+    if (interned != NULL || !insert) {
+        return rc_retain(interned);
+    }
+
+    pthread_mutex_lock(&table->lock);
+    intern_slots *slots = table->slots;
+    intern_slot *slot = intern_find(slots, str, length, hash);
+    if (slot->str == NULL && table->count < INTERN_MAX_COUNT) {
+        if ((table->count + 1) * 2 > slots->mask + 1) {
+            // Table is grown to keep load factor below 1/2
+            intern_slots *grown = intern_slots_alloc((slots->mask + 1) * 2);
+            if (grown == NULL) {
+                pthread_mutex_unlock(&table->lock);
+                return NULL;
+            }
+            for (size_t i = 0; i <= slots->mask; i++) {
+                if (slots->slots[i].str != NULL) {
+                    size_t pos = slots->slots[i].hash & grown->mask;
+                    while (grown->slots[pos].str != NULL) {
+                        pos = (pos + 1) & grown->mask;
+                    }
+                    grown->slots[pos] = slots->slots[i];
+                }
+            }
+            grown->previous = slots;
+            __atomic_store_n(&table->slots, grown, __ATOMIC_RELEASE);
+            slots = grown;
+            slot = intern_find(slots, str, length, hash);
+        }
+        char *copy = rc_alloc(length + 1);
+        memcpy(copy, str, length);
+        copy[length] = 0;
+        slot->hash = hash;
+        __atomic_store_n(&slot->str, copy, __ATOMIC_RELEASE);
+        table->count++;
+    }
+    interned = rc_retain(slot->str);
+    pthread_mutex_unlock(&table->lock);
+    return interned;
+}
+
+/**
+ * Creates intern table
+ * @param flags PARSER_INTERN_* flags
+ * @return Intern table, or NULL if it can't be allocated
+ */
+static struct intern_table *intern_table_create(int flags) {
+    struct intern_table *table = calloc(1, sizeof(struct intern_table));
+    if (table == NULL) {
+        return NULL;
+    }
+    table->slots = intern_slots_alloc(64);
+    if (table->slots == NULL) {
+        free(table);
+        return NULL;
+    }
+    pthread_mutex_init(&table->lock, NULL);
+    table->flags = flags;
+    if (flags & PARSER_INTERN_VALUES) {
+        for (size_t i = 0; i < sizeof(frequent_values) / sizeof(frequent_values[0]); i++) {
+            rc_release(intern_get(table, frequent_values[i], strlen(frequent_values[i]), 1));
+        }
+    }
+    return table;
+}
+
+/**
+ * Destroys intern table, interned strings are freed when they aren't used by messages
+ * @param table Intern table (may be NULL)
+ */
+static void intern_table_destroy(struct intern_table *table) {
+    if (table == NULL) {
+        return;
+    }
+    for (size_t i = 0; i <= table->slots->mask; i++) {
+        rc_release(table->slots->slots[i].str);
+    }
+    intern_slots *slots = table->slots;
+    while (slots != NULL) {
+        intern_slots *previous = slots->previous;
+        free(slots);
+        slots = previous;
+    }
+    pthread_mutex_destroy(&table->lock);
+    free(table);
+}
+
+/**
+ * Replaces name or value of field by interned string.
+ * Names are added to table, values are only looked up among strings which are already interned.
+ * Short values are kept in arena, since interning doesn't save memory for them.
+ * @param table Intern table (may be NULL)
+ * @param field Pointer to header field
+ * @param flag FIELD_NAME_ARENA for name or FIELD_VALUE_ARENA for value
+ */
+static void field_intern(struct intern_table *table, http_header_field *field, int flag) {
+    int is_name = flag == FIELD_NAME_ARENA;
+    if (table == NULL || !(table->flags & (is_name ? PARSER_INTERN_NAMES : PARSER_INTERN_VALUES))) {
+        return;
+    }
+    char **dst = is_name ? &field->name : &field->value;
+    if (*dst == NULL) {
+        return;
+    }
+    if (!is_name && (field->arena_flags & flag)) {
+        return;
+    }
+    char *interned = intern_get(table, *dst, strlen(*dst), is_name);
+    if (interned == NULL) {
+        return;
+    }
+    if (!(field->arena_flags & flag)) {
+        rc_release(*dst);
+    }
+    *dst = interned;
+    field->arena_flags &= ~flag;
+}
+
 /*
  *  Internal callbacks:
  */
@@ -274,6 +961,11 @@ int http_parser_on_message_begin(http_parser *parser) {
     connection_context *context = CONTEXT(parser);
     CTX_LOG(LOG_LEVEL_TRACE, "http_parser_on_message_begin(parser=%p)", parser);
     create_http_message(&context->message);
+    if (context->keep_raw_headers) {
+        // Stop parser to find where header block starts
+        context->header_event = HEADER_EVENT_MESSAGE_BEGIN;
+        http_parser_pause(parser, 1);
+    }
     CTX_LOG(LOG_LEVEL_TRACE, "http_parser_on_message_begin() returned %d", 0);
     return 0;
 }
@@ -305,12 +997,24 @@ int http_parser_on_header_field(http_parser *parser, const char *at, size_t leng
     connection_context *context = CONTEXT(parser);
     CTX_LOG(LOG_LEVEL_TRACE, "http_parser_on_header_field(parser=%p, at=%.*s)", parser, (int) length, at);
     http_message *message = context->message;
+    if (message == NULL) {
+        // Message is detached by callback, trailing header fields are ignored
+        return 0;
+    }
     if (at != NULL && length > 0) {
         if (!context->in_field) {
             context->in_field = 1;
+            if (message->field_count > 0) {
+                // Value of previous field is complete
+                field_intern(context->parser_ctx->interned, &message->fields[message->field_count - 1],
+                             FIELD_VALUE_ARENA);
+            }
             add_http_header_param(message);
         }
-        append_chars(&message->fields[message->field_count - 1].name, at, length);
+        // Name is appended after field is added, so index may be built by this time
+        header_index_invalidate(message);
+        unshare_fields(message);
+        field_append_chars(message, &message->fields[message->field_count - 1], FIELD_NAME_ARENA, at, length);
     }
     CTX_LOG(LOG_LEVEL_TRACE, "http_parser_on_header_field() returned %d", 0);
     return 0;
@@ -320,11 +1024,20 @@ int http_parser_on_header_value(http_parser *parser, const char *at, size_t leng
     connection_context *context = CONTEXT(parser);
     CTX_LOG(LOG_LEVEL_TRACE, "http_parser_on_header_value(parser=%p, at=%.*s)", parser, (int) length, at);
     http_message *message = context->message;
+    int name_complete = context->in_field;
     context->in_field = 0;
+    if (message == NULL) {
+        return 0;
+    }
+    unshare_fields(message);
+    if (name_complete) {
+        field_intern(context->parser_ctx->interned, &message->fields[message->field_count - 1], FIELD_NAME_ARENA);
+    }
     if (at != NULL && length > 0) {
-        append_chars(&message->fields[message->field_count - 1].value, at, length);
-    } else {
-        message->fields[message->field_count - 1].value = calloc(1, 1);
+        field_append_chars(message, &message->fields[message->field_count - 1], FIELD_VALUE_ARENA, at, length);
+    } else if (message->fields[message->field_count - 1].value == NULL) {
+        // Empty part of value is passed when value ends at the start of input, don't lose value parts before it
+        field_set_chars(message, &message->fields[message->field_count - 1], FIELD_VALUE_ARENA, "", 0);
     }
     CTX_LOG(LOG_LEVEL_TRACE, "http_parser_on_header_value() returned %d", 0);
     return 0;
@@ -335,22 +1048,135 @@ int http_parser_on_headers_complete(http_parser *parser) {
     CTX_LOG(LOG_LEVEL_TRACE, "http_parser_on_headers_complete(parser=%p)", parser);
     http_message *message = context->message;
     const char *method;
+    if (message != NULL && message->field_count > 0) {
+        field_intern(context->parser_ctx->interned, &message->fields[message->field_count - 1], FIELD_VALUE_ARENA);
+    }
+    // Message may be detached by callback, so determine encoding before
+    context->content_encoding = get_content_encoding(context);
+    if (parser->type == HTTP_REQUEST) {
+        method = http_method_str(parser->method);
+        set_chars(&message->method, method, strlen(method));
+    }
     int skip = 0;
-    switch (parser->type) {
+    if (context->keep_raw_headers) {
+        // Stop parser, message is passed to callbacks by parser_execute() when header block is attached to it
+        context->header_event = HEADER_EVENT_HEADERS_COMPLETE;
+        http_parser_pause(parser, 1);
+    } else {
+        skip = headers_received(context);
+    }
+
+    CTX_LOG(LOG_LEVEL_TRACE, "http_parser_on_headers_complete() returned %d", skip);
+    return skip;
+}
+
+/**
+ * Passes message with complete header section to callbacks
+ * @param context Connection context
+ * @return 1 if message body should be skipped, 2 if connection is upgraded, 0 otherwise
+ */
+static int headers_received(connection_context *context) {
+    switch (context->parser->type) {
         case HTTP_REQUEST:
-            method = http_method_str(parser->method);
-            set_chars(&message->method, method, strlen(method));
-            skip = context->callbacks->http_request_received(context, message);
-            break;
+            return context->callbacks->http_request_received(context, context->message);
         case HTTP_RESPONSE:
-            skip = context->callbacks->http_response_received(context, message);
-            break;
+            return context->callbacks->http_response_received(context, context->message);
         default:
-            break;
+            return 0;
     }
+}
 
-    CTX_LOG(LOG_LEVEL_TRACE, "http_parser_on_headers_complete() returned %d", skip);
-    return skip;
+/**
+ * Appends part of input to header block of current message
+ * @param context Connection context
+ * @param data Part of header block
+ * @param length Length of data
+ */
+static void header_block_append(connection_context *context, const char *data, size_t length) {
+    if (length > 0) {
+        append_bytes(&context->header_block, &context->header_block_length, data, length);
+    }
+}
+
+/**
+ * Drops collected header block
+ * @param context Connection context
+ */
+static void header_block_reset(connection_context *context) {
+    rc_release(context->header_block);
+    context->header_block = NULL;
+    context->header_block_length = 0;
+    context->in_header_block = 0;
+}
+
+/**
+ * Finds end of header line, including folded continuation lines
+ * @param raw Header block
+ * @param length Length of header block
+ * @param offset Offset of line
+ * @return Offset after LF of line, or 0 if line isn't terminated
+ */
+static size_t header_line_end(const char *raw, size_t length, size_t offset) {
+    for (;;) {
+        const char *lf = memchr(raw + offset, '\n', length - offset);
+        if (lf == NULL) {
+            return 0;
+        }
+        offset = lf - raw + 1;
+        if (offset == length || (raw[offset] != ' ' && raw[offset] != '\t')) {
+            return offset;
+        }
+    }
+}
+
+/**
+ * Attaches collected header block to current message and finds spans of start line and fields in it.
+ * If header block doesn't correspond to parsed fields, message is left without it.
+ * @param context Connection context
+ */
+static void header_block_attach(connection_context *context) {
+    http_message *message = context->message;
+    char *raw = context->header_block;
+    size_t length = context->header_block_length;
+    context->header_block = NULL;
+    header_block_reset(context);
+    if (message == NULL || raw == NULL) {
+        rc_release(raw);
+        return;
+    }
+
+    // Skip empty lines before message
+    size_t start = 0;
+    while (start < length && (raw[start] == '\r' || raw[start] == '\n')) {
+        start++;
+    }
+    if (start > 0) {
+        memmove(raw, raw + start, length - start);
+        length -= start;
+    }
+
+    size_t offset = header_line_end(raw, length, 0);
+    size_t start_line_length = offset;
+    for (unsigned int i = 0; i < message->field_count && offset != 0; i++) {
+        size_t end = header_line_end(raw, length, offset);
+        message->fields[i].raw_offset = offset;
+        message->fields[i].raw_length = end - offset;
+        offset = end;
+    }
+    // The rest is empty line
+    if (offset == 0 || !((length - offset == 1 && raw[offset] == '\n') ||
+                         (length - offset == 2 && raw[offset] == '\r' && raw[offset + 1] == '\n'))) {
+        CTX_LOG(LOG_LEVEL_DEBUG, "Header block doesn't match parsed message, it will be rebuilt");
+        for (unsigned int i = 0; i < message->field_count; i++) {
+            message->fields[i].raw_length = 0;
+        }
+        rc_release(raw);
+        return;
+    }
+    message->raw = raw;
+    message->raw_length = length;
+    message->raw_start_line_length = start_line_length;
+    message->dirty = 0;
 }
 
 int http_parser_on_body(http_parser *parser, const char *at, size_t length) {
@@ -385,6 +1211,9 @@ int http_parser_on_body(http_parser *parser, const char *at, size_t length) {
                 r = PARSER_ZLIB_ERROR;
                 goto out;
             }
+        } else {
+            // Body is passed as is
+            context->content_encoding = CONTENT_ENCODING_IDENTITY;
         }
         context->body_started = 1;
     }
@@ -413,10 +1242,10 @@ static void set_error(connection_context *context, const char *msg) {
  */
 static int message_inflate_init(connection_context *context) {
     CTX_LOG(LOG_LEVEL_TRACE, "message_inflate_init()");
-    context->content_encoding = get_content_encoding(context);
     if (!context->need_decode || context->content_encoding == CONTENT_ENCODING_IDENTITY) {
         // Uncompressed
         context->decode_in_buffer = NULL;
+        context->decode_in_size = 0;
         context->decode_out_buffer = NULL;
         return 0;
     }
@@ -424,6 +1253,7 @@ static int message_inflate_init(connection_context *context) {
     memset(&context->zlib_stream, 0, sizeof(z_stream));
     context->decode_in_buffer = malloc(ZLIB_DECOMPRESS_CHUNK_SIZE);
     memset(context->decode_in_buffer, 0, ZLIB_DECOMPRESS_CHUNK_SIZE);
+    context->decode_in_size = ZLIB_DECOMPRESS_CHUNK_SIZE;
     context->decode_out_buffer = malloc(ZLIB_DECOMPRESS_CHUNK_SIZE);
     memset(context->decode_out_buffer, 0, ZLIB_DECOMPRESS_CHUNK_SIZE);
 
@@ -449,6 +1279,9 @@ static content_encoding_t get_content_encoding(connection_context *context) {
     char *field_name = "Content-Encoding";
     size_t value_length;
     const char *value = http_message_get_header_field(message, field_name, strlen(field_name), &value_length);
+    if (value == NULL) {
+        return CONTENT_ENCODING_IDENTITY;
+    }
     if (!strncasecmp(value, "gzip", value_length) || !strncasecmp(value, "x-gzip", value_length)) {
         return CONTENT_ENCODING_GZIP;
     } else if (!strncasecmp(value, "deflate", value_length)) {
@@ -458,6 +1291,29 @@ static content_encoding_t get_content_encoding(connection_context *context) {
     }
 }
 
+/**
+ * Makes sure that zlib input buffer can hold given number of bytes
+ * @param context Connection context
+ * @param size Required size
+ * @return 0 if success, 1 if buffer can't be grown
+ */
+static int decode_in_reserve(connection_context *context, size_t size) {
+    if (size <= context->decode_in_size) {
+        return 0;
+    }
+    size_t new_size = context->decode_in_size * 2;
+    if (new_size < size) {
+        new_size = size;
+    }
+    char *buffer = realloc(context->decode_in_buffer, new_size);
+    if (buffer == NULL) {
+        return 1;
+    }
+    context->decode_in_buffer = buffer;
+    context->decode_in_size = new_size;
+    return 0;
+}
+
 /**
  * Decompress stream
  * @param context Connection context
@@ -478,14 +1334,17 @@ static int message_inflate(connection_context *context, const char *data, size_t
     }
 
     // If we have a data in input buffer, append new data to it, otherwise process `data' as input buffer
-    if (context->zlib_stream.avail_in > 0) {
-        context->zlib_stream.next_in = (Bytef *) context->decode_in_buffer;
-        if (context->zlib_stream.avail_in + length > ZLIB_DECOMPRESS_CHUNK_SIZE) {
-            result = Z_BUF_ERROR;
+    int buffered = context->zlib_stream.avail_in > 0;
+    if (buffered) {
+        if (decode_in_reserve(context, context->zlib_stream.avail_in + length) != 0) {
+            result = Z_MEM_ERROR;
             goto error;
         }
-        memcpy(context->decode_in_buffer + context->zlib_stream.avail_in, data, length);
-        context->zlib_stream.avail_in += (uInt) length;
+        context->zlib_stream.next_in = (Bytef *) context->decode_in_buffer;
+        if (length > 0) {
+            memcpy(context->decode_in_buffer + context->zlib_stream.avail_in, data, length);
+            context->zlib_stream.avail_in += (uInt) length;
+        }
     } else {
         context->zlib_stream.next_in = (Bytef *) data;
         context->zlib_stream.avail_in = (uInt) length;
@@ -507,11 +1366,17 @@ static int message_inflate(connection_context *context, const char *data, size_t
         if (result != Z_OK) {
             goto error;
         }
-    } while (context->zlib_stream.avail_in > 0 && old_avail_in != context->zlib_stream.avail_in);
+        // Callback paused connection, the rest of input is decompressed on parser_connection_resume()
+    } while (!context->paused && context->zlib_stream.avail_in > 0 && old_avail_in != context->zlib_stream.avail_in);
 
     // Move unprocessed tail to the start of input buffer
     if (context->zlib_stream.avail_in) {
-        memcpy(context->decode_in_buffer, context->zlib_stream.next_in, context->zlib_stream.avail_in);
+        // Tail of caller's input may be larger than buffer if callback paused connection
+        if (!buffered && decode_in_reserve(context, context->zlib_stream.avail_in) != 0) {
+            result = Z_MEM_ERROR;
+            goto error;
+        }
+        memmove(context->decode_in_buffer, context->zlib_stream.next_in, context->zlib_stream.avail_in);
     }
 
     goto finish;
@@ -536,6 +1401,7 @@ static int message_inflate_end(connection_context *context) {
     int result = inflateEnd(&context->zlib_stream);
     free(context->decode_in_buffer);
     context->decode_in_buffer = NULL;
+    context->decode_in_size = 0;
     free(context->decode_out_buffer);
     context->decode_out_buffer = NULL;
     return result;
@@ -615,9 +1481,35 @@ int parser_destroy(parser_context *parser_ctx) {
             }
         }
     }
+    intern_table_destroy(parser_ctx->interned);
+    parser_ctx->interned = NULL;
     PARSER_LOG(LOG_LEVEL_TRACE, "parser_destroy() finished.");
 }
 
+int parser_set_interning(parser_context *parser_ctx, int flags) {
+    if (parser_ctx == NULL) return PARSER_NULL_POINTER_ERROR;
+    if (parser_ctx->interned != NULL || flags == 0) return PARSER_INVALID_ARGUMENT_ERROR;
+    if (flags & ~(PARSER_INTERN_NAMES | PARSER_INTERN_VALUES)) return PARSER_INVALID_ARGUMENT_ERROR;
+    if ((parser_ctx->interned = intern_table_create(flags)) == NULL) return PARSER_OUT_OF_MEMORY_ERROR;
+    PARSER_LOG(LOG_LEVEL_TRACE, "parser_set_interning(flags=%d)", flags);
+    return 0;
+}
+
+int parser_set_keep_raw_headers(parser_context *parser_ctx, int enabled) {
+    if (parser_ctx == NULL) return PARSER_NULL_POINTER_ERROR;
+    parser_ctx->keep_raw_headers = enabled != 0;
+    PARSER_LOG(LOG_LEVEL_TRACE, "parser_set_keep_raw_headers(enabled=%d)", enabled);
+    return 0;
+}
+
+const char *parser_intern(parser_context *parser_ctx, const char *str, size_t length) {
+    if (parser_ctx == NULL || parser_ctx->interned == NULL || str == NULL) return NULL;
+    char *interned = intern_get(parser_ctx->interned, str, length, 1);
+    // Table keeps its own reference until parser context is destroyed
+    rc_release(interned);
+    return interned;
+}
+
 int parser_connect(parser_context *parser_ctx, connection_id_t id, parser_callbacks *callbacks, connection_context **p_context) {
     PARSER_LOG(LOG_LEVEL_TRACE, "parser_connect(id=%d, callbacks=%p, p_context=%p)", (int)id, callbacks, p_context);
     connection_context *context = context_by_id_get(parser_ctx, id);
@@ -636,6 +1528,7 @@ int parser_connect(parser_context *parser_ctx, connection_id_t id, parser_callba
 
     context->id = id;
     context->callbacks = callbacks;
+    context->keep_raw_headers = parser_ctx->keep_raw_headers;
 
     context->settings = &_settings;
     context->parser = malloc(sizeof(http_parser));
@@ -667,12 +1560,17 @@ void parser_reset(connection_context *context) {
         destroy_http_message(context->message);
     }
     context->message = 0;
+    header_block_reset(context);
     context->have_body = 0;
     context->body_started = 0;
     context->content_encoding = CONTENT_ENCODING_IDENTITY;
 
     /* Re-init parser before next message. */
     http_parser_init(context->parser, HTTP_BOTH);
+    if (context->paused) {
+        // Connection was paused by body finished callback, keep it paused
+        http_parser_pause(context->parser, 1);
+    }
 }
 
 int parser_disconnect(connection_context *context, transfer_direction_t direction) {
@@ -687,6 +1585,70 @@ int parser_disconnect(connection_context *context, transfer_direction_t directio
     return 0;
 }
 
+/**
+ * Runs http_parser on input data.
+ * If header blocks are kept, http_parser is stopped by message begin and headers complete callbacks,
+ * so original header block of message can be collected from input and attached to message
+ * before it is passed to callbacks.
+ * @param context Connection context
+ * @param data Input data
+ * @param length Length of input data
+ * @return Number of consumed bytes
+ */
+static size_t parser_execute(connection_context *context, const char *data, size_t length) {
+    http_parser *parser = context->parser;
+    size_t done = 0;
+    // Offset of header block of current message in this input
+    size_t header_start = 0;
+    for (;;) {
+        done += http_parser_execute(parser, context->settings, data + done, length - done);
+        header_event_t event = context->header_event;
+        if (event == HEADER_EVENT_NONE) {
+            break;
+        }
+        context->header_event = HEADER_EVENT_NONE;
+        http_parser_pause(parser, 0);
+        if (event == HEADER_EVENT_MESSAGE_BEGIN) {
+            header_block_reset(context);
+            context->in_header_block = 1;
+            header_start = done - 1;
+        } else {
+            // Parser stopped at the last LF of header block
+            if (context->in_header_block) {
+                header_block_append(context, data + header_start, done + 1 - header_start);
+            }
+            header_block_attach(context);
+            // Result is handled as http_parser handles result of on_headers_complete
+            switch (headers_received(context)) {
+                case 0:
+                    break;
+                case 2:
+                    parser->upgrade = 1;
+                    parser->flags |= F_SKIPBODY;
+                    break;
+                case 1:
+                    parser->flags |= F_SKIPBODY;
+                    break;
+                default:
+                    parser->http_errno = HPE_CB_headers_complete;
+                    break;
+            }
+            if (context->paused) {
+                // Paused by callback, the rest of input (starting with LF) will be passed again
+                break;
+            }
+        }
+        if (HTTP_PARSER_ERRNO(parser) != HPE_OK || done == length) {
+            break;
+        }
+    }
+    if (context->in_header_block && done > header_start) {
+        // Header block continues in next input
+        header_block_append(context, data + header_start, done - header_start);
+    }
+    return done;
+}
+
 #define INPUT_LENGTH_AT_ERROR 1
 
 int parser_input(connection_context *context, transfer_direction_t direction, const char *data,
@@ -695,16 +1657,25 @@ int parser_input(connection_context *context, transfer_direction_t direction, co
     // TODO: this is wrong, null bytes are allowed in content
     context->done = 0;
 
+    int r = 0;
+    if (context->paused) {
+        r = PARSER_PAUSED;
+        goto finish;
+    }
+
     if (HTTP_PARSER_ERRNO(context->parser) != HPE_OK || context->parser->type == HTTP_BOTH) {
         http_parser_init(context->parser, direction == DIRECTION_OUT ? HTTP_REQUEST : HTTP_RESPONSE);
     }
 
-    context->done = http_parser_execute(context->parser, context->settings,
-                                         data, length);
+    context->done = parser_execute(context, data, length);
 
-    int r = 0;
     while (context->done < length)
     {
+        if (context->paused) {
+            // Rest of input should be passed again after parser_connection_resume()
+            r = PARSER_PAUSED;
+            goto finish;
+        }
         if (HTTP_PARSER_ERRNO(context->parser) != HPE_OK) {
             enum http_errno http_parser_errno = HTTP_PARSER_ERRNO(context->parser);
             if (http_parser_errno != HPE_CB_body) {
@@ -720,18 +1691,61 @@ int parser_input(connection_context *context, transfer_direction_t direction, co
         }
 
         // Input was not fully processed, turn on slow mode
-        http_parser_execute(context->parser, context->settings,
-                             data + context->done, INPUT_LENGTH_AT_ERROR);
+        parser_execute(context, data + context->done, INPUT_LENGTH_AT_ERROR);
         context->done+=INPUT_LENGTH_AT_ERROR;
     }
+    if (context->paused) {
+        r = PARSER_PAUSED;
+    }
 
     finish:
     CTX_LOG(LOG_LEVEL_TRACE, "parser_input() returned %d", r);
     return r;
 }
 
+int parser_connection_pause(connection_context *context) {
+    CTX_LOG(LOG_LEVEL_TRACE, "parser_connection_pause(context=%p)", context);
+    if (HTTP_PARSER_ERRNO(context->parser) != HPE_OK && HTTP_PARSER_ERRNO(context->parser) != HPE_PAUSED) {
+        // Parser is in error state, nothing to pause
+        return PARSER_INVALID_ARGUMENT_ERROR;
+    }
+    context->paused = 1;
+    http_parser_pause(context->parser, 1);
+    return 0;
+}
+
+int parser_connection_resume(connection_context *context) {
+    CTX_LOG(LOG_LEVEL_TRACE, "parser_connection_resume(context=%p)", context);
+    int r = 0;
+    if (!context->paused) {
+        goto finish;
+    }
+    context->paused = 0;
+    http_parser_pause(context->parser, 0);
+
+    // Pass the rest of decompressed data which was held by pause
+    if (context->decode_out_buffer != NULL && context->zlib_stream.avail_in > 0) {
+        body_data_callback body_data = context->parser->type == HTTP_REQUEST ?
+                                       context->callbacks->http_request_body_data :
+                                       context->callbacks->http_response_body_data;
+        if (message_inflate(context, NULL, 0, body_data) != 0) {
+            set_error(context, context->zlib_stream.msg);
+            r = PARSER_ZLIB_ERROR;
+            goto finish;
+        }
+    }
+    if (context->paused) {
+        r = PARSER_PAUSED;
+    }
+
+    finish:
+    CTX_LOG(LOG_LEVEL_TRACE, "parser_connection_resume() returned %d", r);
+    return r;
+}
+
 int parser_connection_close(connection_context *context) {
     context_by_id_remove(context->parser_ctx, context->id);
+    header_block_reset(context);
     free(context);
     return 0;
 }
@@ -747,20 +1761,18 @@ http_message *http_message_create() {
 http_message *http_message_clone(const http_message *source) {
     http_message *message;
     create_http_message(&message);
-    if (source->url != NULL)
-        set_chars(&message->url, source->url, strlen(source->url));
-    if (source->status != NULL)
-        set_chars(&message->status, source->status, strlen(source->status));
-    if (source->method != NULL)
-        set_chars(&message->method, source->method, strlen(source->method));
+    // Storage is shared, it is copied by the first change
+    message->url = rc_retain(source->url);
+    message->status = rc_retain(source->status);
+    message->method = rc_retain(source->method);
     message->status_code = source->status_code;
-    for (int i = 0; i < source->field_count; i++) {
-        add_http_header_param(message);
-        set_chars(&message->fields[i].name, source->fields[i].name,
-                       strlen(source->fields[i].name));
-        set_chars(&message->fields[i].value, source->fields[i].value,
-                       strlen(source->fields[i].value));
-    }
+    message->fields = rc_retain(source->fields);
+    message->field_count = source->field_count;
+    message->arena = rc_retain(source->arena);
+    message->raw = rc_retain(source->raw);
+    message->raw_length = source->raw_length;
+    message->raw_start_line_length = source->raw_start_line_length;
+    message->dirty = source->dirty;
     return message;
 }
 
@@ -768,11 +1780,9 @@ int http_message_set_method(http_message *message,
                             const char *method, size_t length) {
     if (method == NULL) return 1;
     if (message == NULL) return 1;
-    if (message->method) {
-        free(message->method);
-        message->method = NULL;
-    }
     set_chars(&message->method, method, length);
+    message->raw_start_line_length = 0;
+    message->dirty = 1;
     return 0;
 }
 
@@ -780,11 +1790,9 @@ int http_message_set_url(http_message *message,
                          const char *url, size_t length) {
     if (url == NULL) return 1;
     if (message == NULL) return 1;
-    if (message->url) {
-        free(message->url);
-        message->url = NULL;
-    }
     set_chars(&message->url, url, length);
+    message->raw_start_line_length = 0;
+    message->dirty = 1;
     return 0;
 }
 
@@ -792,14 +1800,17 @@ int http_message_set_status(http_message *message,
                             const char *status, size_t length) {
     if (status == NULL) return 1;
     if (message == NULL) return 1;
-    if (message->status) free(message->status);
     set_chars(&message->status, status, length);
+    message->raw_start_line_length = 0;
+    message->dirty = 1;
     return 0;
 }
 
 int http_message_set_status_code(http_message *message, int status_code) {
     if (message == NULL) return 1;
     message->status_code = status_code;
+    message->raw_start_line_length = 0;
+    message->dirty = 1;
     return 0;
 }
 
@@ -810,13 +1821,94 @@ int http_message_set_header_field(http_message *message,
         value == NULL || value_length == 0 ) return 1;
     for (int i = 0; i < message->field_count; i++) {
         if (strncmp(message->fields[i].name, name, name_length) == 0) {
-            set_chars(&message->fields[i].value, value, value_length);
+            unshare_fields(message);
+            field_set_chars(message, &message->fields[i], FIELD_VALUE_ARENA, value, value_length);
+            message->fields[i].raw_length = 0;
+            message->dirty = 1;
             return 0;
         }
     }
     return  1;
 }
 
+const char *http_header_field_name(const http_header_field *field, size_t *p_length) {
+    if (field == NULL) return NULL;
+    const char *name = field->name;
+    if (p_length != NULL) {
+        *p_length = name != NULL ? strlen(name) : 0;
+    }
+    return name;
+}
+
+const char *http_header_field_value(const http_header_field *field, size_t *p_length) {
+    if (field == NULL) return NULL;
+    const char *value = field->value;
+    if (p_length != NULL) {
+        *p_length = value != NULL ? strlen(value) : 0;
+    }
+    return value;
+}
+
+const char *http_message_find_header_field(http_message *message, const char *name,
+                                           size_t name_length, size_t *p_value_length) {
+    if (message == NULL || name == NULL || name_length == 0) return NULL;
+    http_header_field *field = header_index_find(message, name, name_length);
+    if (field == NULL || field->value == NULL) {
+        return NULL;
+    }
+    if (p_value_length != NULL) {
+        *p_value_length = strlen(field->value);
+    }
+    return field->value;
+}
+
+void http_message_header_iter(http_message *message, const char *name, size_t name_length,
+                              http_header_iter *iter) {
+    memset(iter, 0, sizeof(http_header_iter));
+    if (message == NULL || name == NULL || name_length == 0) return;
+    iter->message = message;
+    iter->name = name;
+    iter->name_length = name_length;
+    struct http_header_index *index;
+    if (message->field_count >= HEADER_INDEX_MIN_FIELDS && (index = header_index_get(message)) != NULL) {
+        iter->indexed = 1;
+        iter->hash = header_name_hash(name, name_length);
+        iter->position = iter->hash & index->mask;
+    }
+}
+
+const char *http_header_iter_next(http_header_iter *iter, size_t *p_value_length) {
+    http_message *message = iter->message;
+    if (message == NULL) return NULL;
+    http_header_field *field = NULL;
+    if (iter->indexed) {
+        // Fields with equal names are found in order of insertion, until empty slot
+        struct http_header_index *index = __atomic_load_n(&message->index, __ATOMIC_ACQUIRE);
+        while (field == NULL && index->slots[iter->position].field != 0) {
+            http_header_index_slot *slot = &index->slots[iter->position];
+            if (slot->hash == iter->hash
+                && header_name_equals(message->fields[slot->field - 1].name, iter->name, iter->name_length)) {
+                field = &message->fields[slot->field - 1];
+            }
+            iter->position = (iter->position + 1) & index->mask;
+        }
+    } else {
+        while (field == NULL && iter->position < message->field_count) {
+            if (header_name_equals(message->fields[iter->position].name, iter->name, iter->name_length)) {
+                field = &message->fields[iter->position];
+            }
+            iter->position++;
+        }
+    }
+    if (field == NULL || field->value == NULL) {
+        return NULL;
+    }
+    if (p_value_length != NULL) {
+        *p_value_length = strlen(field->value);
+    }
+    return field->value;
+}
+
 const char *http_message_get_header_field(const http_message *message, const char *name,
                                           size_t name_length, size_t *p_value_length) {
     if (message == NULL || name == NULL || name_length == 0) return NULL;
@@ -836,9 +1928,20 @@ int http_message_add_header_field(http_message *message, const char *name, size_
             return 1;
     }
     add_http_header_param(message);
-    append_chars(&message->fields[message->field_count - 1].name,
-                 name, length);
-    message->fields[message->field_count - 1].value = calloc(1, 1);
+    field_set_chars(message, &message->fields[message->field_count - 1], FIELD_NAME_ARENA, name, length);
+    field_set_chars(message, &message->fields[message->field_count - 1], FIELD_VALUE_ARENA, "", 0);
+    return 0;
+}
+
+int http_message_append_header_field(http_message *message,
+                                     const char *name, size_t name_length,
+                                     const char *value, size_t value_length) {
+    if (message == NULL || name == NULL || name_length == 0) return 1;
+    if (value == NULL && value_length != 0) return 1;
+    add_http_header_param(message);
+    http_header_field *field = &message->fields[message->field_count - 1];
+    field_set_chars(message, field, FIELD_NAME_ARENA, name, name_length);
+    field_set_chars(message, field, FIELD_VALUE_ARENA, value != NULL ? value : "", value_length);
     return 0;
 }
 
@@ -846,55 +1949,346 @@ int http_message_del_header_field(http_message *message, const char *name, size_
     if (message == NULL || name == NULL || length == 0) return 1;
     for (int i = 0; i < message->field_count; i++) {
         if (strncasecmp(message->fields[i].name, name, length) == 0) {
-            free (message->fields[i].name);
-            free (message->fields[i].value);
+            unshare_fields(message);
+            field_release(&message->fields[i]);
             for (int j = i + 1; j < message->field_count; j++) {
-                message->fields[j - 1].name = message->fields[j].name;
-                message->fields[j - 1].value = message->fields[j].value;
+                message->fields[j - 1] = message->fields[j];
             }
             message->field_count--;
-            message->fields = realloc(message->fields, message->field_count * sizeof(http_header_field));
+            message->fields = rc_realloc(message->fields, message->field_count * sizeof(http_header_field));
+            header_index_invalidate(message);
+            message->dirty = 1;
             return 0;
         }
     }
     return 1;
 }
 
-char *http_message_raw(const http_message *message, size_t *p_length) {
-    char *out_buffer;
-    size_t length, line_length = 0;
+// Number of edits which are matched without allocation
+#define HEADER_EDITS_ON_STACK 16
 
-    if (message == NULL) return NULL;
+int http_message_apply_edits(http_message *message, const http_header_edit *edits, size_t count) {
+    if (message == NULL || (edits == NULL && count > 0)) return PARSER_NULL_POINTER_ERROR;
+    for (size_t e = 0; e < count; e++) {
+        if (edits[e].name == NULL || edits[e].name_length == 0 || edits[e].type > HTTP_HEADER_EDIT_RENAME
+            || (edits[e].type != HTTP_HEADER_EDIT_REMOVE && edits[e].value == NULL)
+            || (edits[e].type == HTTP_HEADER_EDIT_RENAME && edits[e].value_length == 0)) {
+            return PARSER_INVALID_ARGUMENT_ERROR;
+        }
+    }
+    if (count == 0) return 0;
+
+    // Flags of SET edits which found their field
+    char found_on_stack[HEADER_EDITS_ON_STACK];
+    char *found = found_on_stack;
+    if (count > HEADER_EDITS_ON_STACK) {
+        found = malloc(count);
+        if (found == NULL) return PARSER_OUT_OF_MEMORY_ERROR;
+    }
+    size_t added = 0;
+    for (size_t e = 0; e < count; e++) {
+        found[e] = 0;
+        if (edits[e].type == HTTP_HEADER_EDIT_SET || edits[e].type == HTTP_HEADER_EDIT_ADD) {
+            added++;
+        }
+    }
+
+    unshare_fields(message);
+    header_index_invalidate(message);
+    int changed = 0;
+    unsigned int kept = 0;
+    for (unsigned int i = 0; i < message->field_count; i++) {
+        http_header_field field = message->fields[i];
+        size_t name_length = field.name != NULL ? strlen(field.name) : 0;
+        const http_header_edit *rename = NULL;
+        int removed = 0;
+        for (size_t e = 0; e < count && !removed; e++) {
+            const http_header_edit *edit = &edits[e];
+            if (edit->name_length != name_length || strncasecmp(field.name, edit->name, name_length) != 0) {
+                continue;
+            }
+            changed = 1;
+            switch (edit->type) {
+                case HTTP_HEADER_EDIT_SET:
+                    if (found[e]) {
+                        // Only the first field with this name is kept
+                        removed = 1;
+                    } else {
+                        found[e] = 1;
+                        field_set_chars(message, &field, FIELD_VALUE_ARENA, edit->value, edit->value_length);
+                        field.raw_length = 0;
+                    }
+                    break;
+                case HTTP_HEADER_EDIT_REMOVE:
+                    removed = 1;
+                    break;
+                case HTTP_HEADER_EDIT_RENAME:
+                    // Applied after all edits are matched against original name
+                    rename = edit;
+                    break;
+                default:
+                    break;
+            }
+        }
+        if (removed) {
+            field_release(&field);
+            continue;
+        }
+        if (rename != NULL) {
+            field_set_chars(message, &field, FIELD_NAME_ARENA, rename->value, rename->value_length);
+            field.raw_length = 0;
+        }
+        message->fields[kept++] = field;
+    }
+
+    // Fields array is resized once, for all removed and added fields
+    for (size_t e = 0; e < count; e++) {
+        if (edits[e].type == HTTP_HEADER_EDIT_SET && found[e]) {
+            added--;
+        }
+    }
+    if (kept + added != message->field_count) {
+        message->fields = rc_realloc(message->fields, (kept + added) * sizeof(http_header_field));
+    }
+    message->field_count = kept;
+    for (size_t e = 0; e < count; e++) {
+        const http_header_edit *edit = &edits[e];
+        if (edit->type == HTTP_HEADER_EDIT_ADD || (edit->type == HTTP_HEADER_EDIT_SET && !found[e])) {
+            http_header_field *field = &message->fields[message->field_count++];
+            memset(field, 0, sizeof(http_header_field));
+            field_set_chars(message, field, FIELD_NAME_ARENA, edit->name, edit->name_length);
+            field_set_chars(message, field, FIELD_VALUE_ARENA, edit->value, edit->value_length);
+            changed = 1;
+        }
+    }
+    if (changed) {
+        message->dirty = 1;
+    }
+
+    if (found != found_on_stack) {
+        free(found);
+    }
+    return 0;
+}
 
-    if (message->status && message->status_code) {
-        length = strlen(HTTP_VERSION) + strlen(message->status) + 7;
-        out_buffer = malloc(length + 1);
-        memset(out_buffer, 0, length + 1);
-        snprintf(out_buffer, length + 1, "%s %u %s\r\n",
-                 HTTP_VERSION, message->status_code,
-                 message->status);
+/**
+ * Formats status code as decimal number
+ * @param buffer Output buffer, at least 10 characters
+ * @param status_code Status code
+ * @return Number of written characters
+ */
+static size_t format_status_code(char *buffer, unsigned int status_code) {
+    char digits[10];
+    size_t count = 0;
+    do {
+        digits[count++] = (char) ('0' + status_code % 10);
+        status_code /= 10;
+    } while (status_code != 0);
+    for (size_t i = 0; i < count; i++) {
+        buffer[i] = digits[count - 1 - i];
+    }
+    return count;
+}
+
+/**
+ * Copies string without null byte to output buffer
+ * @param out Output pointer
+ * @param str String (may be NULL)
+ * @param length Length of string
+ * @return Output pointer after copied string
+ */
+static inline char *raw_put(char *out, const char *str, size_t length) {
+    if (length != 0) {
+        memcpy(out, str, length);
+    }
+    return out + length;
+}
+
+/**
+ * Gets length of string which may be NULL
+ * @param str String (may be NULL)
+ * @return Length of string, 0 for NULL
+ */
+static inline size_t raw_strlen(const char *str) {
+    return str != NULL ? strlen(str) : 0;
+}
+
+// Separators of serialized message, pointed to by iovecs
+static const char SEPARATOR_SPACE[] = " ";
+static const char SEPARATOR_FIELD[] = ": ";
+static const char SEPARATOR_CRLF[] = "\r\n";
+
+/**
+ * Calculates length of serialized message header
+ * @param message Pointer to HTTP message
+ * @param status_code Buffer for formatted status code, at least HTTP_MESSAGE_IOV_BUFFER_SIZE characters
+ * @param p_status_code_length Pointer to variable where length of formatted status code will be stored
+ * @return Length of serialized message
+ */
+static size_t serialized_length(const http_message *message, char *status_code, size_t *p_status_code_length) {
+    static const size_t version_length = sizeof(HTTP_VERSION_1_1) - 1;
+    *p_status_code_length = 0;
+    if (message->raw != NULL && !message->dirty) {
+        return message->raw_length;
+    }
+
+    size_t length;
+    if (message->raw != NULL && message->raw_start_line_length != 0) {
+        length = message->raw_start_line_length;
+    } else if (message->status && message->status_code) {
+        *p_status_code_length = format_status_code(status_code, message->status_code);
+        // "<version> <code> <status>\r\n"
+        length = version_length + *p_status_code_length + strlen(message->status) + 4;
     } else {
-        length = strlen(HTTP_VERSION) + strlen(message->url) +
-                 strlen(message->method) + 4;
-        out_buffer = malloc(length + 1);
-        memset(out_buffer, 0, length + 1);
-        snprintf(out_buffer, length + 1, "%s %s %s\r\n",
-                 message->method, message->url, HTTP_VERSION);
+        // "<method> <url> <version>\r\n"
+        length = raw_strlen(message->method) + raw_strlen(message->url) + version_length + 4;
+    }
+    for (unsigned int i = 0; i < message->field_count; i++) {
+        if (message->raw != NULL && message->fields[i].raw_length != 0) {
+            length += message->fields[i].raw_length;
+        } else {
+            // "<name>: <value>\r\n"
+            length += raw_strlen(message->fields[i].name) + raw_strlen(message->fields[i].value) + 4;
+        }
     }
+    return length + 2;
+}
 
-    for (int i = 0; i < message->field_count; i++) {
-        line_length = strlen(message->fields[i].name) +
-                      strlen(message->fields[i].value) + 4;
-        out_buffer = realloc(out_buffer, length + line_length + 1);
-        snprintf(out_buffer + length, line_length + 1, "%s: %s\r\n",
-                 message->fields[i].name,
-                 message->fields[i].value);
-        length += line_length;
+int http_message_serialize_into(const http_message *message, char *buffer, size_t capacity, size_t *p_needed) {
+    static const size_t version_length = sizeof(HTTP_VERSION_1_1) - 1;
+    if (message == NULL || p_needed == NULL) return PARSER_NULL_POINTER_ERROR;
+
+    char status_code[HTTP_MESSAGE_IOV_BUFFER_SIZE];
+    size_t status_code_length;
+    size_t length = serialized_length(message, status_code, &status_code_length);
+    *p_needed = length;
+    if (capacity < length) return PARSER_BUFFER_TOO_SMALL_ERROR;
+    if (buffer == NULL) return PARSER_NULL_POINTER_ERROR;
+
+    // Unchanged message is copied as is
+    const char *raw = message->raw;
+    if (raw != NULL && !message->dirty) {
+        memcpy(buffer, raw, length);
+        return 0;
     }
 
-    out_buffer = realloc(out_buffer, length + 3);
-    snprintf(out_buffer + length, 3, "\r\n");
-    length += 2;
+    char *out = buffer;
+    if (raw != NULL && message->raw_start_line_length != 0) {
+        out = raw_put(out, raw, message->raw_start_line_length);
+    } else {
+        if (message->status && message->status_code) {
+            out = raw_put(out, HTTP_VERSION, version_length);
+            *out++ = ' ';
+            out = raw_put(out, status_code, status_code_length);
+            *out++ = ' ';
+            out = raw_put(out, message->status, strlen(message->status));
+        } else {
+            out = raw_put(out, message->method, raw_strlen(message->method));
+            *out++ = ' ';
+            out = raw_put(out, message->url, raw_strlen(message->url));
+            *out++ = ' ';
+            out = raw_put(out, HTTP_VERSION, version_length);
+        }
+        *out++ = '\r';
+        *out++ = '\n';
+    }
+    for (unsigned int i = 0; i < message->field_count; i++) {
+        const http_header_field *field = &message->fields[i];
+        if (raw != NULL && field->raw_length != 0) {
+            out = raw_put(out, raw + field->raw_offset, field->raw_length);
+            continue;
+        }
+        out = raw_put(out, field->name, raw_strlen(field->name));
+        *out++ = ':';
+        *out++ = ' ';
+        out = raw_put(out, field->value, raw_strlen(field->value));
+        *out++ = '\r';
+        *out++ = '\n';
+    }
+    *out++ = '\r';
+    *out = '\n';
+    return 0;
+}
+
+/**
+ * Fills iovec with string
+ * @param iov Pointer to iovec
+ * @param str String (may be NULL)
+ * @param length Length of string
+ * @return Pointer to next iovec
+ */
+static inline struct iovec *iov_put(struct iovec *iov, const char *str, size_t length) {
+    iov->iov_base = (void *) (str != NULL ? str : "");
+    iov->iov_len = length;
+    return iov + 1;
+}
+
+int http_message_serialize_iov(const http_message *message, struct iovec *iov, size_t iov_capacity,
+                               size_t *p_iov_count, char *buffer) {
+    if (message == NULL || p_iov_count == NULL) return PARSER_NULL_POINTER_ERROR;
+    const char *raw = message->raw;
+    size_t count;
+    if (raw != NULL && !message->dirty) {
+        // Unchanged message is described by one iovec
+        count = 1;
+    } else {
+        // 6 iovecs for start line, 4 for every field and 1 for the ending CRLF, original lines take one
+        count = (raw != NULL && message->raw_start_line_length != 0 ? 1 : 6) + 1;
+        for (unsigned int i = 0; i < message->field_count; i++) {
+            count += raw != NULL && message->fields[i].raw_length != 0 ? 1 : 4;
+        }
+    }
+    *p_iov_count = count;
+    if (iov_capacity < count) return PARSER_BUFFER_TOO_SMALL_ERROR;
+    if (iov == NULL || buffer == NULL) return PARSER_NULL_POINTER_ERROR;
+
+    if (raw != NULL && !message->dirty) {
+        iov_put(iov, raw, message->raw_length);
+        return 0;
+    }
+    struct iovec *out = iov;
+    if (raw != NULL && message->raw_start_line_length != 0) {
+        out = iov_put(out, raw, message->raw_start_line_length);
+    } else {
+        if (message->status && message->status_code) {
+            out = iov_put(out, HTTP_VERSION, sizeof(HTTP_VERSION_1_1) - 1);
+            out = iov_put(out, SEPARATOR_SPACE, 1);
+            out = iov_put(out, buffer, format_status_code(buffer, message->status_code));
+            out = iov_put(out, SEPARATOR_SPACE, 1);
+            out = iov_put(out, message->status, strlen(message->status));
+        } else {
+            out = iov_put(out, message->method, raw_strlen(message->method));
+            out = iov_put(out, SEPARATOR_SPACE, 1);
+            out = iov_put(out, message->url, raw_strlen(message->url));
+            out = iov_put(out, SEPARATOR_SPACE, 1);
+            out = iov_put(out, HTTP_VERSION, sizeof(HTTP_VERSION_1_1) - 1);
+        }
+        out = iov_put(out, SEPARATOR_CRLF, 2);
+    }
+    for (unsigned int i = 0; i < message->field_count; i++) {
+        const http_header_field *field = &message->fields[i];
+        if (raw != NULL && field->raw_length != 0) {
+            out = iov_put(out, raw + field->raw_offset, field->raw_length);
+            continue;
+        }
+        out = iov_put(out, field->name, raw_strlen(field->name));
+        out = iov_put(out, SEPARATOR_FIELD, 2);
+        out = iov_put(out, field->value, raw_strlen(field->value));
+        out = iov_put(out, SEPARATOR_CRLF, 2);
+    }
+    iov_put(out, SEPARATOR_CRLF, 2);
+    return 0;
+}
+
+char *http_message_raw(const http_message *message, size_t *p_length) {
+    size_t length;
+    if (message == NULL) return NULL;
+
+    http_message_serialize_into(message, NULL, 0, &length);
+    char *out_buffer = malloc(length + 1);
+    if (out_buffer == NULL) return NULL;
+    http_message_serialize_into(message, out_buffer, length, &length);
+    out_buffer[length] = '\0';
 
     if (p_length != NULL) {
         *p_length = length;
@@ -910,3 +2304,25 @@ const char *connection_get_error_message(connection_context *context) {
     return context->error_message;
 }
 
+size_t connection_get_input_consumed(connection_context *context) {
+    return context->done;
+}
+
+int connection_is_paused(connection_context *context) {
+    return context->paused;
+}
+
+void connection_set_user_data(connection_context *context, void *user_data) {
+    context->user_data = user_data;
+}
+
+void *connection_get_user_data(connection_context *context) {
+    return context->user_data;
+}
+
+http_message *connection_detach_message(connection_context *context) {
+    http_message *message = context->message;
+    context->message = NULL;
+    return message;
+}
+
@@ -9,6 +9,7 @@ extern "C" {
 #endif
 
 #include <sys/types.h>
+#include <sys/uio.h>
 
 /*
  *  Globals:
@@ -20,10 +21,21 @@ extern "C" {
  *  Types:
  */
 typedef struct {
+    /* Null-terminated name and value. Short strings are stored in small-string arena of message,
+       so copies of field are valid while message (or its clone) exists and field isn't changed. */
     char *name;
     char *value;
+    /* Span of original field line (including folded lines) in raw header block of message.
+       raw_length is 0 if field was added or changed after parsing. */
+    size_t raw_offset;
+    size_t raw_length;
+    /* Which of strings are stored in arena (internal) */
+    unsigned int arena_flags;
 } http_header_field;
 
+struct http_header_index;
+struct http_string_arena;
+
 typedef struct {
     char                    *method;
     char                    *url;
@@ -31,6 +43,21 @@ typedef struct {
     unsigned int            status_code;
     unsigned int            field_count;
     http_header_field      *fields;
+    /* Case-insensitive field name index, built by first lookup and published atomically.
+       Strings and fields are reference counted and may be shared with clones,
+       so they must be changed by http_message_* functions only. */
+    struct http_header_index *index;
+    /* Small-string arena of short field names and values (internal), shared with clones */
+    struct http_string_arena *arena;
+    /* Original header block received by parser, NULL if message wasn't parsed
+       or parser_set_keep_raw_headers() isn't enabled.
+       It is serialized as is while message isn't changed, otherwise only changed lines are rebuilt.
+       raw_start_line_length is 0 if start line was changed after parsing. */
+    char                    *raw;
+    size_t                  raw_length;
+    size_t                  raw_start_line_length;
+    // Message was changed after parsing (set by http_message_* functions)
+    int                     dirty;
 } http_message;
 
 typedef unsigned long connection_id_t;
@@ -58,6 +85,10 @@ typedef enum {
  * Parser error type
  * HTTP - http_parser error
  * DECODE - zlib error
+ * IO - socket error (native engine only)
+ * PAUSED - connection is paused by parser_connection_pause(), not an error
+ * BUFFER_TOO_SMALL - output buffer passed by caller is too small
+ * OUT_OF_MEMORY - memory allocation failed
  */
 typedef enum {
     PARSER_OK = 0,
@@ -65,7 +96,11 @@ typedef enum {
     PARSER_HTTP_PARSE_ERROR = 102,
     PARSER_ZLIB_ERROR = 103,
     PARSER_NULL_POINTER_ERROR = 104,
-    PARSER_INVALID_ARGUMENT_ERROR = 105
+    PARSER_INVALID_ARGUMENT_ERROR = 105,
+    PARSER_IO_ERROR = 106,
+    PARSER_PAUSED = 107,
+    PARSER_BUFFER_TOO_SMALL_ERROR = 108,
+    PARSER_OUT_OF_MEMORY_ERROR = 109
 } error_type_t;
 
 /**
@@ -154,6 +189,47 @@ int parser_create(logger *log, parser_context **p_parser_ctx);
  */
 int parser_destroy(parser_context *parser_ctx);
 
+/* Flags of parser_set_interning() */
+#define PARSER_INTERN_NAMES     1
+#define PARSER_INTERN_VALUES    2
+
+/**
+ * Enables interning of header strings of parsed messages. Interned strings are stored once
+ * for all connections of parser context and are shared by messages, interned names
+ * are compared by pointer in field lookups. Table is thread-safe and is limited in size.
+ * PARSER_INTERN_NAMES adds all field names to table, PARSER_INTERN_VALUES replaces values
+ * which are too long for small-string arena of message by frequent values
+ * (e.g. "text/html; charset=utf-8") and strings added by parser_intern().
+ * Should be called before connections are created.
+ * @param parser_ctx Pointer to parser context
+ * @param flags PARSER_INTERN_* flags
+ * @return 0 if success, PARSER_INVALID_ARGUMENT_ERROR if interning is already enabled,
+ *         PARSER_OUT_OF_MEMORY_ERROR if table can't be allocated
+ */
+int parser_set_interning(parser_context *parser_ctx, int flags);
+
+/**
+ * Enables keeping of original header block of parsed messages (see http_message.raw), so that
+ * unchanged lines are serialized as they were received. Block is copied from input for every message
+ * and parsing is stopped twice per message to collect it, so it's disabled by default.
+ * Affects connections created after the call.
+ * @param parser_ctx Pointer to parser context
+ * @param enabled Non-zero value to keep header blocks
+ * @return 0 if success
+ */
+int parser_set_keep_raw_headers(parser_context *parser_ctx, int enabled);
+
+/**
+ * Adds string to intern table of parser context (e.g. frequent field value or field name
+ * which will be looked up), so field names and values which are equal to it are stored once
+ * @param parser_ctx Pointer to parser context
+ * @param str String (character array)
+ * @param length Length of string
+ * @return Interned string, valid until parser context is destroyed,
+ *         or NULL if interning is disabled or string can't be interned
+ */
+const char *parser_intern(parser_context *parser_ctx, const char *str, size_t length);
+
 /**
  * Create new connection and set callbacks for it
  * @param id Connection id
@@ -175,11 +251,14 @@ int parser_disconnect(connection_context *context, transfer_direction_t directio
 
 /**
  * Process HTTP input data
+ * If connection is paused while processing input, processing stops and PARSER_PAUSED is returned.
+ * Number of consumed bytes is returned by connection_get_input_consumed(), the rest of data
+ * should be passed again after parser_connection_resume().
  * @param id Connection id
  * @param direction Transfer direction
  * @param data Chunk data
  * @param length Data length
- * @return 0 if success
+ * @return 0 if success, PARSER_PAUSED if connection is paused
  */
 int parser_input(connection_context *context, transfer_direction_t direction, const char *data,
           size_t length);
@@ -191,6 +270,23 @@ int parser_input(connection_context *context, transfer_direction_t direction, co
  */
 int parser_connection_close(connection_context *context);
 
+/**
+ * Pauses input processing of connection.
+ * May be called from parser callbacks (usually from body data callback) to stop
+ * current parser_input() call after current callback returns.
+ * @param context Connection context
+ * @return 0 if success
+ */
+int parser_connection_pause(connection_context *context);
+
+/**
+ * Resumes input processing of paused connection.
+ * Decompressed body data held by pause is passed to body data callback before return.
+ * @param context Connection context
+ * @return 0 if success, PARSER_PAUSED if connection was paused again by callback
+ */
+int parser_connection_resume(connection_context *context);
+
 /**
  * Utility methods
  */
@@ -201,7 +297,9 @@ int parser_connection_close(connection_context *context);
 http_message *http_message_create();
 
 /**
- * Makes copy of HTTP message
+ * Makes copy of HTTP message in constant time.
+ * Copy shares strings and field array with original message, they are copied when
+ * one of messages is changed, so messages may be changed and freed independently.
  * @param source Pointer to original message
  * @return Pointer to cloned message. Should be freed by http_message_free()
  */
@@ -264,6 +362,72 @@ int http_message_set_header_field(http_message *message,
                                   const char *name, size_t name_length,
                                   const char *value, size_t value_length);
 
+/**
+ * Gets name of header field
+ * @param field Pointer to header field
+ * @param p_length Pointer to variable where length of name will be stored (may be NULL)
+ * @return Field name, or NULL if it isn't set
+ */
+const char *http_header_field_name(const http_header_field *field, size_t *p_length);
+
+/**
+ * Gets value of header field
+ * @param field Pointer to header field
+ * @param p_length Pointer to variable where length of value will be stored (may be NULL)
+ * @return Field value, or NULL if it isn't set
+ */
+const char *http_header_field_value(const http_header_field *field, size_t *p_length);
+
+/**
+ * Finds value of header field with given name, ignoring case of name.
+ * If there are several fields with this name, the first one is found.
+ * Unlike http_message_get_header_field(), name must match whole field name.
+ * Messages with many fields are indexed on first call, so next lookups don't scan all fields.
+ * Lookups and iterations may run concurrently on the same message, since index is published
+ * atomically, but not concurrently with changes of message.
+ * @param message Pointer to HTTP message
+ * @param name Field name (character array)
+ * @param name_length Length of field name character array
+ * @param p_value_length Pointer to variable where length of value will be stored (may be NULL)
+ * @return Field value, or NULL if there is no such field
+ */
+const char *http_message_find_header_field(http_message *message, const char *name,
+                                           size_t name_length, size_t *p_value_length);
+
+/**
+ * Iterator over values of all header fields with given name, see http_message_header_iter()
+ */
+typedef struct {
+    http_message *message;
+    const char *name;
+    size_t name_length;
+    unsigned int hash;
+    /* Next field, or next slot of field name index if message is indexed */
+    size_t position;
+    int indexed;
+} http_header_iter;
+
+/**
+ * Starts iteration over values of header fields with given name (e.g. Set-Cookie), ignoring case of name.
+ * Fields are kept in one array in order of message, iteration doesn't allocate memory
+ * besides the field name index of messages with many fields.
+ * Message must not be changed while iterator is used, other lookups may run concurrently.
+ * @param message Pointer to HTTP message
+ * @param name Field name (character array, must be valid while iterator is used)
+ * @param name_length Length of field name character array
+ * @param iter Pointer to iterator
+ */
+void http_message_header_iter(http_message *message, const char *name, size_t name_length,
+                              http_header_iter *iter);
+
+/**
+ * Gets value of next header field found by iterator, in order of fields in message
+ * @param iter Pointer to iterator
+ * @param p_value_length Pointer to variable where length of value will be stored (may be NULL)
+ * @return Field value, or NULL if there are no more fields with this name
+ */
+const char *http_header_iter_next(http_header_iter *iter, size_t *p_value_length);
+
 /**
  * Gets header field value of header section of HTTP message
  * @param message Pointer to HTTP message
@@ -285,6 +449,21 @@ const char *http_message_get_header_field(const http_message *message, const cha
 int http_message_add_header_field(http_message *message,
                                   const char *name, size_t length);
 
+/**
+ * Appends header field with value at the end of header section of HTTP message.
+ * Unlike http_message_add_header_field(), field is added even if message already has field
+ * with this name, so multi-valued fields like Set-Cookie can be represented.
+ * @param message Pointer to HTTP message
+ * @param name Field name (character array)
+ * @param name_length Length of field name character array
+ * @param value Value (character array; may be null if value_length is 0)
+ * @param value_length Length of value character array
+ * @return 0 if success
+ */
+int http_message_append_header_field(http_message *message,
+                                     const char *name, size_t name_length,
+                                     const char *value, size_t value_length);
+
 /**
  * Deletes header field from header section of HTTP message
  * @param message Pointer to HTTP message
@@ -295,15 +474,82 @@ int http_message_add_header_field(http_message *message,
 int http_message_del_header_field(http_message *message,
                                   const char *name, size_t length);
 
+/**
+ * Header field edit type
+ * SET - set value of field, other fields with the same name are removed. Field is added if there is no such field.
+ * ADD - add new field, even if there is field with the same name
+ * REMOVE - remove all fields with the name
+ * RENAME - rename all fields with the name, new name is passed as value
+ */
+typedef enum {
+    HTTP_HEADER_EDIT_SET = 0,
+    HTTP_HEADER_EDIT_ADD,
+    HTTP_HEADER_EDIT_REMOVE,
+    HTTP_HEADER_EDIT_RENAME
+} http_header_edit_type_t;
+
+typedef struct {
+    http_header_edit_type_t type;
+    const char              *name;
+    size_t                  name_length;
+    // Value for SET and ADD, new name for RENAME, ignored for REMOVE
+    const char              *value;
+    size_t                  value_length;
+} http_header_edit;
+
+/**
+ * Applies list of header field edits by one pass over header fields.
+ * Unlike http_message_del_header_field(), names must match whole field names (case is ignored).
+ * Every field is matched against its original name, so edits of field renamed by RENAME
+ * should use old name. Fields added by SET and ADD are appended in order of edits.
+ * @param message Pointer to HTTP message
+ * @param edits Edits
+ * @param count Number of edits
+ * @return 0 if success, PARSER_OUT_OF_MEMORY_ERROR if memory allocation failed
+ */
+int http_message_apply_edits(http_message *message, const http_header_edit *edits, size_t count);
+
 /**
  * Serializes HTTP message header section, including request/response line,
- * header fields and the ending CRLF
+ * header fields and the ending CRLF.
+ * Parsed message which wasn't changed is serialized into its original bytes,
+ * changed message is serialized from original lines which weren't changed and new lines.
  * @param message Pointer to HTTP message
  * @param p_length Pointer to size_t variable where length of output will be written
  * @return Character array containing serialized HTTP message
  */
 char *http_message_raw(const http_message *message, size_t *p_length);
 
+/**
+ * Serializes HTTP message header section into caller-provided buffer, like http_message_raw(),
+ * but without terminating null byte. Buffer may be NULL if capacity is 0, to get needed length only.
+ * @param message Pointer to HTTP message
+ * @param buffer Output buffer
+ * @param capacity Size of output buffer
+ * @param p_needed Pointer to variable where length of serialized message will be written
+ * @return 0 if success, PARSER_BUFFER_TOO_SMALL_ERROR if buffer is too small
+ */
+int http_message_serialize_into(const http_message *message, char *buffer, size_t capacity, size_t *p_needed);
+
+/**
+ * Size of buffer needed by http_message_serialize_iov()
+ */
+#define HTTP_MESSAGE_IOV_BUFFER_SIZE 16
+
+/**
+ * Describes serialized HTTP message header section by iovecs, pointing to strings
+ * stored in message, so it may be written by writev() without copying.
+ * Iovecs are valid while message isn't changed or freed and buffer is alive.
+ * @param message Pointer to HTTP message
+ * @param iov Output iovec array
+ * @param iov_capacity Number of elements in iovec array
+ * @param p_iov_count Pointer to variable where number of needed iovecs will be written
+ * @param buffer Buffer of HTTP_MESSAGE_IOV_BUFFER_SIZE bytes for formatted status code
+ * @return 0 if success, PARSER_BUFFER_TOO_SMALL_ERROR if iovec array is too small
+ */
+int http_message_serialize_iov(const http_message *message, struct iovec *iov, size_t iov_capacity,
+                               size_t *p_iov_count, char *buffer);
+
 /**
  * Connection context structure access
  */
@@ -322,6 +568,43 @@ connection_id_t connection_get_id(connection_context *context);
  */
 const char *connection_get_error_message(connection_context *context);
 
+/**
+ * Gets number of bytes consumed by last parser_input() call
+ * @param context Pointer to connection context
+ * @return Number of consumed bytes
+ */
+size_t connection_get_input_consumed(connection_context *context);
+
+/**
+ * Checks if connection is paused by parser_connection_pause()
+ * @param context Pointer to connection context
+ * @return Non-zero value if connection is paused
+ */
+int connection_is_paused(connection_context *context);
+
+/**
+ * Sets user data of connection. Parser doesn't use it and doesn't free it.
+ * @param context Pointer to connection context
+ * @param user_data User data
+ */
+void connection_set_user_data(connection_context *context, void *user_data);
+
+/**
+ * Gets user data of connection
+ * @param context Pointer to connection context
+ * @return User data set by connection_set_user_data(), or NULL
+ */
+void *connection_get_user_data(connection_context *context);
+
+/**
+ * Takes ownership of currently parsed message, so it may be kept without cloning.
+ * Should be called from http_request_received or http_response_received callback only.
+ * After that connection doesn't access the message (trailing header fields of chunked body are ignored).
+ * @param context Pointer to connection context
+ * @return Message which should be freed by http_message_free(), or NULL if it was already detached
+ */
+http_message *connection_detach_message(connection_context *context);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,514 @@
+/*
+ *  Multi-threaded parse scheduler.
+ *  Every worker has its own queue of ready connections. Connection is ready when it has queued input
+ *  and is not processed by another worker. Worker takes connections from the head of its own queue,
+ *  and if it is empty, steals from the tail of queues of other workers.
+ */
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/queue.h>
+
+#include "scheduler.h"
+
+/**
+ * Initial capacity of worker queue
+ */
+#define DEQUE_INITIAL_CAPACITY 64
+
+/*
+ * Input chunk, data is allocated in the same block
+ */
+typedef struct scheduler_chunk {
+    transfer_direction_t            direction;
+    size_t                          offset;
+    size_t                          length;
+    STAILQ_ENTRY(scheduler_chunk)   entry;
+    char                            data[];
+} scheduler_chunk;
+
+struct scheduler_connection {
+    parser_scheduler                *scheduler;
+    connection_context              *context;
+    // Protects chunk queue and state flags
+    pthread_mutex_t                 lock;
+    STAILQ_HEAD(, scheduler_chunk)  chunks;
+    // Connection is in worker queue or is being processed by worker
+    int                             scheduled;
+    // Connection was paused by callback
+    int                             paused;
+    // parser_connection_resume() should be called by worker before processing input
+    int                             resume_requested;
+    // First error returned by parser
+    error_type_t                    error;
+    // Index of worker which processed connection last time
+    int                             last_worker;
+    TAILQ_ENTRY(scheduler_connection) entry;
+};
+
+/*
+ * Ring buffer of ready connections
+ */
+typedef struct {
+    pthread_mutex_t         lock;
+    scheduler_connection    **items;
+    size_t                  head;
+    size_t                  count;
+    size_t                  capacity;
+} scheduler_deque;
+
+typedef struct {
+    parser_scheduler        *scheduler;
+    int                     index;
+    pthread_t               thread;
+    scheduler_deque         deque;
+} scheduler_worker;
+
+struct parser_scheduler {
+    parser_context          *parser_ctx;
+    int                     thread_count;
+    scheduler_worker        *workers;
+    // Protects sleeping workers and waiters, and connection list
+    pthread_mutex_t         lock;
+    // Signaled when connection becomes ready
+    pthread_cond_t          work_cond;
+    // Signaled when connection becomes idle
+    pthread_cond_t          idle_cond;
+    int                     stopping;
+    TAILQ_HEAD(, scheduler_connection) connections;
+
+    // Updated atomically:
+    // Number of connections in worker queues
+    int                     ready;
+    // Number of scheduled connections
+    int                     active;
+    // Number of workers waiting for work_cond
+    int                     sleeping;
+    // Number of threads waiting for idle_cond
+    int                     waiters;
+    // Worker queue for next attached connection
+    unsigned int            next_worker;
+    scheduler_stats         stats;
+};
+
+#define ATOMIC_LOAD(ptr)        __atomic_load_n(ptr, __ATOMIC_SEQ_CST)
+#define ATOMIC_STORE(ptr, v)    __atomic_store_n(ptr, v, __ATOMIC_SEQ_CST)
+#define ATOMIC_ADD(ptr, v)      __atomic_add_fetch(ptr, v, __ATOMIC_SEQ_CST)
+#define ATOMIC_SUB(ptr, v)      __atomic_sub_fetch(ptr, v, __ATOMIC_SEQ_CST)
+
+/*
+ *  Worker queue:
+ */
+
+static void deque_init(scheduler_deque *deque) {
+    pthread_mutex_init(&deque->lock, NULL);
+    deque->items = malloc(DEQUE_INITIAL_CAPACITY * sizeof(scheduler_connection *));
+    deque->head = 0;
+    deque->count = 0;
+    deque->capacity = DEQUE_INITIAL_CAPACITY;
+}
+
+static void deque_destroy(scheduler_deque *deque) {
+    pthread_mutex_destroy(&deque->lock);
+    free(deque->items);
+}
+
+static void deque_push_tail(scheduler_deque *deque, scheduler_connection *conn) {
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count == deque->capacity) {
+        // Grow and unwrap ring
+        scheduler_connection **items = malloc(deque->capacity * 2 * sizeof(scheduler_connection *));
+        for (size_t i = 0; i < deque->count; i++) {
+            items[i] = deque->items[(deque->head + i) % deque->capacity];
+        }
+        free(deque->items);
+        deque->items = items;
+        deque->head = 0;
+        deque->capacity *= 2;
+    }
+    deque->items[(deque->head + deque->count) % deque->capacity] = conn;
+    deque->count++;
+    pthread_mutex_unlock(&deque->lock);
+}
+
+static scheduler_connection *deque_pop_head(scheduler_deque *deque) {
+    scheduler_connection *conn = NULL;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count > 0) {
+        conn = deque->items[deque->head];
+        deque->head = (deque->head + 1) % deque->capacity;
+        deque->count--;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return conn;
+}
+
+static scheduler_connection *deque_pop_tail(scheduler_deque *deque) {
+    scheduler_connection *conn = NULL;
+    pthread_mutex_lock(&deque->lock);
+    if (deque->count > 0) {
+        deque->count--;
+        conn = deque->items[(deque->head + deque->count) % deque->capacity];
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return conn;
+}
+
+/*
+ *  Scheduling:
+ */
+
+/**
+ * Puts connection to worker queue and wakes up sleeping worker
+ * @param scheduler Scheduler
+ * @param conn Connection
+ * @param worker_index Index of worker
+ */
+static void make_ready(parser_scheduler *scheduler, scheduler_connection *conn, int worker_index) {
+    deque_push_tail(&scheduler->workers[worker_index].deque, conn);
+    ATOMIC_ADD(&scheduler->ready, 1);
+    // Workers increment `sleeping' before checking `ready', so wakeup can't be lost
+    if (ATOMIC_LOAD(&scheduler->sleeping) > 0) {
+        pthread_mutex_lock(&scheduler->lock);
+        pthread_cond_signal(&scheduler->work_cond);
+        pthread_mutex_unlock(&scheduler->lock);
+    }
+}
+
+/**
+ * Marks connection as not scheduled (called with connection lock held) and wakes up waiters
+ * @param scheduler Scheduler
+ * @param conn Connection
+ */
+static void make_idle(parser_scheduler *scheduler, scheduler_connection *conn) {
+    ATOMIC_STORE(&conn->scheduled, 0);
+    ATOMIC_SUB(&scheduler->active, 1);
+    if (ATOMIC_LOAD(&scheduler->waiters) > 0) {
+        pthread_mutex_lock(&scheduler->lock);
+        pthread_cond_broadcast(&scheduler->idle_cond);
+        pthread_mutex_unlock(&scheduler->lock);
+    }
+}
+
+/**
+ * Takes next ready connection from own queue or steals it from another worker
+ * @param worker Worker
+ * @return Connection, or NULL if there are no ready connections
+ */
+static scheduler_connection *next_connection(scheduler_worker *worker) {
+    parser_scheduler *scheduler = worker->scheduler;
+    scheduler_connection *conn = deque_pop_head(&worker->deque);
+    if (conn == NULL) {
+        for (int i = 1; i < scheduler->thread_count && conn == NULL; i++) {
+            int victim = (worker->index + i) % scheduler->thread_count;
+            conn = deque_pop_tail(&scheduler->workers[victim].deque);
+        }
+        if (conn != NULL) {
+            __atomic_add_fetch(&scheduler->stats.steals, 1, __ATOMIC_RELAXED);
+        }
+    }
+    if (conn != NULL) {
+        ATOMIC_SUB(&scheduler->ready, 1);
+    }
+    return conn;
+}
+
+/**
+ * Saves parser error of connection
+ * @param conn Connection
+ * @param r parser_input() result
+ */
+static void set_error(scheduler_connection *conn, int r) {
+    pthread_mutex_lock(&conn->lock);
+    conn->error = (error_type_t) r;
+    pthread_mutex_unlock(&conn->lock);
+}
+
+/**
+ * Processes queued input of connection
+ * @param worker Worker
+ * @param conn Connection
+ */
+static void process_connection(scheduler_worker *worker, scheduler_connection *conn) {
+    parser_scheduler *scheduler = worker->scheduler;
+
+    pthread_mutex_lock(&conn->lock);
+    int resume = conn->resume_requested;
+    conn->resume_requested = 0;
+    pthread_mutex_unlock(&conn->lock);
+
+    int paused = 0;
+    if (resume && conn->error == PARSER_OK) {
+        int r = parser_connection_resume(conn->context);
+        if (r == PARSER_PAUSED) {
+            paused = 1;
+        } else if (r != 0) {
+            set_error(conn, r);
+        }
+    }
+
+    // Chunks are appended by producers under lock, but only this worker removes them
+    for (int i = 0; i < SCHEDULER_BATCH_CHUNKS && !paused; i++) {
+        pthread_mutex_lock(&conn->lock);
+        scheduler_chunk *chunk = STAILQ_FIRST(&conn->chunks);
+        pthread_mutex_unlock(&conn->lock);
+        if (chunk == NULL) {
+            break;
+        }
+
+        if (conn->error == PARSER_OK) {
+            int r = parser_input(conn->context, chunk->direction, chunk->data + chunk->offset,
+                                 chunk->length - chunk->offset);
+            if (r == PARSER_PAUSED) {
+                // Rest of chunk is passed again after resume
+                paused = 1;
+                chunk->offset += connection_get_input_consumed(conn->context);
+                if (chunk->offset < chunk->length) {
+                    break;
+                }
+            } else if (r != 0) {
+                set_error(conn, r);
+            }
+        }
+        __atomic_add_fetch(&scheduler->stats.chunks, 1, __ATOMIC_RELAXED);
+
+        pthread_mutex_lock(&conn->lock);
+        STAILQ_REMOVE_HEAD(&conn->chunks, entry);
+        pthread_mutex_unlock(&conn->lock);
+        free(chunk);
+    }
+
+    pthread_mutex_lock(&conn->lock);
+    conn->last_worker = worker->index;
+    if (paused && !conn->resume_requested) {
+        conn->paused = 1;
+    }
+    if (conn->paused || (STAILQ_EMPTY(&conn->chunks) && !conn->resume_requested)) {
+        make_idle(scheduler, conn);
+    } else {
+        // Put it back to the end of own queue to let other connections go
+        make_ready(scheduler, conn, worker->index);
+    }
+    pthread_mutex_unlock(&conn->lock);
+}
+
+/**
+ * Waits until some connection is ready or scheduler is stopping
+ * @param scheduler Scheduler
+ * @return 0 if scheduler is stopping
+ */
+static int wait_for_work(parser_scheduler *scheduler) {
+    pthread_mutex_lock(&scheduler->lock);
+    ATOMIC_ADD(&scheduler->sleeping, 1);
+    while (ATOMIC_LOAD(&scheduler->ready) == 0 && !scheduler->stopping) {
+        pthread_cond_wait(&scheduler->work_cond, &scheduler->lock);
+    }
+    ATOMIC_SUB(&scheduler->sleeping, 1);
+    int r = !scheduler->stopping;
+    pthread_mutex_unlock(&scheduler->lock);
+    return r;
+}
+
+static void *worker_thread(void *arg) {
+    scheduler_worker *worker = arg;
+    for (;;) {
+        scheduler_connection *conn = next_connection(worker);
+        if (conn != NULL) {
+            process_connection(worker, conn);
+        } else if (!wait_for_work(worker->scheduler)) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Schedules connection if it is not scheduled and not paused (called with connection lock held)
+ * @param conn Connection
+ */
+static void schedule(scheduler_connection *conn) {
+    parser_scheduler *scheduler = conn->scheduler;
+    if (conn->scheduled || conn->paused) {
+        return;
+    }
+    ATOMIC_STORE(&conn->scheduled, 1);
+    ATOMIC_ADD(&scheduler->active, 1);
+    make_ready(scheduler, conn, conn->last_worker);
+}
+
+static void free_connection(scheduler_connection *conn) {
+    scheduler_chunk *chunk;
+    while ((chunk = STAILQ_FIRST(&conn->chunks)) != NULL) {
+        STAILQ_REMOVE_HEAD(&conn->chunks, entry);
+        free(chunk);
+    }
+    pthread_mutex_destroy(&conn->lock);
+    free(conn);
+}
+
+/*
+ *  API implementation
+ */
+
+int parser_scheduler_create(parser_context *parser_ctx, int thread_count, parser_scheduler **p_scheduler) {
+    if (parser_ctx == NULL || p_scheduler == NULL) {
+        return PARSER_NULL_POINTER_ERROR;
+    }
+    if (thread_count <= 0) {
+        return PARSER_INVALID_ARGUMENT_ERROR;
+    }
+
+    parser_scheduler *scheduler = calloc(1, sizeof(parser_scheduler));
+    scheduler->parser_ctx = parser_ctx;
+    scheduler->thread_count = thread_count;
+    pthread_mutex_init(&scheduler->lock, NULL);
+    pthread_cond_init(&scheduler->work_cond, NULL);
+    pthread_cond_init(&scheduler->idle_cond, NULL);
+    TAILQ_INIT(&scheduler->connections);
+
+    scheduler->workers = calloc((size_t) thread_count, sizeof(scheduler_worker));
+    for (int i = 0; i < thread_count; i++) {
+        scheduler->workers[i].scheduler = scheduler;
+        scheduler->workers[i].index = i;
+        deque_init(&scheduler->workers[i].deque);
+    }
+    for (int i = 0; i < thread_count; i++) {
+        if (pthread_create(&scheduler->workers[i].thread, NULL, worker_thread, &scheduler->workers[i]) != 0) {
+            // Thread resources are exhausted, stop started workers
+            for (int j = i; j < thread_count; j++) {
+                deque_destroy(&scheduler->workers[j].deque);
+            }
+            scheduler->thread_count = i;
+            parser_scheduler_destroy(scheduler);
+            return PARSER_OUT_OF_MEMORY_ERROR;
+        }
+    }
+
+    *p_scheduler = scheduler;
+    return 0;
+}
+
+int parser_scheduler_destroy(parser_scheduler *scheduler) {
+    parser_scheduler_wait(scheduler);
+
+    pthread_mutex_lock(&scheduler->lock);
+    scheduler->stopping = 1;
+    pthread_cond_broadcast(&scheduler->work_cond);
+    pthread_mutex_unlock(&scheduler->lock);
+    for (int i = 0; i < scheduler->thread_count; i++) {
+        pthread_join(scheduler->workers[i].thread, NULL);
+    }
+
+    scheduler_connection *conn;
+    while ((conn = TAILQ_FIRST(&scheduler->connections)) != NULL) {
+        TAILQ_REMOVE(&scheduler->connections, conn, entry);
+        free_connection(conn);
+    }
+    for (int i = 0; i < scheduler->thread_count; i++) {
+        deque_destroy(&scheduler->workers[i].deque);
+    }
+    free(scheduler->workers);
+    pthread_cond_destroy(&scheduler->work_cond);
+    pthread_cond_destroy(&scheduler->idle_cond);
+    pthread_mutex_destroy(&scheduler->lock);
+    free(scheduler);
+    return 0;
+}
+
+int parser_scheduler_attach(parser_scheduler *scheduler, connection_context *context,
+                            scheduler_connection **p_connection) {
+    if (context == NULL || p_connection == NULL) {
+        return PARSER_NULL_POINTER_ERROR;
+    }
+
+    scheduler_connection *conn = calloc(1, sizeof(scheduler_connection));
+    conn->scheduler = scheduler;
+    conn->context = context;
+    pthread_mutex_init(&conn->lock, NULL);
+    STAILQ_INIT(&conn->chunks);
+    conn->last_worker = (int) (ATOMIC_ADD(&scheduler->next_worker, 1) % scheduler->thread_count);
+
+    pthread_mutex_lock(&scheduler->lock);
+    TAILQ_INSERT_TAIL(&scheduler->connections, conn, entry);
+    pthread_mutex_unlock(&scheduler->lock);
+
+    *p_connection = conn;
+    return 0;
+}
+
+int parser_scheduler_detach(scheduler_connection *connection) {
+    parser_scheduler *scheduler = connection->scheduler;
+    pthread_mutex_lock(&scheduler->lock);
+    ATOMIC_ADD(&scheduler->waiters, 1);
+    while (ATOMIC_LOAD(&connection->scheduled)) {
+        pthread_cond_wait(&scheduler->idle_cond, &scheduler->lock);
+    }
+    ATOMIC_SUB(&scheduler->waiters, 1);
+    TAILQ_REMOVE(&scheduler->connections, connection, entry);
+    pthread_mutex_unlock(&scheduler->lock);
+
+    // Worker makes connection idle with its lock held, wait until it is unlocked
+    pthread_mutex_lock(&connection->lock);
+    pthread_mutex_unlock(&connection->lock);
+    free_connection(connection);
+    return 0;
+}
+
+int parser_scheduler_input(scheduler_connection *connection, transfer_direction_t direction,
+                           const char *data, size_t length) {
+    if (data == NULL && length > 0) {
+        return PARSER_NULL_POINTER_ERROR;
+    }
+
+    scheduler_chunk *chunk = malloc(sizeof(scheduler_chunk) + length);
+    chunk->direction = direction;
+    chunk->offset = 0;
+    chunk->length = length;
+    if (length > 0) {
+        memcpy(chunk->data, data, length);
+    }
+
+    pthread_mutex_lock(&connection->lock);
+    error_type_t error = connection->error;
+    STAILQ_INSERT_TAIL(&connection->chunks, chunk, entry);
+    schedule(connection);
+    pthread_mutex_unlock(&connection->lock);
+    return error;
+}
+
+int parser_scheduler_resume(scheduler_connection *connection) {
+    pthread_mutex_lock(&connection->lock);
+    if (connection->paused) {
+        connection->paused = 0;
+        connection->resume_requested = 1;
+        schedule(connection);
+    } else if (connection->scheduled) {
+        // Callback may have paused connection, but worker hasn't finished processing it yet
+        connection->resume_requested = 1;
+    }
+    pthread_mutex_unlock(&connection->lock);
+    return 0;
+}
+
+int parser_scheduler_wait(parser_scheduler *scheduler) {
+    pthread_mutex_lock(&scheduler->lock);
+    ATOMIC_ADD(&scheduler->waiters, 1);
+    while (ATOMIC_LOAD(&scheduler->active) > 0) {
+        pthread_cond_wait(&scheduler->idle_cond, &scheduler->lock);
+    }
+    ATOMIC_SUB(&scheduler->waiters, 1);
+    pthread_mutex_unlock(&scheduler->lock);
+    return 0;
+}
+
+error_type_t parser_scheduler_get_error(scheduler_connection *connection) {
+    pthread_mutex_lock(&connection->lock);
+    error_type_t error = connection->error;
+    pthread_mutex_unlock(&connection->lock);
+    return error;
+}
+
+void parser_scheduler_get_stats(parser_scheduler *scheduler, scheduler_stats *stats) {
+    stats->chunks = __atomic_load_n(&scheduler->stats.chunks, __ATOMIC_RELAXED);
+    stats->steals = __atomic_load_n(&scheduler->stats.steals, __ATOMIC_RELAXED);
+}
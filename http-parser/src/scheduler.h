@@ -0,0 +1,118 @@
+/*
+ *  Multi-threaded parse scheduler API.
+ *  Accepts input of parser connections into per-connection queues and processes it on a pool
+ *  of worker threads. Each connection is processed by one worker at a time, so callbacks of one
+ *  connection are called in input order and never concurrently. Idle workers steal ready
+ *  connections from queues of busy workers.
+ */
+#ifndef HTTP_PARSER_SCHEDULER_H
+#define HTTP_PARSER_SCHEDULER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "parser.h"
+
+/**
+ * Maximum number of input chunks processed for one connection before it is put back to
+ * the worker queue, so that busy connections don't starve others
+ */
+#define SCHEDULER_BATCH_CHUNKS 16
+
+typedef struct parser_scheduler parser_scheduler;
+typedef struct scheduler_connection scheduler_connection;
+
+/**
+ * Scheduler counters
+ */
+typedef struct {
+    // Number of processed input chunks
+    unsigned long chunks;
+    // Number of connections taken by worker from queue of another worker
+    unsigned long steals;
+} scheduler_stats;
+
+/**
+ * Creates scheduler and starts its worker threads
+ * @param parser_ctx Parser context of scheduled connections
+ * @param thread_count Number of worker threads
+ * @param p_scheduler Pointer to variable where scheduler will be stored
+ * @return 0 if success, PARSER_OUT_OF_MEMORY_ERROR if worker threads can't be created
+ */
+int parser_scheduler_create(parser_context *parser_ctx, int thread_count, parser_scheduler **p_scheduler);
+
+/**
+ * Waits for queued input to be processed, stops worker threads and destroys scheduler.
+ * Connections which are still attached are detached.
+ * @param scheduler Scheduler
+ * @return 0 if success
+ */
+int parser_scheduler_destroy(parser_scheduler *scheduler);
+
+/**
+ * Attaches parser connection to scheduler.
+ * After that, input of connection should be passed only through parser_scheduler_input().
+ * @param scheduler Scheduler
+ * @param context Connection context
+ * @param p_connection Pointer to variable where scheduled connection handle will be stored
+ * @return 0 if success
+ */
+int parser_scheduler_attach(parser_scheduler *scheduler, connection_context *context,
+                            scheduler_connection **p_connection);
+
+/**
+ * Waits until queued input of connection is processed and detaches it from scheduler.
+ * Input held by paused connection is dropped. Connection context is not closed.
+ * @param connection Scheduled connection
+ * @return 0 if success
+ */
+int parser_scheduler_detach(scheduler_connection *connection);
+
+/**
+ * Queues input data of connection. Data is copied, processing is done by worker thread.
+ * May be called from any thread, but input of one connection should be passed in order.
+ * @param connection Scheduled connection
+ * @param direction Transfer direction
+ * @param data Chunk data
+ * @param length Data length
+ * @return 0 if success, or error returned by parser_input() for previous input of this connection
+ */
+int parser_scheduler_input(scheduler_connection *connection, transfer_direction_t direction,
+                           const char *data, size_t length);
+
+/**
+ * Resumes connection paused by its callbacks (see parser_connection_pause()).
+ * Processing of held input is continued by worker thread.
+ * @param connection Scheduled connection
+ * @return 0 if success
+ */
+int parser_scheduler_resume(scheduler_connection *connection);
+
+/**
+ * Waits until all queued input is processed (input of paused connections is held until resume)
+ * @param scheduler Scheduler
+ * @return 0 if success
+ */
+int parser_scheduler_wait(parser_scheduler *scheduler);
+
+/**
+ * Gets first error returned by parser_input() for input of connection.
+ * Once error happened, rest of connection input is dropped.
+ * @param connection Scheduled connection
+ * @return Error code, or PARSER_OK
+ */
+error_type_t parser_scheduler_get_error(scheduler_connection *connection);
+
+/**
+ * Gets scheduler counters
+ * @param scheduler Scheduler
+ * @param stats Pointer to structure where counters will be written
+ */
+void parser_scheduler_get_stats(parser_scheduler *scheduler, scheduler_stats *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HTTP_PARSER_SCHEDULER_H */
@@ -0,0 +1,319 @@
+/*
+ *  Serialized message header cache.
+ *  Direct-mapped table of serialized messages, indexed by hash of message structure.
+ *  Hash covers only first eight bytes of strings, so hit is always confirmed by comparison with
+ *  clone of cached message. Clones share field strings, so for messages cloned from the same template
+ *  strings are mostly compared by pointer.
+ */
+// strnlen() is not declared in strict C99 mode
+#define _POSIX_C_SOURCE 200809L
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "serialize_cache.h"
+
+#define HASH_PRIME 0x100000001b3ULL
+
+/*
+ * Value of volatile field in cached header block
+ */
+typedef struct {
+    unsigned int            field;
+    size_t                  offset;
+    size_t                  length;
+} volatile_value;
+
+typedef struct {
+    uint64_t                hash;
+    // Clone of cached message, NULL if entry is empty
+    http_message            *message;
+    char                    *data;
+    size_t                  length;
+    // Volatile fields in order of field index
+    volatile_value          *volatiles;
+    unsigned int            volatile_count;
+} cache_entry;
+
+struct http_serialize_cache {
+    size_t                  mask;
+    cache_entry             *entries;
+    http_serialize_cache_stats stats;
+};
+
+static inline size_t safe_strlen(const char *str) {
+    return str != NULL ? strlen(str) : 0;
+}
+
+/**
+ * Gets up to eight first bytes of string as little-endian word, bytes after null byte are zero
+ * @param str String (may be NULL)
+ * @return Word
+ */
+static inline uint64_t prefix_word(const char *str) {
+    uint64_t word = 0;
+    if (str == NULL) {
+        return word;
+    }
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    memcpy(&word, str, strnlen(str, sizeof(word)));
+#else
+    for (size_t i = 0; i < sizeof(word) && str[i] != 0; i++) {
+        word |= (uint64_t) (unsigned char) str[i] << (8 * i);
+    }
+#endif
+    return word;
+}
+
+// Little-endian word of eight characters, compared with field name word in is_volatile()
+#define WORD(a, b, c, d, e, f, g, h) \
+    ((uint64_t) (a) | (uint64_t) (b) << 8 | (uint64_t) (c) << 16 | (uint64_t) (d) << 24 \
+     | (uint64_t) (e) << 32 | (uint64_t) (f) << 40 | (uint64_t) (g) << 48 | (uint64_t) (h) << 56)
+
+/**
+ * Checks if value of field with given name may change between otherwise equal messages.
+ * Wrong answer only affects hit rate, since volatile values are patched from message anyway.
+ * @param name Field name (may be NULL)
+ * @param word Prefix word of field name
+ * @return True if field is volatile
+ */
+static inline int is_volatile(const char *name, uint64_t word) {
+    // Letters and null bytes are converted to lower case letters and spaces
+    word |= 0x2020202020202020ULL;
+    if (word == WORD('d', 'a', 't', 'e', ' ', ' ', ' ', ' ')) {
+        return 1;
+    }
+    if (word == WORD('s', 'e', 't', '-', 'c', 'o', 'o', 'k')) {
+        return strcasecmp(name + 8, "ie") == 0;
+    }
+    if (word == WORD('c', 'o', 'n', 't', 'e', 'n', 't', '-')) {
+        return strcasecmp(name + 8, "length") == 0;
+    }
+    return 0;
+}
+
+static inline int field_is_volatile(const http_header_field *field) {
+    return is_volatile(field->name, prefix_word(field->name));
+}
+
+/**
+ * Calculates hash of message structure
+ * @param message Pointer to HTTP message
+ * @return Hash value
+ */
+static uint64_t message_hash(const http_message *message) {
+    uint64_t hash = 0xcbf29ce484222325ULL ^ ((uint64_t) message->status_code << 32 | message->field_count);
+    hash = (hash ^ prefix_word(message->method)) * HASH_PRIME;
+    hash = (hash ^ prefix_word(message->url)) * HASH_PRIME;
+    hash = (hash ^ prefix_word(message->status)) * HASH_PRIME;
+    for (unsigned int i = 0; i < message->field_count; i++) {
+        const http_header_field *field = &message->fields[i];
+        uint64_t name = prefix_word(field->name);
+        hash = (hash ^ name) * HASH_PRIME;
+        if (!is_volatile(field->name, name)) {
+            hash = (hash ^ prefix_word(field->value)) * HASH_PRIME;
+        }
+    }
+    // Final mix of MurmurHash3, so that low bits used as index depend on all bits
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    return hash ^ (hash >> 33);
+}
+
+/**
+ * Compares strings which may be NULL, NULL is equal to empty string
+ */
+static inline int strings_equal(const char *a, const char *b) {
+    if (a == b) {
+        return 1;
+    }
+    return strcmp(a != NULL ? a : "", b != NULL ? b : "") == 0;
+}
+
+/**
+ * Checks if message is serialized in the same way as cached one, except for volatile fields
+ * @param entry Cache entry
+ * @param message Message
+ * @return True if messages are equal
+ */
+static int entry_matches(const cache_entry *entry, const http_message *message) {
+    const http_message *cached = entry->message;
+    if (cached->status_code != message->status_code || cached->field_count != message->field_count
+        || !strings_equal(cached->method, message->method) || !strings_equal(cached->url, message->url)
+        || !strings_equal(cached->status, message->status)) {
+        return 0;
+    }
+    if (cached->fields == message->fields) {
+        // Clone of cached message isn't changed
+        return 1;
+    }
+    unsigned int v = 0;
+    for (unsigned int i = 0; i < message->field_count; i++) {
+        const http_header_field *a = &cached->fields[i], *b = &message->fields[i];
+        if (!strings_equal(a->name, b->name)) {
+            return 0;
+        }
+        // Names are equal, so field of message is volatile too
+        if (v < entry->volatile_count && entry->volatiles[v].field == i) {
+            v++;
+            continue;
+        }
+        if (!strings_equal(a->value, b->value)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Frees cached message of entry
+ * @param entry Cache entry
+ */
+static void entry_clear(cache_entry *entry) {
+    if (entry->message != NULL) {
+        http_message_free(entry->message);
+    }
+    free(entry->data);
+    free(entry->volatiles);
+    memset(entry, 0, sizeof(cache_entry));
+}
+
+/**
+ * Stores serialized message in entry
+ * @param entry Cache entry
+ * @param hash Hash of message
+ * @param message Message
+ * @param data Serialized message
+ * @param length Length of serialized message
+ */
+static void entry_store(cache_entry *entry, uint64_t hash, const http_message *message,
+                        const char *data, size_t length) {
+    unsigned int volatile_count = 0;
+    size_t fields_length = 0;
+    for (unsigned int i = 0; i < message->field_count; i++) {
+        const http_header_field *field = &message->fields[i];
+        fields_length += safe_strlen(field->name) + safe_strlen(field->value) + 4;
+        volatile_count += field_is_volatile(field);
+    }
+    entry->data = malloc(length);
+    entry->volatiles = volatile_count > 0 ? malloc(volatile_count * sizeof(volatile_value)) : NULL;
+    entry->message = http_message_clone(message);
+    if (entry->data == NULL || (volatile_count > 0 && entry->volatiles == NULL) || entry->message == NULL) {
+        entry_clear(entry);
+        return;
+    }
+    memcpy(entry->data, data, length);
+    entry->hash = hash;
+    entry->length = length;
+
+    // Message without original header block is serialized as "<start line><name>: <value>\r\n...\r\n"
+    size_t offset = length - 2 - fields_length;
+    for (unsigned int i = 0; i < message->field_count; i++) {
+        const http_header_field *field = &message->fields[i];
+        size_t value_length = safe_strlen(field->value);
+        offset += safe_strlen(field->name) + 2;
+        if (field_is_volatile(field)) {
+            volatile_value *value = &entry->volatiles[entry->volatile_count++];
+            value->field = i;
+            value->offset = offset;
+            value->length = value_length;
+        }
+        offset += value_length + 2;
+    }
+}
+
+int http_serialize_cache_create(size_t capacity, http_serialize_cache **p_cache) {
+    if (p_cache == NULL) return PARSER_NULL_POINTER_ERROR;
+    if (capacity == 0) return PARSER_INVALID_ARGUMENT_ERROR;
+    size_t size = 1;
+    while (size < capacity) {
+        size <<= 1;
+    }
+    http_serialize_cache *cache = calloc(1, sizeof(http_serialize_cache));
+    if (cache == NULL) return PARSER_OUT_OF_MEMORY_ERROR;
+    cache->entries = calloc(size, sizeof(cache_entry));
+    if (cache->entries == NULL) {
+        free(cache);
+        return PARSER_OUT_OF_MEMORY_ERROR;
+    }
+    cache->mask = size - 1;
+    *p_cache = cache;
+    return 0;
+}
+
+void http_serialize_cache_destroy(http_serialize_cache *cache) {
+    if (cache == NULL) {
+        return;
+    }
+    for (size_t i = 0; i <= cache->mask; i++) {
+        entry_clear(&cache->entries[i]);
+    }
+    free(cache->entries);
+    free(cache);
+}
+
+int http_serialize_cache_serialize(http_serialize_cache *cache, const http_message *message,
+                                   char *buffer, size_t capacity, size_t *p_needed) {
+    if (cache == NULL || message == NULL || p_needed == NULL) return PARSER_NULL_POINTER_ERROR;
+    if (message->raw != NULL) {
+        cache->stats.bypassed++;
+        return http_message_serialize_into(message, buffer, capacity, p_needed);
+    }
+
+    cache->stats.lookups++;
+    uint64_t hash = message_hash(message);
+    cache_entry *entry = &cache->entries[hash & cache->mask];
+    if (entry->message != NULL && entry->hash == hash) {
+        if (entry_matches(entry, message)) {
+            size_t length = entry->length;
+            for (unsigned int i = 0; i < entry->volatile_count; i++) {
+                length += safe_strlen(message->fields[entry->volatiles[i].field].value) - entry->volatiles[i].length;
+            }
+            *p_needed = length;
+            if (capacity < length) return PARSER_BUFFER_TOO_SMALL_ERROR;
+            // Caller's buffer, not an allocation: non-zero capacity without buffer is an argument error,
+            // like in http_message_serialize_into()
+            if (buffer == NULL) return PARSER_NULL_POINTER_ERROR;
+
+            // Cached header block is copied, values of volatile fields are taken from message
+            char *out = buffer;
+            size_t offset = 0;
+            for (unsigned int i = 0; i < entry->volatile_count; i++) {
+                const volatile_value *cached = &entry->volatiles[i];
+                const char *value = message->fields[cached->field].value;
+                size_t value_length = safe_strlen(value);
+                memcpy(out, entry->data + offset, cached->offset - offset);
+                out += cached->offset - offset;
+                if (value_length != 0) {
+                    memcpy(out, value, value_length);
+                }
+                out += value_length;
+                offset = cached->offset + cached->length;
+            }
+            memcpy(out, entry->data + offset, entry->length - offset);
+            cache->stats.hits++;
+            return 0;
+        }
+        cache->stats.collisions++;
+    }
+
+    cache->stats.misses++;
+    int r = http_message_serialize_into(message, buffer, capacity, p_needed);
+    if (r != 0) {
+        return r;
+    }
+    if (entry->message != NULL) {
+        cache->stats.evictions++;
+        entry_clear(entry);
+    }
+    entry_store(entry, hash, message, buffer, *p_needed);
+    return 0;
+}
+
+void http_serialize_cache_get_stats(const http_serialize_cache *cache, http_serialize_cache_stats *p_stats) {
+    *p_stats = cache->stats;
+}
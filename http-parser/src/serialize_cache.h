@@ -0,0 +1,76 @@
+/*
+ *  Serialized message header cache API.
+ *  Responses which differ only by volatile fields (Date, Content-Length, Set-Cookie) are serialized
+ *  by copying cached header block and patching values of these fields.
+ *  Cache isn't thread-safe, it should be used by one thread (e.g. one per worker).
+ */
+#ifndef HTTP_PARSER_SERIALIZE_CACHE_H
+#define HTTP_PARSER_SERIALIZE_CACHE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "parser.h"
+
+typedef struct http_serialize_cache http_serialize_cache;
+
+/**
+ * Cache counters
+ */
+typedef struct {
+    // Number of messages looked up in cache
+    unsigned long           lookups;
+    // Number of messages serialized from cache
+    unsigned long           hits;
+    // Number of messages serialized and stored in cache
+    unsigned long           misses;
+    // Number of misses where cached message had the same hash, but other content
+    unsigned long           collisions;
+    // Number of cached messages replaced by other ones
+    unsigned long           evictions;
+    // Number of messages with original header block, which are serialized without cache
+    unsigned long           bypassed;
+} http_serialize_cache_stats;
+
+/**
+ * Creates cache
+ * @param capacity Maximum number of cached messages (rounded up to a power of two)
+ * @param p_cache Pointer to variable where cache will be stored
+ * @return 0 if success, PARSER_OUT_OF_MEMORY_ERROR if memory allocation failed
+ */
+int http_serialize_cache_create(size_t capacity, http_serialize_cache **p_cache);
+
+/**
+ * Destroys cache and frees cached messages
+ * @param cache Cache (may be NULL)
+ */
+void http_serialize_cache_destroy(http_serialize_cache *cache);
+
+/**
+ * Serializes HTTP message header into caller-provided buffer, output is equal to http_message_serialize_into().
+ * Messages with the same start line and header fields except for values of volatile fields are
+ * copied from cache. Parsed messages are serialized without cache, since their original header block
+ * is copied anyway.
+ * @param cache Cache
+ * @param message Pointer to HTTP message
+ * @param buffer Output buffer (may be NULL if capacity is 0)
+ * @param capacity Size of output buffer
+ * @param p_needed Pointer to variable where length of serialized message will be stored
+ * @return 0 if success, PARSER_BUFFER_TOO_SMALL_ERROR if buffer is too small
+ */
+int http_serialize_cache_serialize(http_serialize_cache *cache, const http_message *message,
+                                   char *buffer, size_t capacity, size_t *p_needed);
+
+/**
+ * Gets cache counters
+ * @param cache Cache
+ * @param p_stats Pointer to variable where counters will be stored
+ */
+void http_serialize_cache_get_stats(const http_serialize_cache *cache, http_serialize_cache_stats *p_stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HTTP_PARSER_SERIALIZE_CACHE_H */
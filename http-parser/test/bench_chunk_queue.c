@@ -0,0 +1,162 @@
+//
+// Chunk queue benchmark: throughput and handoff latency of lock-free SPSC queue
+// compared to mutex-protected list queue.
+// Usage: bench_chunk_queue [chunks] [chunk size]
+//
+
+#include <assert.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/queue.h>
+
+#include "chunk_queue.h"
+
+#define DEFAULT_CHUNKS 1000000
+#define DEFAULT_CHUNK_SIZE 1024
+#define QUEUE_CAPACITY 256
+
+/*
+ * Mutex queue with the same interface, as it would be written by embedder
+ */
+typedef struct mutex_queue_entry {
+    input_chunk *chunk;
+    STAILQ_ENTRY(mutex_queue_entry) entry;
+} mutex_queue_entry;
+
+typedef struct {
+    pthread_mutex_t lock;
+    STAILQ_HEAD(, mutex_queue_entry) entries;
+    size_t count;
+} mutex_queue;
+
+static int mutex_queue_push(void *q, input_chunk *chunk) {
+    mutex_queue *queue = q;
+    pthread_mutex_lock(&queue->lock);
+    if (queue->count >= QUEUE_CAPACITY) {
+        pthread_mutex_unlock(&queue->lock);
+        return 1;
+    }
+    mutex_queue_entry *entry = malloc(sizeof(mutex_queue_entry));
+    entry->chunk = chunk;
+    STAILQ_INSERT_TAIL(&queue->entries, entry, entry);
+    queue->count++;
+    pthread_mutex_unlock(&queue->lock);
+    return 0;
+}
+
+static input_chunk *mutex_queue_pop(void *q) {
+    mutex_queue *queue = q;
+    input_chunk *chunk = NULL;
+    pthread_mutex_lock(&queue->lock);
+    mutex_queue_entry *entry = STAILQ_FIRST(&queue->entries);
+    if (entry != NULL) {
+        STAILQ_REMOVE_HEAD(&queue->entries, entry);
+        queue->count--;
+        chunk = entry->chunk;
+        free(entry);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return chunk;
+}
+
+static int spsc_queue_push(void *q, input_chunk *chunk) {
+    return chunk_queue_push(q, chunk);
+}
+
+static input_chunk *spsc_queue_pop(void *q) {
+    return chunk_queue_pop(q);
+}
+
+struct bench_queue {
+    const char *name;
+    void *queue;
+    int (*push)(void *queue, input_chunk *chunk);
+    input_chunk *(*pop)(void *queue);
+};
+
+static size_t chunk_count;
+static size_t chunk_size;
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return x < y ? -1 : x > y;
+}
+
+static void *producer_thread(void *arg) {
+    struct bench_queue *bq = arg;
+    for (size_t i = 0; i < chunk_count; i++) {
+        input_chunk *chunk = input_chunk_alloc(chunk_size);
+        chunk->length = chunk_size;
+        // Push timestamp is stored in chunk data
+        double pushed = now();
+        memcpy(chunk->data, &pushed, sizeof(pushed));
+        while (bq->push(bq->queue, chunk) != 0) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void run(struct bench_queue *bq) {
+    double *latencies = malloc(chunk_count * sizeof(double));
+    pthread_t producer;
+    double start = now();
+    pthread_create(&producer, NULL, producer_thread, bq);
+
+    size_t received = 0;
+    while (received < chunk_count) {
+        input_chunk *chunk = bq->pop(bq->queue);
+        if (chunk == NULL) {
+            sched_yield();
+            continue;
+        }
+        double pushed;
+        memcpy(&pushed, chunk->data, sizeof(pushed));
+        latencies[received++] = now() - pushed;
+        input_chunk_free(chunk);
+    }
+    double seconds = now() - start;
+    pthread_join(producer, NULL);
+
+    qsort(latencies, chunk_count, sizeof(double), compare_doubles);
+    double sum = 0;
+    for (size_t i = 0; i < chunk_count; i++) {
+        sum += latencies[i];
+    }
+    printf("%-8s %10.0f chunks/s %8.1f MB/s, latency avg %.2f us, p50 %.2f us, p99 %.2f us\n",
+           bq->name, chunk_count / seconds, chunk_count * chunk_size / seconds / 1e6,
+           sum / chunk_count * 1e6, latencies[chunk_count / 2] * 1e6, latencies[chunk_count * 99 / 100] * 1e6);
+    free(latencies);
+}
+
+int main(int argc, char **argv) {
+    chunk_count = argc > 1 ? (size_t) atol(argv[1]) : DEFAULT_CHUNKS;
+    chunk_size = argc > 2 ? (size_t) atol(argv[2]) : DEFAULT_CHUNK_SIZE;
+    assert (chunk_size >= sizeof(double));
+    printf("%zu chunks of %zu bytes, queue capacity %d\n", chunk_count, chunk_size, QUEUE_CAPACITY);
+
+    mutex_queue mq;
+    pthread_mutex_init(&mq.lock, NULL);
+    STAILQ_INIT(&mq.entries);
+    mq.count = 0;
+    struct bench_queue mutex_bq = { "mutex", &mq, mutex_queue_push, mutex_queue_pop };
+    run(&mutex_bq);
+    pthread_mutex_destroy(&mq.lock);
+
+    chunk_queue *queue;
+    assert (chunk_queue_create(QUEUE_CAPACITY, &queue) == 0);
+    struct bench_queue spsc_bq = { "spsc", queue, spsc_queue_push, spsc_queue_pop };
+    run(&spsc_bq);
+    chunk_queue_destroy(queue);
+    return 0;
+}
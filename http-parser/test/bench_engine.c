@@ -0,0 +1,222 @@
+//
+// Native engine benchmark: proxies small requests between loopback clients and stub servers
+// and reports requests per second and engine system calls per request for each backend.
+// Usage: bench_engine [connections] [requests per connection]
+//
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "logger.h"
+#include "parser.h"
+#include "engine.h"
+
+#define DEFAULT_CONNECTIONS 64
+#define DEFAULT_REQUESTS 2000
+
+static const char request[] = "GET / HTTP/1.1\r\n"
+        "Host: localhost\r\n"
+        "\r\n";
+
+static const char response[] = "HTTP/1.1 200 OK\r\n"
+        "Content-Length: 2\r\n"
+        "\r\n"
+        "ok";
+
+/*
+ * Driver side of one proxied connection: client socket which sends requests
+ * or stub server socket which answers them
+ */
+struct bench_socket {
+    int fd;
+    int is_client;
+    size_t received;
+    size_t sent_requests;
+};
+
+struct bench {
+    engine *eng;
+    int connections;
+    int requests;
+    struct bench_socket *clients;
+    struct bench_socket *servers;
+} bench;
+
+int http_request_received(connection_context *context, void *message) { return 0; }
+int http_request_body_started(connection_context *context) { return 0; }
+void http_request_body_data(connection_context *context, const char *data, size_t length) { }
+void http_request_body_finished(connection_context *context) { }
+int http_response_received(connection_context *context, void *message) { return 0; }
+int http_response_body_started(connection_context *context) { return 0; }
+void http_response_body_data(connection_context *context, const char *data, size_t length) { }
+void http_response_body_finished(connection_context *context) { }
+
+parser_callbacks cbs = {
+    .http_request_received = http_request_received,
+    .http_request_body_started = http_request_body_started,
+    .http_request_body_data = http_request_body_data,
+    .http_request_body_finished = http_request_body_finished,
+    .http_response_received = http_response_received,
+    .http_response_body_started = http_response_body_started,
+    .http_response_body_data = http_response_body_data,
+    .http_response_body_finished = http_response_body_finished
+};
+
+static int listen_loopback(unsigned short *port) {
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert (fd >= 0);
+    assert (bind(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+    assert (listen(fd, SOMAXCONN) == 0);
+    assert (getsockname(fd, (struct sockaddr *) &addr, &addr_len) == 0);
+    *port = ntohs(addr.sin_port);
+    return fd;
+}
+
+static int connect_loopback(unsigned short port) {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert (fd >= 0);
+    assert (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+static int accept_nodelay(int listen_fd) {
+    int fd = accept(listen_fd, NULL, NULL);
+    assert (fd >= 0);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    return fd;
+}
+
+/**
+ * Driver thread: clients send next request after receiving response, stub servers respond
+ * to every complete request. Engine is stopped when all responses are received.
+ */
+static void *driver_thread(void *arg) {
+    int epoll_fd = epoll_create1(0);
+    for (int i = 0; i < bench.connections; i++) {
+        struct epoll_event event = { .events = EPOLLIN, .data.ptr = &bench.clients[i] };
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, bench.clients[i].fd, &event);
+        event.data.ptr = &bench.servers[i];
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, bench.servers[i].fd, &event);
+    }
+
+    for (int i = 0; i < bench.connections; i++) {
+        assert (send(bench.clients[i].fd, request, strlen(request), 0) == strlen(request));
+        bench.clients[i].sent_requests++;
+    }
+
+    int finished = 0;
+    char buf[65536];
+    struct epoll_event events[64];
+    while (finished < bench.connections) {
+        int n = epoll_wait(epoll_fd, events, 64, -1);
+        for (int i = 0; i < n; i++) {
+            struct bench_socket *sock = events[i].data.ptr;
+            ssize_t r = recv(sock->fd, buf, sizeof(buf), 0);
+            assert (r > 0);
+            size_t message_length = sock->is_client ? strlen(response) : strlen(request);
+            size_t before = sock->received / message_length;
+            sock->received += r;
+            size_t complete = sock->received / message_length - before;
+            for (size_t j = 0; j < complete; j++) {
+                if (!sock->is_client) {
+                    assert (send(sock->fd, response, strlen(response), 0) == strlen(response));
+                } else if (sock->sent_requests < bench.requests) {
+                    assert (send(sock->fd, request, strlen(request), 0) == strlen(request));
+                    sock->sent_requests++;
+                } else {
+                    finished++;
+                }
+            }
+        }
+    }
+
+    close(epoll_fd);
+    engine_stop(bench.eng);
+    return NULL;
+}
+
+static void run(logger *log, engine_backend_t backend, const char *name) {
+    parser_context *pctx;
+    assert (parser_create(log, &pctx) == 0);
+    assert (engine_create(log, pctx, backend, NULL, &bench.eng) == 0);
+
+    unsigned short proxy_port, server_port;
+    int proxy_listen_fd = listen_loopback(&proxy_port);
+    int server_listen_fd = listen_loopback(&server_port);
+
+    bench.clients = calloc(bench.connections, sizeof(struct bench_socket));
+    bench.servers = calloc(bench.connections, sizeof(struct bench_socket));
+    for (int i = 0; i < bench.connections; i++) {
+        bench.clients[i].fd = connect_loopback(proxy_port);
+        bench.clients[i].is_client = 1;
+        int engine_client_fd = accept_nodelay(proxy_listen_fd);
+        int engine_server_fd = connect_loopback(server_port);
+        bench.servers[i].fd = accept_nodelay(server_listen_fd);
+        assert (engine_add_connection(bench.eng, (connection_id_t) i, engine_client_fd, engine_server_fd,
+                                      &cbs, NULL) == 0);
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pthread_t driver;
+    pthread_create(&driver, NULL, driver_thread, NULL);
+    assert (engine_run(bench.eng) == 0);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    pthread_join(driver, NULL);
+
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+    double total = (double) bench.connections * bench.requests;
+    engine_stats stats;
+    engine_get_stats(bench.eng, &stats);
+    printf("%-10s connections=%d requests=%.0f: %.0f requests/s, %.2f syscalls/request\n",
+           name, bench.connections, total, total / seconds, stats.syscalls / total);
+
+    for (int i = 0; i < bench.connections; i++) {
+        close(bench.clients[i].fd);
+        close(bench.servers[i].fd);
+    }
+    free(bench.clients);
+    free(bench.servers);
+    close(proxy_listen_fd);
+    close(server_listen_fd);
+    engine_destroy(bench.eng);
+    parser_destroy(pctx);
+}
+
+int main(int argc, char **argv) {
+    bench.connections = argc > 1 ? atoi(argv[1]) : DEFAULT_CONNECTIONS;
+    bench.requests = argc > 2 ? atoi(argv[2]) : DEFAULT_REQUESTS;
+
+    logger *log = logger_open(NULL, LOG_LEVEL_ERROR, NULL, NULL);
+    run(log, ENGINE_BACKEND_EPOLL, "epoll");
+    if (engine_backend_supported(ENGINE_BACKEND_IO_URING)) {
+        run(log, ENGINE_BACKEND_IO_URING, "io_uring");
+    } else {
+        printf("io_uring backend is not supported\n");
+    }
+    logger_close(log);
+    return 0;
+}
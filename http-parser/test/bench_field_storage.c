@@ -0,0 +1,129 @@
+//
+// Header field storage benchmark: parses typical browser requests and reports
+// parsing time and heap memory used by parsed messages, without and with interning.
+// Usage: bench_field_storage [messages]
+//
+
+#include <assert.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "logger.h"
+#include "parser.h"
+
+#define DEFAULT_MESSAGES 100000
+// Number of parsed messages which are kept to measure memory
+#define KEPT_MESSAGES 10000
+
+static const char request[] = "GET /search?q=http+parser HTTP/1.1\r\n"
+        "Host: www.example.com\r\n"
+        "Connection: keep-alive\r\n"
+        "Cache-Control: max-age=0\r\n"
+        "sec-ch-ua: \"Chromium\";v=\"118\", \"Google Chrome\";v=\"118\", \"Not=A?Brand\";v=\"99\"\r\n"
+        "sec-ch-ua-mobile: ?0\r\n"
+        "sec-ch-ua-platform: \"Windows\"\r\n"
+        "Upgrade-Insecure-Requests: 1\r\n"
+        "User-Agent: Mozilla/5.0 (Windows NT 10.0; Win64; x64) AppleWebKit/537.36 "
+        "(KHTML, like Gecko) Chrome/118.0.0.0 Safari/537.36\r\n"
+        "Accept: text/html,application/xhtml+xml,application/xml;q=0.9,image/avif,image/webp,*/*;q=0.8\r\n"
+        "Sec-Fetch-Site: same-origin\r\n"
+        "Sec-Fetch-Mode: navigate\r\n"
+        "Sec-Fetch-User: ?1\r\n"
+        "Sec-Fetch-Dest: document\r\n"
+        "Referer: https://www.example.com/\r\n"
+        "Accept-Encoding: gzip, deflate, br\r\n"
+        "Accept-Language: en-US,en;q=0.9\r\n"
+        "Cookie: session=0123456789abcdef; theme=dark\r\n"
+        "\r\n";
+
+static http_message **kept;
+static size_t kept_count;
+
+int http_request_received(connection_context *context, void *message) {
+    http_message *detached = connection_detach_message(context);
+    if (kept != NULL) {
+        kept[kept_count++] = detached;
+    } else {
+        http_message_free(detached);
+    }
+    return 0;
+}
+int http_request_body_started(connection_context *context) { return 0; }
+void http_request_body_data(connection_context *context, const char *data, size_t length) { }
+void http_request_body_finished(connection_context *context) { }
+int http_response_received(connection_context *context, void *message) { return 0; }
+int http_response_body_started(connection_context *context) { return 0; }
+void http_response_body_data(connection_context *context, const char *data, size_t length) { }
+void http_response_body_finished(connection_context *context) { }
+
+parser_callbacks cbs = {
+    .http_request_received = http_request_received,
+    .http_request_body_started = http_request_body_started,
+    .http_request_body_data = http_request_body_data,
+    .http_request_body_finished = http_request_body_finished,
+    .http_response_received = http_response_received,
+    .http_response_body_started = http_response_body_started,
+    .http_response_body_data = http_response_body_data,
+    .http_response_body_finished = http_response_body_finished
+};
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Parses requests and prints results
+ * @param log Logger
+ * @param messages Number of parsed messages
+ * @param intern_flags PARSER_INTERN_* flags, or 0 if interning is disabled
+ */
+static void run(logger *log, long messages, int intern_flags) {
+    parser_context *pctx;
+    connection_context *cctx;
+    assert (parser_create(log, &pctx) == 0);
+    assert (intern_flags == 0 || parser_set_interning(pctx, intern_flags) == 0);
+    assert (parser_connect(pctx, 1L, &cbs, &cctx) == 0);
+
+    // Parsing time, messages are freed by callback
+    double start = now();
+    for (long i = 0; i < messages; i++) {
+        assert (parser_input(cctx, DIRECTION_OUT, request, sizeof(request) - 1) == 0);
+    }
+    double parse_ns = (now() - start) / messages * 1e9;
+
+    // Heap memory of kept messages
+    kept = malloc(KEPT_MESSAGES * sizeof(http_message *));
+    kept_count = 0;
+    size_t heap_before = mallinfo2().uordblks;
+    for (long i = 0; i < KEPT_MESSAGES; i++) {
+        assert (parser_input(cctx, DIRECTION_OUT, request, sizeof(request) - 1) == 0);
+    }
+    size_t heap_after = mallinfo2().uordblks;
+    assert (kept_count == KEPT_MESSAGES);
+    unsigned int field_count = kept[0]->field_count;
+    for (size_t i = 0; i < kept_count; i++) {
+        http_message_free(kept[i]);
+    }
+    free(kept);
+    kept = NULL;
+    parser_connection_close(cctx);
+    parser_destroy(pctx);
+    free(pctx);
+
+    printf("%u fields, %zu bytes, %-9s parse %6.0f ns, %6zu heap bytes per message\n",
+           field_count, sizeof(request) - 1, intern_flags ? "interned:" : "plain:",
+           parse_ns, (heap_after - heap_before) / KEPT_MESSAGES);
+}
+
+int main(int argc, char **argv) {
+    long messages = argc > 1 ? atol(argv[1]) : DEFAULT_MESSAGES;
+    logger *log = logger_open(NULL, LOG_LEVEL_INFO, NULL, NULL);
+    run(log, messages, 0);
+    run(log, messages, PARSER_INTERN_NAMES | PARSER_INTERN_VALUES);
+    return 0;
+}
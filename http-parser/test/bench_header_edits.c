@@ -0,0 +1,144 @@
+//
+// Header rewrite benchmark: typical proxy rewrite of response header
+// with sequential http_message_del/add/set_header_field() calls compared to
+// one http_message_apply_edits() call.
+// Usage: bench_header_edits [iterations]
+//
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "parser.h"
+
+#define DEFAULT_ITERATIONS 100000
+#define FIELD_COUNT 30
+
+static const http_header_edit edits[] = {
+        {HTTP_HEADER_EDIT_REMOVE, "Upgrade", 7, NULL, 0},
+        {HTTP_HEADER_EDIT_REMOVE, "Content-Encoding", 16, NULL, 0},
+        {HTTP_HEADER_EDIT_REMOVE, "Content-Length", 14, NULL, 0},
+        {HTTP_HEADER_EDIT_ADD, "Transfer-Encoding", 17, "chunked", 7},
+        {HTTP_HEADER_EDIT_SET, "Connection", 10, "keep-alive", 10},
+};
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Creates response with typical header fields, padded to FIELD_COUNT fields
+ * @return New message
+ */
+static http_message *create_message() {
+    static const char *fields[][2] = {
+            {"Content-Type", "text/html; charset=utf-8"}, {"Content-Encoding", "gzip"},
+            {"Content-Length", "12345"}, {"Connection", "Upgrade"}, {"Upgrade", "h2c"}
+    };
+    http_message *message = http_message_create();
+    http_message_set_status_code(message, 200);
+    http_message_set_status(message, "OK", 2);
+    char name[32], value[64];
+    for (int i = 0; i < FIELD_COUNT; i++) {
+        const char *field_name = name, *field_value = value;
+        if (i < sizeof(fields) / sizeof(fields[0])) {
+            field_name = fields[i][0];
+            field_value = fields[i][1];
+        } else {
+            snprintf(name, sizeof(name), "X-Header-%d", i);
+            snprintf(value, sizeof(value), "value-%d; some=parameter", i);
+        }
+        http_message_add_header_field(message, field_name, strlen(field_name));
+        http_message_set_header_field(message, field_name, strlen(field_name), field_value, strlen(field_value));
+    }
+    return message;
+}
+
+/**
+ * Rewrites header with one call per edit
+ * @param message Message
+ */
+static void rewrite_sequential(http_message *message) {
+    size_t value_length;
+    for (size_t i = 0; i < sizeof(edits) / sizeof(edits[0]); i++) {
+        const http_header_edit *edit = &edits[i];
+        switch (edit->type) {
+            case HTTP_HEADER_EDIT_REMOVE:
+                while (http_message_del_header_field(message, edit->name, edit->name_length) == 0);
+                break;
+            case HTTP_HEADER_EDIT_ADD:
+                http_message_add_header_field(message, edit->name, edit->name_length);
+                http_message_set_header_field(message, edit->name, edit->name_length,
+                                              edit->value, edit->value_length);
+                break;
+            case HTTP_HEADER_EDIT_SET:
+                if (http_message_get_header_field(message, edit->name, edit->name_length, &value_length) == NULL) {
+                    http_message_add_header_field(message, edit->name, edit->name_length);
+                }
+                http_message_set_header_field(message, edit->name, edit->name_length,
+                                              edit->value, edit->value_length);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+/**
+ * Rewrites header with one batch
+ * @param message Message
+ */
+static void rewrite_batched(http_message *message) {
+    http_message_apply_edits(message, edits, sizeof(edits) / sizeof(edits[0]));
+}
+
+/**
+ * Measures average time of one rewrite of fresh clone of message
+ * @param rewrite Rewrite function
+ * @param message Message
+ * @param iterations Number of iterations
+ * @return Nanoseconds per rewrite
+ */
+static double run(void (*rewrite)(http_message *), const http_message *message, long iterations) {
+    size_t total = 0;
+    double start = now();
+    for (long i = 0; i < iterations; i++) {
+        http_message *clone = http_message_clone(message);
+        rewrite(clone);
+        total += clone->field_count;
+        http_message_free(clone);
+    }
+    double seconds = now() - start;
+    assert (total > 0);
+    return seconds / iterations * 1e9;
+}
+
+int main(int argc, char **argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : DEFAULT_ITERATIONS;
+    http_message *message = create_message();
+
+    // Both ways produce the same output
+    http_message *sequential = http_message_clone(message);
+    http_message *batched = http_message_clone(message);
+    rewrite_sequential(sequential);
+    rewrite_batched(batched);
+    size_t length, batched_length;
+    char *output = http_message_raw(sequential, &length);
+    char *batched_output = http_message_raw(batched, &batched_length);
+    assert (length == batched_length && memcmp(output, batched_output, length) == 0);
+    free(output);
+    free(batched_output);
+    http_message_free(sequential);
+    http_message_free(batched);
+
+    double sequential_ns = run(rewrite_sequential, message, iterations);
+    double batched_ns = run(rewrite_batched, message, iterations);
+    printf("%d fields, %zu edits: sequential %8.0f ns, batched %8.0f ns (%.1fx)\n",
+           FIELD_COUNT, sizeof(edits) / sizeof(edits[0]), sequential_ns, batched_ns, sequential_ns / batched_ns);
+    http_message_free(message);
+    return 0;
+}
@@ -0,0 +1,130 @@
+//
+// HTTP message serialization benchmark: http_message_raw() compared to
+// the previous implementation, which reallocated buffer for every header field.
+// Usage: bench_message_raw [iterations]
+//
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "parser.h"
+
+#define DEFAULT_ITERATIONS 100000
+
+/*
+ * Previous implementation of http_message_raw()
+ */
+static char *legacy_http_message_raw(const http_message *message, size_t *p_length) {
+    char *out_buffer;
+    size_t length, line_length = 0;
+
+    if (message == NULL) return NULL;
+
+    if (message->status && message->status_code) {
+        length = strlen(HTTP_VERSION) + strlen(message->status) + 7;
+        out_buffer = malloc(length + 1);
+        memset(out_buffer, 0, length + 1);
+        snprintf(out_buffer, length + 1, "%s %u %s\r\n",
+                 HTTP_VERSION, message->status_code,
+                 message->status);
+    } else {
+        length = strlen(HTTP_VERSION) + strlen(message->url) +
+                 strlen(message->method) + 4;
+        out_buffer = malloc(length + 1);
+        memset(out_buffer, 0, length + 1);
+        snprintf(out_buffer, length + 1, "%s %s %s\r\n",
+                 message->method, message->url, HTTP_VERSION);
+    }
+
+    for (int i = 0; i < message->field_count; i++) {
+        line_length = strlen(message->fields[i].name) +
+                      strlen(message->fields[i].value) + 4;
+        out_buffer = realloc(out_buffer, length + line_length + 1);
+        snprintf(out_buffer + length, line_length + 1, "%s: %s\r\n",
+                 message->fields[i].name,
+                 message->fields[i].value);
+        length += line_length;
+    }
+
+    out_buffer = realloc(out_buffer, length + 3);
+    snprintf(out_buffer + length, 3, "\r\n");
+    length += 2;
+
+    if (p_length != NULL) {
+        *p_length = length;
+    }
+    return out_buffer;
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Creates response with given number of header fields of typical length
+ * @param field_count Number of header fields
+ * @return New message
+ */
+static http_message *create_message(int field_count) {
+    http_message *message = http_message_create();
+    http_message_set_status_code(message, 200);
+    http_message_set_status(message, "OK", 2);
+    char name[32], value[64];
+    for (int i = 0; i < field_count; i++) {
+        int name_length = snprintf(name, sizeof(name), "X-Header-%d", i);
+        int value_length = snprintf(value, sizeof(value), "value-%d; some=parameter; other=%d", i, i * 31);
+        http_message_add_header_field(message, name, (size_t) name_length);
+        http_message_set_header_field(message, name, (size_t) name_length, value, (size_t) value_length);
+    }
+    return message;
+}
+
+/**
+ * Measures average time of one serialization
+ * @param raw Serializer
+ * @param message Message
+ * @param iterations Number of iterations
+ * @return Nanoseconds per serialization
+ */
+static double run(char *(*raw)(const http_message *, size_t *), const http_message *message, long iterations) {
+    size_t total = 0;
+    double start = now();
+    for (long i = 0; i < iterations; i++) {
+        size_t length;
+        char *output = raw(message, &length);
+        total += length;
+        free(output);
+    }
+    double seconds = now() - start;
+    assert (total > 0);
+    return seconds / iterations * 1e9;
+}
+
+int main(int argc, char **argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : DEFAULT_ITERATIONS;
+    static const int field_counts[] = {10, 50, 200};
+
+    for (size_t i = 0; i < sizeof(field_counts) / sizeof(field_counts[0]); i++) {
+        http_message *message = create_message(field_counts[i]);
+
+        // Both implementations produce the same output
+        size_t length, legacy_length;
+        char *output = http_message_raw(message, &length);
+        char *legacy_output = legacy_http_message_raw(message, &legacy_length);
+        assert (length == legacy_length && memcmp(output, legacy_output, length) == 0);
+        free(output);
+        free(legacy_output);
+
+        double legacy_ns = run(legacy_http_message_raw, message, iterations);
+        double ns = run(http_message_raw, message, iterations);
+        printf("%3d fields, %6zu bytes: legacy %8.0f ns, two-pass %8.0f ns (%.1fx)\n",
+               field_counts[i], length, legacy_ns, ns, legacy_ns / ns);
+        http_message_free(message);
+    }
+    return 0;
+}
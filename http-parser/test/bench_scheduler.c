@@ -0,0 +1,173 @@
+//
+// Scheduler benchmark: parses pipelined requests of many synthetic connections with single-threaded
+// parser_input() and with scheduler on different numbers of worker threads.
+// Usage: bench_scheduler [connections] [thread counts...]
+//
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "logger.h"
+#include "parser.h"
+#include "scheduler.h"
+
+#define DEFAULT_CONNECTIONS 4096
+#define REQUEST_COUNT 16
+#define BODY_LENGTH 1024
+#define CHUNK_SIZE 4096
+
+static char *input;
+static size_t input_length;
+static unsigned long checksums[2];
+
+int http_request_received(connection_context *context, void *message) { return 0; }
+int http_request_body_started(connection_context *context) { return 0; }
+
+void http_request_body_data(connection_context *context, const char *data, size_t length) {
+    // Some work per body byte, like filtering content would do
+    unsigned long sum = 0;
+    for (size_t i = 0; i < length; i++) {
+        sum = sum * 31 + (unsigned char) data[i];
+    }
+    __atomic_add_fetch(&checksums[connection_get_id(context) & 1], sum & 0xff, __ATOMIC_RELAXED);
+}
+
+void http_request_body_finished(connection_context *context) { }
+int http_response_received(connection_context *context, void *message) { return 0; }
+int http_response_body_started(connection_context *context) { return 0; }
+void http_response_body_data(connection_context *context, const char *data, size_t length) { }
+void http_response_body_finished(connection_context *context) { }
+
+parser_callbacks cbs = {
+    .http_request_received = http_request_received,
+    .http_request_body_started = http_request_body_started,
+    .http_request_body_data = http_request_body_data,
+    .http_request_body_finished = http_request_body_finished,
+    .http_response_received = http_response_received,
+    .http_response_body_started = http_response_body_started,
+    .http_response_body_data = http_response_body_data,
+    .http_response_body_finished = http_response_body_finished
+};
+
+static void make_input() {
+    size_t capacity = REQUEST_COUNT * (BODY_LENGTH + 256);
+    input = malloc(capacity);
+    input_length = 0;
+    for (int i = 0; i < REQUEST_COUNT; i++) {
+        input_length += snprintf(input + input_length, capacity - input_length,
+                                 "POST /upload/%d HTTP/1.1\r\n"
+                                 "Host: example.org\r\n"
+                                 "User-Agent: bench_scheduler\r\n"
+                                 "Content-Type: application/octet-stream\r\n"
+                                 "Content-Length: %d\r\n"
+                                 "\r\n", i, BODY_LENGTH);
+        for (int j = 0; j < BODY_LENGTH; j++) {
+            input[input_length++] = (char) ('a' + (i + j) % 26);
+        }
+    }
+}
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void report(const char *name, int connections, double seconds) {
+    double bytes = (double) input_length * connections;
+    printf("%-22s %8.1f MB/s %10.0f requests/s\n", name,
+           bytes / seconds / 1e6, (double) connections * REQUEST_COUNT / seconds);
+}
+
+static void bench_single_thread(logger *log, int connection_count) {
+    parser_context *pctx;
+    assert (parser_create(log, &pctx) == 0);
+    connection_context **contexts = malloc(connection_count * sizeof(connection_context *));
+    for (int i = 0; i < connection_count; i++) {
+        assert (parser_connect(pctx, (connection_id_t) i, &cbs, &contexts[i]) == 0);
+    }
+
+    double start = now();
+    for (size_t offset = 0; offset < input_length; offset += CHUNK_SIZE) {
+        size_t length = input_length - offset < CHUNK_SIZE ? input_length - offset : CHUNK_SIZE;
+        for (int i = 0; i < connection_count; i++) {
+            assert (parser_input(contexts[i], DIRECTION_OUT, input + offset, length) == 0);
+        }
+    }
+    report("parser_input", connection_count, now() - start);
+
+    for (int i = 0; i < connection_count; i++) {
+        parser_connection_close(contexts[i]);
+    }
+    free(contexts);
+    parser_destroy(pctx);
+}
+
+static void bench_scheduler(logger *log, int connection_count, int thread_count) {
+    parser_context *pctx;
+    assert (parser_create(log, &pctx) == 0);
+    parser_scheduler *scheduler;
+    assert (parser_scheduler_create(pctx, thread_count, &scheduler) == 0);
+    connection_context **contexts = malloc(connection_count * sizeof(connection_context *));
+    scheduler_connection **handles = malloc(connection_count * sizeof(scheduler_connection *));
+    for (int i = 0; i < connection_count; i++) {
+        assert (parser_connect(pctx, (connection_id_t) i, &cbs, &contexts[i]) == 0);
+        assert (parser_scheduler_attach(scheduler, contexts[i], &handles[i]) == 0);
+    }
+
+    double start = now();
+    for (size_t offset = 0; offset < input_length; offset += CHUNK_SIZE) {
+        size_t length = input_length - offset < CHUNK_SIZE ? input_length - offset : CHUNK_SIZE;
+        for (int i = 0; i < connection_count; i++) {
+            assert (parser_scheduler_input(handles[i], DIRECTION_OUT, input + offset, length) == 0);
+        }
+    }
+    parser_scheduler_wait(scheduler);
+    double seconds = now() - start;
+
+    char name[64];
+    snprintf(name, sizeof(name), "scheduler, %d threads", thread_count);
+    report(name, connection_count, seconds);
+    scheduler_stats stats;
+    parser_scheduler_get_stats(scheduler, &stats);
+    printf("%-22s %lu chunks, %lu steals\n", "", stats.chunks, stats.steals);
+
+    for (int i = 0; i < connection_count; i++) {
+        assert (parser_scheduler_get_error(handles[i]) == PARSER_OK);
+    }
+    parser_scheduler_destroy(scheduler);
+    for (int i = 0; i < connection_count; i++) {
+        parser_connection_close(contexts[i]);
+    }
+    free(handles);
+    free(contexts);
+    parser_destroy(pctx);
+}
+
+int main(int argc, char **argv) {
+    int connection_count = argc > 1 ? atoi(argv[1]) : DEFAULT_CONNECTIONS;
+    int default_threads[] = { 1, 8, 16, 32, 64 };
+
+    make_input();
+    logger *log = logger_open(NULL, LOG_LEVEL_ERROR, NULL, NULL);
+    printf("%d connections, %d requests with %d bytes body each, %d bytes chunks\n",
+           connection_count, REQUEST_COUNT, BODY_LENGTH, CHUNK_SIZE);
+
+    bench_single_thread(log, connection_count);
+    if (argc > 2) {
+        for (int i = 2; i < argc; i++) {
+            bench_scheduler(log, connection_count, atoi(argv[i]));
+        }
+    } else {
+        for (int i = 0; i < sizeof(default_threads) / sizeof(default_threads[0]); i++) {
+            bench_scheduler(log, connection_count, default_threads[i]);
+        }
+    }
+
+    logger_close(log);
+    free(input);
+    return 0;
+}
@@ -0,0 +1,129 @@
+//
+// Serialized message header cache benchmark: responses of few origins, which differ only by
+// Date, Content-Length and Set-Cookie, serialized by http_message_serialize_into() and through cache.
+// Usage: bench_serialize_cache [iterations]
+//
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "parser.h"
+#include "serialize_cache.h"
+
+#define DEFAULT_ITERATIONS 1000000
+#define ORIGIN_COUNT 8
+#define MESSAGE_COUNT 1024
+#define FIELD_COUNT 20
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/**
+ * Creates response template of origin
+ * @param origin Origin number
+ * @return New message
+ */
+static http_message *create_template(int origin) {
+    static const char *fields[][2] = {
+            {"Date", "Mon, 19 Oct 2026 10:00:00 GMT"}, {"Server", "nginx/1.24.0"},
+            {"Content-Type", "text/html; charset=utf-8"}, {"Content-Length", "0"},
+            {"Connection", "keep-alive"}, {"Cache-Control", "private, max-age=0, must-revalidate"},
+            {"Set-Cookie", "session=0; Path=/; HttpOnly; Secure"},
+            {"Strict-Transport-Security", "max-age=31536000; includeSubDomains"},
+            {"X-Frame-Options", "SAMEORIGIN"}, {"X-Content-Type-Options", "nosniff"},
+            {"Vary", "Accept-Encoding"}, {"Content-Encoding", "gzip"}
+    };
+    http_message *message = http_message_create();
+    http_message_set_status_code(message, 200);
+    http_message_set_status(message, "OK", 2);
+    char name[32], value[64];
+    for (int i = 0; i < FIELD_COUNT; i++) {
+        const char *field_name = name, *field_value = value;
+        if (i < sizeof(fields) / sizeof(fields[0])) {
+            field_name = fields[i][0];
+            field_value = fields[i][1];
+        } else {
+            snprintf(name, sizeof(name), "X-Origin-Header-%d", i);
+            snprintf(value, sizeof(value), "origin-%d; value=%d", origin, i);
+        }
+        http_message_append_header_field(message, field_name, strlen(field_name), field_value, strlen(field_value));
+    }
+    return message;
+}
+
+/**
+ * Measures average time of one serialization
+ * @param cache Cache, or NULL for direct serialization
+ * @param messages Messages
+ * @param iterations Number of iterations
+ * @return Nanoseconds per serialization
+ */
+static double run(http_serialize_cache *cache, http_message **messages, long iterations) {
+    char buffer[4096];
+    size_t total = 0, length;
+    double start = now();
+    for (long i = 0; i < iterations; i++) {
+        const http_message *message = messages[i % MESSAGE_COUNT];
+        int r = cache != NULL ? http_serialize_cache_serialize(cache, message, buffer, sizeof(buffer), &length)
+                              : http_message_serialize_into(message, buffer, sizeof(buffer), &length);
+        assert (r == 0);
+        total += length;
+    }
+    double seconds = now() - start;
+    assert (total > 0);
+    return seconds / iterations * 1e9;
+}
+
+int main(int argc, char **argv) {
+    long iterations = argc > 1 ? atol(argv[1]) : DEFAULT_ITERATIONS;
+    http_message *templates[ORIGIN_COUNT];
+    for (int i = 0; i < ORIGIN_COUNT; i++) {
+        templates[i] = create_template(i);
+    }
+    // Responses differ from templates by volatile fields only
+    http_message *messages[MESSAGE_COUNT];
+    for (int i = 0; i < MESSAGE_COUNT; i++) {
+        char date[64], content_length[16], cookie[64];
+        int date_length = snprintf(date, sizeof(date), "Mon, 19 Oct 2026 10:%02d:%02d GMT", i / 60 % 60, i % 60);
+        int content_length_length = snprintf(content_length, sizeof(content_length), "%d", i * 37 % 100000);
+        int cookie_length = snprintf(cookie, sizeof(cookie), "session=%08x; Path=/; HttpOnly; Secure", i * 2654435761u);
+        messages[i] = http_message_clone(templates[i % ORIGIN_COUNT]);
+        http_message_set_header_field(messages[i], "Date", 4, date, (size_t) date_length);
+        http_message_set_header_field(messages[i], "Content-Length", 14, content_length, (size_t) content_length_length);
+        http_message_set_header_field(messages[i], "Set-Cookie", 10, cookie, (size_t) cookie_length);
+    }
+
+    // Both ways produce the same output
+    http_serialize_cache *cache;
+    assert (http_serialize_cache_create(64, &cache) == 0);
+    for (int i = 0; i < MESSAGE_COUNT; i++) {
+        char expected[4096], output[4096];
+        size_t expected_length, length;
+        assert (http_message_serialize_into(messages[i], expected, sizeof(expected), &expected_length) == 0);
+        assert (http_serialize_cache_serialize(cache, messages[i], output, sizeof(output), &length) == 0);
+        assert (length == expected_length && memcmp(output, expected, length) == 0);
+    }
+
+    double direct_ns = run(NULL, messages, iterations);
+    double cached_ns = run(cache, messages, iterations);
+    http_serialize_cache_stats stats;
+    http_serialize_cache_get_stats(cache, &stats);
+    printf("%d origins, %d fields: direct %6.0f ns, cached %6.0f ns (%.1fx), hit rate %.2f%%, %lu collisions\n",
+           ORIGIN_COUNT, FIELD_COUNT, direct_ns, cached_ns, direct_ns / cached_ns,
+           100.0 * stats.hits / stats.lookups, stats.collisions);
+
+    http_serialize_cache_destroy(cache);
+    for (int i = 0; i < MESSAGE_COUNT; i++) {
+        http_message_free(messages[i]);
+    }
+    for (int i = 0; i < ORIGIN_COUNT; i++) {
+        http_message_free(templates[i]);
+    }
+    return 0;
+}
@@ -0,0 +1,213 @@
+//
+// SPSC chunk queue test: ordering and ownership in one thread, handoff between producer
+// and consumer threads, draining into parser with pauses.
+//
+
+#include <assert.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "logger.h"
+#include "parser.h"
+#include "chunk_queue.h"
+
+#define QUEUE_CAPACITY 16
+#define HANDOFF_CHUNKS 200000
+#define REQUEST_COUNT 50
+
+int requests;
+int body_finished;
+size_t body_length;
+int pause_on_data;
+
+int http_request_received(connection_context *context, void *message) {
+    char url[32];
+    snprintf(url, sizeof(url), "/%d", requests);
+    assert (!strcmp(((http_message *) message)->url, url));
+    requests++;
+    return 0;
+}
+
+int http_request_body_started(connection_context *context) {
+    return 0;
+}
+
+void http_request_body_data(connection_context *context, const char *data, size_t length) {
+    body_length += length;
+    if (pause_on_data) {
+        assert (parser_connection_pause(context) == 0);
+    }
+}
+
+void http_request_body_finished(connection_context *context) {
+    body_finished++;
+}
+
+int http_response_received(connection_context *context, void *message) {
+    return 0;
+}
+
+int http_response_body_started(connection_context *context) {
+    return 0;
+}
+
+void http_response_body_data(connection_context *context, const char *data, size_t length) {
+}
+
+void http_response_body_finished(connection_context *context) {
+}
+
+parser_callbacks cbs = {
+    .http_request_received = http_request_received,
+    .http_request_body_started = http_request_body_started,
+    .http_request_body_data = http_request_body_data,
+    .http_request_body_finished = http_request_body_finished,
+    .http_response_received = http_response_received,
+    .http_response_body_started = http_response_body_started,
+    .http_response_body_data = http_response_body_data,
+    .http_response_body_finished = http_response_body_finished
+};
+
+static input_chunk *make_chunk(unsigned int seq) {
+    input_chunk *chunk = input_chunk_alloc(sizeof(seq));
+    memcpy(chunk->data, &seq, sizeof(seq));
+    chunk->length = sizeof(seq);
+    return chunk;
+}
+
+static unsigned int chunk_seq(input_chunk *chunk) {
+    unsigned int seq;
+    memcpy(&seq, chunk->data, sizeof(seq));
+    return seq;
+}
+
+static void test_single_thread() {
+    fprintf(stderr, "Testing queue in single thread\n");
+    chunk_queue *queue;
+    assert (chunk_queue_create(0, &queue) == PARSER_INVALID_ARGUMENT_ERROR);
+    // Capacity is rounded up to a power of two
+    assert (chunk_queue_create(QUEUE_CAPACITY - 1, &queue) == 0);
+    assert (chunk_queue_is_empty(queue));
+    assert (chunk_queue_pop(queue) == NULL);
+
+    for (unsigned int round = 0; round < 3; round++) {
+        for (unsigned int i = 0; i < QUEUE_CAPACITY; i++) {
+            assert (chunk_queue_push(queue, make_chunk(i)) == 0);
+        }
+        // Full queue doesn't take ownership
+        input_chunk *extra = make_chunk(QUEUE_CAPACITY);
+        assert (chunk_queue_push(queue, extra) != 0);
+        input_chunk_free(extra);
+        assert (!chunk_queue_is_empty(queue));
+
+        for (unsigned int i = 0; i < QUEUE_CAPACITY; i++) {
+            input_chunk *chunk = chunk_queue_pop(queue);
+            assert (chunk != NULL);
+            assert (chunk_seq(chunk) == i);
+            input_chunk_free(chunk);
+        }
+        assert (chunk_queue_pop(queue) == NULL);
+        assert (chunk_queue_is_empty(queue));
+    }
+
+    // Remaining chunks are freed by destroy
+    assert (chunk_queue_push(queue, make_chunk(0)) == 0);
+    chunk_queue_destroy(queue);
+}
+
+static void *producer_thread(void *arg) {
+    chunk_queue *queue = arg;
+    for (unsigned int i = 0; i < HANDOFF_CHUNKS; i++) {
+        input_chunk *chunk = make_chunk(i);
+        while (chunk_queue_push(queue, chunk) != 0) {
+            sched_yield();
+        }
+    }
+    return NULL;
+}
+
+static void test_handoff() {
+    fprintf(stderr, "Testing handoff between threads\n");
+    chunk_queue *queue;
+    assert (chunk_queue_create(QUEUE_CAPACITY, &queue) == 0);
+    pthread_t producer;
+    pthread_create(&producer, NULL, producer_thread, queue);
+
+    unsigned int expected = 0;
+    while (expected < HANDOFF_CHUNKS) {
+        input_chunk *chunk = chunk_queue_pop(queue);
+        if (chunk == NULL) {
+            sched_yield();
+            continue;
+        }
+        assert (chunk_seq(chunk) == expected);
+        expected++;
+        input_chunk_free(chunk);
+    }
+    pthread_join(producer, NULL);
+    assert (chunk_queue_is_empty(queue));
+    chunk_queue_destroy(queue);
+}
+
+static void test_drain(parser_context *pctx, int pause) {
+    fprintf(stderr, "Testing drain into parser%s\n", pause ? " with pauses" : "");
+    requests = 0;
+    body_finished = 0;
+    body_length = 0;
+    pause_on_data = pause;
+
+    char input[REQUEST_COUNT * 128];
+    size_t input_length = 0;
+    for (int i = 0; i < REQUEST_COUNT; i++) {
+        input_length += snprintf(input + input_length, sizeof(input) - input_length,
+                                 "POST /%d HTTP/1.1\r\nContent-Length: 5\r\n\r\nhello", i);
+    }
+
+    connection_context *cctx;
+    assert (parser_connect(pctx, 1L, &cbs, &cctx) == 0);
+    chunk_queue *queue;
+    assert (chunk_queue_create(REQUEST_COUNT * 2, &queue) == 0);
+
+    // Push input in chunks of 37 bytes, then drain it
+    for (size_t offset = 0; offset < input_length; offset += 37) {
+        size_t length = input_length - offset < 37 ? input_length - offset : 37;
+        input_chunk *chunk = input_chunk_alloc(length);
+        chunk->direction = DIRECTION_OUT;
+        memcpy(chunk->data, input + offset, length);
+        chunk->length = length;
+        assert (chunk_queue_push(queue, chunk) == 0);
+    }
+
+    int pauses = 0;
+    int r;
+    while ((r = chunk_queue_drain(queue, cctx)) == PARSER_PAUSED) {
+        pauses++;
+        assert (parser_connection_resume(cctx) == 0);
+    }
+    assert (r == 0);
+    assert (chunk_queue_is_empty(queue));
+    assert (pause ? pauses >= REQUEST_COUNT : pauses == 0);
+    assert (requests == REQUEST_COUNT);
+    assert (body_finished == REQUEST_COUNT);
+    assert (body_length == REQUEST_COUNT * 5);
+
+    chunk_queue_destroy(queue);
+    parser_connection_close(cctx);
+}
+
+int main(int argc, char **argv) {
+    test_single_thread();
+    test_handoff();
+
+    logger *log = logger_open(NULL, LOG_LEVEL_INFO, NULL, NULL);
+    parser_context *pctx;
+    assert (parser_create(log, &pctx) == 0);
+    test_drain(pctx, 0);
+    test_drain(pctx, 1);
+    parser_destroy(pctx);
+    logger_close(log);
+    return 0;
+}
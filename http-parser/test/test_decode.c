@@ -17,6 +17,9 @@ struct process_context {
     int finished;
 } process_context;
 
+// Take ownership of response messages in callback
+int detach_message;
+
 struct test_file {
     char *name;
     char *contents;
@@ -38,6 +41,12 @@ void http_request_body_finished(connection_context *context) {
 
 }
 int http_response_received(connection_context *context, void *message) {
+    if (detach_message) {
+        http_message *detached = connection_detach_message(context);
+        assert (detached == message);
+        assert (connection_detach_message(context) == NULL);
+        http_message_free(detached);
+    }
     return 0;
 }
 
@@ -128,6 +137,11 @@ int main(int argc, char **argv) {
         return 1;
     }
 
+    process(cctx, &license_txt_http_gzip, &license_txt);
+    process(cctx, &license_txt_http_gzip_chunked, &license_txt);
+
+    // Body is decoded after message is detached and freed
+    detach_message = 1;
     process(cctx, &license_txt_http_gzip, &license_txt);
     process(cctx, &license_txt_http_gzip_chunked, &license_txt);
     return 0;
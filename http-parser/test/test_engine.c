@@ -0,0 +1,347 @@
+//
+// Native engine test: proxies request/response between socket pair and loopback stub server
+//
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "logger.h"
+#include "parser.h"
+#include "engine.h"
+
+#include "test_http_parser.h"
+
+static const char request[] = "GET /test HTTP/1.1\r\n"
+        "Host: 127.0.0.1\r\n"
+        "Accept: */*\r\n"
+        "\r\n";
+
+static const char response[] = "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/plain\r\n"
+        "Content-Length: 12\r\n"
+        "\r\n"
+        "Hello world!";
+
+// Response which body is terminated by EOF
+static const char eof_response[] = "HTTP/1.1 200 OK\r\n"
+        "Content-Type: text/plain\r\n"
+        "\r\n"
+        "Hello world!";
+
+struct stub_server {
+    int listen_fd;
+    unsigned short port;
+    const char *response;
+    char received[1024];
+    size_t received_length;
+} stub;
+
+int callbacks_mask;
+int content_length;
+int closed;
+error_type_t closed_error;
+// If set, response received callback pauses connection
+int pause_response;
+
+int http_request_received(connection_context *context, void *message) {
+    callbacks_mask |= HTTP_REQUEST_RECEIVED;
+    return 0;
+}
+
+int http_request_body_started(connection_context *context) {
+    callbacks_mask |= HTTP_REQUEST_BODY_STARTED;
+    return 0;
+}
+
+void http_request_body_data(connection_context *context, const char *data, size_t length) {
+    callbacks_mask |= HTTP_REQUEST_BODY_DATA;
+}
+
+void http_request_body_finished(connection_context *context) {
+    callbacks_mask |= HTTP_REQUEST_BODY_FINISHED;
+}
+
+int http_response_received(connection_context *context, void *message) {
+    callbacks_mask |= HTTP_RESPONSE_RECEIVED;
+    if (pause_response) {
+        parser_connection_pause(context);
+    }
+    return 0;
+}
+
+int http_response_body_started(connection_context *context) {
+    callbacks_mask |= HTTP_RESPONSE_BODY_STARTED;
+    return 0;
+}
+
+void http_response_body_data(connection_context *context, const char *data, size_t length) {
+    callbacks_mask |= HTTP_RESPONSE_BODY_DATA;
+    content_length += length;
+}
+
+void http_response_body_finished(connection_context *context) {
+    callbacks_mask |= HTTP_RESPONSE_BODY_FINISHED;
+}
+
+void connection_closed(connection_context *context, error_type_t error) {
+    closed = 1;
+    closed_error = error;
+}
+
+parser_callbacks cbs = {
+    .http_request_received = http_request_received,
+    .http_request_body_started = http_request_body_started,
+    .http_request_body_data = http_request_body_data,
+    .http_request_body_finished = http_request_body_finished,
+    .http_response_received = http_response_received,
+    .http_response_body_started = http_response_body_started,
+    .http_response_body_data = http_response_body_data,
+    .http_response_body_finished = http_response_body_finished
+};
+
+engine_callbacks engine_cbs = {
+    .connection_closed = connection_closed
+};
+
+/**
+ * Stub server: reads request, writes response and closes connection after client's EOF
+ */
+static void *stub_server_thread(void *arg) {
+    int fd = accept(stub.listen_fd, NULL, NULL);
+    assert (fd >= 0);
+    ssize_t n;
+    while ((n = recv(fd, stub.received + stub.received_length,
+                     sizeof(stub.received) - stub.received_length - 1, 0)) > 0) {
+        stub.received_length += n;
+        stub.received[stub.received_length] = 0;
+        if (strstr(stub.received, "\r\n\r\n") != NULL) {
+            assert (send(fd, stub.response, strlen(stub.response), 0) == strlen(stub.response));
+        }
+    }
+    close(fd);
+    return NULL;
+}
+
+static void stub_server_start(pthread_t *thread) {
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    stub.listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert (stub.listen_fd >= 0);
+    assert (bind(stub.listen_fd, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+    assert (listen(stub.listen_fd, 1) == 0);
+    assert (getsockname(stub.listen_fd, (struct sockaddr *) &addr, &addr_len) == 0);
+    stub.port = ntohs(addr.sin_port);
+    pthread_create(thread, NULL, stub_server_thread, NULL);
+}
+
+static int stub_server_connect() {
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(stub.port);
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    assert (fd >= 0);
+    assert (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0);
+    return fd;
+}
+
+/**
+ * Proxies one request/response through engine with given backend
+ * @param pause If set, response received callback pauses connection, and it's resumed by test
+ */
+static void test_backend(logger *log, engine_backend_t backend, int pause) {
+    fprintf(stderr, "Testing engine backend %d%s\n", (int) backend, pause ? " with paused response" : "");
+    memset(&stub, 0, sizeof(stub));
+    stub.response = response;
+    callbacks_mask = 0;
+    content_length = 0;
+    closed = 0;
+    pause_response = pause;
+
+    pthread_t stub_thread;
+    stub_server_start(&stub_thread);
+
+    parser_context *pctx;
+    assert (parser_create(log, &pctx) == 0);
+    engine *eng;
+    assert (engine_create(log, pctx, backend, &engine_cbs, &eng) == 0);
+
+    // Client side is a socket pair, test writes request to one end, engine owns the other
+    int client_fds[2];
+    assert (socketpair(AF_UNIX, SOCK_STREAM, 0, client_fds) == 0);
+    int server_fd = stub_server_connect();
+
+    connection_context *cctx;
+    assert (engine_add_connection(eng, 1L, client_fds[0], server_fd, &cbs, &cctx) == 0);
+    assert (engine_get_connection_count(eng) == 1);
+
+    assert (send(client_fds[1], request, strlen(request), 0) == strlen(request));
+
+    char received[1024];
+    size_t received_length = 0;
+    if (pause) {
+        // Nothing is forwarded to client while connection is paused
+        for (int i = 0; i < 1000 && !(callbacks_mask & HTTP_RESPONSE_RECEIVED); i++) {
+            assert (engine_run_once(eng, 10) >= 0);
+        }
+        for (int i = 0; i < 10; i++) {
+            assert (engine_run_once(eng, 10) >= 0);
+        }
+        assert (recv(client_fds[1], received, sizeof(received), MSG_DONTWAIT) < 0);
+        assert (content_length == 0);
+        assert (!closed);
+        assert (engine_get_connection_count(eng) == 1);
+        // Test thread runs the engine, so connection may be resumed here
+        pause_response = 0;
+        assert (parser_connection_resume(cctx) == 0);
+    }
+
+    // Receive proxied response
+    for (int i = 0; i < 1000 && received_length < strlen(response); i++) {
+        assert (engine_run_once(eng, 10) >= 0);
+        ssize_t n = recv(client_fds[1], received + received_length,
+                         sizeof(received) - received_length, MSG_DONTWAIT);
+        if (n > 0) {
+            received_length += n;
+        }
+    }
+    assert (received_length == strlen(response));
+    assert (!memcmp(received, response, received_length));
+    assert (callbacks_mask == (HTTP_REQUEST_RECEIVED | HTTP_RESPONSE_RECEIVED | HTTP_RESPONSE_BODY_STARTED |
+                               HTTP_RESPONSE_BODY_DATA | HTTP_RESPONSE_BODY_FINISHED));
+    assert (content_length == 12);
+
+    // Client closes its side, engine should close server side and then the whole connection
+    shutdown(client_fds[1], SHUT_WR);
+    for (int i = 0; i < 1000 && !closed; i++) {
+        assert (engine_run_once(eng, 10) >= 0);
+    }
+    assert (closed);
+    assert (closed_error == PARSER_OK);
+    assert (engine_get_connection_count(eng) == 0);
+
+    pthread_join(stub_thread, NULL);
+    // Request is forwarded unchanged
+    assert (stub.received_length == strlen(request));
+    assert (!memcmp(stub.received, request, stub.received_length));
+
+    // Client gets EOF after server closed
+    for (int i = 0; i < 1000 && engine_run_once(eng, 0) > 0; i++);
+    assert (recv(client_fds[1], received, sizeof(received), 0) == 0);
+    close(client_fds[1]);
+    close(stub.listen_fd);
+
+    engine_stats stats;
+    engine_get_stats(eng, &stats);
+    assert (stats.bytes_received == strlen(request) + strlen(response));
+    assert (stats.bytes_sent == stats.bytes_received);
+    assert (stats.syscalls > 0);
+
+    engine_destroy(eng);
+    parser_destroy(pctx);
+}
+
+/**
+ * Server sends response terminated by EOF and hangs up while connection is paused by response callback.
+ * Hang up must not be processed before held response is parsed, and it must not be reported in a loop.
+ */
+static void test_hangup_while_paused(logger *log, engine_backend_t backend) {
+    fprintf(stderr, "Testing engine backend %d with hang up while paused\n", (int) backend);
+    memset(&stub, 0, sizeof(stub));
+    stub.response = eof_response;
+    callbacks_mask = 0;
+    content_length = 0;
+    closed = 0;
+    pause_response = 1;
+
+    pthread_t stub_thread;
+    stub_server_start(&stub_thread);
+
+    parser_context *pctx;
+    assert (parser_create(log, &pctx) == 0);
+    engine *eng;
+    assert (engine_create(log, pctx, backend, &engine_cbs, &eng) == 0);
+
+    int client_fds[2];
+    assert (socketpair(AF_UNIX, SOCK_STREAM, 0, client_fds) == 0);
+    int server_fd = stub_server_connect();
+    connection_context *cctx;
+    assert (engine_add_connection(eng, 1L, client_fds[0], server_fd, &cbs, &cctx) == 0);
+
+    // Client closes its side right after request, so engine shuts down server socket for writing,
+    // and stub server closes connection after response: server socket is hung up
+    assert (send(client_fds[1], request, strlen(request), 0) == strlen(request));
+    shutdown(client_fds[1], SHUT_WR);
+    for (int i = 0; i < 1000 && !(callbacks_mask & HTTP_RESPONSE_RECEIVED); i++) {
+        assert (engine_run_once(eng, 10) >= 0);
+    }
+    assert (callbacks_mask & HTTP_RESPONSE_RECEIVED);
+    pthread_join(stub_thread, NULL);
+
+    // Hang up may be reported once, then engine must wait for resume
+    assert (engine_run_once(eng, 10) >= 0);
+    for (int i = 0; i < 10; i++) {
+        assert (engine_run_once(eng, 10) == 0);
+    }
+    assert (!(callbacks_mask & HTTP_RESPONSE_BODY_FINISHED));
+    assert (content_length == 0);
+    assert (!closed);
+
+    pause_response = 0;
+    assert (parser_connection_resume(cctx) == 0);
+
+    // Held body is parsed before EOF finishes the message
+    char received[1024];
+    size_t received_length = 0;
+    for (int i = 0; i < 1000 && !closed; i++) {
+        assert (engine_run_once(eng, 10) >= 0);
+        ssize_t n = recv(client_fds[1], received + received_length,
+                         sizeof(received) - received_length, MSG_DONTWAIT);
+        if (n > 0) {
+            received_length += n;
+        }
+    }
+    assert (closed);
+    assert (closed_error == PARSER_OK);
+    assert (callbacks_mask & HTTP_RESPONSE_BODY_FINISHED);
+    assert (content_length == 12);
+    ssize_t n;
+    while ((n = recv(client_fds[1], received + received_length, sizeof(received) - received_length, 0)) > 0) {
+        received_length += n;
+    }
+    assert (received_length == strlen(eof_response));
+    assert (!memcmp(received, eof_response, received_length));
+
+    close(client_fds[1]);
+    close(stub.listen_fd);
+    engine_destroy(eng);
+    parser_destroy(pctx);
+}
+
+int main(int argc, char **argv) {
+    logger *log = logger_open(NULL, LOG_LEVEL_INFO, NULL, NULL);
+    assert (engine_backend_supported(ENGINE_BACKEND_EPOLL));
+    test_backend(log, ENGINE_BACKEND_EPOLL, 0);
+    test_backend(log, ENGINE_BACKEND_EPOLL, 1);
+    test_hangup_while_paused(log, ENGINE_BACKEND_EPOLL);
+    if (engine_backend_supported(ENGINE_BACKEND_IO_URING)) {
+        test_backend(log, ENGINE_BACKEND_IO_URING, 0);
+        test_backend(log, ENGINE_BACKEND_IO_URING, 1);
+        test_hangup_while_paused(log, ENGINE_BACKEND_IO_URING);
+    } else {
+        fprintf(stderr, "io_uring backend is not supported, skipping\n");
+    }
+    logger_close(log);
+    return 0;
+}
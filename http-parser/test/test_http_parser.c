@@ -1,4 +1,5 @@
 #include <assert.h>
+#include <pthread.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <memory.h>
@@ -11,9 +12,11 @@
 
 int callbacks_mask;
 int content_length;
+int user_data;
 
 int http_request_received(connection_context *context, void *message) {
     callbacks_mask |= HTTP_REQUEST_RECEIVED;
+    assert(connection_get_user_data(context) == &user_data);
     return 0;
 }
 
@@ -32,6 +35,7 @@ void http_request_body_finished(connection_context *context) {
 }
 int http_response_received(connection_context *context, void *message) {
     callbacks_mask |= HTTP_RESPONSE_RECEIVED;
+    assert(connection_get_user_data(context) == &user_data);
     return 0;
 }
 
@@ -60,6 +64,215 @@ parser_callbacks cbs = {
     .http_response_body_finished = http_response_body_finished
 };
 
+/*
+ * Original header block tests
+ */
+// Unusual formatting must be kept: case of names, spaces, bare LF, folded line
+static const char raw_request[] = "POST /form HTTP/1.1\r\n"
+        "host:example.org\r\n"
+        "X-Folded: first\r\n  second\r\n"
+        "Content-Length:   4\n"
+        "\r\n";
+static const char raw_request_patched[] = "POST /form HTTP/1.1\r\n"
+        "host:example.org\r\n"
+        "Content-Length:   4\n"
+        "X-Added: 1\r\n"
+        "\r\n";
+static int raw_messages;
+
+static int raw_request_received(connection_context *context, void *m) {
+    http_message *message = m;
+    raw_messages++;
+    size_t value_length;
+    const char *value = http_message_find_header_field(message, "Content-Length", 14, &value_length);
+    assert(value != NULL && strcmp(value, "4") == 0);
+    size_t length;
+    char *raw = http_message_raw(message, &length);
+    assert(length == strlen(raw_request) && memcmp(raw, raw_request, length) == 0);
+    free(raw);
+
+    // Only changed lines are rebuilt
+    http_message *clone = http_message_clone(message);
+    assert(http_message_del_header_field(clone, "X-Folded", 8) == 0);
+    assert(http_message_add_header_field(clone, "X-Added", 7) == 0);
+    assert(http_message_set_header_field(clone, "X-Added", 7, "1", 1) == 0);
+    raw = http_message_raw(clone, &length);
+    assert(length == strlen(raw_request_patched) && memcmp(raw, raw_request_patched, length) == 0);
+    free(raw);
+    http_message_set_url(clone, "/", 1);
+    raw = http_message_raw(clone, &length);
+    static const char start[] = "POST / HTTP/1.1\r\nhost:example.org\r\n";
+    assert(strncmp(raw, start, sizeof(start) - 1) == 0);
+    free(raw);
+    http_message_free(clone);
+    return 0;
+}
+
+/**
+ * Parses two pipelined requests split into chunks of given size and checks header blocks
+ * @param pctx Parser context
+ * @param chunk_size Input chunk size
+ */
+static void test_raw_header_block(parser_context *pctx, size_t chunk_size) {
+    parser_callbacks raw_cbs = cbs;
+    raw_cbs.http_request_received = raw_request_received;
+    connection_context *cctx;
+    assert(parser_connect(pctx, 2L, &raw_cbs, &cctx) == 0);
+    connection_set_user_data(cctx, &user_data);
+
+    char input[512];
+    int input_length = snprintf(input, sizeof(input), "%sbody\r\n%sbody", raw_request, raw_request);
+    raw_messages = 0;
+    for (size_t offset = 0; offset < input_length; offset += chunk_size) {
+        size_t length = input_length - offset < chunk_size ? input_length - offset : chunk_size;
+        assert(parser_input(cctx, DIRECTION_OUT, input + offset, length) == 0);
+    }
+    assert(raw_messages == 2);
+    parser_connection_close(cctx);
+}
+
+/*
+ * Result of received callback
+ */
+static const char skipped_request[] = "POST /upgrade HTTP/1.1\r\n"
+        "Content-Length: 4\r\n"
+        "\r\n";
+static int skip_result;
+static int skip_messages;
+
+static int skip_request_received(connection_context *context, void *m) {
+    http_message *message = m;
+    skip_messages++;
+    callbacks_mask |= HTTP_REQUEST_RECEIVED;
+    // Header block is kept only if it's enabled in parser context
+    assert((message->raw != NULL) == (connection_get_user_data(context) != NULL));
+    return skip_result;
+}
+
+/**
+ * Checks that body is skipped if received callback returns 1 (skip) or 2 (upgrade),
+ * with and without original header blocks
+ * @param log Logger
+ * @param keep_raw_headers Keep original header blocks
+ */
+static void test_headers_received_result(logger *log, int keep_raw_headers) {
+    parser_context *pctx;
+    assert(parser_create(log, &pctx) == 0);
+    assert(parser_set_keep_raw_headers(pctx, keep_raw_headers) == 0);
+    parser_callbacks skip_cbs = cbs;
+    skip_cbs.http_request_received = skip_request_received;
+    for (skip_result = 0; skip_result <= 2; skip_result++) {
+        connection_context *cctx;
+        assert(parser_connect(pctx, 20L + skip_result, &skip_cbs, &cctx) == 0);
+        connection_set_user_data(cctx, keep_raw_headers ? &user_data : NULL);
+        callbacks_mask = 0;
+        skip_messages = 0;
+        assert(parser_input(cctx, DIRECTION_OUT, skipped_request, sizeof(skipped_request) - 1) == 0);
+        assert(skip_messages == 1);
+        if (skip_result == 0) {
+            assert(parser_input(cctx, DIRECTION_OUT, "body", 4) == 0);
+            assert(callbacks_mask & HTTP_REQUEST_BODY_FINISHED);
+        } else {
+            // Body isn't expected, so the next input is parsed as the next message
+            assert(parser_input(cctx, DIRECTION_OUT, skipped_request, sizeof(skipped_request) - 1) == 0);
+            assert(skip_messages == 2);
+            assert(!(callbacks_mask & HTTP_REQUEST_BODY_DATA));
+        }
+        parser_connection_close(cctx);
+    }
+    parser_destroy(pctx);
+    free(pctx);
+}
+
+/*
+ * Interning tests
+ */
+static const char interned_request[] = "GET / HTTP/1.1\r\n"
+        "Host: example.org\r\n"
+        "Upgrade-Insecure-Requests: 1\r\n"
+        "Content-Type: text/html; charset=utf-8\r\n"
+        "Cookie: a=b\r\n"
+        "\r\n";
+static http_message *interned_messages[2];
+
+static int interned_request_received(connection_context *context, void *m) {
+    interned_messages[connection_get_user_data(context) != NULL] = connection_detach_message(context);
+    return 0;
+}
+
+static void *intern_thread(void *arg) {
+    parser_context *pctx = arg;
+    char name[32];
+    for (int i = 0; i < 1000; i++) {
+        int length = snprintf(name, sizeof(name), "X-Field-%d", i % 100);
+        const char *interned = parser_intern(pctx, name, (size_t) length);
+        assert(interned != NULL && strcmp(interned, name) == 0);
+        assert(parser_intern(pctx, name, (size_t) length) == interned);
+    }
+    return NULL;
+}
+
+/**
+ * Parses the same request on two connections of parser context with interning
+ * and checks that names and frequent values are shared
+ * @param log Logger
+ */
+static void test_interning(logger *log) {
+    parser_context *pctx;
+    assert(parser_create(log, &pctx) == 0);
+    assert(parser_intern(pctx, "X", 1) == NULL);
+    assert(parser_set_interning(pctx, PARSER_INTERN_NAMES | PARSER_INTERN_VALUES) == 0);
+    assert(parser_set_interning(pctx, PARSER_INTERN_NAMES) == PARSER_INVALID_ARGUMENT_ERROR);
+
+    parser_callbacks intern_cbs = cbs;
+    intern_cbs.http_request_received = interned_request_received;
+    for (int i = 0; i < 2; i++) {
+        connection_context *cctx;
+        assert(parser_connect(pctx, 10L + i, &intern_cbs, &cctx) == 0);
+        connection_set_user_data(cctx, i ? &user_data : NULL);
+        // Split input, so strings are collected from several chunks
+        size_t half = sizeof(interned_request) / 2 + i;
+        assert(parser_input(cctx, DIRECTION_OUT, interned_request, half) == 0);
+        assert(parser_input(cctx, DIRECTION_OUT, interned_request + half, sizeof(interned_request) - 1 - half) == 0);
+        parser_connection_close(cctx);
+    }
+    http_message *first = interned_messages[0], *second = interned_messages[1];
+    assert(first != NULL && second != NULL && first->field_count == 4 && second->field_count == 4);
+    for (unsigned int i = 0; i < first->field_count; i++) {
+        assert(first->fields[i].name == second->fields[i].name);
+    }
+    assert(strcmp(first->fields[1].name, "Upgrade-Insecure-Requests") == 0);
+    // Frequent values are interned, other values are not
+    assert(first->fields[2].value == second->fields[2].value);
+    assert(strcmp(first->fields[2].value, "text/html; charset=utf-8") == 0);
+    assert(first->fields[3].value != second->fields[3].value && strcmp(first->fields[3].value, "a=b") == 0);
+
+    // Lookup by interned name
+    const char *name = parser_intern(pctx, "Cookie", 6);
+    assert(name == first->fields[3].name);
+    assert(strcmp(http_message_find_header_field(first, name, 6, NULL), "a=b") == 0);
+
+    // Concurrent interning
+    pthread_t threads[4];
+    for (int i = 0; i < 4; i++) {
+        assert(pthread_create(&threads[i], NULL, intern_thread, pctx) == 0);
+    }
+    for (int i = 0; i < 4; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    // Interned strings outlive parser context
+    parser_destroy(pctx);
+    free(pctx);
+    size_t length;
+    char *raw = http_message_raw(first, &length);
+    assert(length == sizeof(interned_request) - 1 && memcmp(raw, interned_request, length) == 0);
+    free(raw);
+    http_message_set_header_field(second, "Content-Type", 12, "text/plain", 10);
+    http_message_free(first);
+    http_message_free(second);
+}
+
 int main(int argc, char **argv) {
     logger *log = logger_open(NULL, LOG_LEVEL_INFO, NULL, NULL);
     parser_context *pctx;
@@ -72,6 +285,8 @@ int main(int argc, char **argv) {
         fprintf(stderr, "Error creating connection\n");
         return 1;
     }
+    assert(connection_get_user_data(cctx) == NULL);
+    connection_set_user_data(cctx, &user_data);
 
     int count = sizeof(messages) / sizeof(struct test_message);
     for (int i = 0; i < count; i++) {
@@ -84,5 +299,14 @@ int main(int argc, char **argv) {
         assert(content_length == message->content_length);
     }
 
+    assert(parser_set_keep_raw_headers(pctx, 1) == 0);
+    static const size_t chunk_sizes[] = {1, 2, 5, 17, 512};
+    for (int i = 0; i < sizeof(chunk_sizes) / sizeof(chunk_sizes[0]); i++) {
+        test_raw_header_block(pctx, chunk_sizes[i]);
+    }
+    test_headers_received_result(log, 0);
+    test_headers_received_result(log, 1);
+    test_interning(log);
+
     return 0;
 }
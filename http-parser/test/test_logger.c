@@ -8,9 +8,68 @@
 #include <memory.h>
 #include <unistd.h>
 
+#include <pthread.h>
+#include <stdlib.h>
+
 #include "logger.h"
 
+#define BATCHED_THREADS 4
+// Total number of records fits into ring, so nothing is dropped even if flush thread is slow
+#define BATCHED_RECORDS 200
+
+int batched_received[BATCHED_THREADS];
+int batched_callbacks;
+
+void batch_callback(logger *ctx, const logger_record *records, size_t count) {
+    assert(count > 0 && count <= LOGGER_BATCH_SIZE);
+    assert(ctx->attachment == batched_received);
+    batched_callbacks++;
+    for (size_t i = 0; i < count; i++) {
+        assert(records[i].log_level == LOG_LEVEL_INFO);
+        assert(strstr(records[i].thread_info, "tid=") != NULL);
+        int thread, seq;
+        assert(sscanf(records[i].message, "thread %d record %d", &thread, &seq) == 2);
+        // Records of each thread are delivered in order
+        assert(seq == batched_received[thread]);
+        batched_received[thread]++;
+    }
+}
+
+void *batched_log_thread(void *arg) {
+    logger *log = arg;
+    static int next_thread;
+    int thread = __atomic_fetch_add(&next_thread, 1, __ATOMIC_RELAXED);
+    for (int i = 0; i < BATCHED_RECORDS; i++) {
+        logger_log(log, LOG_LEVEL_TRACE, "filtered %d", i);
+        logger_log(log, LOG_LEVEL_INFO, "thread %d record %d", thread, i);
+    }
+    return NULL;
+}
+
+void test_batched() {
+    logger *log = logger_open_batched(LOG_LEVEL_INFO, batch_callback, batched_received);
+    assert(log != NULL);
+    assert(logger_is_enabled(log, LOG_LEVEL_INFO));
+    assert(!logger_is_enabled(log, LOG_LEVEL_TRACE));
+
+    pthread_t threads[BATCHED_THREADS];
+    for (int i = 0; i < BATCHED_THREADS; i++) {
+        pthread_create(&threads[i], NULL, batched_log_thread, log);
+    }
+    for (int i = 0; i < BATCHED_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    // Remaining records are delivered by logger_close()
+    assert(logger_close(log) == 0);
+    for (int i = 0; i < BATCHED_THREADS; i++) {
+        assert(batched_received[i] == BATCHED_RECORDS);
+    }
+    assert(batched_callbacks >= BATCHED_THREADS * BATCHED_RECORDS / LOGGER_BATCH_SIZE);
+}
+
 int main() {
+    test_batched();
+
     // Generate output file name
     char file_name[L_tmpnam];
     tmpnam(file_name);
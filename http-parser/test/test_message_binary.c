@@ -0,0 +1,141 @@
+//
+// Binary message format test: round trip, views of relocated buffer, corrupted buffers.
+//
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parser.h"
+#include "message_binary.h"
+
+/**
+ * Creates response with well-known, custom, repeated and empty fields
+ * @return New message
+ */
+static http_message *create_message() {
+    http_message *message = http_message_create();
+    http_message_set_status_code(message, 404);
+    http_message_set_status(message, "Not Found", 9);
+    http_message_append_header_field(message, "Content-Type", 12, "text/html", 9);
+    http_message_append_header_field(message, "X-Custom", 8, "custom value", 12);
+    http_message_append_header_field(message, "Set-Cookie", 10, "a=1", 3);
+    http_message_append_header_field(message, "set-cookie", 10, "b=2", 3);
+    http_message_append_header_field(message, "X-Empty", 7, "", 0);
+    return message;
+}
+
+/**
+ * Encodes message and checks that view and decoded message are equal to it
+ * @param message Message
+ */
+static void test_round_trip(const http_message *message) {
+    size_t needed;
+    assert (http_message_encode_binary(message, NULL, 0, &needed) == PARSER_BUFFER_TOO_SMALL_ERROR);
+    char *buffer = malloc(needed + 1);
+    assert (http_message_encode_binary(message, buffer, needed - 1, &needed) == PARSER_BUFFER_TOO_SMALL_ERROR);
+    assert (http_message_encode_binary(message, buffer, needed, &needed) == 0);
+
+    // Encoded buffer is relocatable and needs no alignment
+    char *moved = malloc(needed + 1);
+    memcpy(moved + 1, buffer, needed);
+    memset(buffer, 0, needed);
+    free(buffer);
+
+    http_message_view view;
+    assert (http_message_view_init(&view, moved + 1, needed) == 0);
+    assert (http_message_view_length(&view) == needed);
+    assert (view.status_code == message->status_code && view.field_count == message->field_count);
+    size_t length;
+    const char *str = http_message_view_status(&view, &length);
+    assert (message->status == NULL ? str == NULL : strcmp(str, message->status) == 0 && length == strlen(str));
+    str = http_message_view_method(&view, &length);
+    assert (message->method == NULL ? str == NULL : strcmp(str, message->method) == 0);
+    str = http_message_view_url(&view, &length);
+    assert (message->url == NULL ? str == NULL : strcmp(str, message->url) == 0);
+    for (unsigned int i = 0; i < view.field_count; i++) {
+        http_header_field_view field;
+        assert (http_message_view_field(&view, i, &field) == 0);
+        assert (strcmp(field.name, message->fields[i].name) == 0 && field.name_length == strlen(field.name));
+        assert (strcmp(field.value, message->fields[i].value) == 0 && field.value_length == strlen(field.value));
+    }
+    http_header_field_view field;
+    assert (http_message_view_field(&view, view.field_count, &field) == PARSER_INVALID_ARGUMENT_ERROR);
+
+    // Decoded message is serialized in the same way
+    http_message *decoded = http_message_view_to_message(&view);
+    size_t raw_length, decoded_length;
+    char *raw = http_message_raw(message, &raw_length);
+    char *decoded_raw = http_message_raw(decoded, &decoded_length);
+    assert (raw_length == decoded_length && memcmp(raw, decoded_raw, raw_length) == 0);
+    free(raw);
+    free(decoded_raw);
+    http_message_free(decoded);
+    free(moved);
+}
+
+/**
+ * Tests that corrupted buffers are rejected
+ */
+static void test_corrupted() {
+    http_message *message = create_message();
+    size_t needed;
+    http_message_encode_binary(message, NULL, 0, &needed);
+    unsigned char *buffer = malloc(needed);
+    assert (http_message_encode_binary(message, (char *) buffer, needed, &needed) == 0);
+    http_message_free(message);
+
+    http_message_view view;
+    assert (http_message_view_init(&view, buffer, needed - 1) == PARSER_INVALID_ARGUMENT_ERROR);
+    assert (http_message_view_init(&view, buffer, 16) == PARSER_INVALID_ARGUMENT_ERROR);
+    // Every changed byte of header and field table must be either rejected or harmless
+    for (size_t i = 0; i < 40 + 5 * 20; i++) {
+        unsigned char saved = buffer[i];
+        buffer[i] = 0xff;
+        if (http_message_view_init(&view, buffer, needed) == 0) {
+            http_header_field_view field;
+            for (unsigned int j = 0; j < view.field_count; j++) {
+                assert (http_message_view_field(&view, j, &field) == 0);
+                assert (field.name == NULL || strlen(field.name) == field.name_length);
+                assert (field.value == NULL || strlen(field.value) == field.value_length);
+            }
+        }
+        buffer[i] = saved;
+    }
+    // Missing null byte
+    buffer[needed - 1] = 'x';
+    assert (http_message_view_init(&view, buffer, needed) == PARSER_INVALID_ARGUMENT_ERROR);
+    free(buffer);
+}
+
+int main() {
+    http_message *message = create_message();
+    test_round_trip(message);
+
+    // Lookup in view
+    size_t needed;
+    http_message_encode_binary(message, NULL, 0, &needed);
+    char *buffer = malloc(needed);
+    http_message_encode_binary(message, buffer, needed, &needed);
+    http_message_view view;
+    assert (http_message_view_init(&view, buffer, needed) == 0);
+    size_t value_length;
+    const char *value = http_message_view_find_header_field(&view, "x-CUSTOM", 8, &value_length);
+    assert (value != NULL && value_length == 12 && strcmp(value, "custom value") == 0);
+    value = http_message_view_find_header_field(&view, "SET-COOKIE", 10, NULL);
+    assert (value != NULL && strcmp(value, "a=1") == 0);
+    assert (http_message_view_find_header_field(&view, "X-Custo", 7, NULL) == NULL);
+    free(buffer);
+    http_message_free(message);
+
+    // Request without fields
+    message = http_message_create();
+    http_message_set_method(message, "GET", 3);
+    http_message_set_url(message, "/index.html", 11);
+    test_round_trip(message);
+    http_message_free(message);
+
+    test_corrupted();
+    return 0;
+}
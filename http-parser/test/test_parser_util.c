@@ -8,6 +8,7 @@
 #include <stdlib.h>
 #include <memory.h>
 #include <limits.h>
+#include <pthread.h>
 
 #include "parser.h"
 
@@ -27,7 +28,402 @@ static const char correct_output_response[] = "HTTP/1.1 200 OK\r\n"
 
 static char *const HTTP_STATUS_OK = "OK";
 
+/**
+ * Tests case-insensitive header field lookup, with and without index
+ */
+static void test_find_header_field() {
+    http_message *message = http_message_create();
+    size_t value_len = INT_MAX;
+
+    // Few fields, linear scan
+    http_message_add_header_field(message, "Host", 4);
+    http_message_set_header_field(message, "Host", 4, "example.org", 11);
+    http_message_add_header_field(message, "Hostname", 8);
+    http_message_set_header_field(message, "Hostname", 8, "x", 1);
+    const char *value = http_message_find_header_field(message, "hOST", 4, &value_len);
+    assert (value != NULL && value_len == 11 && strcmp(value, "example.org") == 0);
+    // Whole name must match
+    assert (http_message_find_header_field(message, "Hos", 3, NULL) == NULL);
+    value = http_message_find_header_field(message, "HOSTNAME", 8, NULL);
+    assert (value != NULL && strcmp(value, "x") == 0);
+
+    // Many fields, lookup by index
+    char name[32], field_value[32];
+    for (int i = 0; i < 30; i++) {
+        int name_len = snprintf(name, sizeof(name), "X-Field-%d", i);
+        int value_len = snprintf(field_value, sizeof(field_value), "%d", i);
+        http_message_add_header_field(message, name, (size_t) name_len);
+        http_message_set_header_field(message, name, (size_t) name_len, field_value, (size_t) value_len);
+    }
+    for (int i = 0; i < 30; i++) {
+        int name_len = snprintf(name, sizeof(name), "x-FIELD-%d", i);
+        snprintf(field_value, sizeof(field_value), "%d", i);
+        value = http_message_find_header_field(message, name, (size_t) name_len, NULL);
+        assert (value != NULL && strcmp(value, field_value) == 0);
+    }
+    assert (http_message_find_header_field(message, "X-Field-30", 10, NULL) == NULL);
+
+    // Index is updated after fields are changed
+    value = http_message_find_header_field(message, "host", 4, NULL);
+    assert (value != NULL && strcmp(value, "example.org") == 0);
+    http_message_del_header_field(message, "Host", 4);
+    assert (http_message_find_header_field(message, "Host", 4, NULL) == NULL);
+    http_message_add_header_field(message, "Cookie", 6);
+    http_message_set_header_field(message, "Cookie", 6, "a=b", 3);
+    value = http_message_find_header_field(message, "cookie", 6, &value_len);
+    assert (value != NULL && value_len == 3);
+
+    // Clone has its own index
+    http_message *clone = http_message_clone(message);
+    value = http_message_find_header_field(clone, "x-field-29", 10, NULL);
+    assert (value != NULL && strcmp(value, "29") == 0);
+    http_message_free(clone);
+
+    http_message_free(message);
+}
+
+/**
+ * Tests serialization into caller-provided buffer and iovecs, output must be equal to http_message_raw()
+ * @param message Message
+ */
+static void test_serialize(const http_message *message) {
+    size_t raw_length;
+    char *raw = http_message_raw(message, &raw_length);
+
+    size_t needed = 0;
+    assert (http_message_serialize_into(message, NULL, 0, &needed) == PARSER_BUFFER_TOO_SMALL_ERROR);
+    assert (needed == raw_length);
+    char buffer[512];
+    assert (http_message_serialize_into(message, buffer, raw_length - 1, &needed) == PARSER_BUFFER_TOO_SMALL_ERROR);
+    assert (http_message_serialize_into(message, buffer, sizeof(buffer), &needed) == 0);
+    assert (needed == raw_length && memcmp(buffer, raw, raw_length) == 0);
+
+    struct iovec iov[32];
+    char status_buffer[HTTP_MESSAGE_IOV_BUFFER_SIZE];
+    size_t iov_count = 0;
+    assert (http_message_serialize_iov(message, iov, 1, &iov_count, status_buffer) == PARSER_BUFFER_TOO_SMALL_ERROR);
+    assert (iov_count > 1 && iov_count <= 32);
+    assert (http_message_serialize_iov(message, iov, 32, &iov_count, status_buffer) == 0);
+    size_t offset = 0;
+    for (size_t i = 0; i < iov_count; i++) {
+        assert (offset + iov[i].iov_len <= raw_length);
+        assert (memcmp(raw + offset, iov[i].iov_base, iov[i].iov_len) == 0);
+        offset += iov[i].iov_len;
+    }
+    assert (offset == raw_length);
+    free(raw);
+}
+
+/**
+ * Tests that clones share storage and are changed independently
+ */
+static void test_clone() {
+    // Long value is stored on heap and shared, short names are stored in arena
+    static const char long_value[] = "value which doesn't fit small-string arena";
+    http_message *message = http_message_create();
+    http_message_set_method(message, "GET", 3);
+    http_message_set_url(message, "/", 1);
+    for (int i = 0; i < 40; i++) {
+        char name[32];
+        int name_len = snprintf(name, sizeof(name), "X-Field-%d", i);
+        http_message_add_header_field(message, name, (size_t) name_len);
+        http_message_set_header_field(message, name, (size_t) name_len, long_value, sizeof(long_value) - 1);
+    }
+    size_t length;
+    char *original = http_message_raw(message, &length);
+
+    http_message *clone = http_message_clone(message);
+    assert (clone->fields == message->fields && clone->url == message->url);
+    http_message *clone2 = http_message_clone(clone);
+
+    // Change of clone copies field array, but not unchanged fields
+    http_message_set_header_field(clone, "X-Field-1", 9, "changed", 7);
+    http_message_del_header_field(clone, "X-Field-2", 9);
+    http_message_add_header_field(clone, "X-Added", 7);
+    http_message_set_url(clone, "/changed", 8);
+    assert (clone->fields != message->fields && clone->url != message->url);
+    assert (clone->fields[0].value == message->fields[0].value);
+    assert (clone->fields[0].name == message->fields[0].name && strcmp(clone->fields[0].name, "X-Field-0") == 0);
+    assert (clone->field_count == 40 && strcmp(clone->fields[1].value, "changed") == 0);
+    assert (strcmp(clone->fields[2].name, "X-Field-3") == 0);
+
+    // Original message and other clone are not changed
+    char *output = http_message_raw(message, &length);
+    assert (strcmp(output, original) == 0);
+    free(output);
+    http_message_free(message);
+    output = http_message_raw(clone2, &length);
+    assert (strcmp(output, original) == 0);
+    free(output);
+    http_message_set_header_field(clone2, "X-Field-39", 10, "v", 1);
+    http_message_free(clone2);
+    assert (strcmp(clone->fields[38].value, long_value) == 0);
+    http_message_free(clone);
+    free(original);
+}
+
+#define CLONE_THREADS 4
+#define CLONE_ROUNDS 1000
+
+static pthread_barrier_t clone_barrier;
+
+/**
+ * Frees given clones after all threads are started
+ */
+static void *free_clones_thread(void *arg) {
+    http_message **clones = arg;
+    pthread_barrier_wait(&clone_barrier);
+    for (int i = 0; i < CLONE_ROUNDS; i++) {
+        http_message_free(clones[i]);
+    }
+    return NULL;
+}
+
+/**
+ * Tests that clones sharing heap strings are freed concurrently without races (leaks are reported by sanitizer)
+ */
+static void test_clone_threads() {
+    static const char long_value[] = "value which doesn't fit small-string arena";
+    http_message **clones = malloc(CLONE_THREADS * CLONE_ROUNDS * sizeof(http_message *));
+    for (int i = 0; i < CLONE_ROUNDS; i++) {
+        http_message *message = http_message_create();
+        http_message_set_url(message, "/", 1);
+        for (int j = 0; j < 4; j++) {
+            char name[32];
+            int name_len = snprintf(name, sizeof(name), "X-Field-%d", j);
+            http_message_add_header_field(message, name, (size_t) name_len);
+            http_message_set_header_field(message, name, (size_t) name_len, long_value, sizeof(long_value) - 1);
+        }
+        // The last reference to shared field array may be removed by any thread
+        for (int t = 0; t < CLONE_THREADS; t++) {
+            clones[t * CLONE_ROUNDS + i] = http_message_clone(message);
+        }
+        http_message_free(message);
+    }
+
+    pthread_t threads[CLONE_THREADS];
+    pthread_barrier_init(&clone_barrier, NULL, CLONE_THREADS);
+    for (int t = 0; t < CLONE_THREADS; t++) {
+        assert (pthread_create(&threads[t], NULL, free_clones_thread, &clones[t * CLONE_ROUNDS]) == 0);
+    }
+    for (int t = 0; t < CLONE_THREADS; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    pthread_barrier_destroy(&clone_barrier);
+    free(clones);
+}
+
+#define LOOKUP_MESSAGES 200
+
+static http_message *lookup_messages[LOOKUP_MESSAGES];
+
+/**
+ * Looks up fields of all messages, the first lookup builds index
+ */
+static void *lookup_thread(void *arg) {
+    pthread_barrier_wait(&clone_barrier);
+    for (int i = 0; i < LOOKUP_MESSAGES; i++) {
+        const char *value = http_message_find_header_field(lookup_messages[i], "x-field-29", 10, NULL);
+        assert (value != NULL && strcmp(value, "29") == 0);
+        http_header_iter iter;
+        http_message_header_iter(lookup_messages[i], "X-FIELD-3", 9, &iter);
+        value = http_header_iter_next(&iter, NULL);
+        assert (value != NULL && strcmp(value, "3") == 0);
+        assert (http_header_iter_next(&iter, NULL) == NULL);
+    }
+    return NULL;
+}
+
+/**
+ * Tests that concurrent lookups on the same messages are safe
+ */
+static void test_find_header_field_threads() {
+    for (int i = 0; i < LOOKUP_MESSAGES; i++) {
+        http_message *message = http_message_create();
+        for (int j = 0; j < 40; j++) {
+            char name[32], value[32];
+            int name_len = snprintf(name, sizeof(name), "X-Field-%d", j);
+            int value_len = snprintf(value, sizeof(value), "%d", j);
+            http_message_add_header_field(message, name, (size_t) name_len);
+            http_message_set_header_field(message, name, (size_t) name_len, value, (size_t) value_len);
+        }
+        lookup_messages[i] = message;
+    }
+
+    pthread_t threads[CLONE_THREADS];
+    pthread_barrier_init(&clone_barrier, NULL, CLONE_THREADS);
+    for (int t = 0; t < CLONE_THREADS; t++) {
+        assert (pthread_create(&threads[t], NULL, lookup_thread, NULL) == 0);
+    }
+    for (int t = 0; t < CLONE_THREADS; t++) {
+        pthread_join(threads[t], NULL);
+    }
+    pthread_barrier_destroy(&clone_barrier);
+    for (int i = 0; i < LOOKUP_MESSAGES; i++) {
+        http_message_free(lookup_messages[i]);
+    }
+}
+
+/**
+ * Tests batched header edits
+ */
+static void test_apply_edits() {
+    http_message *message = http_message_create();
+    http_message_set_method(message, "GET", 3);
+    http_message_set_url(message, "/", 1);
+    static const char *fields[][2] = {
+            {"Host", "example.org"}, {"Upgrade", "h2c"}, {"Content-Encoding", "gzip"},
+            {"Connection", "Upgrade"}, {"X-Old", "1"}, {"Content-Length", "10"}
+    };
+    for (int i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+        http_message_add_header_field(message, fields[i][0], strlen(fields[i][0]));
+        http_message_set_header_field(message, fields[i][0], strlen(fields[i][0]), fields[i][1], strlen(fields[i][1]));
+    }
+    // Duplicate field, which is removed by SET
+    http_message_add_header_field(message, "Connection2", 11);
+    strcpy(message->fields[message->field_count - 1].name, "connection");
+    size_t length;
+    char *original = http_message_raw(message, &length);
+    http_message *clone = http_message_clone(message);
+
+    http_header_edit edits[] = {
+            {HTTP_HEADER_EDIT_REMOVE, "upgrade", 7, NULL, 0},
+            {HTTP_HEADER_EDIT_REMOVE, "Content-Encoding", 16, NULL, 0},
+            {HTTP_HEADER_EDIT_REMOVE, "Content-Length", 14, NULL, 0},
+            {HTTP_HEADER_EDIT_SET, "Connection", 10, "keep-alive", 10},
+            {HTTP_HEADER_EDIT_RENAME, "X-Old", 5, "X-New", 5},
+            {HTTP_HEADER_EDIT_ADD, "Transfer-Encoding", 17, "chunked", 7},
+            {HTTP_HEADER_EDIT_SET, "Via", 3, "1.1 proxy", 9},
+            {HTTP_HEADER_EDIT_REMOVE, "X-Missing", 9, NULL, 0},
+    };
+    assert (http_message_apply_edits(message, edits, sizeof(edits) / sizeof(edits[0])) == 0);
+
+    static const char expected[] = "GET / HTTP/1.1\r\n"
+            "Host: example.org\r\n"
+            "Connection: keep-alive\r\n"
+            "X-New: 1\r\n"
+            "Transfer-Encoding: chunked\r\n"
+            "Via: 1.1 proxy\r\n"
+            "\r\n";
+    char *output = http_message_raw(message, &length);
+    assert (strcmp(output, expected) == 0);
+    free(output);
+
+    // Clone is not changed
+    output = http_message_raw(clone, &length);
+    assert (strcmp(output, original) == 0);
+    free(output);
+    free(original);
+    http_message_free(clone);
+
+    http_header_edit invalid = {HTTP_HEADER_EDIT_SET, "X", 1, NULL, 0};
+    assert (http_message_apply_edits(message, &invalid, 1) == PARSER_INVALID_ARGUMENT_ERROR);
+    http_message_free(message);
+}
+
+/**
+ * Tests iteration over multi-valued header fields, with and without index
+ */
+static void test_header_iter() {
+    http_message *message = http_message_create();
+    http_message_set_status_code(message, 200);
+    http_message_set_status(message, "OK", 2);
+    static const char *cookies[] = {"a=1", "b=2", "c=3"};
+
+    for (int pass = 0; pass < 2; pass++) {
+        http_message_append_header_field(message, "Set-Cookie", 10, cookies[0], 3);
+        http_message_append_header_field(message, "Set-Cookie2", 11, "x", 1);
+        http_message_append_header_field(message, "set-cookie", 10, cookies[1], 3);
+        http_message_append_header_field(message, "Content-Type", 12, "text/html", 9);
+        http_message_append_header_field(message, "SET-COOKIE", 10, cookies[2], 3);
+        assert (http_message_append_header_field(message, "X-Empty", 7, NULL, 0) == 0);
+
+        http_header_iter iter;
+        const char *value;
+        size_t value_length;
+        int count = 0;
+        http_message_header_iter(message, "Set-Cookie", 10, &iter);
+        while ((value = http_header_iter_next(&iter, &value_length)) != NULL) {
+            assert (value_length == 3 && strcmp(value, cookies[count % 3]) == 0);
+            count++;
+        }
+        assert (count == 3 * (pass + 1));
+        assert (http_header_iter_next(&iter, NULL) == NULL);
+
+        http_message_header_iter(message, "X-Missing", 9, &iter);
+        assert (http_header_iter_next(&iter, NULL) == NULL);
+        http_message_header_iter(message, "x-empty", 7, &iter);
+        value = http_header_iter_next(&iter, &value_length);
+        assert (value != NULL && value_length == 0);
+    }
+    // Second pass has enough fields to be indexed
+    assert (message->field_count >= 8 && message->index != NULL);
+
+    size_t length;
+    char *output = http_message_raw(message, &length);
+    assert (strstr(output, "Set-Cookie: a=1\r\nSet-Cookie2: x\r\nset-cookie: b=2\r\n") != NULL);
+    free(output);
+    http_message_free(message);
+}
+
+/**
+ * Tests small-string arena of short field strings
+ */
+static void test_field_arena() {
+    static const char long_value[] = "value which doesn't fit small-string arena";
+    http_message *message = http_message_create();
+    http_message_append_header_field(message, "Host", 4, "example.org", 11);
+    http_header_field *field = &message->fields[0];
+    assert (sizeof(http_header_field) <= 40);
+
+    // Copy of field is valid while message exists, changed field gets new string
+    http_header_field copy = *field;
+    http_message *clone = http_message_clone(message);
+    http_message_set_header_field(message, "Host", 4, "example.com", 11);
+    size_t length;
+    const char *value = http_header_field_value(&copy, &length);
+    assert (value == copy.value && length == 11 && strcmp(value, "example.org") == 0);
+    assert (strcmp(http_header_field_name(&copy, NULL), "Host") == 0);
+    // Field array was shared with clone, so it's copied by change
+    field = &message->fields[0];
+    assert (strcmp(field->value, "example.com") == 0);
+    // Clone keeps arena of original strings
+    assert (clone->fields[0].value == copy.value);
+    http_message_free(clone);
+
+    // Value moves to heap and back
+    http_message_set_header_field(message, "Host", 4, long_value, sizeof(long_value) - 1);
+    assert (strcmp(field->value, long_value) == 0);
+    http_message_set_header_field(message, "Host", 4, "a", 1);
+    assert (strcmp(field->value, "a") == 0);
+
+    // Strings don't move when field array is reallocated
+    copy = *field;
+    for (int i = 0; i < 100; i++) {
+        char name[32];
+        int name_len = snprintf(name, sizeof(name), "X-Field-%d", i);
+        http_message_append_header_field(message, name, (size_t) name_len, name, (size_t) name_len);
+    }
+    http_message_del_header_field(message, "X-Field-0", 9);
+    assert (message->fields[0].name == copy.name && message->fields[0].value == copy.value);
+    for (unsigned int i = 0; i < message->field_count; i++) {
+        field = &message->fields[i];
+        assert (field->name == http_header_field_name(field, NULL));
+        assert (field->value == http_header_field_value(field, NULL));
+    }
+    assert (strcmp(message->fields[1].value, "X-Field-1") == 0);
+    http_message_free(message);
+}
+
 int main() {
+    test_find_header_field();
+    test_field_arena();
+    test_header_iter();
+    test_apply_edits();
+    test_clone();
+    test_clone_threads();
+    test_find_header_field_threads();
+
     http_message *message = http_message_create();
     assert (message != NULL);
 
@@ -71,6 +467,7 @@ int main() {
     assert (output != NULL);
     assert (!strcmp(output, correct_output));
     free(output);
+    test_serialize(message);
 
     clone = http_message_clone(message);
 
@@ -81,5 +478,6 @@ int main() {
     assert (output != NULL);
     assert (!strcmp(output, correct_output_response));
     free(output);
+    test_serialize(clone);
 }
 
@@ -0,0 +1,267 @@
+//
+// Pause/resume test: body callbacks pause connection, caller passes the rest of input after resume
+//
+
+#define _GNU_SOURCE
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "logger.h"
+#include "parser.h"
+
+#include "../zlib/zlib.h"
+
+static const char chunked_responses[] = "HTTP/1.1 200 OK\r\n"
+        "Transfer-Encoding: chunked\r\n"
+        "\r\n"
+        "5\r\nHello\r\n"
+        "7\r\n world!\r\n"
+        "0\r\n\r\n"
+        "HTTP/1.1 200 OK\r\n"
+        "Content-Length: 3\r\n"
+        "\r\n"
+        "abc";
+
+struct pause_context {
+    char body[65536];
+    size_t body_length;
+    // If set, body is compared with expected data instead of being collected
+    const char *expected;
+    int messages;
+    int finished;
+    int pause_on_data;
+    int pause_on_finished;
+} pc;
+
+struct test_file {
+    char *contents;
+    size_t size;
+};
+
+int http_request_received(connection_context *context, void *message) {
+    return 0;
+}
+
+int http_request_body_started(connection_context *context) {
+    return 0;
+}
+
+void http_request_body_data(connection_context *context, const char *data, size_t length) {
+}
+
+void http_request_body_finished(connection_context *context) {
+}
+
+int http_response_received(connection_context *context, void *message) {
+    pc.messages++;
+    return 0;
+}
+
+int http_response_body_started(connection_context *context) {
+    return 1;
+}
+
+void http_response_body_data(connection_context *context, const char *data, size_t length) {
+    if (pc.expected != NULL) {
+        assert (!memcmp(pc.expected + pc.body_length, data, length));
+    } else {
+        assert (pc.body_length + length <= sizeof(pc.body));
+        memcpy(pc.body + pc.body_length, data, length);
+    }
+    pc.body_length += length;
+    if (pc.pause_on_data) {
+        assert (parser_connection_pause(context) == 0);
+    }
+}
+
+void http_response_body_finished(connection_context *context) {
+    pc.finished++;
+    if (pc.pause_on_finished) {
+        assert (parser_connection_pause(context) == 0);
+    }
+}
+
+parser_callbacks cbs = {
+    .http_request_received = http_request_received,
+    .http_request_body_started = http_request_body_started,
+    .http_request_body_data = http_request_body_data,
+    .http_request_body_finished = http_request_body_finished,
+    .http_response_received = http_response_received,
+    .http_response_body_started = http_response_body_started,
+    .http_response_body_data = http_response_body_data,
+    .http_response_body_finished = http_response_body_finished
+};
+
+static void read_file(const char *file_name, struct test_file *test_file) {
+    FILE *file = fopen(file_name, "r");
+    assert (file != NULL);
+    fseek(file, 0L, SEEK_END);
+    test_file->size = (size_t) ftell(file);
+    fseek(file, 0L, SEEK_SET);
+    test_file->contents = malloc(test_file->size);
+    assert (fread(test_file->contents, 1, test_file->size, file) == test_file->size);
+    fclose(file);
+}
+
+/**
+ * Passes data to parser, resuming connection and passing the rest of data after every pause
+ * @return Number of pauses
+ */
+static int input_with_pauses(connection_context *cctx, const char *data, size_t length) {
+    int pauses = 0;
+    size_t offset = 0;
+    while (offset < length) {
+        int r = parser_input(cctx, DIRECTION_IN, data + offset, length - offset);
+        size_t consumed = connection_get_input_consumed(cctx);
+        assert (consumed <= length - offset);
+        offset += consumed;
+        if (r == PARSER_PAUSED) {
+            pauses++;
+            // Paused connection doesn't consume any input
+            if (offset < length) {
+                assert (parser_input(cctx, DIRECTION_IN, data + offset, length - offset) == PARSER_PAUSED);
+                assert (connection_get_input_consumed(cctx) == 0);
+            }
+            while ((r = parser_connection_resume(cctx)) == PARSER_PAUSED) {
+                pauses++;
+            }
+        }
+        assert (r == 0);
+    }
+    return pauses;
+}
+
+static void test_pause_on_body_data(parser_context *pctx) {
+    fprintf(stderr, "Testing pause on body data\n");
+    memset(&pc, 0, sizeof(pc));
+    pc.pause_on_data = 1;
+    connection_context *cctx;
+    assert (parser_connect(pctx, 1L, &cbs, &cctx) == 0);
+
+    int pauses = input_with_pauses(cctx, chunked_responses, strlen(chunked_responses));
+    assert (pauses == 3);
+    assert (pc.messages == 2);
+    assert (pc.finished == 2);
+    assert (pc.body_length == strlen("Hello world!abc"));
+    assert (!memcmp(pc.body, "Hello world!abc", pc.body_length));
+    parser_connection_close(cctx);
+}
+
+static void test_pause_on_body_finished(parser_context *pctx) {
+    fprintf(stderr, "Testing pause on body finished\n");
+    memset(&pc, 0, sizeof(pc));
+    pc.pause_on_finished = 1;
+    connection_context *cctx;
+    assert (parser_connect(pctx, 1L, &cbs, &cctx) == 0);
+
+    // Second response is not parsed until connection is resumed
+    assert (parser_input(cctx, DIRECTION_IN, chunked_responses, strlen(chunked_responses)) == PARSER_PAUSED);
+    assert (pc.messages == 1);
+    assert (pc.finished == 1);
+    size_t consumed = connection_get_input_consumed(cctx);
+    assert (!strncmp(chunked_responses + consumed, "HTTP/1.1 200 OK\r\nContent-Length: 3", 34));
+
+    assert (parser_connection_resume(cctx) == 0);
+    assert (parser_input(cctx, DIRECTION_IN, chunked_responses + consumed,
+                         strlen(chunked_responses) - consumed) == PARSER_PAUSED);
+    assert (connection_get_input_consumed(cctx) == strlen(chunked_responses) - consumed);
+    assert (pc.messages == 2);
+    assert (pc.finished == 2);
+    assert (parser_connection_resume(cctx) == 0);
+    parser_connection_close(cctx);
+}
+
+static void test_pause_decoded(parser_context *pctx, const char *file_name, struct test_file *expected) {
+    fprintf(stderr, "Testing pause on decoded body data: %s\n", file_name);
+    struct test_file file;
+    read_file(file_name, &file);
+    memset(&pc, 0, sizeof(pc));
+    pc.pause_on_data = 1;
+    connection_context *cctx;
+    assert (parser_connect(pctx, 1L, &cbs, &cctx) == 0);
+
+    assert (input_with_pauses(cctx, file.contents, file.size) > 0);
+    assert (pc.finished == 1);
+    assert (pc.body_length == expected->size);
+    assert (!memcmp(pc.body, expected->contents, expected->size));
+    parser_connection_close(cctx);
+    free(file.contents);
+}
+
+/**
+ * Compressed body is larger than zlib input buffer, so that the tail of input which is held
+ * by pause doesn't fit it
+ * @param piece_size Size of input pieces
+ */
+static void test_pause_large_gzip(parser_context *pctx, size_t piece_size) {
+    fprintf(stderr, "Testing pause on large gzip body, input pieces of %d bytes\n", (int) piece_size);
+    // Pseudo-random data is not compressible
+    size_t body_size = 1024 * 1024;
+    char *body = malloc(body_size);
+    uint32_t x = 2463534242u;
+    for (size_t i = 0; i < body_size; i++) {
+        x ^= x << 13;
+        x ^= x >> 17;
+        x ^= x << 5;
+        body[i] = (char) x;
+    }
+
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    assert (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 31, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+    size_t compressed_capacity = deflateBound(&stream, body_size);
+    char *response = malloc(compressed_capacity + 128);
+    int header_length = sprintf(response, "HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\nContent-Length: %08d\r\n\r\n", 0);
+    stream.next_in = (Bytef *) body;
+    stream.avail_in = (uInt) body_size;
+    stream.next_out = (Bytef *) response + header_length;
+    stream.avail_out = (uInt) compressed_capacity;
+    assert (deflate(&stream, Z_FINISH) == Z_STREAM_END);
+    size_t compressed_size = stream.total_out;
+    deflateEnd(&stream);
+    // Content-Length has fixed width, so header length doesn't change
+    sprintf(response, "HTTP/1.1 200 OK\r\nContent-Encoding: gzip\r\nContent-Length: %08d\r\n\r", (int) compressed_size);
+    response[header_length - 1] = '\n';
+
+    memset(&pc, 0, sizeof(pc));
+    pc.pause_on_data = 1;
+    pc.expected = body;
+    connection_context *cctx;
+    assert (parser_connect(pctx, 1L, &cbs, &cctx) == 0);
+    size_t length = header_length + compressed_size;
+    for (size_t offset = 0; offset < length; offset += piece_size) {
+        size_t piece = length - offset < piece_size ? length - offset : piece_size;
+        input_with_pauses(cctx, response + offset, piece);
+    }
+    assert (pc.finished == 1);
+    assert (pc.body_length == body_size);
+    parser_connection_close(cctx);
+    free(response);
+    free(body);
+}
+
+int main(int argc, char **argv) {
+    logger *log = logger_open(NULL, LOG_LEVEL_INFO, NULL, NULL);
+    parser_context *pctx;
+    assert (parser_create(log, &pctx) == 0);
+
+    test_pause_on_body_data(pctx);
+    test_pause_on_body_finished(pctx);
+
+    struct test_file license_txt;
+    read_file("data/LICENSE-2.0.txt", &license_txt);
+    test_pause_decoded(pctx, "data/LICENSE-2.0.txt-HTTP-gzip.bin", &license_txt);
+    test_pause_decoded(pctx, "data/LICENSE-2.0.txt-HTTP-gzip-chunked.bin", &license_txt);
+    free(license_txt.contents);
+
+    test_pause_large_gzip(pctx, SIZE_MAX);
+    test_pause_large_gzip(pctx, 300 * 1024);
+
+    parser_destroy(pctx);
+    logger_close(log);
+    return 0;
+}
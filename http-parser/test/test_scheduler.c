@@ -0,0 +1,246 @@
+//
+// Scheduler test: pipelined requests of many connections are fed in small chunks
+// and processed by worker threads. Callbacks of each connection should be called in order
+// and never concurrently.
+//
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "logger.h"
+#include "parser.h"
+#include "scheduler.h"
+
+#define THREAD_COUNT 8
+#define CONNECTION_COUNT 256
+#define REQUEST_COUNT 20
+#define PAUSED_CONNECTION 7
+// Connection which is attached, fed and detached right away many times
+#define DETACHED_CONNECTION CONNECTION_COUNT
+#define DETACH_ROUNDS 2000
+
+struct test_connection {
+    connection_context *context;
+    scheduler_connection *handle;
+    char *input;
+    size_t input_length;
+    // Updated by callbacks
+    int in_callback;
+    int requests;
+    int body_finished;
+    size_t body_length;
+    int order_error;
+    int pause_on_data;
+} connections[CONNECTION_COUNT + 1];
+
+static struct test_connection *get_connection(connection_context *context) {
+    return &connections[connection_get_id(context)];
+}
+
+static void enter(struct test_connection *conn) {
+    // Detect concurrent callbacks of one connection
+    if (__atomic_exchange_n(&conn->in_callback, 1, __ATOMIC_SEQ_CST)) {
+        conn->order_error = 1;
+    }
+}
+
+static void leave(struct test_connection *conn) {
+    __atomic_store_n(&conn->in_callback, 0, __ATOMIC_SEQ_CST);
+}
+
+int http_request_received(connection_context *context, void *message) {
+    struct test_connection *conn = get_connection(context);
+    enter(conn);
+    char url[32];
+    snprintf(url, sizeof(url), "/%d", conn->requests);
+    if (strcmp(((http_message *) message)->url, url) != 0 || conn->body_finished != conn->requests) {
+        conn->order_error = 1;
+    }
+    conn->requests++;
+    leave(conn);
+    return 0;
+}
+
+int http_request_body_started(connection_context *context) {
+    return 0;
+}
+
+void http_request_body_data(connection_context *context, const char *data, size_t length) {
+    struct test_connection *conn = get_connection(context);
+    enter(conn);
+    conn->body_length += length;
+    if (conn->pause_on_data) {
+        assert (parser_connection_pause(context) == 0);
+    }
+    leave(conn);
+}
+
+void http_request_body_finished(connection_context *context) {
+    struct test_connection *conn = get_connection(context);
+    enter(conn);
+    conn->body_finished++;
+    leave(conn);
+}
+
+int http_response_received(connection_context *context, void *message) {
+    return 0;
+}
+
+int http_response_body_started(connection_context *context) {
+    return 0;
+}
+
+void http_response_body_data(connection_context *context, const char *data, size_t length) {
+}
+
+void http_response_body_finished(connection_context *context) {
+}
+
+parser_callbacks cbs = {
+    .http_request_received = http_request_received,
+    .http_request_body_started = http_request_body_started,
+    .http_request_body_data = http_request_body_data,
+    .http_request_body_finished = http_request_body_finished,
+    .http_response_received = http_response_received,
+    .http_response_body_started = http_response_body_started,
+    .http_response_body_data = http_response_body_data,
+    .http_response_body_finished = http_response_body_finished
+};
+
+/**
+ * Makes pipelined POST requests "/0", "/1", ... with 10 bytes body each
+ */
+static void make_input(struct test_connection *conn) {
+    size_t capacity = REQUEST_COUNT * 128;
+    conn->input = malloc(capacity);
+    conn->input_length = 0;
+    for (int i = 0; i < REQUEST_COUNT; i++) {
+        conn->input_length += snprintf(conn->input + conn->input_length, capacity - conn->input_length,
+                                       "POST /%d HTTP/1.1\r\n"
+                                       "Host: example.org\r\n"
+                                       "Content-Length: 10\r\n"
+                                       "\r\n"
+                                       "0123456789", i);
+    }
+}
+
+/**
+ * Detaches connection right after its input is queued, while worker may still be processing it
+ */
+static void test_detach_after_input(parser_context *pctx, parser_scheduler *scheduler) {
+    fprintf(stderr, "Detaching connection right after input %d times\n", DETACH_ROUNDS);
+    static const char request[] = "POST /0 HTTP/1.1\r\n"
+            "Host: example.org\r\n"
+            "Content-Length: 10\r\n"
+            "\r\n"
+            "0123456789";
+    struct test_connection *conn = &connections[DETACHED_CONNECTION];
+    for (int i = 0; i < DETACH_ROUNDS; i++) {
+        memset(conn, 0, sizeof(*conn));
+        assert (parser_connect(pctx, (connection_id_t) DETACHED_CONNECTION, &cbs, &conn->context) == 0);
+        assert (parser_scheduler_attach(scheduler, conn->context, &conn->handle) == 0);
+        assert (parser_scheduler_input(conn->handle, DIRECTION_OUT, request, strlen(request)) == 0);
+        assert (parser_scheduler_detach(conn->handle) == 0);
+        // Queued input is processed before detach returns
+        assert (conn->requests == 1);
+        assert (conn->body_finished == 1);
+        parser_connection_close(conn->context);
+    }
+}
+
+int main(int argc, char **argv) {
+    logger *log = logger_open(NULL, LOG_LEVEL_INFO, NULL, NULL);
+    parser_context *pctx;
+    assert (parser_create(log, &pctx) == 0);
+    parser_scheduler *scheduler;
+    assert (parser_scheduler_create(pctx, 0, &scheduler) == PARSER_INVALID_ARGUMENT_ERROR);
+    assert (parser_scheduler_create(pctx, THREAD_COUNT, &scheduler) == 0);
+
+    memset(connections, 0, sizeof(connections));
+    for (int i = 0; i < CONNECTION_COUNT; i++) {
+        assert (parser_connect(pctx, (connection_id_t) i, &cbs, &connections[i].context) == 0);
+        assert (parser_scheduler_attach(scheduler, connections[i].context, &connections[i].handle) == 0);
+        make_input(&connections[i]);
+    }
+    connections[PAUSED_CONNECTION].pause_on_data = 1;
+
+    // Feed all connections round-robin with chunks of various sizes
+    fprintf(stderr, "Feeding %d connections\n", CONNECTION_COUNT);
+    size_t offsets[CONNECTION_COUNT];
+    memset(offsets, 0, sizeof(offsets));
+    int remaining = CONNECTION_COUNT;
+    for (size_t round = 0; remaining > 0; round++) {
+        for (int i = 0; i < CONNECTION_COUNT; i++) {
+            struct test_connection *conn = &connections[i];
+            if (offsets[i] == conn->input_length) {
+                continue;
+            }
+            size_t length = 1 + (round * 7 + i) % 61;
+            if (length > conn->input_length - offsets[i]) {
+                length = conn->input_length - offsets[i];
+            }
+            assert (parser_scheduler_input(conn->handle, DIRECTION_OUT, conn->input + offsets[i], length) == 0);
+            offsets[i] += length;
+            if (offsets[i] == conn->input_length) {
+                remaining--;
+            }
+        }
+    }
+    assert (parser_scheduler_wait(scheduler) == 0);
+
+    for (int i = 0; i < CONNECTION_COUNT; i++) {
+        if (i == PAUSED_CONNECTION) {
+            continue;
+        }
+        struct test_connection *conn = &connections[i];
+        assert (!conn->order_error);
+        assert (conn->requests == REQUEST_COUNT);
+        assert (conn->body_finished == REQUEST_COUNT);
+        assert (conn->body_length == REQUEST_COUNT * 10);
+        assert (parser_scheduler_get_error(conn->handle) == PARSER_OK);
+    }
+
+    // Paused connection holds input until it is resumed
+    fprintf(stderr, "Resuming paused connection\n");
+    struct test_connection *paused = &connections[PAUSED_CONNECTION];
+    assert (paused->requests == 1);
+    assert (paused->body_finished == 0);
+    int resumes = 0;
+    while (paused->body_finished < REQUEST_COUNT) {
+        assert (parser_scheduler_resume(paused->handle) == 0);
+        assert (parser_scheduler_wait(scheduler) == 0);
+        assert (++resumes <= REQUEST_COUNT * 10);
+    }
+    assert (!paused->order_error);
+    assert (paused->requests == REQUEST_COUNT);
+    assert (paused->body_length == REQUEST_COUNT * 10);
+
+    // Parse error is reported by next input
+    struct test_connection *conn = &connections[0];
+    assert (parser_scheduler_input(conn->handle, DIRECTION_OUT, "GARBAGE\r\n\r\n", 11) == 0);
+    assert (parser_scheduler_wait(scheduler) == 0);
+    assert (parser_scheduler_get_error(conn->handle) == PARSER_HTTP_PARSE_ERROR);
+    assert (parser_scheduler_input(conn->handle, DIRECTION_OUT, "GET", 3) == PARSER_HTTP_PARSE_ERROR);
+
+    scheduler_stats stats;
+    parser_scheduler_get_stats(scheduler, &stats);
+    fprintf(stderr, "Processed %lu chunks, %lu steals\n", stats.chunks, stats.steals);
+    assert (stats.chunks > 0);
+
+    test_detach_after_input(pctx, scheduler);
+
+    for (int i = 0; i < CONNECTION_COUNT / 2; i++) {
+        assert (parser_scheduler_detach(connections[i].handle) == 0);
+    }
+    // The rest is detached by destroy
+    assert (parser_scheduler_destroy(scheduler) == 0);
+    for (int i = 0; i < CONNECTION_COUNT; i++) {
+        parser_connection_close(connections[i].context);
+        free(connections[i].input);
+    }
+    parser_destroy(pctx);
+    logger_close(log);
+    return 0;
+}
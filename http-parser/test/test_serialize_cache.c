@@ -0,0 +1,110 @@
+//
+// Serialized message header cache test: output must be equal to http_message_serialize_into()
+// for hits, misses, collisions and bypassed messages.
+//
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "parser.h"
+#include "serialize_cache.h"
+
+static http_serialize_cache *cache;
+
+/**
+ * Serializes message by cache and checks output
+ * @param message Message
+ */
+static void check_serialize(const http_message *message) {
+    char expected[1024], output[1024];
+    size_t expected_length, length;
+    assert (http_message_serialize_into(message, expected, sizeof(expected), &expected_length) == 0);
+    assert (http_serialize_cache_serialize(cache, message, output, sizeof(output), &length) == 0);
+    assert (length == expected_length && memcmp(output, expected, length) == 0);
+}
+
+/**
+ * Creates response template
+ * @return New message
+ */
+static http_message *create_template() {
+    http_message *message = http_message_create();
+    http_message_set_status_code(message, 200);
+    http_message_set_status(message, "OK", 2);
+    http_message_append_header_field(message, "Date", 4, "Mon, 19 Oct 2026 10:00:00 GMT", 29);
+    http_message_append_header_field(message, "Content-Type", 12, "text/html; charset=utf-8", 24);
+    http_message_append_header_field(message, "Set-Cookie", 10, "a=1", 3);
+    http_message_append_header_field(message, "Cache-Control", 13, "no-cache", 8);
+    http_message_append_header_field(message, "Set-Cookie", 10, "b=2", 3);
+    http_message_append_header_field(message, "Content-Length", 14, "100", 3);
+    return message;
+}
+
+int main() {
+    http_serialize_cache_stats stats;
+    assert (http_serialize_cache_create(0, &cache) == PARSER_INVALID_ARGUMENT_ERROR);
+    assert (http_serialize_cache_create(4, &cache) == 0);
+    http_message *template = create_template();
+
+    // Miss, then hits of unchanged and patched clones
+    check_serialize(template);
+    http_message *clone = http_message_clone(template);
+    check_serialize(clone);
+    http_message_set_header_field(clone, "Date", 4, "Mon, 19 Oct 2026 10:00:01 GMT", 29);
+    http_message_set_header_field(clone, "Content-Length", 14, "123456", 6);
+    http_message_set_header_field(clone, "Set-Cookie", 10, "a=changed; Path=/", 17);
+    check_serialize(clone);
+    http_message_free(clone);
+    http_serialize_cache_get_stats(cache, &stats);
+    assert (stats.lookups == 3 && stats.misses == 1 && stats.hits == 2);
+
+    // Message with the same content built separately
+    http_message *other = create_template();
+    http_message_set_header_field(other, "Content-Length", 14, "", 0);
+    check_serialize(other);
+    http_message_free(other);
+    http_serialize_cache_get_stats(cache, &stats);
+    assert (stats.hits == 3);
+
+    // Change of non-volatile field or start line is a miss
+    clone = http_message_clone(template);
+    http_message_set_header_field(clone, "Cache-Control", 13, "no-store", 8);
+    check_serialize(clone);
+    http_message_set_status_code(clone, 404);
+    check_serialize(clone);
+    http_message_free(clone);
+    http_serialize_cache_get_stats(cache, &stats);
+    assert (stats.hits == 3 && stats.misses == 3);
+
+    // Value beyond hashed prefix differs: hash is the same, but message is not
+    clone = http_message_clone(template);
+    http_message_set_header_field(clone, "Content-Type", 12, "text/html; charset=utf-7", 24);
+    check_serialize(template);
+    check_serialize(clone);
+    check_serialize(clone);
+    http_message_free(clone);
+    http_serialize_cache_get_stats(cache, &stats);
+    assert (stats.collisions >= 1 && stats.evictions >= 1);
+
+    // Buffer is too small
+    char small[16];
+    size_t needed;
+    assert (http_serialize_cache_serialize(cache, template, small, sizeof(small), &needed) == PARSER_BUFFER_TOO_SMALL_ERROR);
+    assert (needed > sizeof(small));
+    assert (http_serialize_cache_serialize(cache, template, NULL, 0, &needed) == PARSER_BUFFER_TOO_SMALL_ERROR);
+
+    // Request
+    http_message *request = http_message_create();
+    http_message_set_method(request, "GET", 3);
+    http_message_set_url(request, "/", 1);
+    http_message_append_header_field(request, "Host", 4, "example.org", 11);
+    check_serialize(request);
+    check_serialize(request);
+    http_message_free(request);
+
+    http_message_free(template);
+    http_serialize_cache_destroy(cache);
+    return 0;
+}